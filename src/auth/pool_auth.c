@@ -152,7 +152,7 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 					(errmsg("password authentication failed for user:%s", cp->sp->user),
 					 errdetail("backend replied with invalid kind")));
 
-		cp->con->auth_kind = AUTH_REQ_OK;
+		cp->con->auth_kind = AUTH_REQ_PASSWORD;
 	}
 	else if (auth_kind == AUTH_REQ_CRYPT)	/* crypt password? */
 	{
@@ -175,7 +175,7 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 					(errmsg("crypt authentication failed for user:%s", cp->sp->user),
 					 errdetail("backend replied with invalid kind")));
 
-		cp->con->auth_kind = AUTH_REQ_OK;
+		cp->con->auth_kind = AUTH_REQ_CRYPT;
 	}
 	else if (auth_kind == AUTH_REQ_MD5) /* md5 password? */
 	{
@@ -210,7 +210,7 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 					(errmsg("md5 authentication failed for user:%s", cp->sp->user),
 					 errdetail("backend replied with invalid kind")));
 
-		cp->con->auth_kind = AUTH_REQ_OK;
+		cp->con->auth_kind = AUTH_REQ_MD5;
 	}
 	else if (auth_kind == AUTH_REQ_SASL)
 	{
@@ -222,7 +222,7 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 		}
 		ereport(DEBUG1,
 				(errmsg("SCRAM authentication successful for user:%s", cp->sp->user)));
-		cp->con->auth_kind = AUTH_REQ_OK;
+		cp->con->auth_kind = AUTH_REQ_SASL;
 	}
 	else
 	{
@@ -297,7 +297,6 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 			case 'S':			/* parameter status */
 			case 'N':			/* notice response */
 			case 'E':			/* error response */
-				/* Just throw away data */
 				pool_read_with_error(cp->con, &length, sizeof(length),
 									 "backend message length");
 
@@ -310,6 +309,14 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 							(errmsg("failed to authenticate"),
 							 errdetail("unable to read data from socket")));
 
+				/*
+				 * Remember parameter status so that the connection can be
+				 * handed to a frontend later (see pool_prewarm_cp()).  Other
+				 * messages are just thrown away.
+				 */
+				if (kind == 'S')
+					pool_add_param(&cp->con->params, p, p + strlen(p) + 1);
+
 				break;
 
 			default:
@@ -323,6 +330,69 @@ connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password)
 			(errmsg("failed to authenticate")));
 }
 
+/*
+ * Prepare a backend connection made by make_persistent_db_connection() so
+ * that pool_do_reauth() can authenticate frontends against it later.
+ * "password" is the one used to connect to the backend, either in plain text
+ * or md5 hashed. Returns false if frontends cannot be authenticated with the
+ * auth method the backend requested.
+ */
+bool
+pool_prepare_reauth(POOL_CONNECTION * backend, char *user, char *password)
+{
+	char		buf[MD5_PASSWD_LEN + 1];
+
+	switch (backend->auth_kind)
+	{
+		case AUTH_REQ_OK:
+			/* trust */
+			return true;
+
+		case AUTH_REQ_PASSWORD:
+			/* do_clear_text_password() compares with the saved password */
+			if (password == NULL || get_password_type(password) != PASSWORD_TYPE_PLAINTEXT ||
+				strlen(password) > MAX_PASSWORD_SIZE)
+				return false;
+
+			backend->pwd_size = strlen(password);
+			memcpy(backend->password, password, backend->pwd_size);
+			backend->passwordType = PASSWORD_TYPE_PLAINTEXT;
+			return true;
+
+		case AUTH_REQ_MD5:
+			/* with multiple backends frontends are checked with pool_passwd */
+			if (!RAW_MODE && NUM_BACKENDS > 1)
+				return true;
+
+			if (password == NULL)
+				return false;
+
+			/*
+			 * do_md5_single_backend() compares the frontend's response with
+			 * the saved one, so compute the response for our own salt.
+			 */
+			if (!strncmp("md5", password, 3) && (strlen(password) - 3) == MD5_PASSWD_LEN)
+				memcpy(buf, password + 3, MD5_PASSWD_LEN + 1);
+			else
+				pool_md5_encrypt(password, user, strlen(user), buf);
+
+			pool_random_salt(backend->salt);
+			memcpy(backend->password, "md5", 3);
+			pool_md5_encrypt(buf, backend->salt, sizeof(backend->salt), backend->password + 3);
+			/* the size sent by frontends includes the terminating null */
+			backend->pwd_size = strlen(backend->password) + 1;
+			backend->passwordType = PASSWORD_TYPE_MD5;
+			return true;
+
+		case AUTH_REQ_SASL:
+			/* authenticate_frontend_SCRAM() always uses pool_passwd */
+			return true;
+
+		default:
+			return false;
+	}
+}
+
 /*
  * After sending the start up packet to the backend, do the
  * authentication against backend. if success return 0 otherwise non
@@ -518,6 +518,7 @@ char *yytext;
 #include "utils/regex_array.h"
 #ifndef POOL_PRIVATE
 #include "utils/elog.h"
+#include "utils/memutils.h"
 #else
 #include "utils/fe_ports.h"
 #endif
@@ -1831,6 +1832,22 @@ void yyfree (void * ptr )
 
 int pool_init_config(void)
 {
+#ifndef POOL_PRIVATE
+	MemoryContext oldContext;
+
+	/*
+	 * Configuration values are kept in a memory context of their own, so
+	 * that they do not share pages with data allocated and freed later in
+	 * TopMemoryContext.  The values loaded before the children are forked
+	 * then stay on pages the children only read, and the copy-on-write
+	 * copies of them are not made in every child.
+	 */
+	ConfigMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												"ConfigMemoryContext",
+												ALLOCSET_DEFAULT_SIZES);
+	oldContext = MemoryContextSwitchTo(ConfigMemoryContext);
+#endif
+
 	memset(pool_config, 0, sizeof(POOL_CONFIG));
 
 #ifndef POOL_PRIVATE
@@ -1843,6 +1860,10 @@ int pool_init_config(void)
 
 	InitializeConfigOptions();
 
+#ifndef POOL_PRIVATE
+	MemoryContextSwitchTo(oldContext);
+#endif
+
 	return 0;
 }
 
@@ -2141,11 +2162,21 @@ bool pool_get_config(const char *config_file, ConfigContext context)
 	bool res;
 	int elevel = (context == CFGCXT_INIT)?FATAL:WARNING;
 
+#ifndef POOL_PRIVATE
+	MemoryContext oldContext;
+#endif
+
 	res = ParseConfigFile(config_file, elevel, &head_p, &tail_p);
 	if (res == false || head_p == NULL)
 		return false;
 
+#ifndef POOL_PRIVATE
+	oldContext = MemoryContextSwitchTo(ConfigMemoryContext);
+#endif
 	res = set_config_options(head_p, context, PGC_S_FILE, elevel);
+#ifndef POOL_PRIVATE
+	MemoryContextSwitchTo(oldContext);
+#endif
 	FreeConfigVariables(head_p);
 	return res;
 }
@@ -2322,11 +2353,21 @@ char* backend_status_to_str(BackendInfo *bi)
 		break;
 
 		case CON_CONNECT_WAIT:
-		statusName = BACKEND_STATUS_CON_CONNECT_WAIT;
+		{
+			if (bi->draining)
+				statusName = BACKEND_STATUS_DRAINING;
+			else
+				statusName = BACKEND_STATUS_CON_CONNECT_WAIT;
+		}
 		break;
 
 		case CON_UP:
-		statusName = BACKEND_STATUS_CON_UP;
+		{
+			if (bi->draining)
+				statusName = BACKEND_STATUS_DRAINING;
+			else
+				statusName = BACKEND_STATUS_CON_UP;
+		}
 		break;
 
 		case CON_DOWN:
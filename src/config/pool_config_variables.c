@@ -226,6 +226,12 @@ static const struct config_enum_entry memqcache_method_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry memqcache_compression_options[] = {
+	{"off", MEMQCACHE_COMPRESSION_OFF, false},
+	{"lz4", MEMQCACHE_COMPRESSION_LZ4, false},
+	{NULL, 0, false}
+};
+
 static const struct config_enum_entry wd_lifecheck_method_options[] = {
 	{"query", LIFECHECK_BY_QUERY, false},
 	{"heartbeat", LIFECHECK_BY_HB, false},
@@ -259,6 +265,25 @@ static const struct config_enum_entry relcache_query_target_options[] = {
 	{NULL, 0, false}
 };
 
+static const struct config_enum_entry process_management_mode_options[] = {
+	{"static", PM_STATIC, false},
+	{"dynamic", PM_DYNAMIC, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry huge_pages_options[] = {
+	{"off", HUGE_PAGES_OFF, false},
+	{"on", HUGE_PAGES_ON, false},
+	{"try", HUGE_PAGES_TRY, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry shared_memory_numa_policy_options[] = {
+	{"default", NUMA_POLICY_DEFAULT, false},
+	{"interleave", NUMA_POLICY_INTERLEAVE, false},
+	{NULL, 0, false}
+};
+
 static const struct config_enum_entry check_temp_table_options[] = {
 	{"catalog", CHECK_TEMP_CATALOG, false},	/* search system catalogs */
 	{"trace", CHECK_TEMP_TRACE, false},		/* tracing temp tables */
@@ -457,6 +482,26 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"replication_parallel_execution", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"Sends write queries to all nodes at once in replication mode.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.replication_parallel_execution,
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"sequence_preallocation", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"Gives INSERT pre-allocated sequence values instead of locking the table.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.sequence_preallocation,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"ignore_leading_white_space", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
 			"Ignores leading white spaces of each query string.",
@@ -577,6 +622,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_lazy_backend_connection", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Connects to backend at the first query not found in the query cache.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.memqcache_lazy_backend_connection,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"allow_sql_comments", CFGCXT_SESSION, LOAD_BALANCE_CONFIG,
 			"Ignore SQL comments, while judging if load balance or query cache is possible.",
@@ -606,6 +661,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"load_balance_by_response_time", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
+			"Scales load balance weights by the response time of health check.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.load_balance_by_response_time,
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"auto_failback", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"Enables nodes automatically reattach, when dettached node continue streaming replication.",
@@ -616,6 +681,16 @@ static struct config_bool ConfigureNamesBool[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"health_check_async", CFGCXT_INIT, HEALTH_CHECK_CONFIG,
+			"Check all backend nodes from a single process using non-blocking sockets.",
+			CONFIG_VAR_TYPE_BOOL, false, 0
+		},
+		&g_pool_config.health_check_async,
+		false,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	EMPTY_CONFIG_BOOL
 
@@ -1140,6 +1215,32 @@ static struct config_string_list ConfigureNamesStringList[] =
 		NULL, NULL, NULL		/* assign, check, show funcs */
 	},
 
+	{
+		{"prewarm_connection_list", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"list of user:database pairs whose backend connections are created in advance.",
+			CONFIG_VAR_TYPE_STRING_LIST, false, 0
+		},
+		&g_pool_config.prewarm_connection_list,
+		&g_pool_config.num_prewarm_connection_list,
+		NULL,
+		",",
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"child_cpu_affinity", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"list of CPU sets child processes are bound to in turn.",
+			CONFIG_VAR_TYPE_STRING_LIST, false, 0
+		},
+		&g_pool_config.child_cpu_affinity,
+		&g_pool_config.num_child_cpu_affinity,
+		NULL,
+		";",
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"white_function_list", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
 			"list of functions that does not writes to database.",
@@ -1191,6 +1292,32 @@ static struct config_string_list ConfigureNamesStringList[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_expire_table_list", CFGCXT_RELOAD, CACHE_CONFIG,
+			"list of table patterns and their cache expiration time.",
+			CONFIG_VAR_TYPE_STRING_LIST, false, 0
+		},
+		&g_pool_config.memqcache_expire_table_list,
+		&g_pool_config.num_memqcache_expire_table_list,
+		NULL,
+		",",
+		false,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_expire_query_list", CFGCXT_RELOAD, CACHE_CONFIG,
+			"list of query patterns and their cache expiration time.",
+			CONFIG_VAR_TYPE_STRING_LIST, false, 0
+		},
+		&g_pool_config.memqcache_expire_query_list,
+		&g_pool_config.num_memqcache_expire_query_list,
+		NULL,
+		",",
+		false,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"black_query_pattern_list", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
 			"list of query patterns that should be sent to primary node.",
@@ -1247,7 +1374,7 @@ static struct config_long ConfigureNamesLong[] =
 	},
 
 	{
-		{"memqcache_total_size", CFGCXT_INIT, CACHE_CONFIG,
+		{"memqcache_total_size", CFGCXT_RELOAD, CACHE_CONFIG,
 			"Total memory size in bytes for storing memory cache.",
 			CONFIG_VAR_TYPE_LONG, false, 0
 		},
@@ -1257,6 +1384,17 @@ static struct config_long ConfigureNamesLong[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_total_size_limit", CFGCXT_INIT, CACHE_CONFIG,
+			"Memory size in bytes reserved for memqcache_total_size to grow up to.",
+			CONFIG_VAR_TYPE_LONG, false, 0
+		},
+		&g_pool_config.memqcache_total_size_limit,
+		(int64) 0,
+		0, LONG_MAX,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	EMPTY_CONFIG_LONG
 
@@ -1650,6 +1788,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"min_spare_children", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Minimum number of idle children in dynamic process management mode.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.min_spare_children,
+		5,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"max_spare_children", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of idle children in dynamic process management mode.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.max_spare_children,
+		10,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"listen_backlog_multiplier", CFGCXT_INIT, CONNECTION_CONFIG,
 			"length of connection queue from frontend to pgpool-II",
@@ -1694,6 +1854,50 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"connection_check_interval", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Interval in seconds to check that idle pooled connections are alive.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.connection_check_interval,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"backend_keepalives_idle", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"TCP keepalive idle time in seconds for backend connections.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.backend_keepalives_idle,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"backend_keepalives_interval", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"TCP keepalive interval in seconds for backend connections.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.backend_keepalives_interval,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"backend_keepalives_count", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Maximum number of TCP keepalive probes for backend connections.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.backend_keepalives_count,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"child_max_connections", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
 			"A pgpool-II child process will be terminated after this many connections from clients.",
@@ -1705,6 +1909,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"prewarm_connection_count", CFGCXT_RELOAD, CONNECTION_POOL_CONFIG,
+			"Number of child processes keeping pre-warmed backend connections.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.prewarm_connection_count,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"authentication_timeout", CFGCXT_INIT, CONNECTION_CONFIG,
 			"Time out value in seconds for client authentication.",
@@ -1771,6 +1986,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"replication_parallel_lock_timeout", CFGCXT_RELOAD, REPLICATION_CONFIG,
+			"Lock wait time in milliseconds after which a query sent to all nodes at once is retried.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.replication_parallel_lock_timeout,
+		1000,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"sequence_preallocation_size", CFGCXT_INIT, REPLICATION_CONFIG,
+			"Number of sequence values fetched from the master node at once.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.sequence_preallocation_size,
+		100,
+		1, 10000,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"wd_port", CFGCXT_INIT, WATCHDOG_CONFIG,
 			"tcp/IP port number on which watchdog of process of pgpool will listen on.",
@@ -1871,7 +2108,62 @@ static struct config_int ConfigureNamesInt[] =
 	},
 
 	{
-		{"memqcache_max_num_cache", CFGCXT_INIT, CACHE_CONFIG,
+		{"memqcache_memcached_timeout", CFGCXT_INIT, CACHE_CONFIG,
+			"Timeout in milliseconds of connecting to and waiting for memcached.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_memcached_timeout,
+		1000,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_memcached_retry_timeout", CFGCXT_INIT, CACHE_CONFIG,
+			"Seconds to stop using a memcached server after an error.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_memcached_retry_timeout,
+		10,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_single_flight_timeout", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Milliseconds to wait for another process running the same query on cache miss.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_single_flight_timeout,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_stale_grace", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Seconds to serve expired cache while it is refreshed.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_stale_grace,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_admission_threshold", CFGCXT_RELOAD, CACHE_CONFIG,
+			"Number of cache misses of a query before its result is cached.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_admission_threshold,
+		1,
+		1, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_max_num_cache", CFGCXT_RELOAD, CACHE_CONFIG,
 			"Total number of cache entries.",
 			CONFIG_VAR_TYPE_INT, false, 0
 		},
@@ -1881,6 +2173,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_max_num_cache_limit", CFGCXT_INIT, CACHE_CONFIG,
+			"Number of cache entries reserved for memqcache_max_num_cache to grow up to.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_max_num_cache_limit,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"memqcache_expire", CFGCXT_INIT, CACHE_CONFIG,
 			"Memory cache entry life time specified in seconds.",
@@ -1914,6 +2217,28 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_compression_threshold", CFGCXT_INIT, CACHE_CONFIG,
+			"Minimum SELECT result size in bytes to be compressed.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_compression_threshold,
+		8192,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
+	{
+		{"memqcache_maxcache_uncompressed", CFGCXT_INIT, CACHE_CONFIG,
+			"Maximum SELECT result size in bytes before compression.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.memqcache_maxcache_uncompressed,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	{
 		{"auto_failback_interval", CFGCXT_RELOAD, FAILOVER_CONFIG,
 			"min interval of executing auto_failback in seconds",
@@ -1925,6 +2250,17 @@ static struct config_int ConfigureNamesInt[] =
 		NULL, NULL, NULL
 	},
 
+	{
+		{"health_check_async_interval", CFGCXT_RELOAD, HEALTH_CHECK_CONFIG,
+			"Time interval in milliseconds between asynchronous health checks. 0 means health_check_period.",
+			CONFIG_VAR_TYPE_INT, false, 0
+		},
+		&g_pool_config.health_check_async_interval,
+		0,
+		0, INT_MAX,
+		NULL, NULL, NULL
+	},
+
 	/* End-of-list marker */
 	EMPTY_CONFIG_INT
 };
@@ -2021,6 +2357,17 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"memqcache_compression", CFGCXT_INIT, CACHE_CONFIG,
+			"Compression method of cached SELECT results.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.memqcache_compression,
+		MEMQCACHE_COMPRESSION_OFF,
+		memqcache_compression_options,
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"disable_load_balance_on_write", CFGCXT_RELOAD, LOAD_BALANCE_CONFIG,
 			"Load balance behavior when write query is received.",
@@ -2043,6 +2390,39 @@ static struct config_enum ConfigureNamesEnum[] =
 		NULL, NULL, NULL, NULL
 	},
 
+	{
+		{"process_management_mode", CFGCXT_INIT, CONNECTION_POOL_CONFIG,
+			"child process management mode.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.process_management_mode,
+		PM_STATIC,
+		process_management_mode_options,
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"shared_memory_numa_policy", CFGCXT_INIT, GENERAL_CONFIG,
+			"NUMA memory placement of shared memory segments.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.shared_memory_numa_policy,
+		NUMA_POLICY_DEFAULT,
+		shared_memory_numa_policy_options,
+		NULL, NULL, NULL, NULL
+	},
+
+	{
+		{"huge_pages", CFGCXT_INIT, GENERAL_CONFIG,
+			"Use huge pages for shared memory.",
+			CONFIG_VAR_TYPE_ENUM, false, 0
+		},
+		(int *) &g_pool_config.huge_pages,
+		HUGE_PAGES_OFF,
+		huge_pages_options,
+		NULL, NULL, NULL, NULL
+	},
+
 	{
 		{"check_temp_table", CFGCXT_RELOAD, GENERAL_CONFIG,
 			"Enables temporary table check.",
@@ -4464,6 +4844,58 @@ config_post_processor(ConfigContext context, int elevel)
 	}
 
 
+	for (i = 0; i < pool_config->num_prewarm_connection_list; i++)
+	{
+		char	   *item = pool_config->prewarm_connection_list[i];
+		char	   *delim = strchr(item, ':');
+
+		if (delim == NULL || delim == item || *(delim + 1) == '\0')
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration for key \"prewarm_connection_list\""),
+					 errdetail("\"%s\" is not in \"user:database\" format", item)));
+			return false;
+		}
+	}
+
+	for (i = 0; i < pool_config->num_child_cpu_affinity; i++)
+	{
+		if (!pool_parse_cpu_list(pool_config->child_cpu_affinity[i], NULL))
+		{
+			ereport(elevel,
+					(errmsg("invalid configuration for key \"child_cpu_affinity\""),
+					 errdetail("\"%s\" is not a valid CPU list", pool_config->child_cpu_affinity[i])));
+			return false;
+		}
+	}
+
+	if (pool_config->min_spare_children >= pool_config->max_spare_children)
+	{
+		ereport(elevel,
+				(errmsg("invalid configuration, max_spare_children:%d must be greater than min_spare_children:%d",
+						pool_config->max_spare_children, pool_config->min_spare_children)));
+		return false;
+	}
+
+	if (pool_config->process_management_mode == PM_DYNAMIC &&
+		pool_config->max_spare_children > pool_config->num_init_children)
+	{
+		ereport(elevel,
+				(errmsg("invalid configuration, max_spare_children:%d must not be greater than num_init_children:%d",
+						pool_config->max_spare_children, pool_config->num_init_children)));
+		return false;
+	}
+
+#ifndef USE_LZ4
+	if (pool_config->memqcache_compression == MEMQCACHE_COMPRESSION_LZ4)
+	{
+		ereport(elevel,
+				(errmsg("invalid configuration, memqcache_compression = lz4 requires LZ4 support"),
+				 errhint("Build Pgpool-II with --with-lz4.")));
+		return false;
+	}
+#endif
+
 	if (strcmp(pool_config->recovery_1st_stage_command, "") ||
 		strcmp(pool_config->recovery_2nd_stage_command, ""))
 	{
@@ -4484,6 +4916,55 @@ config_post_processor(ConfigContext context, int elevel)
 	return true;
 }
 
+/*
+ * Parse a list of CPU numbers and ranges like "0-7,16-23".  If cpus is not
+ * NULL, the listed CPUs are set in it, which must have POOL_MAX_CPUS
+ * elements.  Returns false if the list is malformed.
+ */
+bool
+pool_parse_cpu_list(const char *list, bool *cpus)
+{
+	const char *p = list;
+
+	for (;;)
+	{
+		char	   *end;
+		long		first;
+		long		last;
+
+		while (isspace((unsigned char) *p))
+			p++;
+		if (!isdigit((unsigned char) *p))
+			return false;
+		first = last = strtol(p, &end, 10);
+		p = end;
+		if (*p == '-')
+		{
+			p++;
+			if (!isdigit((unsigned char) *p))
+				return false;
+			last = strtol(p, &end, 10);
+			p = end;
+		}
+		if (first > last || last >= POOL_MAX_CPUS)
+			return false;
+
+		if (cpus)
+		{
+			for (; first <= last; first++)
+				cpus[first] = true;
+		}
+
+		while (isspace((unsigned char) *p))
+			p++;
+		if (*p == '\0')
+			return true;
+		if (*p != ',')
+			return false;
+		p++;
+	}
+}
+
 static bool
 MakeAppRedirectListRegex(char *newval, int elevel)
 {
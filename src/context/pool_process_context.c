@@ -229,7 +229,7 @@ pool_coninfo_backend_pid(int backend_pid, int *backend_node_id)
 	for (child = 0; child < pool_config->num_init_children; child++)
 	{
 		int			pool;
-		ProcessInfo *pi = pool_get_process_info(process_info[child].pid);
+		ProcessInfo *pi = &process_info[child];
 
 		for (pool = 0; pool < pool_config->max_pool; pool++)
 		{
@@ -313,9 +313,11 @@ pool_virtual_master_db_node_id(void)
 	POOL_SESSION_CONTEXT *sc;
 
 	/*
-	 * Check whether failover is in progress. If so, just abort this session.
+	 * Check whether failover is in progress. If so, just abort this session,
+	 * unless the failover only detaches standby nodes. Sessions using those
+	 * nodes are terminated by pgpool main.
 	 */
-	if (Req_info->switching)
+	if (Req_info->switching && !Req_info->switching_standby_only)
 	{
 		POOL_SETMASK(&BlockSig);
 		ereport(WARNING,
@@ -127,6 +127,13 @@ pool_init_session_context(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * bac
 	/* Forget transaction isolation mode */
 	pool_unset_transaction_isolation();
 
+	/* Forget transaction timestamp */
+	pool_unset_transaction_timestamp();
+
+	/* No DDL has been executed in this transaction yet */
+	session_context->ddl_in_transaction = false;
+	session_context->sequence_reset_in_transaction = false;
+
 	/* We don't skip reading from backends */
 	pool_unset_skip_reading_from_backends();
 
@@ -441,6 +448,9 @@ pool_sent_message_destroy(POOL_SENT_MESSAGE * message)
 		if (message->name)
 			pfree(message->name);
 
+		if (message->portal_cache.data)
+			pfree(message->portal_cache.data);
+
 		if (message->query_context)
 		{
 			if (session_context->query_context != message->query_context)
@@ -550,6 +560,12 @@ pool_create_sent_message(char kind, int len, char *contents,
 	msg->num_tsparams = num_tsparams;
 	msg->name = pstrdup(name);
 	msg->query_context = query_context;
+	msg->is_cache_safe = false;
+	msg->param_offset = 0;
+	msg->is_executed = false;
+	msg->portal_cache.data = NULL;
+	msg->portal_cache.len = 0;
+	msg->portal_cache.offset = 0;
 	MemoryContextSwitchTo(old_context);
 
 	return msg;
@@ -671,6 +687,30 @@ pool_get_sent_message_by_query_context(POOL_QUERY_CONTEXT * query_context)
 	return NULL;
 }
 
+/*
+ * Returns true if a prepared statement or portal in the sent message list
+ * is routed to the backend node.  Those would not be found on another node
+ * by a later Bind or Execute.
+ */
+bool
+pool_sent_messages_use_node(int node_id)
+{
+	int			i;
+	POOL_SENT_MESSAGE_LIST *msglist;
+	POOL_QUERY_CONTEXT *query_context;
+
+	msglist = &pool_get_session_context(false)->message_list;
+
+	for (i = 0; i < msglist->size; i++)
+	{
+		query_context = msglist->sent_messages[i]->query_context;
+		if (query_context && query_context->where_to_send[node_id])
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * Set message state to POOL_SENT_MESSAGE_STATE to POOL_SENT_MESSAGE_CLOSED.
  */
@@ -783,6 +823,42 @@ pool_set_transaction_isolation(POOL_TRANSACTION_ISOLATION isolation_level)
 	pool_get_session_context(false)->transaction_isolation = isolation_level;
 }
 
+/*
+ * Forget transaction timestamp
+ */
+void
+pool_unset_transaction_timestamp(void)
+{
+	ereport(DEBUG5,
+			(errmsg("session context: clearing transaction timestamp. DONE")));
+	pool_get_session_context(false)->transaction_timestamp[0] = '\0';
+}
+
+/*
+ * Remember transaction timestamp
+ */
+void
+pool_set_transaction_timestamp(const char *timestamp)
+{
+	ereport(DEBUG5,
+			(errmsg("session context: setting transaction timestamp. DONE")));
+	strlcpy(pool_get_session_context(false)->transaction_timestamp, timestamp,
+			sizeof(session_context->transaction_timestamp));
+}
+
+/*
+ * Return cached transaction timestamp, or NULL if not known
+ */
+char *
+pool_get_transaction_timestamp(void)
+{
+	POOL_SESSION_CONTEXT *sc = pool_get_session_context(true);
+
+	if (!sc || sc->transaction_timestamp[0] == '\0')
+		return NULL;
+	return sc->transaction_timestamp;
+}
+
 /*
  * Get or return cached transaction isolation mode
  */
@@ -90,6 +90,11 @@ typedef struct
 	int			param_offset;	/* Offset from contents where actual bind
 								 * parameters are stored. This is meaningful
 								 * only when is_cache_safe is true. */
+	bool		is_executed;	/* true if the portal has been executed on
+								 * backend, so its rest must not be fetched
+								 * from cache */
+	POOL_PORTAL_CACHE portal_cache; /* cached result of the portal being
+									 * fetched by row-limited Executes */
 }			POOL_SENT_MESSAGE;
 
 /*
@@ -204,6 +209,18 @@ typedef struct
 	 */
 	POOL_TRANSACTION_ISOLATION transaction_isolation;
 
+	/*
+	 * Current timestamp of the transaction on the master node, used to
+	 * rewrite now() etc.  Empty if not fetched yet in this transaction.
+	 */
+	char		transaction_timestamp[64];
+
+	/* If true, DDL has been executed in this transaction */
+	bool		ddl_in_transaction;
+
+	/* If true, sequences may have been reset in this transaction */
+	bool		sequence_reset_in_transaction;
+
 	/*
 	 * Associated query context, only used for non-extended protocol. In
 	 * extended protocol, the query context resides in "PreparedStatementList
@@ -312,6 +329,7 @@ extern POOL_SENT_MESSAGE * pool_get_sent_message(char kind, const char *name, PO
 extern void pool_set_sent_message_state(POOL_SENT_MESSAGE * message);
 extern void pool_zap_query_context_in_sent_messages(POOL_QUERY_CONTEXT *query_context);
 extern POOL_SENT_MESSAGE * pool_get_sent_message_by_query_context(POOL_QUERY_CONTEXT * query_context);
+extern bool pool_sent_messages_use_node(int node_id);
 extern void pool_unset_writing_transaction(void);
 extern void pool_set_writing_transaction(void);
 extern bool pool_is_writing_transaction(void);
@@ -321,6 +339,9 @@ extern bool pool_is_failed_transaction(void);
 extern void pool_unset_transaction_isolation(void);
 extern void pool_set_transaction_isolation(POOL_TRANSACTION_ISOLATION isolation_level);
 extern POOL_TRANSACTION_ISOLATION pool_get_transaction_isolation(void);
+extern void pool_unset_transaction_timestamp(void);
+extern void pool_set_transaction_timestamp(const char *timestamp);
+extern char *pool_get_transaction_timestamp(void);
 extern void pool_unset_command_success(void);
 extern void pool_set_command_success(void);
 extern bool pool_is_command_success(void);
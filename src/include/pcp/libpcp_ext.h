@@ -58,6 +58,7 @@ typedef enum
 #define BACKEND_STATUS_CON_UP			"up"
 #define BACKEND_STATUS_CON_DOWN			"down"
 #define BACKEND_STATUS_QUARANTINE		"quarantine"
+#define BACKEND_STATUS_DRAINING			"draining"
 
 /*
  * Backend status record file
@@ -97,6 +98,12 @@ typedef struct
 								 * primary node */
 	char		replication_state [NAMEDATALEN];	/* "state" from pg_stat_replication */
 	char		replication_sync_state [NAMEDATALEN];	/* "sync_state" from pg_stat_replication */
+	bool		draining;		/* true if the node is up but no new work
+								 * should be routed to it */
+	uint64		health_check_rtt;	/* response time of the last
+									 * asynchronous health check in
+									 * microseconds */
+	uint64		health_check_srtt;	/* smoothed health_check_rtt */
 }			BackendInfo;
 
 typedef struct
@@ -231,6 +238,71 @@ typedef struct
 	char		version[POOLCONFIG_MAXVALLEN + 1];
 }			POOL_REPORT_VERSION;
 
+/* backend statement counters report struct */
+typedef struct
+{
+	char		node_id[POOLCONFIG_MAXIDLEN + 1];
+	char		hostname[MAX_DB_HOST_NAMELEN + 1];
+	char		port[POOLCONFIG_MAXPORTLEN + 1];
+	char		status[POOLCONFIG_MAXSTATLEN + 1];
+	char		role[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		select_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		insert_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		update_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		delete_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		ddl_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		other_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		health_check_rtt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		health_check_srtt[POOLCONFIG_MAXWEIGHTLEN + 1];
+}			POOL_REPORT_BACKEND_STATS;
+
+/* latency report struct, all times are in microseconds */
+typedef struct
+{
+	char		scope[POOLCONFIG_MAXSTATLEN + 1];	/* global, node, database
+													 * or child */
+	char		name[POOLCONFIG_MAXIDENTLEN + 1];	/* node id, database name or
+													 * pid */
+	char		statement[POOLCONFIG_MAXSTATLEN + 1];
+	char		count[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		backend_avg[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		backend_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		backend_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		backend_max[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		pgpool_avg[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		pgpool_p50[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		pgpool_p99[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		pgpool_max[POOLCONFIG_MAXWEIGHTLEN + 1];
+}			POOL_REPORT_LATENCY;
+
+/* lightweight lock report struct, wait times are in microseconds */
+typedef struct
+{
+	char		lock_name[POOLCONFIG_MAXIDENTLEN + 1];
+	char		acquire_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		contended_cnt[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		total_wait[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		max_wait[POOLCONFIG_MAXWEIGHTLEN + 1];
+}			POOL_REPORT_LWLOCKS;
+
+/* failover trace report struct */
+typedef struct
+{
+	char		seq[POOLCONFIG_MAXWEIGHTLEN + 1];
+	char		time[POOLCONFIG_MAXDATELEN + 1];
+	char		pid[POOLCONFIG_MAXCOUNTLEN + 1];
+	char		request[POOLCONFIG_MAXCOUNTLEN + 1];	/* failover request
+														 * number */
+	char		kind[POOLCONFIG_MAXSTATLEN + 1];	/* failover, failback,
+													 * promote... */
+	char		event[POOLCONFIG_MAXIDENTLEN + 1];
+	char		node_id[POOLCONFIG_MAXIDLEN + 1];
+	char		elapsed[POOLCONFIG_MAXWEIGHTLEN + 1];	/* msec since the
+														 * previous event of the
+														 * request */
+	char		detail[POOLCONFIG_MAXIDENTLEN + 1];
+}			POOL_REPORT_FAILOVER_TRACE;
+
 typedef enum
 {
 	PCP_CONNECTION_OK,
@@ -296,8 +368,11 @@ extern PCPResultInfo * pcp_process_info(PCPConnInfo * pcpConn, int pid);
 
 extern PCPResultInfo * pcp_detach_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_detach_node_gracefully(PCPConnInfo * pcpConn, int nid);
+extern PCPResultInfo * pcp_drain_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_attach_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_pool_status(PCPConnInfo * pcpConn);
+extern PCPResultInfo * pcp_latency_stats(PCPConnInfo * pcpConn);
+extern PCPResultInfo * pcp_failover_trace(PCPConnInfo * pcpConn);
 extern PCPResultInfo * pcp_recovery_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_promote_node(PCPConnInfo * pcpConn, int nid);
 extern PCPResultInfo * pcp_promote_node_gracefully(PCPConnInfo * pcpConn, int nid);
@@ -325,6 +325,8 @@ typedef struct
 	time_t		closetime;		/* absolute time in second when the connection
 								 * closed if 0, that means the connection is
 								 * under use. */
+	time_t		checktime;		/* absolute time in second when the idle
+								 * connection was last found alive */
 }			POOL_CONNECTION_POOL_SLOT;
 
 typedef struct
@@ -456,13 +458,6 @@ typedef enum
 #define NO_LOAD_BALANCE "/*NO LOAD BALANCE*/"
 #define NO_LOAD_BALANCE_COMMENT_SZ (sizeof(NO_LOAD_BALANCE)-1)
 
-#define MAX_NUM_SEMAPHORES		6
-#define CONN_COUNTER_SEM		0
-#define REQUEST_INFO_SEM		1
-#define SHM_CACHE_SEM			2
-#define QUERY_CACHE_STATS_SEM	3
-#define PCP_REQUEST_SEM			4
-#define ACCEPT_FD_SEM			5
 #define MAX_REQUEST_QUEUE_SIZE	10
 
 #define MAX_SEC_WAIT_FOR_CLUSTER_TRANSATION 10	/* time in seconds to keep
@@ -494,7 +489,9 @@ typedef enum
 	NODE_RECOVERY_REQUEST,
 	CLOSE_IDLE_REQUEST,
 	PROMOTE_NODE_REQUEST,
-	NODE_QUARANTINE_REQUEST
+	NODE_QUARANTINE_REQUEST,
+	NODE_DRAIN_REQUEST,
+	NODE_UNDRAIN_REQUEST
 }			POOL_REQUEST_KIND;
 
 #define REQ_DETAIL_SWITCHOVER	0x00000001	/* failover due to switch over */
@@ -510,8 +507,43 @@ typedef struct
 	unsigned char request_details;	/* option flags kind */
 	int			node_id[MAX_NUM_BACKENDS];	/* request node id */
 	int			count;			/* request node ids count */
+	struct timeval request_time;	/* when the request was queued */
 }			POOL_REQUEST_NODE;
 
+/*
+ * Failover trace events. Keep event_names[] in failover_trace.c in sync.
+ */
+typedef enum
+{
+	FAILOVER_TRACE_REQUEST_QUEUED,
+	FAILOVER_TRACE_CONSENSUS_START,
+	FAILOVER_TRACE_CONSENSUS_END,
+	FAILOVER_TRACE_FAILOVER_START,
+	FAILOVER_TRACE_COMMAND_START,
+	FAILOVER_TRACE_COMMAND_END,
+	FAILOVER_TRACE_DEGENERATE_DONE,
+	FAILOVER_TRACE_PRIMARY_SEARCH_START,
+	FAILOVER_TRACE_PRIMARY_SEARCH_END,
+	FAILOVER_TRACE_CHILD_RESTART_START,
+	FAILOVER_TRACE_CHILD_RESTART_END,
+	FAILOVER_TRACE_FAILOVER_END
+}			FAILOVER_TRACE_EVENT_KIND;
+
+#define FAILOVER_TRACE_SIZE 1024	/* number of events kept in shared memory */
+
+typedef struct
+{
+	volatile uint32 seq;		/* event number + 1, 0 while being written */
+	FAILOVER_TRACE_EVENT_KIND kind;
+	int			request_no;		/* failover request number, -1 if not
+								 * queued yet */
+	POOL_REQUEST_KIND reqkind;
+	int			node_id;
+	pid_t		pid;			/* process which recorded the event */
+	struct timeval time;
+	char		detail[64];
+}			FAILOVER_TRACE_EVENT;
+
 typedef struct
 {
 	POOL_REQUEST_NODE request[MAX_REQUEST_QUEUE_SIZE];
@@ -524,6 +556,9 @@ typedef struct
 	int			conn_counter;
 	bool		switching;		/* it true, failover or failback is in
 								 * progress */
+	bool		switching_standby_only; /* if true, the failover in progress
+										 * only detaches standby nodes and
+										 * children keep running */
 }			POOL_REQUEST_INFO;
 
 /* description of row. corresponding to RowDescription message */
@@ -662,6 +697,7 @@ extern POOL_STATUS pool_process_query(POOL_CONNECTION * frontend,
 									  int reset_request);
 
 extern void connection_do_auth(POOL_CONNECTION_POOL_SLOT * cp, char *password);
+extern bool pool_prepare_reauth(POOL_CONNECTION * backend, char *user, char *password);
 extern int	pool_do_auth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern int	pool_do_reauth(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * cp);
 extern void authenticate_frontend(POOL_CONNECTION * frontend);
@@ -738,12 +774,10 @@ extern void init_prepared_list(void);
 extern void proc_exit(int);
 
 extern void *pool_shared_memory_create(size_t size);
+extern bool pool_shared_memory_info(void *addr, size_t *size, size_t *page_size);
+extern void pool_shared_memory_report(void);
 extern void pool_shmem_exit(int code);
 
-extern void pool_semaphore_create(int numSems);
-extern void pool_semaphore_lock(int semNum);
-extern void pool_semaphore_unlock(int semNum);
-
 extern BackendInfo * pool_get_node_info(int node_number);
 extern int	pool_get_node_count(void);
 extern int *pool_get_process_list(int *array_size);
@@ -830,7 +864,10 @@ extern int	pool_init_cp(void);
 extern POOL_CONNECTION_POOL * pool_create_cp(void);
 extern POOL_CONNECTION_POOL * pool_get_cp(char *user, char *database, int protoMajor, int check_socket);
 extern void pool_discard_cp(char *user, char *database, int protoMajor);
-extern void pool_backend_timer(void);
+extern void pool_detach_down_nodes(POOL_CONNECTION_POOL * backend);
+extern bool pool_forget_undrained_nodes(void);
+extern bool pool_prewarm_cp(char *user, char *database, char *password);
+extern void pool_backend_timer(bool check_connections);
 extern void pool_connection_pool_timer(POOL_CONNECTION_POOL * backend);
 extern RETSIGTYPE pool_backend_timer_handler(int sig);
 extern int	connect_inet_domain_socket(int slot, bool retry);
@@ -840,11 +877,58 @@ extern int	connect_unix_domain_socket_by_port(int port, char *socket_dir, bool r
 extern int	pool_pool_index(void);
 
 /* utils/statistics.c */
+#define STAT_MAX_DATABASES	64	/* number of per database stat slots */
+
+typedef enum
+{
+	STAT_SELECT,
+	STAT_INSERT,
+	STAT_UPDATE,
+	STAT_DELETE,
+	STAT_DDL,
+	STAT_OTHER,
+	STAT_NUM_STMT_TYPES
+}			STAT_STMT_TYPE;
+
+typedef enum
+{
+	STAT_SCOPE_GLOBAL,
+	STAT_SCOPE_NODE,
+	STAT_SCOPE_DATABASE,
+	STAT_SCOPE_CHILD
+}			STAT_SCOPE;
+
+/* latency summary in microseconds */
+typedef struct
+{
+	uint64		count;
+	uint64		backend_avg;
+	uint64		backend_p50;
+	uint64		backend_p99;
+	uint64		backend_max;
+	uint64		pgpool_avg;
+	uint64		pgpool_p50;
+	uint64		pgpool_p99;
+	uint64		pgpool_max;
+}			STAT_LATENCY_SUMMARY;
+
 size_t		stat_shared_memory_size(void);
 void		stat_set_stat_area(void *address);
 void		stat_init_stat_area(void);
+void		stat_reset_child_stat(int child_id);
+void		stat_start_session(char *database);
+void		stat_start_request(void);
+void		stat_end_request(void);
 void		stat_count_up(int backend_node_id, Node *parsetree);
 uint64		stat_get_select_count(int backend_node_id);
+uint64		stat_get_insert_count(int backend_node_id);
+uint64		stat_get_update_count(int backend_node_id);
+uint64		stat_get_delete_count(int backend_node_id);
+uint64		stat_get_ddl_count(int backend_node_id);
+uint64		stat_get_other_count(int backend_node_id);
+char	   *stat_get_database_name(int slot);
+bool		stat_get_latency(STAT_SCOPE scope, int id, int type, STAT_LATENCY_SUMMARY * summary);
+char	   *stat_stmt_type_name(int type);
 
 extern int	PgpoolMain(bool discard_status, bool clear_memcache_oidmaps);
 
@@ -862,9 +946,18 @@ extern int	pool_frontend_exists(void);
 extern pid_t pool_waitpid(int *status);
 extern int	write_status_file(void);
 extern void do_health_check_child(int *node_id);
+extern void do_async_health_check_child(void);
 extern POOL_NODE_STATUS * verify_backend_node_status(POOL_CONNECTION_POOL_SLOT * *slots);
 extern POOL_NODE_STATUS * pool_get_node_status(void);
 extern void pool_set_backend_status_changed_time(int backend_id);
 extern int	get_next_master_node(void);
 
+/* failover_trace.c */
+extern size_t failover_trace_shared_memory_size(void);
+extern void failover_trace_init(void *addr);
+extern void failover_trace_event(FAILOVER_TRACE_EVENT_KIND kind, int request_no,
+					 POOL_REQUEST_KIND reqkind, int node_id, const char *detail);
+extern FAILOVER_TRACE_EVENT * failover_trace_get_events(int *nevents);
+extern const char *failover_trace_event_name(FAILOVER_TRACE_EVENT_KIND kind);
+
 #endif							/* POOL_H */
@@ -99,6 +99,34 @@ typedef enum RELQTARGET_OPTION
 	RELQTARGET_LOAD_BALANCE_NODE
 }			RELQTARGET_OPTION;
 
+typedef enum ProcessManagementModes
+{
+	PM_STATIC = 1,
+	PM_DYNAMIC
+}			ProcessManagementModes;
+
+typedef enum HugePagesModes
+{
+	HUGE_PAGES_OFF = 1,
+	HUGE_PAGES_ON,
+	HUGE_PAGES_TRY
+}			HugePagesModes;
+
+typedef enum MemqcacheCompressions
+{
+	MEMQCACHE_COMPRESSION_OFF = 1,
+	MEMQCACHE_COMPRESSION_LZ4
+}			MemqcacheCompressions;
+
+typedef enum NumaPolicies
+{
+	NUMA_POLICY_DEFAULT = 1,
+	NUMA_POLICY_INTERLEAVE
+}			NumaPolicies;
+
+/* Largest CPU number accepted in child_cpu_affinity */
+#define POOL_MAX_CPUS	1024
+
 typedef enum CHECK_TEMP_TABLE_OPTION
 {
 	CHECK_TEMP_CATALOG = 1,
@@ -177,13 +205,39 @@ typedef struct
 	int			listen_backlog_multiplier;	/* determines the size of the
 											 * connection queue */
 	int			reserved_connections;	/* # of reserved connections */
+	ProcessManagementModes process_management_mode;	/* static or dynamic
+														 * child process pool */
+	int			min_spare_children; /* minimum # of idle children in
+									 * dynamic mode */
+	int			max_spare_children; /* maximum # of idle children in
+									 * dynamic mode */
+	char	  **child_cpu_affinity; /* CPU sets children are bound to */
+	NumaPolicies shared_memory_numa_policy;	/* NUMA placement of shared
+											 * memory */
+	HugePagesModes huge_pages;	/* use huge pages for shared memory */
 	bool		serialize_accept;	/* if non 0, serialize call to accept() to
 									 * avoid thundering herd problem */
 	int			child_life_time;	/* if idle for this seconds, child exits */
 	int			connection_life_time;	/* if idle for this seconds,
 										 * connection closes */
+	int			connection_check_interval;	/* interval in seconds to check
+											 * idle pooled connections are
+											 * alive. 0 disables the check */
+	int			backend_keepalives_idle;	/* TCP_KEEPIDLE for backend
+											 * connections. 0 uses the
+											 * system default */
+	int			backend_keepalives_interval;	/* TCP_KEEPINTVL for backend
+												 * connections */
+	int			backend_keepalives_count;	/* TCP_KEEPCNT for backend
+											 * connections */
 	int			child_max_connections;	/* if max_connections received, child
 										 * exits */
+	char	  **prewarm_connection_list;	/* list of "user:database" pairs
+											 * whose backend connections are
+											 * created in advance */
+	int			prewarm_connection_count;	/* # of child processes keeping
+											 * pre-warmed connections. 0
+											 * disables pre-warming */
 	int			client_idle_limit;	/* If client_idle_limit is n (n > 0), the
 									 * client is forced to be disconnected
 									 * after n seconds idle */
@@ -274,6 +328,12 @@ typedef struct
 									 * connecting to backend */
 	HealthCheckParams *health_check_params; /* per node health check
 											 * parameters */
+	bool		health_check_async;	/* if true, a single process checks all
+									 * the nodes with non-blocking sockets */
+	int			health_check_async_interval;	/* period of the asynchronous
+												 * health check in
+												 * milliseconds. 0 means
+												 * health_check_period */
 	int			sr_check_period;	/* streaming replication check period */
 	char	   *sr_check_user;	/* PostgreSQL user name for streaming
 								 * replication check */
@@ -321,6 +381,16 @@ typedef struct
 	bool		log_client_messages;	/* If true, logs any client messages */
 	char	   *lobj_lock_table;	/* table name to lock for rewriting
 									 * lo_creat */
+	bool		replication_parallel_execution; /* send write queries to all
+												 * nodes at once */
+	int			replication_parallel_lock_timeout;	/* lock_timeout in
+													 * milliseconds for
+													 * parallel execution */
+	bool		sequence_preallocation; /* give INSERT pre-allocated
+										 * sequence values instead of
+										 * insert_lock */
+	int			sequence_preallocation_size;	/* number of sequence values
+												 * fetched at once */
 
 	BackendDesc *backend_desc;	/* PostgreSQL Server description. Placed on
 								 * shared memory */
@@ -331,6 +401,10 @@ typedef struct
 
 	/* followings till syslog, does not exist in the configuration file */
 	int			num_reset_queries;	/* number of queries in reset_query_list */
+	int			num_prewarm_connection_list;	/* number of items in
+												 * prewarm_connection_list */
+	int			num_child_cpu_affinity; /* number of CPU sets in
+										 * child_cpu_affinity */
 	int			num_white_function_list;	/* number of functions in
 											 * white_function_list */
 	int			num_black_function_list;	/* number of functions in
@@ -339,6 +413,10 @@ typedef struct
 												 * white_memqcache_table_list */
 	int			num_black_memqcache_table_list; /* number of functions in
 												 * black_memqcache_table_list */
+	int			num_memqcache_expire_table_list;	/* number of rules in
+													 * memqcache_expire_table_list */
+	int			num_memqcache_expire_query_list;	/* number of rules in
+													 * memqcache_expire_query_list */
 	int			num_black_query_pattern_list;	/* number of query patterns in
 												 * black_query_pattern_list */
 	int			num_wd_monitoring_interfaces_list;	/* number of items in
@@ -387,9 +465,31 @@ typedef struct
 	int			memqcache_memcached_port;	/* Memcached port number.
 											 * Mandatory if
 											 * memqcache_method=memcached. */
+	int			memqcache_memcached_timeout;	/* Timeout in milliseconds
+												 * of connecting to and
+												 * waiting for memcached */
+	int			memqcache_memcached_retry_timeout;	/* Seconds to stop using
+													 * a memcached server
+													 * after an error */
+	int			memqcache_single_flight_timeout;	/* Milliseconds to wait for
+													 * another process
+													 * running the same query
+													 * on cache miss */
+	int			memqcache_admission_threshold;	/* Number of cache misses
+												 * before the result of a
+												 * query is cached */
+	int			memqcache_stale_grace;	/* Seconds to serve expired cache
+										 * while it is refreshed */
 	int64		memqcache_total_size;	/* Total memory size in bytes for
 										 * storing memory cache. Mandatory if
 										 * memqcache_method=shmem. */
+	int64		memqcache_total_size_limit; /* Memory size in bytes reserved
+											 * for memqcache_total_size to
+											 * grow up to */
+	int			memqcache_max_num_cache_limit;	/* Number of cache entries
+												 * reserved for
+												 * memqcache_max_num_cache to
+												 * grow up to */
 	int			memqcache_max_num_cache;	/* Total number of cache entries.
 											 * Mandatory if
 											 * memqcache_method=shmem. */
@@ -401,13 +501,28 @@ typedef struct
 													 * corresponding */
 	/* DDL/DML/DCL(and memqcache_expire).  If false, it is only triggered */
 	/* by memqcache_expire.  True by default. */
+	bool		memqcache_lazy_backend_connection;	/* If true, connect to
+													 * backend at the first
+													 * query not found in
+													 * the query cache */
 	int			memqcache_maxcache; /* Maximum SELECT result size in bytes. */
 	int			memqcache_cache_block_size; /* Cache block size in bytes. 8192
 											 * by default */
+	MemqcacheCompressions memqcache_compression;	/* compression method of
+													 * cached results */
+	int			memqcache_compression_threshold;	/* minimum result size in
+													 * bytes to compress */
+	int			memqcache_maxcache_uncompressed;	/* maximum SELECT result
+													 * size in bytes before
+													 * compression */
 	char	   *memqcache_oiddir;	/* Temporary work directory to record
 									 * table oids */
 	char	  **white_memqcache_table_list; /* list of tables to memqcache */
 	char	  **black_memqcache_table_list; /* list of tables not to memqcache */
+	char	  **memqcache_expire_table_list;	/* list of table patterns and
+												 * their cache expiration */
+	char	  **memqcache_expire_query_list;	/* list of query patterns and
+												 * their cache expiration */
 
 	RegPattern *lists_memqcache_table_patterns; /* Precompiled regex patterns
 												 * for black/white lists */
@@ -465,6 +580,9 @@ typedef struct
 												 * until the session ends. */
 
 	bool		statement_level_load_balance; /* if on, select load balancing node per statement */
+	bool		load_balance_by_response_time;	/* if on, load balance weights
+												 * are scaled by the response
+												 * time of health check */
 
 	/*
 	 * add for watchdog
@@ -552,6 +670,7 @@ extern bool pool_get_config(const char *config_file, ConfigContext context);
 extern int	eval_logical(const char *str);
 extern char *pool_flag_to_str(unsigned short flag);
 extern char *backend_status_to_str(BackendInfo * bi);
+extern bool pool_parse_cpu_list(const char *list, bool *cpus);
 
 /* methods used for regexp support */
 extern int	add_regex_pattern(const char *type, char *s);
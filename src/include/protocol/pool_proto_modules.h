@@ -160,8 +160,10 @@ extern int	check_copy_from_stdin(Node *node);	/* returns non 0 if this is a
 												 * COPY FROM STDIN */
 extern void query_ps_status(char *query, POOL_CONNECTION_POOL * backend);	/* show ps status */
 extern POOL_STATUS start_internal_transaction(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, Node *node);
+extern POOL_STATUS start_internal_transaction_with_lock_timeout(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, Node *node, int lock_timeout);
 extern POOL_STATUS end_internal_transaction(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern int	detect_deadlock_error(POOL_CONNECTION * master, int major);
+extern int	detect_lock_not_available_error(POOL_CONNECTION * backend, int major);
 extern int	detect_serialization_error(POOL_CONNECTION * master, int major, bool unread);
 extern int	detect_active_sql_transaction_error(POOL_CONNECTION * backend, int major);
 extern int	detect_query_cancel_error(POOL_CONNECTION * backend, int major);
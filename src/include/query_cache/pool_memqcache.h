@@ -104,6 +104,8 @@ typedef struct
 	unsigned int total_length;	/* total length in bytes including myself */
 	time_t		timestamp;		/* cache creation time */
 	int			expire;			/* cache expire	*/
+	int			rule_slot;		/* stats slot of the cache rule which
+								 * decided expire */
 }			POOL_CACHE_ITEM_HEADER;
 
 typedef struct
@@ -122,8 +124,41 @@ typedef struct
 #define MAX_VALUE 8192
 #define MAX_KEY 256
 
+/*
+ * Maximum number of memcached servers listed in memqcache_memcached_host
+ */
+#define MAX_MEMCACHED_SERVERS 32
+
+/*
+ * Number of points each memcached server has on the consistent hashing
+ * ring.
+ */
+#define MEMCACHED_POINTS_PER_SERVER 160
+
+/*
+ * Cached result of a portal being fetched from cache by Execute messages
+ * with a row limit.
+ */
+typedef struct
+{
+	char	   *data;			/* cached messages */
+	size_t		len;			/* length of data */
+	size_t		offset;			/* offset of the next message to send */
+}			POOL_PORTAL_CACHE;
+
 extern int	memcached_connect(void);
 extern void memcached_disconnect(void);
+extern size_t pool_memcached_shared_memory_size(void);
+extern void pool_memcached_init(void *addr);
+extern size_t pool_in_flight_shared_memory_size(void);
+extern void pool_in_flight_init(void *addr);
+extern void pool_release_in_flight(void);
+extern size_t pool_admission_sketch_shared_memory_size(void);
+extern void pool_admission_sketch_init(void *addr);
+extern size_t pool_startup_params_shared_memory_size(void);
+extern void pool_startup_params_init(void *addr);
+extern void pool_save_startup_params(POOL_CONNECTION_POOL * backend);
+extern bool pool_get_startup_params(StartupPacket *sp, char **params, int *len, int *auth_kind);
 extern void memqcache_register(char kind, POOL_CONNECTION * frontend, char *data, int data_len);
 
 /*
@@ -158,6 +193,7 @@ typedef struct
 	POOL_INTERNAL_BUFFER *buffer;
 	int			num_oids;
 	POOL_INTERNAL_BUFFER *oids;
+	int			rule;			/* cache rule of the SELECT */
 }			POOL_TEMP_QUERY_CACHE;
 
 /*
@@ -171,14 +207,34 @@ typedef struct
 }			POOL_QUERY_CACHE_ARRAY;
 
 /*
- * Query cache statistics structure. This area must be placed on shared
- * memory and protected by QUERY_CACHE_STATS_SEM.
+ * Cache rules given by memqcache_expire_table_list and
+ * memqcache_expire_query_list.  Rule 0 stands for the SELECTs no rule
+ * matched.
+ */
+#define MAX_CACHE_RULES 32
+
+typedef struct
+{
+	char	   *rule;			/* the rule as written in the list, or NULL
+								 * for rule 0 */
+	long long int num_cache_hits;	/* number of SELECTs extracted from cache */
+	long long int num_cache_stores; /* number of SELECT results cached */
+	long long int num_not_admitted; /* number of SELECT results not cached
+									 * by memqcache_admission_threshold */
+}			POOL_CACHE_RULE_STATS;
+
+/*
+ * Query cache statistics structure.  The counters live in per process
+ * shards on shared memory and this is the sum of them.
  */
 typedef struct
 {
 	time_t		start_time;		/* start time when the statistics begins */
 	long long int num_selects;	/* number of successful SELECTs */
 	long long int num_cache_hits;	/* number of SELECTs extracted from cache */
+	long long int num_cache_stores; /* number of SELECT results cached */
+	long long int num_not_admitted; /* number of SELECT results not cached
+									 * by memqcache_admission_threshold */
 }			POOL_QUERY_CACHE_STATS;
 
 /*
@@ -196,6 +252,8 @@ typedef struct
 	long		fragment_cache_entries_size;	/* total size of
 												 * fragment(unusable) cache
 												 * entries */
+	long		shmem_size;		/* mapped size of the cache storage */
+	long		shmem_page_size;	/* page size backing the cache storage */
 	POOL_QUERY_CACHE_STATS cache_stats;
 }			POOL_SHMEM_STATS;
 
@@ -226,9 +284,18 @@ typedef struct
 {
 	long		nhash;			/* number of hash keys (power of 2) */
 	uint32		mask;			/* mask for hash function */
+	int			max_entries;	/* number of hash elements allowed to use */
+	int			num_entries;	/* number of hash elements in use */
 	POOL_HEADER_ELEMENT elements[1];	/* actual hash elements follows */
 }			POOL_HASH_HEADER;
 
+/* Lock modes of pool_shmem_lock() */
+typedef enum
+{
+	POOL_MEMQ_SHARED_LOCK,
+	POOL_MEMQ_EXCLUSIVE_LOCK
+}			POOL_MEMQ_LOCK_TYPE;
+
 extern int	pool_hash_init(int nelements);
 extern POOL_CACHEID * pool_hash_search(POOL_QUERY_HASH * key);
 extern int	pool_hash_delete(POOL_QUERY_HASH * key);
@@ -237,6 +304,12 @@ extern uint32 hash_any(unsigned char *k, int keylen);
 extern POOL_STATUS pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 												POOL_CONNECTION_POOL * backend,
 												char *contents, bool *foundp);
+extern POOL_STATUS pool_fetch_portal_from_memory_cache(POOL_CONNECTION * frontend,
+													   POOL_CONNECTION_POOL * backend,
+													   POOL_PORTAL_CACHE * portal,
+													   char *contents, int max_rows, bool *foundp);
+extern bool pool_fetch_cache_without_backend(POOL_CONNECTION * frontend,
+											 char *user, char *database, char *query);
 
 extern int pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len);
 extern int pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen);
@@ -254,6 +327,7 @@ extern bool pool_is_shmem_cache(void);
 extern size_t pool_shared_memory_cache_size(void);
 extern int	pool_init_memory_cache(size_t size);
 extern void pool_clear_memory_cache(void);
+extern void pool_resize_memory_cache(void);
 extern size_t pool_shared_memory_fsmm_size(void);
 extern int	pool_init_fsmm(size_t size);
 extern void pool_allocate_fsmm_clock_hand(void);
@@ -267,18 +341,19 @@ extern void pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query,
 extern int	pool_init_memqcache_stats(void);
 extern POOL_QUERY_CACHE_STATS * pool_get_memqcache_stats(void);
 extern void pool_reset_memqcache_stats(void);
-extern long long int pool_stats_count_up_num_selects(long long int num);
-extern long long int pool_stats_count_up_num_cache_hits(void);
+extern void pool_stats_count_up_num_selects(long long int num);
+extern void pool_stats_count_up_num_cache_hits(void);
 extern long long int pool_tmp_stats_count_up_num_selects(void);
 extern long long int pool_tmp_stats_get_num_selects(void);
 extern void pool_tmp_stats_reset_num_selects(void);
 extern POOL_SHMEM_STATS * pool_get_shmem_storage_stats(void);
+extern POOL_CACHE_RULE_STATS * pool_get_cache_rule_stats(int *nrules);
 
 extern POOL_TEMP_QUERY_CACHE * pool_get_current_cache(void);
 extern POOL_TEMP_QUERY_CACHE * pool_get_current_cache(void);
 extern void pool_discard_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache);
 
-extern void pool_shmem_lock(void);
+extern void pool_shmem_lock(POOL_MEMQ_LOCK_TYPE type);
 extern void pool_shmem_unlock(void);
 extern bool pool_is_shmem_lock(void);
 
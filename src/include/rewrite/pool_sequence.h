@@ -0,0 +1,39 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2019	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_sequence.h.: header file for pool_sequence.c
+ *
+ */
+
+#ifndef POOL_SEQUENCE_H
+#define POOL_SEQUENCE_H
+#include "pool.h"
+#include "parser/nodes.h"
+
+/* Number of sequences whose pre-allocated values are kept */
+#define SEQUENCE_PREALLOC_SLOTS	128
+
+extern size_t pool_sequence_shared_memory_size(void);
+extern void pool_sequence_init(void *addr);
+extern char *rewrite_insert_sequence(POOL_CONNECTION_POOL * backend, Node *node);
+extern void pool_sequence_invalidate(POOL_CONNECTION_POOL * backend);
+
+#endif							/* POOL_SEQUENCE_H */
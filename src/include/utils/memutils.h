@@ -56,6 +56,7 @@ extern MemoryContext TopMemoryContext;
 extern MemoryContext ErrorContext;
 extern MemoryContext ProcessLoopContext;
 extern MemoryContext CacheMemoryContext;
+extern MemoryContext ConfigMemoryContext;
 extern MemoryContext MessageContext;
 extern MemoryContext QueryContext;
 
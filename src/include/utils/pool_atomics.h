@@ -0,0 +1,120 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2019	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_atomics.h: atomic operations on variables in shared memory.
+ *
+ * These are thin wrappers around the compiler's __atomic builtins, so
+ * that shared counters can be updated by many processes without taking
+ * a lock.
+ */
+
+#ifndef POOL_ATOMICS_H
+#define POOL_ATOMICS_H
+
+#include "pool_type.h"
+
+/*
+ * Size of a CPU cache line.  Shared data written by different processes
+ * should be placed on different cache lines so that the processes do not
+ * keep stealing the line from each other.
+ */
+#define POOL_CACHE_LINE_SIZE	64
+#define CACHELINEALIGN(LEN)		TYPEALIGN(POOL_CACHE_LINE_SIZE, (LEN))
+
+static inline uint64
+pool_atomic_read_u64(volatile uint64 *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+static inline void
+pool_atomic_write_u64(volatile uint64 *ptr, uint64 val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELAXED);
+}
+
+static inline uint64
+pool_atomic_fetch_add_u64(volatile uint64 *ptr, uint64 add)
+{
+	return __atomic_fetch_add(ptr, add, __ATOMIC_RELAXED);
+}
+
+/*
+ * Raise *ptr to val if val is larger.
+ */
+static inline void
+pool_atomic_max_u64(volatile uint64 *ptr, uint64 val)
+{
+	uint64		cur = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+	while (cur < val &&
+		   !__atomic_compare_exchange_n(ptr, &cur, val, true,
+										__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * If *ptr equals *expected, set it to newval and return true.  Otherwise
+ * store the current value into *expected and return false.
+ */
+static inline bool
+pool_atomic_compare_exchange_u64(volatile uint64 *ptr, uint64 *expected, uint64 newval)
+{
+	return __atomic_compare_exchange_n(ptr, expected, newval, false,
+									   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32
+pool_atomic_read_u32(volatile uint32 *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+pool_atomic_write_u32(volatile uint32 *ptr, uint32 val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline uint32
+pool_atomic_fetch_add_u32(volatile uint32 *ptr, uint32 add)
+{
+	return __atomic_fetch_add(ptr, add, __ATOMIC_ACQ_REL);
+}
+
+static inline uint32
+pool_atomic_fetch_sub_u32(volatile uint32 *ptr, uint32 sub)
+{
+	return __atomic_fetch_sub(ptr, sub, __ATOMIC_ACQ_REL);
+}
+
+/*
+ * If *ptr equals *expected, set it to newval and return true.  Otherwise
+ * store the current value into *expected and return false.
+ */
+static inline bool
+pool_atomic_compare_exchange_u32(volatile uint32 *ptr, uint32 *expected, uint32 newval)
+{
+	return __atomic_compare_exchange_n(ptr, expected, newval, false,
+									   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+#endif							/* POOL_ATOMICS_H */
@@ -0,0 +1,75 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2019	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_lwlock.h: lightweight locks in shared memory.
+ *
+ */
+
+#ifndef POOL_LWLOCK_H
+#define POOL_LWLOCK_H
+
+#include "pool_type.h"
+
+/*
+ * Lock ids
+ */
+#define CONN_COUNTER_LOCK		0
+#define REQUEST_INFO_LOCK		1
+#define SHM_CACHE_LOCK			2
+#define PCP_REQUEST_LOCK		3
+#define ACCEPT_FD_LOCK			4
+#define SEQUENCE_LOCK			5
+#define MAX_NUM_LWLOCKS			6
+
+/*
+ * Number of entries in the lock holder table for num_init_children
+ * children.  Children replaced after failover may not have been reaped
+ * yet when their successors take locks, and other processes take locks
+ * too.
+ */
+#define LWLOCK_HOLDERS(nchildren)	((nchildren) * 2 + 32)
+
+typedef enum
+{
+	POOL_LW_EXCLUSIVE,
+	POOL_LW_SHARED
+}			POOL_LWLOCK_MODE;
+
+/*
+ * Wait time statistics of a lock.
+ */
+typedef struct
+{
+	const char *name;			/* lock name */
+	uint64		acquire_count;	/* number of times the lock was acquired */
+	uint64		contended_count;	/* number of times we had to wait */
+	uint64		wait_usec;		/* total time spent waiting */
+	uint64		max_wait_usec;	/* longest single wait */
+}			POOL_LWLOCK_STATS;
+
+extern void pool_lwlock_create(int numLocks, int numHolders);
+extern void pool_lwlock_acquire(int lockid, POOL_LWLOCK_MODE mode);
+extern void pool_lwlock_release(int lockid);
+extern bool pool_lwlock_held(int lockid);
+extern void pool_lwlock_cleanup_process(pid_t pid);
+extern void pool_lwlock_get_stats(int lockid, POOL_LWLOCK_STATS * stats);
+
+#endif							/* POOL_LWLOCK_H */
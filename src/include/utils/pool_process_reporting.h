@@ -34,12 +34,20 @@ extern POOL_REPORT_POOLS * get_pools(int *nrows);
 extern POOL_REPORT_PROCESSES * get_processes(int *nrows);
 extern POOL_REPORT_NODES * get_nodes(int *nrows);
 extern POOL_REPORT_VERSION * get_version(void);
+extern POOL_REPORT_BACKEND_STATS * get_backend_stats(int *nrows);
+extern POOL_REPORT_LATENCY * get_latency(int *nrows);
+extern POOL_REPORT_LWLOCKS * get_lwlocks(int *nrows);
+extern POOL_REPORT_FAILOVER_TRACE * get_failover_trace(int *nrows);
 extern void config_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void processes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void nodes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void version_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 extern void cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void backend_stats_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void latency_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void lwlocks_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
+extern void failover_trace_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend);
 
 extern void send_config_var_detail_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, const char *name, const char *value, const char *description);
 extern void send_config_var_value_only_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, const char *value);
@@ -44,6 +44,7 @@ typedef struct
 	int			refcnt;			/* reference count */
 	int			session_id;		/* LocalSessionId */
 	time_t		expire;			/* cache expiration absolute time in seconds */
+	uint32		generation;		/* relcache generation when registered */
 }			PoolRelCache;
 
 typedef struct
@@ -74,6 +75,9 @@ extern POOL_RELCACHE * pool_create_relcache(int cachesize, char *sql,
 											func_ptr register_func, func_ptr unregister_func,
 											bool issessionlocal);
 extern void pool_discard_relcache(POOL_RELCACHE * relcache);
+extern size_t pool_relcache_shared_memory_size(void);
+extern void pool_relcache_init(void *addr);
+extern void pool_relcache_invalidate(void);
 extern void *pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, char *table);
 extern char *remove_quotes_and_schema_from_relname(char *table);
 extern void *int_register_func(POOL_SELECT_RESULT * res);
@@ -49,6 +49,7 @@ extern void pool_read_with_error(POOL_CONNECTION * cp, void *buf, int len,
 					 const char *err_context);
 
 extern char *pool_read2(POOL_CONNECTION * cp, int len);
+extern int	pool_read_some(POOL_CONNECTION * cp, void *buf, int len);
 extern int	pool_write(POOL_CONNECTION * cp, void *buf, int len);
 extern int	pool_write_noerror(POOL_CONNECTION * cp, void *buf, int len);
 extern int	pool_flush(POOL_CONNECTION * cp);
@@ -50,6 +50,7 @@ typedef struct WDPGBackendStatus
 	int			primary_node_id;
 	int			node_count;
 	BACKEND_STATUS backend_status[MAX_NUM_BACKENDS];
+	bool		draining[MAX_NUM_BACKENDS];
 	char		nodeName[WD_MAX_HOST_NAMELEN];	/* name of the watchdog node
 												 * that sent the data */
 }			WDPGBackendStatus;
@@ -69,6 +69,8 @@ static void process_command_complete_response(PCPConnInfo * pcpConn, char *buf,
 static void process_watchdog_info_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_process_info_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_pool_status_response(PCPConnInfo * pcpConn, char *buf, int len);
+static void process_latency_stats_response(PCPConnInfo * pcpConn, char *buf, int len);
+static void process_failover_trace_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_pcp_node_count_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_process_count_response(PCPConnInfo * pcpConn, char *buf, int len);
 static void process_salt_info_response(PCPConnInfo * pcpConn, char *buf, int len);
@@ -448,7 +450,7 @@ static PCPResultInfo * process_pcp_response(PCPConnInfo * pcpConn, char sentMsg)
 				break;
 
 			case 'd':
-				if (sentMsg != 'D' && sentMsg != 'J')
+				if (sentMsg != 'D' && sentMsg != 'J' && sentMsg != 'G')
 					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
 				else
 					process_command_complete_response(pcpConn, buf, rsize);
@@ -489,6 +491,20 @@ static PCPResultInfo * process_pcp_response(PCPConnInfo * pcpConn, char sentMsg)
 					process_pool_status_response(pcpConn, buf, rsize);
 				break;
 
+			case 's':
+				if (sentMsg != 'S')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_latency_stats_response(pcpConn, buf, rsize);
+				break;
+
+			case 'v':
+				if (sentMsg != 'V')
+					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+				else
+					process_failover_trace_response(pcpConn, buf, rsize);
+				break;
+
 			case 't':
 				if (sentMsg != 'T')
 					setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
@@ -750,6 +766,13 @@ process_node_info_response(PCPConnInfo * pcpConn, char *buf, int len)
 		if (index == NULL)
 			goto INVALID_RESPONSE;
 
+		/* older servers do not send the draining flag */
+		index++;
+		if (index < buf + len - sizeof(int))
+			backend_info->draining = atoi(index) ? true : false;
+		else
+			backend_info->draining = false;
+
 		if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) backend_info, sizeof(BackendInfo), NULL) < 0)
 			goto INVALID_RESPONSE;
 
@@ -1120,6 +1143,39 @@ _pcp_detach_node(PCPConnInfo * pcpConn, int nid, bool gracefully)
 	return process_pcp_response(pcpConn, 'D');
 }
 
+/* --------------------------------
+ * pcp_drain_node - stop routing new work to a node given by the argument
+ * and move pooled sessions off it at transaction boundaries
+ *
+ * return 0 on success, -1 otherwise
+ * --------------------------------
+ */
+PCPResultInfo *
+pcp_drain_node(PCPConnInfo * pcpConn, int nid)
+{
+	int			wsize;
+	char		node_id[16];
+
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	snprintf(node_id, sizeof(node_id), "%d", nid);
+
+	pcp_write(pcpConn->pcpConn, "G", 1);
+	wsize = htonl(strlen(node_id) + 1 + sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	pcp_write(pcpConn->pcpConn, node_id, strlen(node_id) + 1);
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG: send: tos=\"G\", len=%d\n", ntohl(wsize));
+
+	return process_pcp_response(pcpConn, 'G');
+}
+
 static void
 process_command_complete_response(PCPConnInfo * pcpConn, char *buf, int len)
 {
@@ -1236,6 +1292,228 @@ INVALID_RESPONSE:
 	setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
 }
 
+/* --------------------------------
+ * pcp_latency_stats - return query latency statistics
+ *
+ * returns and array of POOL_REPORT_LATENCY, NULL otherwise
+ * --------------------------------
+ */
+static void
+process_latency_stats_response(PCPConnInfo * pcpConn, char *buf, int len)
+{
+	char	   *index;
+	char	   *end = buf + len;
+	POOL_REPORT_LATENCY *stats = NULL;
+
+	if (strcmp(buf, "ArraySize") == 0)
+	{
+		int			ci_size;
+
+		index = (char *) memchr(buf, '\0', len) + 1;
+		ci_size = ntohl(*((int *) index));
+
+		setResultStatus(pcpConn, PCP_RES_INCOMPLETE);
+		setResultSlotCount(pcpConn, ci_size);
+		pcpConn->pcpResInfo->nextFillSlot = 0;
+		return;
+	}
+	else if (strcmp(buf, "LatencyStats") == 0)
+	{
+		struct
+		{
+			char	   *dst;
+			int			size;
+		}			fields[12];
+		int			i;
+
+		if (PCPResultStatus(pcpConn->pcpResInfo) != PCP_RES_INCOMPLETE)
+			goto INVALID_RESPONSE;
+
+		stats = palloc0(sizeof(POOL_REPORT_LATENCY));
+
+		fields[0].dst = stats->scope;
+		fields[0].size = sizeof(stats->scope);
+		fields[1].dst = stats->name;
+		fields[1].size = sizeof(stats->name);
+		fields[2].dst = stats->statement;
+		fields[2].size = sizeof(stats->statement);
+		fields[3].dst = stats->count;
+		fields[3].size = sizeof(stats->count);
+		fields[4].dst = stats->backend_avg;
+		fields[4].size = sizeof(stats->backend_avg);
+		fields[5].dst = stats->backend_p50;
+		fields[5].size = sizeof(stats->backend_p50);
+		fields[6].dst = stats->backend_p99;
+		fields[6].size = sizeof(stats->backend_p99);
+		fields[7].dst = stats->backend_max;
+		fields[7].size = sizeof(stats->backend_max);
+		fields[8].dst = stats->pgpool_avg;
+		fields[8].size = sizeof(stats->pgpool_avg);
+		fields[9].dst = stats->pgpool_p50;
+		fields[9].size = sizeof(stats->pgpool_p50);
+		fields[10].dst = stats->pgpool_p99;
+		fields[10].size = sizeof(stats->pgpool_p99);
+		fields[11].dst = stats->pgpool_max;
+		fields[11].size = sizeof(stats->pgpool_max);
+
+		index = buf;
+		for (i = 0; i < 12; i++)
+		{
+			index = (char *) memchr(index, '\0', end - index);
+			if (index == NULL || index + 1 >= end)
+				goto INVALID_RESPONSE;
+			index += 1;
+			strlcpy(fields[i].dst, index, fields[i].size);
+		}
+
+		if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) stats, sizeof(POOL_REPORT_LATENCY), NULL) < 0)
+			goto INVALID_RESPONSE;
+		return;
+	}
+	else if (strcmp(buf, "CommandComplete") == 0)
+	{
+		setResultStatus(pcpConn, PCP_RES_COMMAND_OK);
+		return;
+	}
+
+INVALID_RESPONSE:
+
+	if (stats)
+		pfree(stats);
+	pcp_internal_error(pcpConn,
+					   "command failed. invalid response");
+	setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+}
+
+PCPResultInfo *
+pcp_latency_stats(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "S", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG pcp_latency_stats: send: tos=\"S\", len=%d\n", ntohl(wsize));
+	return process_pcp_response(pcpConn, 'S');
+}
+
+/* --------------------------------
+ * pcp_failover_trace - return the failover trace events
+ *
+ * returns and array of POOL_REPORT_FAILOVER_TRACE, NULL otherwise
+ * --------------------------------
+ */
+static void
+process_failover_trace_response(PCPConnInfo * pcpConn, char *buf, int len)
+{
+	char	   *index;
+	char	   *end = buf + len;
+	POOL_REPORT_FAILOVER_TRACE *trace = NULL;
+
+	if (strcmp(buf, "ArraySize") == 0)
+	{
+		int			ci_size;
+
+		index = (char *) memchr(buf, '\0', len) + 1;
+		ci_size = ntohl(*((int *) index));
+
+		setResultStatus(pcpConn, PCP_RES_INCOMPLETE);
+		setResultSlotCount(pcpConn, ci_size);
+		pcpConn->pcpResInfo->nextFillSlot = 0;
+		return;
+	}
+	else if (strcmp(buf, "FailoverTrace") == 0)
+	{
+		struct
+		{
+			char	   *dst;
+			int			size;
+		}			fields[9];
+		int			i;
+
+		if (PCPResultStatus(pcpConn->pcpResInfo) != PCP_RES_INCOMPLETE)
+			goto INVALID_RESPONSE;
+
+		trace = palloc0(sizeof(POOL_REPORT_FAILOVER_TRACE));
+
+		fields[0].dst = trace->seq;
+		fields[0].size = sizeof(trace->seq);
+		fields[1].dst = trace->time;
+		fields[1].size = sizeof(trace->time);
+		fields[2].dst = trace->pid;
+		fields[2].size = sizeof(trace->pid);
+		fields[3].dst = trace->request;
+		fields[3].size = sizeof(trace->request);
+		fields[4].dst = trace->kind;
+		fields[4].size = sizeof(trace->kind);
+		fields[5].dst = trace->event;
+		fields[5].size = sizeof(trace->event);
+		fields[6].dst = trace->node_id;
+		fields[6].size = sizeof(trace->node_id);
+		fields[7].dst = trace->elapsed;
+		fields[7].size = sizeof(trace->elapsed);
+		fields[8].dst = trace->detail;
+		fields[8].size = sizeof(trace->detail);
+
+		index = buf;
+		for (i = 0; i < 9; i++)
+		{
+			index = (char *) memchr(index, '\0', end - index);
+			if (index == NULL || index + 1 >= end)
+				goto INVALID_RESPONSE;
+			index += 1;
+			strlcpy(fields[i].dst, index, fields[i].size);
+		}
+
+		if (setNextResultBinaryData(pcpConn->pcpResInfo, (void *) trace, sizeof(POOL_REPORT_FAILOVER_TRACE), NULL) < 0)
+			goto INVALID_RESPONSE;
+		return;
+	}
+	else if (strcmp(buf, "CommandComplete") == 0)
+	{
+		setResultStatus(pcpConn, PCP_RES_COMMAND_OK);
+		return;
+	}
+
+INVALID_RESPONSE:
+
+	if (trace)
+		pfree(trace);
+	pcp_internal_error(pcpConn,
+					   "command failed. invalid response");
+	setResultStatus(pcpConn, PCP_RES_BAD_RESPONSE);
+}
+
+PCPResultInfo *
+pcp_failover_trace(PCPConnInfo * pcpConn)
+{
+	int			wsize;
+
+	if (PCPConnectionStatus(pcpConn) != PCP_CONNECTION_OK)
+	{
+		pcp_internal_error(pcpConn, "invalid PCP connection");
+		return NULL;
+	}
+
+	pcp_write(pcpConn->pcpConn, "V", 1);
+	wsize = htonl(sizeof(int));
+	pcp_write(pcpConn->pcpConn, &wsize, sizeof(int));
+	if (PCPFlush(pcpConn) < 0)
+		return NULL;
+	if (pcpConn->Pfdebug)
+		fprintf(pcpConn->Pfdebug, "DEBUG pcp_failover_trace: send: tos=\"V\", len=%d\n", ntohl(wsize));
+	return process_pcp_response(pcpConn, 'V');
+}
+
 PCPResultInfo *
 pcp_pool_status(PCPConnInfo * pcpConn)
 {
@@ -0,0 +1,156 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2019	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * failover_trace.c: trace of failover events.
+ *
+ * Each step of failover and failback processing records an event with a
+ * timestamp into a ring buffer in shared memory, so that the time spent
+ * in a slow failover can be broken down afterwards with SHOW
+ * pool_failover_trace or pcp_failover_trace.  Events may be recorded by
+ * any process without taking a lock: a writer reserves a slot by
+ * incrementing the shared event counter and publishes the slot by setting
+ * its sequence number last.
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "pool.h"
+#include "utils/palloc.h"
+#include "utils/pool_atomics.h"
+
+typedef struct
+{
+	volatile uint32 next;		/* number of events ever recorded */
+	FAILOVER_TRACE_EVENT events[FAILOVER_TRACE_SIZE];
+}			FAILOVER_TRACE;
+
+static FAILOVER_TRACE * failover_trace = NULL;
+
+static const char *event_names[] = {
+	"request_queued",			/* FAILOVER_TRACE_REQUEST_QUEUED */
+	"consensus_start",			/* FAILOVER_TRACE_CONSENSUS_START */
+	"consensus_end",			/* FAILOVER_TRACE_CONSENSUS_END */
+	"failover_start",			/* FAILOVER_TRACE_FAILOVER_START */
+	"command_start",			/* FAILOVER_TRACE_COMMAND_START */
+	"command_end",				/* FAILOVER_TRACE_COMMAND_END */
+	"degenerate_done",			/* FAILOVER_TRACE_DEGENERATE_DONE */
+	"primary_search_start",		/* FAILOVER_TRACE_PRIMARY_SEARCH_START */
+	"primary_search_end",		/* FAILOVER_TRACE_PRIMARY_SEARCH_END */
+	"child_restart_start",		/* FAILOVER_TRACE_CHILD_RESTART_START */
+	"child_restart_end",		/* FAILOVER_TRACE_CHILD_RESTART_END */
+	"failover_end"				/* FAILOVER_TRACE_FAILOVER_END */
+};
+
+size_t
+failover_trace_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(FAILOVER_TRACE));
+}
+
+void
+failover_trace_init(void *addr)
+{
+	failover_trace = (FAILOVER_TRACE *) addr;
+	memset(failover_trace, 0, sizeof(FAILOVER_TRACE));
+}
+
+/*
+ * Record a failover event.  request_no is the number of the failover
+ * request the event belongs to, or -1 if the request has not been queued
+ * yet.  detail may be NULL.
+ */
+void
+failover_trace_event(FAILOVER_TRACE_EVENT_KIND kind, int request_no,
+					 POOL_REQUEST_KIND reqkind, int node_id, const char *detail)
+{
+	FAILOVER_TRACE_EVENT *ev;
+	uint32		n;
+
+	if (failover_trace == NULL)
+		return;
+
+	n = pool_atomic_fetch_add_u32(&failover_trace->next, 1);
+	ev = &failover_trace->events[n % FAILOVER_TRACE_SIZE];
+
+	/* mark the slot as being written */
+	pool_atomic_write_u32(&ev->seq, 0);
+
+	gettimeofday(&ev->time, NULL);
+	ev->kind = kind;
+	ev->request_no = request_no;
+	ev->reqkind = reqkind;
+	ev->node_id = node_id;
+	ev->pid = getpid();
+	strlcpy(ev->detail, detail ? detail : "", sizeof(ev->detail));
+
+	pool_atomic_write_u32(&ev->seq, n + 1);
+}
+
+/*
+ * Return a palloc'd copy of the events still in the ring buffer, oldest
+ * first.  Slots being written at the moment are skipped.
+ */
+FAILOVER_TRACE_EVENT *
+failover_trace_get_events(int *nevents)
+{
+	FAILOVER_TRACE_EVENT *events;
+	uint32		next;
+	uint32		n;
+	int			count = 0;
+
+	events = palloc0(sizeof(FAILOVER_TRACE_EVENT) * FAILOVER_TRACE_SIZE);
+
+	if (failover_trace == NULL)
+	{
+		*nevents = 0;
+		return events;
+	}
+
+	next = pool_atomic_read_u32(&failover_trace->next);
+	n = (next > FAILOVER_TRACE_SIZE) ? next - FAILOVER_TRACE_SIZE : 0;
+
+	for (; n != next; n++)
+	{
+		FAILOVER_TRACE_EVENT *ev = &failover_trace->events[n % FAILOVER_TRACE_SIZE];
+
+		if (pool_atomic_read_u32(&ev->seq) != n + 1)
+			continue;
+
+		events[count] = *ev;
+
+		/* the slot was reused while we were copying it */
+		if (pool_atomic_read_u32(&ev->seq) != n + 1)
+			continue;
+
+		count++;
+	}
+
+	*nevents = count;
+	return events;
+}
+
+const char *
+failover_trace_event_name(FAILOVER_TRACE_EVENT_KIND kind)
+{
+	if (kind < 0 || kind >= sizeof(event_names) / sizeof(char *))
+		return "unknown";
+	return event_names[kind];
+}
@@ -44,6 +44,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 #ifdef HAVE_CRYPT_H
 #include <crypt.h>
@@ -375,6 +376,763 @@ discard_persistent_connection(int node)
 	}
 }
 
+/*
+ * Asynchronous health check.
+ *
+ * Instead of one process per backend node doing blocking connections, a
+ * single process checks all the nodes at once.  Each check opens a
+ * non-blocking connection, sends a startup packet and waits for the first
+ * message of the server, like pg_isready does.  Any authentication request
+ * or error other than "the database system is starting up" means that the
+ * node is alive.  Authentication is not performed.
+ *
+ * Next check times and check timeouts are kept in a timer wheel, so the
+ * check period can be shorter than a second.  Nodes which are down, or
+ * whose failover is disallowed, are checked less and less often while the
+ * checks keep failing.  The response time of each successful check is
+ * recorded in BackendInfo.
+ */
+
+#define HC_WHEEL_SIZE		256		/* number of timer wheel slots */
+#define HC_TICK_MSEC		10		/* timer wheel resolution */
+#define HC_MAX_BACKOFF		5		/* check period is multiplied by 2^5 at most */
+#define HC_MAX_BACKOFF_MSEC 60000	/* but backoff does not go beyond this */
+#define HC_DISABLED_MSEC	1000	/* recheck config of disabled nodes */
+#define HC_RESPONSE_SIZE	256
+
+typedef struct HC_TIMER
+{
+	struct HC_TIMER *next;
+	struct HC_TIMER *prev;
+	uint64		expires;		/* tick at which the timer fires */
+	bool		armed;
+	int			node_id;
+}			HC_TIMER;
+
+typedef enum
+{
+	HC_IDLE,					/* waiting for the next check */
+	HC_CONNECTING,				/* non-blocking connect in progress */
+	HC_SENDING,					/* sending the startup packet */
+	HC_RECEIVING				/* waiting for the response */
+}			HC_PROBE_STATE;
+
+typedef struct
+{
+	HC_PROBE_STATE state;
+	int			fd;
+	uint64		start_usec;		/* when the check started */
+	int			failures;		/* consecutive failed checks */
+	int			backoff;		/* check period is multiplied by 2^backoff */
+	bool		check_failback; /* checking a down node for auto_failback */
+	bool		check_quarantine;	/* checking a quarantined node */
+	struct sockaddr_storage addr;	/* cached address of the node */
+	socklen_t	addrlen;
+	char	   *packet;			/* startup packet */
+	int			packet_len;
+	int			sent;
+	char		response[HC_RESPONSE_SIZE];
+	int			response_len;
+	HC_TIMER	timer;
+}			HC_NODE;
+
+static HC_NODE hc_nodes[MAX_NUM_BACKENDS];
+static HC_TIMER *hc_wheel[HC_WHEEL_SIZE];
+static uint64 hc_current_tick;
+static time_t hc_auto_failback_resume = 0;
+
+/*
+ * Returns monotonic time in microseconds.
+ */
+static uint64
+hc_now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+hc_timer_del(HC_TIMER * t)
+{
+	if (!t->armed)
+		return;
+
+	if (t->prev)
+		t->prev->next = t->next;
+	else
+		hc_wheel[t->expires % HC_WHEEL_SIZE] = t->next;
+	if (t->next)
+		t->next->prev = t->prev;
+	t->next = t->prev = NULL;
+	t->armed = false;
+}
+
+/*
+ * Arm the timer to fire after msec milliseconds.
+ */
+static void
+hc_timer_add(HC_TIMER * t, int msec)
+{
+	uint64		ticks = (msec + HC_TICK_MSEC - 1) / HC_TICK_MSEC;
+	int			slot;
+
+	hc_timer_del(t);
+
+	if (ticks == 0)
+		ticks = 1;
+	t->expires = hc_current_tick + ticks;
+	slot = t->expires % HC_WHEEL_SIZE;
+	t->prev = NULL;
+	t->next = hc_wheel[slot];
+	if (t->next)
+		t->next->prev = t;
+	hc_wheel[slot] = t;
+	t->armed = true;
+}
+
+/*
+ * Returns the number of milliseconds until the next timer fires.  Timers
+ * further than one turn of the wheel are not looked for.
+ */
+static int
+hc_timer_next_msec(void)
+{
+	int			i;
+
+	for (i = 1; i <= HC_WHEEL_SIZE; i++)
+	{
+		uint64		tick = hc_current_tick + i;
+		HC_TIMER   *t;
+
+		for (t = hc_wheel[tick % HC_WHEEL_SIZE]; t; t = t->next)
+		{
+			if (t->expires <= tick)
+				return i * HC_TICK_MSEC;
+		}
+	}
+	return HC_WHEEL_SIZE * HC_TICK_MSEC;
+}
+
+/*
+ * Returns the check period of the node in milliseconds, or 0 if the health
+ * check is disabled for the node.
+ */
+static int
+hc_period_msec(int node)
+{
+	if (pool_config->health_check_params[node].health_check_period <= 0)
+		return 0;
+
+	if (pool_config->health_check_async_interval > 0)
+		return pool_config->health_check_async_interval;
+
+	return pool_config->health_check_params[node].health_check_period * 1000;
+}
+
+/*
+ * Returns the check period of the node with backoff applied.
+ */
+static int
+hc_backoff_msec(int node)
+{
+	int			period = hc_period_msec(node);
+	int64		msec = (int64) period << hc_nodes[node].backoff;
+
+	if (msec > HC_MAX_BACKOFF_MSEC)
+		msec = Max(period, HC_MAX_BACKOFF_MSEC);
+	return (int) msec;
+}
+
+static int
+hc_retry_delay_msec(int node)
+{
+	int			msec = pool_config->health_check_params[node].health_check_retry_delay * 1000;
+
+	if (pool_config->health_check_async_interval > 0 &&
+		pool_config->health_check_async_interval < msec)
+		msec = pool_config->health_check_async_interval;
+	return msec;
+}
+
+/*
+ * Close the check connection, if any.
+ */
+static void
+hc_close(HC_NODE * n)
+{
+	if (n->fd >= 0)
+		close(n->fd);
+	n->fd = -1;
+	if (n->packet)
+		pfree(n->packet);
+	n->packet = NULL;
+	n->state = HC_IDLE;
+}
+
+/*
+ * Build the startup packet.  Only user and database are sent.
+ */
+static void
+hc_build_startup_packet(HC_NODE * n, int node)
+{
+	char	   *user = pool_config->health_check_params[node].health_check_user;
+	char	   *database = pool_config->health_check_params[node].health_check_database;
+	int			len;
+	int			protov = htonl(PROTO_MAJOR_V3 << 16);
+	char	   *p;
+
+	if (*database == '\0')
+		database = "postgres";
+
+	len = 4 + 4 + strlen("user") + 1 + strlen(user) + 1 +
+		strlen("database") + 1 + strlen(database) + 1 + 1;
+
+	n->packet = MemoryContextAlloc(TopMemoryContext, len);
+	p = n->packet;
+	*(int *) p = htonl(len);
+	p += 4;
+	memcpy(p, &protov, 4);
+	p += 4;
+	strcpy(p, "user");
+	p += strlen("user") + 1;
+	strcpy(p, user);
+	p += strlen(user) + 1;
+	strcpy(p, "database");
+	p += strlen("database") + 1;
+	strcpy(p, database);
+	p += strlen(database) + 1;
+	*p = '\0';
+	n->packet_len = len;
+	n->sent = 0;
+}
+
+/*
+ * Resolve the address of the node.  The address is cached until a check
+ * of the node fails.
+ */
+static bool
+hc_resolve(HC_NODE * n, BackendInfo * bkinfo)
+{
+	if (n->addrlen > 0)
+		return true;
+
+	if (*bkinfo->backend_hostname == '/')
+	{
+		struct sockaddr_un *addr = (struct sockaddr_un *) &n->addr;
+
+		memset(addr, 0, sizeof(*addr));
+		addr->sun_family = AF_UNIX;
+		snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/.s.PGSQL.%d",
+				 bkinfo->backend_hostname, bkinfo->backend_port);
+		n->addrlen = sizeof(*addr);
+	}
+	else
+	{
+		struct addrinfo hints;
+		struct addrinfo *res;
+		char		portstr[16];
+		int			ret;
+
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		snprintf(portstr, sizeof(portstr), "%d", bkinfo->backend_port);
+
+		ret = getaddrinfo(bkinfo->backend_hostname, portstr, &hints, &res);
+		if (ret != 0)
+		{
+			ereport(LOG,
+					(errmsg("health check failed to resolve \"%s\"", bkinfo->backend_hostname),
+					 errdetail("%s", gai_strerror(ret))));
+			return false;
+		}
+		memcpy(&n->addr, res->ai_addr, res->ai_addrlen);
+		n->addrlen = res->ai_addrlen;
+		freeaddrinfo(res);
+	}
+	return true;
+}
+
+/*
+ * Returns true if the node should be checked now.  Sets check_failback and
+ * check_quarantine.
+ */
+static bool
+hc_need_check(int node, BackendInfo * bkinfo)
+{
+	HC_NODE    *n = &hc_nodes[node];
+
+	n->check_failback = false;
+	n->check_quarantine = false;
+
+	if (bkinfo->backend_status == CON_UNUSED ||
+		(bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == false))
+	{
+		if (pool_config->auto_failback && hc_auto_failback_resume < time(NULL) &&
+			STREAM && !strcmp(bkinfo->replication_state, "streaming") && !Req_info->switching)
+		{
+			ereport(DEBUG1,
+					(errmsg("health check DB node: %d (status:%d) for auto_failback", node, bkinfo->backend_status)));
+			n->check_failback = true;
+			return true;
+		}
+		return false;
+	}
+
+	if (bkinfo->backend_status == CON_DOWN && bkinfo->quarantine == true)
+		n->check_quarantine = true;
+
+	return true;
+}
+
+static void hc_probe_done(int node, bool ok, bool timed_out);
+
+/*
+ * Start checking the node.
+ */
+static void
+hc_start_probe(int node)
+{
+	HC_NODE    *n = &hc_nodes[node];
+	BackendInfo *bkinfo = pool_get_node_info(node);
+	int			timeout;
+
+	if (hc_period_msec(node) == 0)
+	{
+		hc_timer_add(&n->timer, HC_DISABLED_MSEC);
+		return;
+	}
+
+	if (!hc_need_check(node, bkinfo))
+	{
+		n->failures = 0;
+		hc_timer_add(&n->timer, hc_period_msec(node));
+		return;
+	}
+
+	n->start_usec = hc_now_usec();
+
+	if (!hc_resolve(n, bkinfo))
+	{
+		hc_probe_done(node, false, false);
+		return;
+	}
+
+	n->fd = socket(n->addr.ss_family, SOCK_STREAM, 0);
+	if (n->fd < 0)
+	{
+		ereport(LOG,
+				(errmsg("health check failed to create socket for DB node: %d", node),
+				 errdetail("%m")));
+		hc_probe_done(node, false, false);
+		return;
+	}
+	pool_set_nonblock(n->fd);
+
+	hc_build_startup_packet(n, node);
+
+	if (connect(n->fd, (struct sockaddr *) &n->addr, n->addrlen) < 0)
+	{
+		if (errno != EINPROGRESS && errno != EINTR)
+		{
+			ereport(DEBUG1,
+					(errmsg("health check failed to connect to DB node: %d", node),
+					 errdetail("%m")));
+			hc_probe_done(node, false, false);
+			return;
+		}
+		n->state = HC_CONNECTING;
+	}
+	else
+		n->state = HC_SENDING;
+
+	timeout = pool_config->health_check_params[node].health_check_timeout;
+	if (timeout > 0)
+		hc_timer_add(&n->timer, timeout * 1000);
+	else
+		hc_timer_del(&n->timer);
+}
+
+/*
+ * Look at the first message from the server.  Returns 1 if the node is
+ * alive, 0 if it is not and -1 if more data is needed.
+ */
+static int
+hc_parse_response(HC_NODE * n)
+{
+	char		kind = n->response[0];
+	int			len;
+	char	   *p;
+	char	   *end;
+
+	switch (kind)
+	{
+		case 'R':				/* authentication request */
+		case 'v':				/* NegotiateProtocolVersion */
+		case 'N':				/* notice */
+			return 1;
+
+		case 'E':
+			if (n->response_len < 5)
+				return -1;
+			memcpy(&len, n->response + 1, sizeof(len));
+			len = ntohl(len);
+			if (n->response_len < len + 1 && n->response_len < HC_RESPONSE_SIZE)
+				return -1;
+
+			/*
+			 * Look for the SQLSTATE.  "the database system is starting up"
+			 * and friends mean the node cannot be used yet.
+			 */
+			end = n->response + Min(len + 1, n->response_len);
+			for (p = n->response + 5; p < end && *p; p += strnlen(p, end - p) + 1)
+			{
+				if (*p == 'C')
+					return (end - p - 1 >= 5 && strncmp(p + 1, "57P03", 5) == 0) ? 0 : 1;
+			}
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+/*
+ * Drive the check of the node forward after its socket became ready.
+ */
+static void
+hc_handle_io(int node)
+{
+	HC_NODE    *n = &hc_nodes[node];
+	int			ret;
+
+	if (n->state == HC_CONNECTING)
+	{
+		int			error;
+		socklen_t	len = sizeof(error);
+
+		if (getsockopt(n->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+		{
+			ereport(DEBUG1,
+					(errmsg("health check failed to connect to DB node: %d", node),
+					 errdetail("%s", strerror(error))));
+			hc_probe_done(node, false, false);
+			return;
+		}
+		n->state = HC_SENDING;
+	}
+
+	if (n->state == HC_SENDING)
+	{
+		ret = send(n->fd, n->packet + n->sent, n->packet_len - n->sent, 0);
+		if (ret < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return;
+			hc_probe_done(node, false, false);
+			return;
+		}
+		n->sent += ret;
+		if (n->sent < n->packet_len)
+			return;
+		n->state = HC_RECEIVING;
+		n->response_len = 0;
+		return;
+	}
+
+	if (n->state == HC_RECEIVING)
+	{
+		ret = recv(n->fd, n->response + n->response_len,
+				   HC_RESPONSE_SIZE - n->response_len, 0);
+		if (ret < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return;
+			hc_probe_done(node, false, false);
+			return;
+		}
+		if (ret == 0)
+		{
+			/* EOF before the server said anything */
+			hc_probe_done(node, false, false);
+			return;
+		}
+		n->response_len += ret;
+
+		ret = hc_parse_response(n);
+		if (ret >= 0)
+			hc_probe_done(node, ret == 1, false);
+	}
+}
+
+/*
+ * Record the response time of a successful check.  The smoothed value is
+ * computed the same way as TCP's smoothed round trip time.
+ */
+static void
+hc_record_rtt(int node, uint64 rtt)
+{
+	BackendInfo *bkinfo = pool_get_node_info(node);
+
+	bkinfo->health_check_rtt = rtt;
+	if (bkinfo->health_check_srtt == 0)
+		bkinfo->health_check_srtt = rtt;
+	else
+		bkinfo->health_check_srtt = (bkinfo->health_check_srtt * 7 + rtt) / 8;
+}
+
+/*
+ * The check of the node finished.  Act on the result and schedule the next
+ * check.
+ */
+static void
+hc_probe_done(int node, bool ok, bool timed_out)
+{
+	HC_NODE    *n = &hc_nodes[node];
+	BackendInfo *bkinfo = pool_get_node_info(node);
+
+	hc_close(n);
+
+#ifdef HEALTHCHECK_DEBUG
+	if (ok && check_backend_down_request(node, false) == true)
+		ok = false;
+#endif
+
+	if (ok)
+	{
+		hc_record_rtt(node, hc_now_usec() - n->start_usec);
+
+		if (n->failures > 0 && !n->check_failback && !n->check_quarantine)
+			ereport(LOG,
+					(errmsg("health check retrying on DB node: %d succeeded", node)));
+		n->failures = 0;
+		n->backoff = 0;
+
+		if (n->check_failback)
+		{
+			if (!Req_info->switching)
+			{
+				ereport(LOG,
+						(errmsg("request auto failback, node id:%d", node)));
+				hc_auto_failback_resume = time(NULL) + pool_config->auto_failback_interval;
+				send_failback_request(node, true, REQ_DETAIL_CONFIRMED);
+			}
+		}
+		else if (n->check_quarantine)
+		{
+			/*
+			 * The node has become reachable again. Reset the quarantine
+			 * state
+			 */
+			send_failback_request(node, false, REQ_DETAIL_UPDATE | REQ_DETAIL_WATCHDOG);
+		}
+
+		hc_timer_add(&n->timer, hc_period_msec(node));
+		return;
+	}
+
+	/* The node may have moved */
+	n->addrlen = 0;
+
+	if (n->check_failback || n->check_quarantine)
+	{
+		if (n->check_quarantine)
+			ereport(LOG, (errmsg("health check failed on quarantine node %d (timeout:%d)",
+								 node, timed_out),
+						  errdetail("ignoring..")));
+		n->backoff = Min(n->backoff + 1, HC_MAX_BACKOFF);
+		hc_timer_add(&n->timer, hc_backoff_msec(node));
+		return;
+	}
+
+	if (n->failures < pool_config->health_check_params[node].health_check_max_retries)
+	{
+		n->failures++;
+		ereport(LOG,
+				(errmsg("health check retrying on DB node: %d (round:%d)",
+						node, n->failures)));
+		hc_timer_add(&n->timer, hc_retry_delay_msec(node));
+		return;
+	}
+	n->failures = 0;
+
+	if (POOL_DISALLOW_TO_FAILOVER(bkinfo->flag))
+	{
+		ereport(LOG,
+				(errmsg("health check failed on node %d but failover is disallowed for the node",
+						node)));
+		n->backoff = Min(n->backoff + 1, HC_MAX_BACKOFF);
+	}
+	else
+	{
+		ereport(LOG, (errmsg("health check failed on node %d (timeout:%d)",
+							 node, timed_out)));
+
+		/* trigger failover */
+		degenerate_backend_set(&node, 1, timed_out ? 0 : REQ_DETAIL_SWITCHOVER);
+	}
+	hc_timer_add(&n->timer, hc_backoff_msec(node));
+}
+
+/*
+ * Fire the timers which are due.
+ */
+static void
+hc_advance_wheel(uint64 now_tick)
+{
+	while (hc_current_tick < now_tick)
+	{
+		HC_TIMER   *t;
+		HC_TIMER   *next;
+
+		hc_current_tick++;
+		for (t = hc_wheel[hc_current_tick % HC_WHEEL_SIZE]; t; t = next)
+		{
+			next = t->next;
+			if (t->expires > hc_current_tick)
+				continue;
+
+			hc_timer_del(t);
+			if (hc_nodes[t->node_id].state == HC_IDLE)
+				hc_start_probe(t->node_id);
+			else
+				hc_probe_done(t->node_id, false, true);
+		}
+	}
+}
+
+/*
+ * Abandon all checks in progress and schedule new ones.
+ */
+static void
+hc_reset_all(void)
+{
+	int			i;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+	{
+		hc_close(&hc_nodes[i]);
+		if (i < NUM_BACKENDS)
+			hc_timer_add(&hc_nodes[i].timer, HC_TICK_MSEC);
+		else
+			hc_timer_del(&hc_nodes[i].timer);
+	}
+}
+
+/*
+* asynchronous health check process main loop
+*/
+void
+do_async_health_check_child(void)
+{
+	sigjmp_buf	local_sigjmp_buf;
+	MemoryContext HealthCheckMemoryContext;
+	int			i;
+
+	ereport(DEBUG1,
+			(errmsg("I am asynchronous health check process pid:%d", getpid())));
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("health check process(async)", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, my_signal_handler);
+	signal(SIGINT, my_signal_handler);
+	signal(SIGHUP, reload_config_handler);
+	signal(SIGQUIT, my_signal_handler);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, my_signal_handler);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Create per loop iteration memory context */
+	HealthCheckMemoryContext = AllocSetContextCreate(TopMemoryContext,
+													 "health_check_main_loop",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+
+	MemoryContextSwitchTo(TopMemoryContext);
+
+	/* Initialize my backend status */
+	pool_initialize_private_backend_status();
+
+	/* Initialize per process context */
+	pool_init_process_context();
+
+	hc_current_tick = hc_now_usec() / 1000 / HC_TICK_MSEC;
+	for (i = 0; i < MAX_NUM_BACKENDS; i++)
+	{
+		memset(&hc_nodes[i], 0, sizeof(HC_NODE));
+		hc_nodes[i].fd = -1;
+		hc_nodes[i].timer.node_id = i;
+	}
+	hc_reset_all();
+
+	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
+	{
+		error_context_stack = NULL;
+		EmitErrorReport();
+		MemoryContextSwitchTo(TopMemoryContext);
+		FlushErrorState();
+		hc_reset_all();
+	}
+	/* We can now handle ereport(ERROR) */
+	PG_exception_stack = &local_sigjmp_buf;
+
+	for (;;)
+	{
+		fd_set		rmask;
+		fd_set		wmask;
+		int			nfds = 0;
+		int			msec;
+		struct timeval timeout;
+
+		MemoryContextSwitchTo(HealthCheckMemoryContext);
+		MemoryContextResetAndDeleteChildren(HealthCheckMemoryContext);
+
+		CHECK_REQUEST;
+
+		FD_ZERO(&rmask);
+		FD_ZERO(&wmask);
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			HC_NODE    *n = &hc_nodes[i];
+
+			if (n->state == HC_IDLE)
+				continue;
+			if (n->state == HC_RECEIVING)
+				FD_SET(n->fd, &rmask);
+			else
+				FD_SET(n->fd, &wmask);
+			nfds = Max(nfds, n->fd + 1);
+		}
+
+		msec = hc_timer_next_msec();
+		timeout.tv_sec = msec / 1000;
+		timeout.tv_usec = (msec % 1000) * 1000;
+
+		if (select(nfds, &rmask, &wmask, NULL, &timeout) > 0)
+		{
+			for (i = 0; i < NUM_BACKENDS; i++)
+			{
+				HC_NODE    *n = &hc_nodes[i];
+
+				if (n->state != HC_IDLE &&
+					(FD_ISSET(n->fd, &rmask) || FD_ISSET(n->fd, &wmask)))
+					hc_handle_io(i);
+			}
+		}
+
+		hc_advance_wheel(hc_now_usec() / 1000 / HC_TICK_MSEC);
+	}
+	exit(0);
+}
+
 static RETSIGTYPE my_signal_handler(int sig)
 {
 	int			save_errno = errno;
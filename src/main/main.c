@@ -39,6 +39,7 @@
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/pool_path.h"
+#include "utils/pool_lwlock.h"
 
 #include "version.h"
 #include "auth/pool_passwd.h"
@@ -344,7 +345,7 @@ main(int argc, char **argv)
 		pool_init_pool_passwd(pool_passwd, POOL_PASSWD_R);
 	}
 
-	pool_semaphore_create(MAX_NUM_SEMAPHORES);
+	pool_lwlock_create(MAX_NUM_LWLOCKS, LWLOCK_HOLDERS(pool_config->num_init_children));
 
 	PgpoolMain(discard_status, clear_memcache_oidmaps); /* this is an infinate
 														 * loop */
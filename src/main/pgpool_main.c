@@ -45,11 +45,16 @@
 #include <signal.h>
 
 #include <libgen.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include "utils/elog.h"
 
 #include "pool.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
+#include "utils/pool_lwlock.h"
+#include "utils/pool_relcache.h"
 #include "pool_config.h"
 #include "context/pool_process_context.h"
 #include "version.h"
@@ -57,6 +62,7 @@
 #include "auth/pool_passwd.h"
 #include "auth/pool_hba.h"
 #include "query_cache/pool_memqcache.h"
+#include "rewrite/pool_sequence.h"
 #include "watchdog/wd_ipc_commands.h"
 #include "watchdog/wd_lifecheck.h"
 
@@ -118,7 +124,13 @@ static void signal_user1_to_parent_with_reason(User1SignalReason reason);
 static void FileUnlink(int code, Datum path);
 static pid_t pcp_fork_a_child(int unix_fd, int inet_fd, char *pcp_conf_file);
 static pid_t fork_a_child(int *fds, int id);
+static void set_child_cpu_affinity(int id);
+static bool child_is_idle(int id);
+static void vacate_child_slot(int id);
+static void restart_child_process(int id, int *nforked);
+static void manage_child_pool(void);
 static pid_t worker_fork_a_child(ProcessType type, void (*func) (), void *params);
+static pid_t fork_health_check_child(int node_id);
 static int	create_unix_domain_socket(struct sockaddr_un un_addr_tmp);
 static int	create_inet_domain_socket(const char *hostname, const int port);
 static int *create_inet_domain_sockets(const char *hostname, const int port);
@@ -143,12 +155,16 @@ static int trigger_failover_command(int node, const char *command_line,
 						 int old_master, int new_master, int old_primary);
 static int	find_primary_node(void);
 static int	find_primary_node_repeatedly(void);
+static int	probe_backend_node_status(POOL_NODE_STATUS * status);
+static long elapsed_msec(struct timeval *start, struct timeval *end);
+static void probe_node_in_recovery(int node_id, char *password, int fd);
 static void terminate_all_childrens();
 static void system_will_go_down(int code, Datum arg);
 static char *process_name_from_pid(pid_t pid);
 static void sync_backend_from_watchdog(void);
 static void update_backend_quarantine_status(void);
 static void degenerate_all_quarantine_nodes(void);
+static void set_backend_draining(int node_id, bool draining);
 static int	get_server_version(POOL_CONNECTION_POOL_SLOT * *slots, int node_id);
 static void get_info_from_conninfo(char *conninfo, char *host, char *port);
 
@@ -188,6 +204,10 @@ extern char *hba_file;
 static int	exiting = 0;		/* non 0 if I'm exiting */
 static int	switching = 0;		/* non 0 if I'm failing over or degenerating */
 
+/* failover request being processed, for the failover trace */
+static int	trace_request_no = -1;
+static POOL_REQUEST_KIND trace_reqkind = NODE_UP_REQUEST;
+
 POOL_REQUEST_INFO *Req_info;	/* request info area in shared memory */
 volatile sig_atomic_t *InRecovery;	/* non 0 if recovery is started */
 volatile sig_atomic_t reload_config_request = 0;
@@ -378,9 +398,29 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	 * is harmless.
 	 */
 	POOL_SETMASK(&BlockSig);
+
+	if (pool_config->num_child_cpu_affinity > 0)
+	{
+#ifdef __linux__
+		ereport(LOG,
+				(errmsg("binding child processes to %d CPU set(s)", pool_config->num_child_cpu_affinity)));
+#else
+		ereport(WARNING,
+				(errmsg("child_cpu_affinity is not supported on this platform")));
+#endif
+	}
+
 	/* fork the children */
 	for (i = 0; i < pool_config->num_init_children; i++)
 	{
+		/*
+		 * In dynamic process management mode start with min_spare_children
+		 * children and leave the rest to manage_child_pool().
+		 */
+		if (pool_config->process_management_mode == PM_DYNAMIC &&
+			i >= pool_config->min_spare_children)
+			break;
+
 		process_info[i].pid = fork_a_child(fds, i);
 		process_info[i].start_time = time(NULL);
 	}
@@ -413,6 +453,10 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 		Req_info->primary_node_id = find_primary_node_repeatedly();
 	}
 
+	/* the primary node cannot be drained */
+	if (Req_info->primary_node_id >= 0)
+		BACKEND_INFO(Req_info->primary_node_id).draining = false;
+
 	/* fork a child for PCP handling */
 	pcp_unix_fd = create_unix_domain_socket(pcp_un_addr);
 	/* Add onproc exit to clean up the unix domain socket at exit */
@@ -428,10 +472,15 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 	worker_pid = worker_fork_a_child(PT_WORKER, do_worker_child, NULL);
 
 	/* Fork health check process */
-	for (i = 0; i < NUM_BACKENDS; i++)
+	if (pool_config->health_check_async)
+		health_check_pids[0] = fork_health_check_child(0);
+	else
 	{
-		if (VALID_BACKEND(i))
-			health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (VALID_BACKEND(i))
+				health_check_pids[i] = fork_health_check_child(i);
+		}
 	}
 
 	if (sigsetjmp(local_sigjmp_buf, 1) != 0)
@@ -495,17 +544,25 @@ PgpoolMain(bool discard_status, bool clear_memcache_oidmaps)
 		}
 		first = false;
 
+		manage_child_pool();
+
 		processState = SLEEPING;
 		for (;;)
 		{
 			int			r;
 			struct timeval t = {3, 0};
 
+			/* wake up every second to adjust the number of children */
+			if (pool_config->process_management_mode == PM_DYNAMIC)
+				t.tv_sec = 1;
+
 			POOL_SETMASK(&UnBlockSig);
 			r = pool_pause(&t);
 			POOL_SETMASK(&BlockSig);
 			if (r > 0)
 				break;
+
+			manage_child_pool();
 		}
 	}
 }
@@ -522,6 +579,8 @@ register_node_operation_request(POOL_REQUEST_KIND kind, int *node_id_set, int co
 	bool		failover_in_progress;
 	pool_sigset_t oldmask;
 	int			index;
+	int			request_no;
+	char		detail[64];
 
 	/*
 	 * if the queue is already full what to do?
@@ -531,14 +590,15 @@ register_node_operation_request(POOL_REQUEST_KIND kind, int *node_id_set, int co
 		return false;
 	}
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(REQUEST_INFO_SEM);
+	pool_lwlock_acquire(REQUEST_INFO_LOCK, POOL_LW_EXCLUSIVE);
 
 	if ((Req_info->request_queue_tail - MAX_REQUEST_QUEUE_SIZE) == Req_info->request_queue_head)
 	{
-		pool_semaphore_unlock(REQUEST_INFO_SEM);
+		pool_lwlock_release(REQUEST_INFO_LOCK);
 		return false;
 	}
 	Req_info->request_queue_tail++;
+	request_no = Req_info->request_queue_tail;
 	index = Req_info->request_queue_tail % MAX_REQUEST_QUEUE_SIZE;
 	Req_info->request[index].kind = kind;
 
@@ -547,8 +607,13 @@ register_node_operation_request(POOL_REQUEST_KIND kind, int *node_id_set, int co
 	if (count > 0)
 		memcpy(Req_info->request[index].node_id, node_id_set, (sizeof(int) * count));
 	Req_info->request[index].count = count;
+	gettimeofday(&Req_info->request[index].request_time, NULL);
 	failover_in_progress = Req_info->switching;
-	pool_semaphore_unlock(REQUEST_INFO_SEM);
+	pool_lwlock_release(REQUEST_INFO_LOCK);
+
+	snprintf(detail, sizeof(detail), "%d node(s), flags %x", count, flags);
+	failover_trace_event(FAILOVER_TRACE_REQUEST_QUEUED, request_no, kind,
+						 count > 0 ? node_id_set[0] : -1, detail);
 
 	POOL_SETMASK(&oldmask);
 	if (failover_in_progress == false)
@@ -634,6 +699,9 @@ fork_a_child(int *fds, int id)
 {
 	pid_t		pid;
 
+	/* the latencies of the previous child in the slot are not ours */
+	stat_reset_child_stat(id);
+
 	pid = fork();
 
 	if (pid == 0)
@@ -657,6 +725,8 @@ fork_a_child(int *fds, int id)
 		/* Set the process type variable */
 		processType = PT_CHILD;
 
+		set_child_cpu_affinity(id);
+
 		/* call child main */
 		POOL_SETMASK(&UnBlockSig);
 		health_check_timer_expired = 0;
@@ -674,6 +744,198 @@ fork_a_child(int *fds, int id)
 	return pid;
 }
 
+/*
+ * Bind the child in slot id to its CPU set in child_cpu_affinity.  The
+ * sets are assigned to the slots in turn, so with one set per NUMA node
+ * the children are spread evenly over the nodes and each child stays on
+ * one node, next to the memory it touches.
+ */
+static void
+set_child_cpu_affinity(int id)
+{
+#ifdef __linux__
+	bool		cpus[POOL_MAX_CPUS];
+	cpu_set_t	set;
+	char	   *list;
+	int			i;
+
+	if (pool_config->num_child_cpu_affinity <= 0)
+		return;
+
+	list = pool_config->child_cpu_affinity[id % pool_config->num_child_cpu_affinity];
+	memset(cpus, 0, sizeof(cpus));
+	if (!pool_parse_cpu_list(list, cpus))
+		return;
+
+	CPU_ZERO(&set);
+	for (i = 0; i < POOL_MAX_CPUS && i < CPU_SETSIZE; i++)
+	{
+		if (cpus[i])
+			CPU_SET(i, &set);
+	}
+
+	if (sched_setaffinity(0, sizeof(set), &set) < 0)
+		ereport(WARNING,
+				(errmsg("could not bind child process to CPUs \"%s\"", list),
+				 errdetail("sched_setaffinity() failed with reason: \"%s\"", strerror(errno))));
+#endif
+}
+
+/*
+ * Return true if the child in slot id is not serving a client.
+ */
+static bool
+child_is_idle(int id)
+{
+	int			i;
+
+	for (i = 0; i < pool_config->max_pool * MAX_NUM_BACKENDS; i++)
+	{
+		if (process_info[id].connection_info[i].connected)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Mark the slot of an exited child as empty.  The connection info left
+ * behind by the child is cleared so that it is neither reported nor
+ * inherited by the next child forked into the slot.
+ */
+static void
+vacate_child_slot(int id)
+{
+	process_info[id].pid = 0;
+	process_info[id].start_time = 0;
+	process_info[id].need_to_restart = 0;
+	memset(process_info[id].connection_info, 0,
+		   sizeof(ConnectionInfo) * pool_config->max_pool * MAX_NUM_BACKENDS);
+}
+
+/*
+ * Kill the child in slot id and fork a new one in its place.  In dynamic
+ * process management mode no more than min_spare_children children are
+ * forked in one restart round, *nforked being the number forked so far.
+ * The other slots are left empty and refilled by manage_child_pool() as
+ * clients come back, rather than forking all of them at once.
+ */
+static void
+restart_child_process(int id, int *nforked)
+{
+	kill(process_info[id].pid, SIGQUIT);
+
+	if (pool_config->process_management_mode == PM_DYNAMIC &&
+		*nforked >= pool_config->min_spare_children)
+	{
+		vacate_child_slot(id);
+		return;
+	}
+
+	process_info[id].pid = fork_a_child(fds, id);
+	process_info[id].start_time = time(NULL);
+	(*nforked)++;
+}
+
+/*
+ * Keep the number of idle children between min_spare_children and
+ * max_spare_children in dynamic process management mode.
+ *
+ * This is called from the main loop about once a second.  If there are too
+ * few idle children, new ones are forked into empty slots; the number
+ * forked per call starts at one and doubles on each consecutive call that
+ * still finds too few idle children, up to MAX_SPAWN_RATE, so that a burst
+ * of clients is followed quickly without forking a crowd of processes
+ * when only a few are needed.  If there are too many idle children, one
+ * of them is asked to exit per call by a smart shutdown request.
+ */
+#define MAX_SPAWN_RATE	32
+
+static void
+manage_child_pool(void)
+{
+	static int	spawn_rate = 1;
+	static time_t last_run = 0;
+	static pid_t retiring_pid = 0;
+	time_t		now;
+	int			num_children = 0;
+	int			num_idle = 0;
+	int			last_idle = -1;
+	int			i;
+
+	if (pool_config->process_management_mode != PM_DYNAMIC ||
+		exiting || switching)
+		return;
+
+	/* pace ourselves even if we are woken up by signals */
+	now = time(NULL);
+	if (now == last_run)
+		return;
+	last_run = now;
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		pid_t		pid = process_info[i].pid;
+
+		if (pid == 0)
+			continue;
+
+		num_children++;
+
+		/* a child asked to exit does not count as a spare */
+		if (pid == retiring_pid)
+			continue;
+
+		if (child_is_idle(i))
+		{
+			num_idle++;
+			last_idle = i;
+		}
+	}
+
+	if (num_idle < pool_config->min_spare_children)
+	{
+		int			num_to_fork = Min(spawn_rate, pool_config->min_spare_children - num_idle);
+		int			num_forked = 0;
+
+		for (i = 0; i < pool_config->num_init_children && num_forked < num_to_fork; i++)
+		{
+			if (process_info[i].pid != 0)
+				continue;
+
+			process_info[i].pid = fork_a_child(fds, i);
+			process_info[i].start_time = time(NULL);
+			num_forked++;
+		}
+
+		if (num_forked > 0)
+			ereport(DEBUG1,
+					(errmsg("forked %d child process(es)", num_forked),
+					 errdetail("%d idle out of %d child process(es)", num_idle, num_children)));
+		else if (num_children == pool_config->num_init_children)
+			ereport(DEBUG1,
+					(errmsg("cannot fork more child processes, all %d slots are in use",
+							pool_config->num_init_children)));
+
+		if (spawn_rate < MAX_SPAWN_RATE)
+			spawn_rate *= 2;
+		return;
+	}
+
+	spawn_rate = 1;
+
+	if (num_idle > pool_config->max_spare_children && last_idle >= 0)
+	{
+		retiring_pid = process_info[last_idle].pid;
+
+		ereport(DEBUG1,
+				(errmsg("stopping idle child process with pid: %d", retiring_pid),
+				 errdetail("%d idle out of %d child process(es)", num_idle, num_children)));
+
+		/* smart shutdown: a child that just got a client exits after it */
+		kill(retiring_pid, SIGTERM);
+	}
+}
+
 /*
 * fork worker child process
 */
@@ -720,6 +982,19 @@ static pid_t worker_fork_a_child(ProcessType type, void (*func) (), void *params
 	return pid;
 }
 
+/*
+ * Fork the health check process for the node, or the asynchronous health
+ * check process for all the nodes if health_check_async is on.
+ */
+static pid_t
+fork_health_check_child(int node_id)
+{
+	if (pool_config->health_check_async)
+		return worker_fork_a_child(PT_HEALTH_CHECK, do_async_health_check_child, NULL);
+
+	return worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &node_id);
+}
+
 static int *
 create_inet_domain_sockets(const char *hostname, const int port)
 {
@@ -1709,15 +1984,22 @@ failover(void)
 		int			node_count;
 		unsigned char request_details;
 		bool		search_primary = true;
+		struct timeval request_time;
+		struct timeval start_time;
+		struct timeval degenerate_time;
+		struct timeval search_time;
+		struct timeval end_time;
+		char		detail[64];
 
-		pool_semaphore_lock(REQUEST_INFO_SEM);
+		pool_lwlock_acquire(REQUEST_INFO_LOCK, POOL_LW_EXCLUSIVE);
 
 		if (Req_info->request_queue_tail == Req_info->request_queue_head)	/* request queue is
 																			 * empty */
 		{
 			switching = 0;
 			Req_info->switching = false;
-			pool_semaphore_unlock(REQUEST_INFO_SEM);
+			Req_info->switching_standby_only = false;
+			pool_lwlock_release(REQUEST_INFO_LOCK);
 			break;
 		}
 
@@ -1728,7 +2010,15 @@ failover(void)
 		reqkind = Req_info->request[queue_index].kind;
 		request_details = Req_info->request[queue_index].request_details;
 		node_count = Req_info->request[queue_index].count;
-		pool_semaphore_unlock(REQUEST_INFO_SEM);
+		request_time = Req_info->request[queue_index].request_time;
+		trace_request_no = Req_info->request_queue_head;
+		trace_reqkind = reqkind;
+		Req_info->switching_standby_only = false;
+		pool_lwlock_release(REQUEST_INFO_LOCK);
+
+		gettimeofday(&start_time, NULL);
+		failover_trace_event(FAILOVER_TRACE_FAILOVER_START, trace_request_no, reqkind,
+							 node_count > 0 ? node_id_set[0] : -1, NULL);
 
 		ereport(DEBUG1,
 				(errmsg("failover handler"),
@@ -1740,6 +2030,12 @@ failover(void)
 			continue;
 		}
 
+		if (reqkind == NODE_DRAIN_REQUEST || reqkind == NODE_UNDRAIN_REQUEST)
+		{
+			set_backend_draining(node_id_set[0], reqkind == NODE_DRAIN_REQUEST);
+			continue;
+		}
+
 		/* inform all remote watchdog nodes that we are starting the failover */
 		wd_failover_start();
 
@@ -1780,6 +2076,7 @@ failover(void)
 			all_backend_down = check_all_backend_down();
 
 			BACKEND_INFO(node_id).backend_status = CON_CONNECT_WAIT;	/* unset down status */
+			BACKEND_INFO(node_id).draining = false;
 			pool_set_backend_status_changed_time(node_id);
 
 			if ((request_details & REQ_DETAIL_UPDATE))
@@ -1884,6 +2181,7 @@ failover(void)
 									BACKEND_INFO(node_id_set[i]).backend_port)));
 
 					BACKEND_INFO(node_id_set[i]).backend_status = CON_DOWN; /* set down status */
+					BACKEND_INFO(node_id_set[i]).draining = false;
 					pool_set_backend_status_changed_time(node_id_set[i]);
 					if (reqkind == NODE_QUARANTINE_REQUEST)
 					{
@@ -1979,17 +2277,23 @@ failover(void)
 
 		/*
 		 * If the mode is streaming replication and the request is
-		 * NODE_DOWN_REQUEST and it's actually a switch over request, we don't
-		 * need to restart all children, except the node is primary.
+		 * NODE_DOWN_REQUEST or NODE_QUARANTINE_REQUEST for standby nodes
+		 * only, we don't need to restart all children.  Only children whose
+		 * session uses one of the down nodes as the load balance node are
+		 * restarted.  The others keep their sessions and pooled connections,
+		 * and close their connections to the down nodes by themselves (see
+		 * pool_detach_down_nodes()).
 		 */
 		else if (STREAM && (reqkind == NODE_DOWN_REQUEST || reqkind == NODE_QUARANTINE_REQUEST) &&
-				 request_details & REQ_DETAIL_SWITCHOVER && node_id != PRIMARY_NODE_ID)
+				 Req_info->primary_node_id >= 0 && !nodes[Req_info->primary_node_id] &&
+				 new_master >= 0)
 		{
 			ereport(LOG,
-					(errmsg("Do not restart children because we are switching over node id %d host: %s port: %d and we are in streaming replication mode", node_id,
+					(errmsg("Do not restart children because we are detaching standby node id %d host: %s port: %d and we are in streaming replication mode", node_id,
 							BACKEND_INFO(node_id).backend_hostname,
 							BACKEND_INFO(node_id).backend_port)));
 
+			Req_info->switching_standby_only = true;
 			need_to_restart_children = true;
 			partial_restart = true;
 
@@ -2003,11 +2307,12 @@ failover(void)
 					{
 						ConnectionInfo *con = pool_coninfo(i, j, k);
 
-						if (con->connected && con->load_balancing_node == node_id)
+						if (con->connected && con->load_balancing_node >= 0 &&
+							nodes[con->load_balancing_node])
 						{
 							ereport(LOG,
 									(errmsg("child pid %d needs to restart because pool %d uses backend %d",
-											process_info[i].pid, j, node_id)));
+											process_info[i].pid, j, con->load_balancing_node)));
 							restart = true;
 							break;
 						}
@@ -2068,6 +2373,10 @@ failover(void)
 			}
 		}
 
+		gettimeofday(&degenerate_time, NULL);
+		failover_trace_event(FAILOVER_TRACE_DEGENERATE_DONE, trace_request_no, reqkind, node_id, NULL);
+		failover_trace_event(FAILOVER_TRACE_PRIMARY_SEARCH_START, trace_request_no, reqkind, node_id, NULL);
+
 		if (reqkind == PROMOTE_NODE_REQUEST && VALID_BACKEND(node_id))
 		{
 			new_primary = node_id;
@@ -2125,6 +2434,10 @@ failover(void)
 			new_primary = find_primary_node_repeatedly();
 		}
 
+		gettimeofday(&search_time, NULL);
+		snprintf(detail, sizeof(detail), "new primary %d", new_primary);
+		failover_trace_event(FAILOVER_TRACE_PRIMARY_SEARCH_END, trace_request_no, reqkind, node_id, detail);
+
 		/*
 		 * If follow_master_command is provided and in master/slave streaming
 		 * replication mode, we start degenerating all backends as they are
@@ -2204,6 +2517,10 @@ failover(void)
 		ereport(LOG,
 				(errmsg("failover: set new primary node: %d", Req_info->primary_node_id)));
 
+		/* the primary node cannot be drained */
+		if (new_primary >= 0)
+			BACKEND_INFO(new_primary).draining = false;
+
 		if (new_master >= 0)
 		{
 			Req_info->master_node_id = new_master;
@@ -2214,8 +2531,13 @@ failover(void)
 
 
 		/* Kill children and restart them if needed */
+		failover_trace_event(FAILOVER_TRACE_CHILD_RESTART_START, trace_request_no, reqkind, node_id,
+							 !need_to_restart_children ? "restart request" :
+							 partial_restart ? "partial restart" : "full restart");
 		if (need_to_restart_children)
 		{
+			int			num_forked = 0;
+
 			for (i = 0; i < pool_config->num_init_children; i++)
 			{
 				/*
@@ -2224,7 +2546,7 @@ failover(void)
 				 * multiple PostgreSQL are going down (or even starting
 				 * pgpool, without starting PostgreSQL can trigger this).
 				 * Child calls degenerate_backend() and it tries to aquire
-				 * semaphore to write a failover request. In this case the
+				 * lock to write a failover request. In this case the
 				 * signal mask is set as well, thus signals are never
 				 * received.
 				 */
@@ -2239,12 +2561,13 @@ failover(void)
 						{
 							ConnectionInfo *con = pool_coninfo(i, j, k);
 
-							if (con->connected && con->load_balancing_node == node_id)
+							if (con->connected && con->load_balancing_node >= 0 &&
+								nodes[con->load_balancing_node])
 							{
 
 								ereport(LOG,
 										(errmsg("child pid %d needs to restart because pool %d uses backend %d",
-												process_info[i].pid, j, node_id)));
+												process_info[i].pid, j, con->load_balancing_node)));
 								restart = true;
 								break;
 							}
@@ -2257,14 +2580,14 @@ failover(void)
 				if (restart)
 				{
 					if (process_info[i].pid)
-					{
-						kill(process_info[i].pid, SIGQUIT);
-
-						process_info[i].pid = fork_a_child(fds, i);
-						process_info[i].start_time = time(NULL);
-					}
+						restart_child_process(i, &num_forked);
 				}
-				else
+
+				/*
+				 * After a partial restart, the remaining children pick up
+				 * the new backend status from shared memory.
+				 */
+				else if (!partial_restart)
 					process_info[i].need_to_restart = 1;
 			}
 		}
@@ -2286,6 +2609,9 @@ failover(void)
 		 */
 		kill(worker_pid, SIGUSR1);
 
+		gettimeofday(&end_time, NULL);
+		failover_trace_event(FAILOVER_TRACE_CHILD_RESTART_END, trace_request_no, reqkind, node_id, NULL);
+
 		if (sync_required)
 			wd_failover_end();
 
@@ -2297,7 +2623,7 @@ failover(void)
 							BACKEND_INFO(node_id).backend_port)));
 
 			/* Fork health check process if needed */
-			for (i = 0; i < NUM_BACKENDS; i++)
+			for (i = 0; i < (pool_config->health_check_async ? 1 : NUM_BACKENDS); i++)
 			{
 				if (health_check_pids[i] == 0)
 				{
@@ -2306,7 +2632,7 @@ failover(void)
 									BACKEND_INFO(node_id).backend_hostname,
 									BACKEND_INFO(node_id).backend_port)));
 
-					health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
+					health_check_pids[i] = fork_health_check_child(i);
 				}
 			}
 		}
@@ -2334,6 +2660,30 @@ failover(void)
 							BACKEND_INFO(node_id).backend_hostname,
 							BACKEND_INFO(node_id).backend_port)));
 		}
+
+		/*
+		 * Report how long each phase of the request took: "detect" is the
+		 * time the request waited in the queue, "degenerate" covers the
+		 * status change, killing children and failover/failback command,
+		 * "primary search" is finding the new primary node and "child
+		 * restart" is the follow degeneration and restarting children.
+		 */
+		ereport(LOG,
+				(errmsg("failover timing: %s of node %d took %ld ms",
+						(reqkind == NODE_UP_REQUEST) ? "failback" :
+						(reqkind == PROMOTE_NODE_REQUEST) ? "promotion" :
+						(reqkind == NODE_DOWN_REQUEST) ? "failover" : "quarantine",
+						node_id, elapsed_msec(&request_time, &end_time)),
+				 errdetail("detect: %ld ms, degenerate: %ld ms, primary search: %ld ms, child restart: %ld ms",
+						   elapsed_msec(&request_time, &start_time),
+						   elapsed_msec(&start_time, &degenerate_time),
+						   elapsed_msec(&degenerate_time, &search_time),
+						   elapsed_msec(&search_time, &end_time))));
+
+		snprintf(detail, sizeof(detail), "total %ld ms", elapsed_msec(&request_time, &end_time));
+		failover_trace_event(FAILOVER_TRACE_FAILOVER_END, trace_request_no, reqkind, node_id, detail);
+		trace_request_no = -1;
+
 		need_to_restart_pcp = true;
 	}
 	switching = 0;
@@ -2637,6 +2987,9 @@ reaper(void)
 			ereport(LOG,
 					(errmsg("%s process with pid: %d exits with status %d", exiting_process_name, pid, status)));
 
+		/* give back the lightweight locks the process held in shared mode */
+		pool_lwlock_cleanup_process(pid);
+
 		/* if exiting child process was PCP handler */
 		if (pid == pcp_pid)
 		{
@@ -2710,7 +3063,7 @@ reaper(void)
 						new_pid = process_info[i].pid;
 					}
 					else
-						process_info[i].pid = 0;
+						vacate_child_slot(i);
 					break;
 				}
 			}
@@ -2726,9 +3079,10 @@ reaper(void)
 					found = true;
 
 					/* Fork new health check worker */
-					if (!switching && !exiting && VALID_BACKEND(i))
+					if (!switching && !exiting &&
+						(pool_config->health_check_async || VALID_BACKEND(i)))
 					{
-						health_check_pids[i] = worker_fork_a_child(PT_HEALTH_CHECK, do_health_check_child, &i);
+						health_check_pids[i] = fork_health_check_child(i);
 					}
 					else
 						health_check_pids[i] = 0;
@@ -2788,10 +3142,14 @@ pool_get_process_list(int *array_size)
 	int		   *array;
 	int			i;
 
-	*array_size = pool_config->num_init_children;
-	array = palloc0(*array_size * sizeof(int));
-	for (i = 0; i < *array_size; i++)
-		array[i] = process_info[i].pid;
+	/* empty slots of the dynamic child pool are not listed */
+	*array_size = 0;
+	array = palloc0(pool_config->num_init_children * sizeof(int));
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		if (process_info[i].pid)
+			array[(*array_size)++] = process_info[i].pid;
+	}
 
 	return array;
 }
@@ -2981,10 +3339,18 @@ trigger_failover_command(int node, const char *command_line,
 	BackendInfo *info;
 	BackendInfo *newmaster;
 	BackendInfo *oldprimary;
+	const char *command_name;
 
 	if (command_line == NULL || (strlen(command_line) == 0))
 		return 0;
 
+	if (command_line == pool_config->failover_command)
+		command_name = "failover_command";
+	else if (command_line == pool_config->failback_command)
+		command_name = "failback_command";
+	else
+		command_name = "follow_master_command";
+
 	/* check failed nodeID */
 	if (node < 0 || node >= NUM_BACKENDS)
 		return -1;
@@ -3100,9 +3466,15 @@ trigger_failover_command(int node, const char *command_line,
 
 	if (strlen(exec_cmd->data) != 0)
 	{
+		char		detail[64];
+
 		ereport(LOG,
 				(errmsg("execute command: %s", exec_cmd->data)));
+		failover_trace_event(FAILOVER_TRACE_COMMAND_START, trace_request_no, trace_reqkind, node,
+							 command_name);
 		r = system(exec_cmd->data);
+		snprintf(detail, sizeof(detail), "exit status %d", r);
+		failover_trace_event(FAILOVER_TRACE_COMMAND_END, trace_request_no, trace_reqkind, node, detail);
 	}
 
 	free_string(exec_cmd);
@@ -3390,6 +3762,195 @@ pool_get_node_status(void)
 	return pool_node_status;
 }
 
+/*
+ * Body of the process forked by probe_backend_node_status().  Checks
+ * whether the node is in recovery and writes the result to fd: 'p' for a
+ * primary, 's' for a standby and 'e' if the node could not be checked.
+ */
+static void
+probe_node_in_recovery(int node_id, char *password, int fd)
+{
+	BackendInfo *bkinfo;
+	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
+	POOL_SELECT_RESULT *res;
+	char		result = 'e';
+
+	on_exit_reset();
+	processType = PT_FOLLOWCHILD;
+
+	/*
+	 * Make ERROR terminate this process instead of jumping back into the
+	 * main loop of the parent, which we are a copy of.
+	 */
+	PG_exception_stack = NULL;
+
+	pool_signal(SIGTERM, SIG_DFL);
+	pool_signal(SIGINT, SIG_DFL);
+	pool_signal(SIGQUIT, SIG_DFL);
+	pool_signal(SIGCHLD, SIG_DFL);
+	pool_signal(SIGUSR1, SIG_DFL);
+	pool_signal(SIGUSR2, SIG_DFL);
+	pool_signal(SIGHUP, SIG_DFL);
+	POOL_SETMASK(&UnBlockSig);
+
+	memset(slots, 0, sizeof(slots));
+	bkinfo = pool_get_node_info(node_id);
+	slots[node_id] = make_persistent_db_connection_noerror(node_id, bkinfo->backend_hostname,
+														   bkinfo->backend_port,
+														   pool_config->sr_check_database,
+														   pool_config->sr_check_user,
+														   password ? password : "", true);
+	if (slots[node_id])
+	{
+		if (get_query_result(slots, node_id, "SELECT pg_is_in_recovery()", &res) == 0)
+		{
+			if (res->data[0] && !strcmp(res->data[0], "t"))
+				result = 's';
+			else if (res->data[0] && !strcmp(res->data[0], "f"))
+				result = 'p';
+			free_select_result(res);
+		}
+		discard_persistent_db_connection(slots[node_id]);
+	}
+	else
+	{
+		ereport(LOG,
+				(errmsg("find_primary_node: make_persistent_db_connection_noerror failed on node %d", node_id)));
+	}
+
+	if (write(fd, &result, 1) != 1)
+		exit(1);
+	exit(0);
+}
+
+/*
+ * Check all valid backends for being in recovery at the same time, so that
+ * a slow or unreachable node does not delay finding the primary.  One
+ * short-lived process is forked per node and reports back through a pipe.
+ * The result is stored into status[].  Returns the number of primary nodes
+ * found.
+ */
+static int
+probe_backend_node_status(POOL_NODE_STATUS * status)
+{
+	pid_t		pids[MAX_NUM_BACKENDS];
+	int			fds[MAX_NUM_BACKENDS];
+	char	   *password;
+	int			num_primaries = 0;
+	int			running = 0;
+	int			i;
+
+	password = get_pgpool_config_user_password(pool_config->sr_check_user,
+											   pool_config->sr_check_password);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		int			pipefds[2];
+
+		status[i] = POOL_NODE_STATUS_UNUSED;
+		pids[i] = 0;
+		fds[i] = -1;
+
+		if (!VALID_BACKEND(i))
+			continue;
+
+		if (pipe(pipefds) < 0)
+		{
+			ereport(LOG,
+					(errmsg("find_primary_node: failed to check node %d", i),
+					 errdetail("pipe() failed with reason: \"%s\"", strerror(errno))));
+			continue;
+		}
+
+		pids[i] = fork();
+		if (pids[i] == 0)
+		{
+			close(pipefds[0]);
+			probe_node_in_recovery(i, password, pipefds[1]);
+		}
+
+		close(pipefds[1]);
+		if (pids[i] < 0)
+		{
+			ereport(LOG,
+					(errmsg("find_primary_node: failed to check node %d", i),
+					 errdetail("fork() failed with reason: \"%s\"", strerror(errno))));
+			close(pipefds[0]);
+			pids[i] = 0;
+			continue;
+		}
+		fds[i] = pipefds[0];
+		running++;
+	}
+
+	if (password)
+		pfree(password);
+
+	while (running > 0)
+	{
+		fd_set		rmask;
+		int			maxfd = -1;
+
+		FD_ZERO(&rmask);
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (fds[i] < 0)
+				continue;
+			FD_SET(fds[i], &rmask);
+			if (fds[i] > maxfd)
+				maxfd = fds[i];
+		}
+
+		if (select(maxfd + 1, &rmask, NULL, NULL, NULL) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			ereport(LOG,
+					(errmsg("find_primary_node: select() failed with reason: \"%s\"", strerror(errno))));
+			break;
+		}
+
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			char		result;
+
+			if (fds[i] < 0 || !FD_ISSET(fds[i], &rmask))
+				continue;
+
+			if (read(fds[i], &result, 1) == 1)
+			{
+				if (result == 'p')
+				{
+					status[i] = POOL_NODE_STATUS_PRIMARY;
+					num_primaries++;
+				}
+				else if (result == 's')
+					status[i] = POOL_NODE_STATUS_STANDBY;
+			}
+			close(fds[i]);
+			fds[i] = -1;
+			running--;
+		}
+	}
+
+	/* cancel the checks still running and reap all of the processes */
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (fds[i] >= 0)
+		{
+			kill(pids[i], SIGKILL);
+			close(fds[i]);
+		}
+		if (pids[i] > 0)
+		{
+			while (waitpid(pids[i], NULL, 0) < 0 && errno == EINTR)
+				;
+		}
+	}
+
+	return num_primaries;
+}
+
 /*
  * Find the primary node (i.e. not standby node) and returns its node
  * id. If no primary node is found, returns -1.
@@ -3401,6 +3962,8 @@ find_primary_node(void)
 	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
 	int			i;
 	POOL_NODE_STATUS *status;
+	int			num_primaries;
+	int			num_standbys = 0;
 	int			primary = -1;
 	char	   *password = NULL;
 
@@ -3430,38 +3993,61 @@ find_primary_node(void)
 		}
 	}
 
-	password = get_pgpool_config_user_password(pool_config->sr_check_user,
-											   pool_config->sr_check_password);
-
 	/*
-	 * Establish connections to backend
+	 * Check all nodes in parallel.  The answer is used only if exactly one
+	 * primary is found, and if detach_false_primary is on, there are no
+	 * standbys which need the additional checks of
+	 * verify_backend_node_status().  Otherwise check the nodes one by one.
 	 */
+	num_primaries = probe_backend_node_status(pool_node_status);
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
 		slots[i] = NULL;
+		if (pool_node_status[i] == POOL_NODE_STATUS_STANDBY)
+			num_standbys++;
+	}
 
-		if (!VALID_BACKEND(i))
-			continue;
+	status = pool_node_status;
 
-		bkinfo = pool_get_node_info(i);
+	if (num_primaries != 1 ||
+		(pool_config->detach_false_primary && num_standbys > 0))
+	{
+		if (num_primaries != 1)
+			ereport(LOG,
+					(errmsg("find_primary_node: %d primary nodes found by checking all nodes at once", num_primaries),
+					 errdetail("checking the nodes one by one")));
 
-		slots[i] = make_persistent_db_connection_noerror(i, bkinfo->backend_hostname,
-														 bkinfo->backend_port,
-														 pool_config->sr_check_database,
-														 pool_config->sr_check_user,
-														 password ? password : "", true);
-		if (!slots[i])
+		password = get_pgpool_config_user_password(pool_config->sr_check_user,
+												   pool_config->sr_check_password);
+
+		/*
+		 * Establish connections to backend
+		 */
+		for (i = 0; i < NUM_BACKENDS; i++)
 		{
-			ereport(LOG,
-					(errmsg("find_primary_node: make_persistent_db_connection_noerror failed on node %d", i)));
+			if (!VALID_BACKEND(i))
+				continue;
+
+			bkinfo = pool_get_node_info(i);
+
+			slots[i] = make_persistent_db_connection_noerror(i, bkinfo->backend_hostname,
+															 bkinfo->backend_port,
+															 pool_config->sr_check_database,
+															 pool_config->sr_check_user,
+															 password ? password : "", true);
+			if (!slots[i])
+			{
+				ereport(LOG,
+						(errmsg("find_primary_node: make_persistent_db_connection_noerror failed on node %d", i)));
+			}
 		}
-	}
 
-	if (password)
-		pfree(password);
+		if (password)
+			pfree(password);
 
-	/* Verify backend status */
-	status = verify_backend_node_status(slots);
+		/* Verify backend status */
+		status = verify_backend_node_status(slots);
+	}
 
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
@@ -3547,6 +4133,16 @@ find_primary_node_repeatedly(void)
 	return node_id;
 }
 
+/*
+ * Returns the time between start and end in milliseconds.
+ */
+static long
+elapsed_msec(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000L +
+		(end->tv_usec - start->tv_usec) / 1000L;
+}
+
 /*
 * fork a follow child
 */
@@ -3679,7 +4275,8 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 			ereport(LOG,
 					(errmsg("pool_discard_oid_maps: discarded memqcache oid maps")));
 
-			pool_hash_init(pool_config->memqcache_max_num_cache);
+			pool_hash_init(Max(pool_config->memqcache_max_num_cache,
+							   pool_config->memqcache_max_num_cache_limit));
 		}
 
 #ifdef USE_MEMCACHED
@@ -3696,15 +4293,40 @@ initialize_shared_mem_objects(bool clear_memcache_oidmaps)
 				ereport(DEBUG1,
 						(errmsg("skipped discarding memqcache oid maps")));
 			}
+
+			/* Initialize circuit breakers of memcached servers */
+			pool_memcached_init(pool_shared_memory_create(pool_memcached_shared_memory_size()));
 		}
 #endif
 
 		pool_init_memqcache_stats();
+
+		/* Initialize single-flight area of cache misses */
+		pool_in_flight_init(pool_shared_memory_create(pool_in_flight_shared_memory_size()));
+
+		/* Initialize frequency sketch of cache admission */
+		pool_admission_sketch_init(pool_shared_memory_create(pool_admission_sketch_shared_memory_size()));
+
+		/* Initialize startup parameters of sessions for lazy connection */
+		pool_startup_params_init(pool_shared_memory_create(pool_startup_params_shared_memory_size()));
 	}
 
 	/* Initialize statistics area */
 	stat_set_stat_area(pool_shared_memory_create(stat_shared_memory_size()));
 	stat_init_stat_area();
+
+	/* Initialize failover trace area */
+	failover_trace_init(pool_shared_memory_create(failover_trace_shared_memory_size()));
+
+	/* Initialize relation cache generation */
+	pool_relcache_init(pool_shared_memory_create(pool_relcache_shared_memory_size()));
+
+	/* Initialize sequence value pre-allocation area */
+	if (pool_config->replication_mode)
+		pool_sequence_init(pool_shared_memory_create(pool_sequence_shared_memory_size()));
+
+	pool_shared_memory_report();
+
 	/* initialize watchdog IPC unix domain socket address */
 	if (pool_config->use_watchdog)
 	{
@@ -3794,9 +4416,9 @@ read_status_file(bool discard_status)
 		 * Fall back to new ascii format file. the format looks like(case is
 		 * ignored):
 		 *
-		 * up|down|unused UP|down|unused : :
+		 * up|down|unused|draining UP|down|unused|draining : :
 		 */
-#define MAXLINE 10
+#define MAXLINE 16
 		char		readbuf[MAXLINE];
 
 		fd = fopen(fnamebuf, "r");
@@ -3810,6 +4432,7 @@ read_status_file(bool discard_status)
 		for (i = 0; i < MAX_NUM_BACKENDS; i++)
 		{
 			BACKEND_INFO(i).backend_status = CON_UNUSED;
+			BACKEND_INFO(i).draining = false;
 			pool_set_backend_status_changed_time(i);
 		}
 
@@ -3836,6 +4459,14 @@ read_status_file(bool discard_status)
 				BACKEND_INFO(i).backend_status = CON_UNUSED;
 				pool_set_backend_status_changed_time(i);
 			}
+			else if (!strncasecmp("draining", readbuf, 8))
+			{
+				BACKEND_INFO(i).backend_status = CON_UP;
+				BACKEND_INFO(i).draining = true;
+				someone_wakeup = true;
+				ereport(LOG,
+						(errmsg("reading status file: %d th backend is set to draining status", i)));
+			}
 			else
 			{
 				ereport(WARNING,
@@ -3871,7 +4502,7 @@ write_status_file(void)
 	FILE	   *fd;
 	int			fdnum;
 	char		fnamebuf[POOLMAXPATHLEN];
-	char		buf[10];
+	char		buf[16];
 	int			i;
 
 	if (!pool_config)
@@ -3920,8 +4551,12 @@ write_status_file(void)
 	{
 		char	   *status;
 
-		if (BACKEND_INFO(i).backend_status == CON_UP ||
-			BACKEND_INFO(i).backend_status == CON_CONNECT_WAIT)
+		if ((BACKEND_INFO(i).backend_status == CON_UP ||
+			 BACKEND_INFO(i).backend_status == CON_CONNECT_WAIT) &&
+			BACKEND_INFO(i).draining)
+			status = "draining";
+		else if (BACKEND_INFO(i).backend_status == CON_UP ||
+				 BACKEND_INFO(i).backend_status == CON_CONNECT_WAIT)
 			status = "up";
 		else if (BACKEND_INFO(i).backend_status == CON_DOWN)
 			status = "down";
@@ -3983,6 +4618,10 @@ reload_config(void)
 	(void) write_status_file();
 
 	MemoryContextSwitchTo(oldContext);
+
+	/* Follow the new size of the shared memory cache */
+	if (pool_config->memory_cache_enabled && pool_is_shmem_cache())
+		pool_resize_memory_cache();
 	if (pool_config->enable_pool_hba)
 		load_hba(hba_file);
 	kill_all_children(SIGHUP);
@@ -4053,6 +4692,54 @@ pool_frontend_exists(void)
 	return -1;
 }
 
+/*
+ * Apply a drain or undrain request queued by pcp_detach_node -D or
+ * pcp_attach_node.  The status was checked when the request was made, but
+ * a failover handled in the meantime may have promoted the node or taken
+ * it down, in which case a drain request is ignored.
+ */
+static void
+set_backend_draining(int node_id, bool draining)
+{
+	BackendInfo *bi;
+
+	if (node_id < 0 || node_id >= NUM_BACKENDS)
+		return;
+
+	bi = &BACKEND_INFO(node_id);
+	if (bi->draining == draining)
+		return;
+
+	if (draining &&
+		(node_id == REAL_PRIMARY_NODE_ID ||
+		 (bi->backend_status != CON_UP && bi->backend_status != CON_CONNECT_WAIT)))
+	{
+		ereport(LOG,
+				(errmsg("drain request of node id %d is ignored", node_id),
+				 errdetail("the node is no longer an up standby node")));
+		return;
+	}
+
+	bi->draining = draining;
+
+	/*
+	 * Save the status so that it is kept across restarts, and have the
+	 * standby watchdog nodes sync it the same way as at the end of failover.
+	 */
+	pool_set_backend_status_changed_time(node_id);
+	(void) write_status_file();
+	wd_failover_end();
+
+	if (draining)
+		ereport(LOG,
+				(errmsg("draining node id %d host: %s port: %d",
+						node_id, bi->backend_hostname, bi->backend_port)));
+	else
+		ereport(LOG,
+				(errmsg("node id %d host: %s port: %d is no longer draining",
+						node_id, bi->backend_hostname, bi->backend_port)));
+}
+
 static void
 degenerate_all_quarantine_nodes(void)
 {
@@ -4113,6 +4800,7 @@ sync_backend_from_watchdog(void)
 	bool		need_to_restart_children = false;
 	bool		partial_restart = false;
 	bool		reload_maste_node_id = false;
+	bool		draining_was_changed = false;
 
 	int			down_node_ids[MAX_NUM_BACKENDS];
 	int			down_node_ids_index = 0;
@@ -4192,8 +4880,26 @@ sync_backend_from_watchdog(void)
 
 			}
 		}
+
+		/*
+		 * Children pick up the draining flag by themselves, so it does not
+		 * need restart of children.
+		 */
+		if (BACKEND_INFO(i).draining != backendStatus->draining[i])
+		{
+			BACKEND_INFO(i).draining = backendStatus->draining[i];
+			pool_set_backend_status_changed_time(i);
+			draining_was_changed = true;
+			ereport(LOG,
+					(errmsg("backend:%d is %s", i,
+							backendStatus->draining[i] ? "set to draining" : "no longer draining"),
+					 errdetail("draining status of backend:%d is synced from cluster master \"%s\"", i, backendStatus->nodeName)));
+		}
 	}
 
+	if (draining_was_changed)
+		(void) write_status_file();
+
 	if (Req_info->primary_node_id != backendStatus->primary_node_id)
 	{
 		/* Do not produce this log message if we are starting up the Pgpool-II */
@@ -4297,6 +5003,8 @@ sync_backend_from_watchdog(void)
 	/* Kill children and restart them if needed */
 	if (need_to_restart_children)
 	{
+		int			num_forked = 0;
+
 		for (i = 0; i < pool_config->num_init_children; i++)
 		{
 			bool		restart = false;
@@ -4339,12 +5047,7 @@ sync_backend_from_watchdog(void)
 			if (restart)
 			{
 				if (process_info[i].pid)
-				{
-					kill(process_info[i].pid, SIGQUIT);
-
-					process_info[i].pid = fork_a_child(fds, i);
-					process_info[i].start_time = time(NULL);
-				}
+					restart_child_process(i, &num_forked);
 			}
 			else
 				process_info[i].need_to_restart = 1;
@@ -57,6 +57,7 @@
 #include "pool.h"
 #include "pool_config.h"
 #include "utils/elog.h"
+#include "utils/pool_lwlock.h"
 #include "parser/pg_list.h"
 
 static int	pcp_unix_fd,
@@ -457,10 +458,10 @@ pcp_mark_recovery_in_progress(void)
 		return false;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(PCP_REQUEST_SEM);
+	pool_lwlock_acquire(PCP_REQUEST_LOCK, POOL_LW_EXCLUSIVE);
 	command_already_inprogress = *pcp_recovery_in_progress;
 	*pcp_recovery_in_progress = true;
-	pool_semaphore_unlock(PCP_REQUEST_SEM);
+	pool_lwlock_release(PCP_REQUEST_LOCK);
 	POOL_SETMASK(&oldmask);
 	return (command_already_inprogress == false);
 }
@@ -481,8 +482,8 @@ pcp_mark_recovery_finished(void)
 		return;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(PCP_REQUEST_SEM);
+	pool_lwlock_acquire(PCP_REQUEST_LOCK, POOL_LW_EXCLUSIVE);
 	*pcp_recovery_in_progress = false;
-	pool_semaphore_unlock(PCP_REQUEST_SEM);
+	pool_lwlock_release(PCP_REQUEST_LOCK);
 	POOL_SETMASK(&oldmask);
 }
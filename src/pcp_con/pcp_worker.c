@@ -68,6 +68,9 @@ static void send_md5salt(PCP_CONNECTION * frontend, char *salt);
 static void pcp_process_command(char tos, char *buf, int buf_len);
 
 static int	pool_detach_node(int node_id, bool gracefully);
+static void pool_drain_node(int node_id);
+static bool pool_undrain_node(int node_id);
+static void check_draining_on_master(char *request);
 static int	pool_promote_node(int node_id, bool gracefully);
 static void inform_process_count(PCP_CONNECTION * frontend);
 static void inform_process_info(PCP_CONNECTION * frontend, char *buf);
@@ -76,8 +79,11 @@ static void inform_node_info(PCP_CONNECTION * frontend, char *buf);
 static void inform_node_count(PCP_CONNECTION * frontend);
 static void process_detach_node(PCP_CONNECTION * frontend, char *buf, char tos);
 static void process_attach_node(PCP_CONNECTION * frontend, char *buf);
+static void process_drain_node(PCP_CONNECTION * frontend, char *buf);
 static void process_recovery_request(PCP_CONNECTION * frontend, char *buf);
 static void process_status_request(PCP_CONNECTION * frontend);
+static void process_latency_stats_request(PCP_CONNECTION * frontend);
+static void process_failover_trace_request(PCP_CONNECTION * frontend);
 static void process_promote_node(PCP_CONNECTION * frontend, char *buf, char tos);
 static void process_shutown_request(PCP_CONNECTION * frontend, char mode);
 static void process_set_configration_parameter(PCP_CONNECTION * frontend, char *buf, int len);
@@ -285,6 +291,11 @@ pcp_process_command(char tos, char *buf, int buf_len)
 			process_detach_node(pcp_frontend, buf, tos);
 			break;
 
+		case 'G':				/* drain node */
+			set_ps_display("PCP: processing drain node request", false);
+			process_drain_node(pcp_frontend, buf);
+			break;
+
 		case 'C':				/* attach node */
 			set_ps_display("PCP: processing attach node request", false);
 			process_attach_node(pcp_frontend, buf);
@@ -305,6 +316,16 @@ pcp_process_command(char tos, char *buf, int buf_len)
 			process_status_request(pcp_frontend);
 			break;
 
+		case 'S':				/* latency statistics request */
+			set_ps_display("PCP: processing latency statistics request", false);
+			process_latency_stats_request(pcp_frontend);
+			break;
+
+		case 'V':				/* failover trace request */
+			set_ps_display("PCP: processing failover trace request", false);
+			process_failover_trace_request(pcp_frontend);
+			break;
+
 		case 'J':				/* promote node */
 		case 'j':				/* promote node gracefully */
 			set_ps_display("PCP: processing promote node request", false);
@@ -554,6 +575,90 @@ pool_detach_node(int node_id, bool gracefully)
 	return 0;
 }
 
+/*
+ * Drain a node.  The node stays up but it is no longer chosen as a load
+ * balance node, and children close their connections to it once the
+ * session using them is idle between transactions.  The status is changed
+ * by the main process, like other node status changes.
+ */
+static void
+pool_drain_node(int node_id)
+{
+	BackendInfo *bi;
+
+	if (node_id < 0 || node_id >= NUM_BACKENDS)
+		ereport(ERROR,
+				(errmsg("could not process drain request"),
+				 errdetail("node id %d is not valid", node_id)));
+
+	/*
+	 * In replication mode every node has to receive the writes, so only a
+	 * standby in master slave mode can be drained.
+	 */
+	if (!MASTER_SLAVE)
+		ereport(ERROR,
+				(errmsg("could not process drain request"),
+				 errdetail("not in master slave mode, can't drain node id %d", node_id)));
+
+	if (node_id == REAL_PRIMARY_NODE_ID)
+		ereport(ERROR,
+				(errmsg("could not process drain request"),
+				 errdetail("node id %d is the primary node", node_id)));
+
+	bi = pool_get_node_info(node_id);
+	if (bi->backend_status != CON_UP && bi->backend_status != CON_CONNECT_WAIT)
+		ereport(ERROR,
+				(errmsg("could not process drain request"),
+				 errdetail("node id %d is not up", node_id)));
+
+	if (bi->draining)
+		return;
+
+	check_draining_on_master("drain");
+
+	if (!register_node_operation_request(NODE_DRAIN_REQUEST, &node_id, 1, REQ_DETAIL_CONFIRMED))
+		ereport(ERROR,
+				(errmsg("could not process drain request"),
+				 errdetail("failover request queue is full")));
+}
+
+/*
+ * Undo pool_drain_node().  Children which closed their connections to the
+ * node pick it up again by themselves when the next client connects.
+ * Returns false if the node was not draining.
+ */
+static bool
+pool_undrain_node(int node_id)
+{
+	BackendInfo *bi;
+
+	bi = pool_get_node_info(node_id);
+	if (bi == NULL || !bi->draining)
+		return false;
+
+	check_draining_on_master("attach");
+
+	if (!register_node_operation_request(NODE_UNDRAIN_REQUEST, &node_id, 1, REQ_DETAIL_CONFIRMED))
+		ereport(ERROR,
+				(errmsg("could not process attach request"),
+				 errdetail("failover request queue is full")));
+	return true;
+}
+
+/*
+ * The draining status is shared by the watchdog cluster, and it can only be
+ * changed on the master watchdog node, from which the other nodes sync it.
+ */
+static void
+check_draining_on_master(char *request)
+{
+	if (pool_config->use_watchdog &&
+		get_watchdog_local_node_state() != WD_COORDINATOR)
+		ereport(ERROR,
+				(errmsg("could not process %s request", request),
+				 errdetail("draining status can only be changed on the master watchdog node")));
+}
+
 /* Promote a node */
 static int
 pool_promote_node(int node_id, bool gracefully)
@@ -822,6 +927,7 @@ inform_node_info(PCP_CONNECTION * frontend, char *buf)
 	char		role_str[10];
 	char		standby_delay_str[20];
 	char		status_changed_time_str[20];
+	char		draining_str[2];
 	char		code[] = "CommandComplete";
 	BackendInfo *bi = NULL;
 	SERVER_ROLE role;
@@ -863,6 +969,8 @@ inform_node_info(PCP_CONNECTION * frontend, char *buf)
 
 	snprintf(status_changed_time_str, sizeof(status_changed_time_str), UINT64_FORMAT, bi->status_changed_time);
 
+	snprintf(draining_str, sizeof(draining_str), "%d", bi->draining ? 1 : 0);
+
 	pcp_write(frontend, "i", 1);
 	wsize = htonl(sizeof(code) +
 				  strlen(bi->backend_hostname) + 1 +
@@ -874,6 +982,7 @@ inform_node_info(PCP_CONNECTION * frontend, char *buf)
 				  strlen(bi->replication_state) + 1 +
 				  strlen(bi->replication_sync_state) + 1 +
 				  strlen(status_changed_time_str) + 1 +
+				  strlen(draining_str) + 1 +
 				  sizeof(int));
 	pcp_write(frontend, &wsize, sizeof(int));
 	pcp_write(frontend, code, sizeof(code));
@@ -886,6 +995,7 @@ inform_node_info(PCP_CONNECTION * frontend, char *buf)
 	pcp_write(frontend, bi->replication_state, strlen(bi->replication_state) + 1);
 	pcp_write(frontend, bi->replication_sync_state, strlen(bi->replication_sync_state) + 1);
 	pcp_write(frontend, status_changed_time_str, strlen(status_changed_time_str) + 1);
+	pcp_write(frontend, draining_str, strlen(draining_str) + 1);
 
 	do_pcp_flush(frontend);
 }
@@ -953,7 +1063,9 @@ process_attach_node(PCP_CONNECTION * frontend, char *buf)
 			(errmsg("PCP: processing attach node"),
 			 errdetail("attaching Node ID %d", node_id)));
 
-	send_failback_request(node_id, true, REQ_DETAIL_CONFIRMED);
+	/* attaching a draining node just stops draining it */
+	if (!pool_undrain_node(node_id))
+		send_failback_request(node_id, true, REQ_DETAIL_CONFIRMED);
 
 	pcp_write(frontend, "c", 1);
 	wsize = htonl(sizeof(code) + sizeof(int));
@@ -963,6 +1075,27 @@ process_attach_node(PCP_CONNECTION * frontend, char *buf)
 }
 
 
+static void
+process_drain_node(PCP_CONNECTION * frontend, char *buf)
+{
+	int			node_id;
+	int			wsize;
+	char		code[] = "CommandComplete";
+
+	node_id = atoi(buf);
+	ereport(DEBUG1,
+			(errmsg("PCP: processing drain node"),
+			 errdetail("draining Node ID %d", node_id)));
+
+	pool_drain_node(node_id);
+
+	pcp_write(frontend, "d", 1);
+	wsize = htonl(sizeof(code) + sizeof(int));
+	pcp_write(frontend, &wsize, sizeof(int));
+	pcp_write(frontend, code, sizeof(code));
+	do_pcp_flush(frontend);
+}
+
 static void
 process_recovery_request(PCP_CONNECTION * frontend, char *buf)
 {
@@ -1077,6 +1210,119 @@ process_status_request(PCP_CONNECTION * frontend)
 			 errdetail("retrieved status information")));
 }
 
+static void
+process_latency_stats_request(PCP_CONNECTION * frontend)
+{
+	int			nrows = 0;
+	int			i;
+	POOL_REPORT_LATENCY *rows = get_latency(&nrows);
+	int			len = 0;
+
+	/* First, send array size of latency rows */
+	char		arr_code[] = "ArraySize";
+	char		code[] = "LatencyStats";
+
+	/* Finally, indicate that all data is sent */
+	char		fin_code[] = "CommandComplete";
+
+	pcp_write(frontend, "s", 1);
+	len = htonl(sizeof(arr_code) + sizeof(int) + sizeof(int));
+	pcp_write(frontend, &len, sizeof(int));
+	pcp_write(frontend, arr_code, sizeof(arr_code));
+	len = htonl(nrows);
+	pcp_write(frontend, &len, sizeof(int));
+
+	do_pcp_flush(frontend);
+
+	for (i = 0; i < nrows; i++)
+	{
+		char	   *fields[] = {rows[i].scope, rows[i].name, rows[i].statement,
+			rows[i].count, rows[i].backend_avg, rows[i].backend_p50,
+			rows[i].backend_p99, rows[i].backend_max, rows[i].pgpool_avg,
+		rows[i].pgpool_p50, rows[i].pgpool_p99, rows[i].pgpool_max};
+		int			nfields = sizeof(fields) / sizeof(char *);
+		int			j;
+
+		len = sizeof(int) + sizeof(code);
+		for (j = 0; j < nfields; j++)
+			len += strlen(fields[j]) + 1;
+
+		pcp_write(frontend, "s", 1);
+		len = htonl(len);
+		pcp_write(frontend, &len, sizeof(int));
+		pcp_write(frontend, code, sizeof(code));
+		for (j = 0; j < nfields; j++)
+			pcp_write(frontend, fields[j], strlen(fields[j]) + 1);
+	}
+
+	pcp_write(frontend, "s", 1);
+	len = htonl(sizeof(fin_code) + sizeof(int));
+	pcp_write(frontend, &len, sizeof(int));
+	pcp_write(frontend, fin_code, sizeof(fin_code));
+	do_pcp_flush(frontend);
+
+	pfree(rows);
+	ereport(DEBUG1,
+			(errmsg("PCP: processing latency statistics request"),
+			 errdetail("retrieved latency statistics")));
+}
+
+static void
+process_failover_trace_request(PCP_CONNECTION * frontend)
+{
+	int			nrows = 0;
+	int			i;
+	POOL_REPORT_FAILOVER_TRACE *rows = get_failover_trace(&nrows);
+	int			len = 0;
+
+	/* First, send array size of trace rows */
+	char		arr_code[] = "ArraySize";
+	char		code[] = "FailoverTrace";
+
+	/* Finally, indicate that all data is sent */
+	char		fin_code[] = "CommandComplete";
+
+	pcp_write(frontend, "v", 1);
+	len = htonl(sizeof(arr_code) + sizeof(int) + sizeof(int));
+	pcp_write(frontend, &len, sizeof(int));
+	pcp_write(frontend, arr_code, sizeof(arr_code));
+	len = htonl(nrows);
+	pcp_write(frontend, &len, sizeof(int));
+
+	do_pcp_flush(frontend);
+
+	for (i = 0; i < nrows; i++)
+	{
+		char	   *fields[] = {rows[i].seq, rows[i].time, rows[i].pid,
+			rows[i].request, rows[i].kind, rows[i].event, rows[i].node_id,
+		rows[i].elapsed, rows[i].detail};
+		int			nfields = sizeof(fields) / sizeof(char *);
+		int			j;
+
+		len = sizeof(int) + sizeof(code);
+		for (j = 0; j < nfields; j++)
+			len += strlen(fields[j]) + 1;
+
+		pcp_write(frontend, "v", 1);
+		len = htonl(len);
+		pcp_write(frontend, &len, sizeof(int));
+		pcp_write(frontend, code, sizeof(code));
+		for (j = 0; j < nfields; j++)
+			pcp_write(frontend, fields[j], strlen(fields[j]) + 1);
+	}
+
+	pcp_write(frontend, "v", 1);
+	len = htonl(sizeof(fin_code) + sizeof(int));
+	pcp_write(frontend, &len, sizeof(int));
+	pcp_write(frontend, fin_code, sizeof(fin_code));
+	do_pcp_flush(frontend);
+
+	pfree(rows);
+	ereport(DEBUG1,
+			(errmsg("PCP: processing failover trace request"),
+			 errdetail("retrieved failover trace")));
+}
+
 static void
 process_promote_node(PCP_CONNECTION * frontend, char *buf, char tos)
 {
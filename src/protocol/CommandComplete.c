@@ -29,17 +29,21 @@
 
 #include "pool.h"
 #include "protocol/pool_proto_modules.h"
+#include "parser/pg_class.h"
 #include "parser/pg_config_manual.h"
 #include "parser/pool_string.h"
 #include "pool_config.h"
 #include "context/pool_session_context.h"
 #include "context/pool_query_context.h"
+#include "rewrite/pool_sequence.h"
 #include "utils/elog.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_relcache.h"
 
 static int	extract_ntuples(char *message);
+static bool is_session_local_ddl(Node *node);
 static POOL_STATUS handle_mismatch_tuples(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *packet, int packetlen, bool command_complete);
 static int	foward_command_complete(POOL_CONNECTION * frontend, char *packet, int packetlen);
 static int	foward_empty_query(POOL_CONNECTION * frontend, char *packet, int packetlen);
@@ -254,12 +258,16 @@ handle_query_context(POOL_CONNECTION_POOL * backend)
 {
 	POOL_SESSION_CONTEXT *session_context;
 	Node	   *node;
+	bool		session_local;
 
 	/* Get session context */
 	session_context = pool_get_session_context(false);
 
 	node = session_context->query_context->parse_tree;
 
+	/* Check before the temp tables dropped are forgotten below */
+	session_local = is_session_local_ddl(node);
+
 	if (IsA(node, PrepareStmt))
 	{
 		if (session_context->uncompleted_message)
@@ -393,6 +401,83 @@ handle_query_context(POOL_CONNECTION_POOL * backend)
 			}
 		}
 	}
+
+	/*
+	 * DDL may have changed the definitions of relations and functions
+	 * registered in relation caches.  Objects local to the session are not
+	 * seen by other sessions.
+	 */
+	if ((IsA(node, CreateStmt) || IsA(node, CreateTableAsStmt) ||
+		 IsA(node, ViewStmt) || IsA(node, AlterTableStmt) ||
+		 IsA(node, DropStmt) || IsA(node, RenameStmt) ||
+		 IsA(node, AlterObjectSchemaStmt) || IsA(node, CreateFunctionStmt) ||
+		 IsA(node, AlterFunctionStmt)) && !session_local)
+	{
+		pool_relcache_invalidate();
+		session_context->ddl_in_transaction = true;
+	}
+
+	/*
+	 * If sequences may have been reset or recreated, discard the
+	 * pre-allocated values of sequences.
+	 */
+	if (pool_config->sequence_preallocation &&
+		(IsA(node, AlterSeqStmt) || IsA(node, AlterTableStmt) ||
+		 (IsA(node, DropStmt) &&
+		  (((DropStmt *) node)->removeType == OBJECT_TABLE ||
+		   ((DropStmt *) node)->removeType == OBJECT_SEQUENCE)) ||
+		 (IsA(node, TruncateStmt) && ((TruncateStmt *) node)->restart_seqs)))
+	{
+		pool_sequence_invalidate(backend);
+		session_context->sequence_reset_in_transaction = true;
+	}
+}
+
+/*
+ * Returns true if the statement creates or drops only objects local to
+ * the session, i.e. temporary tables and views.
+ */
+static bool
+is_session_local_ddl(Node *node)
+{
+	if (IsA(node, CreateStmt))
+		return ((CreateStmt *) node)->relation->relpersistence == RELPERSISTENCE_TEMP;
+
+	if (IsA(node, CreateTableAsStmt))
+		return ((CreateTableAsStmt *) node)->into->rel->relpersistence == RELPERSISTENCE_TEMP;
+
+	if (IsA(node, ViewStmt))
+		return ((ViewStmt *) node)->view->relpersistence == RELPERSISTENCE_TEMP;
+
+	if (IsA(node, DropStmt))
+	{
+		DropStmt   *stmt = (DropStmt *) node;
+		ListCell   *cell;
+
+		if (stmt->removeType != OBJECT_TABLE && stmt->removeType != OBJECT_VIEW)
+			return false;
+
+		/*
+		 * All the objects must be temp tables created in this session, or be
+		 * in the temp schema.
+		 */
+		foreach(cell, stmt->objects)
+		{
+			List	   *names = (List *) lfirst(cell);
+
+			if (list_length(names) == 1)
+			{
+				if (pool_temp_tables_find(strVal(linitial(names))) == NULL)
+					return false;
+			}
+			else if (list_length(names) != 2 ||
+					 strncmp(strVal(linitial(names)), "pg_temp", 7) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	return false;
 }
 
 /*
@@ -43,6 +43,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <fcntl.h>
 
 #include "pool.h"
 #include "utils/palloc.h"
@@ -58,9 +59,15 @@
 #include "auth/pool_passwd.h"
 #include "auth/pool_hba.h"
 #include "utils/pool_relcache.h"
+#include "utils/pool_lwlock.h"
+#include "query_cache/pool_memqcache.h"
 
 static StartupPacket *read_startup_packet(POOL_CONNECTION * cp);
 static POOL_CONNECTION_POOL * connect_backend(StartupPacket *sp, POOL_CONNECTION * frontend);
+static bool can_connect_lazily(POOL_CONNECTION * frontend, StartupPacket *sp, char **params, int *paramslen);
+static bool serve_cache_before_connecting(POOL_CONNECTION * frontend, StartupPacket *sp, char *params, int paramslen);
+static POOL_CONNECTION_POOL * connect_backend_lazily(StartupPacket *sp, POOL_CONNECTION * frontend, char *params, int paramslen);
+static void wait_for_frontend_lazily(POOL_CONNECTION * frontend);
 static RETSIGTYPE die(int sig);
 static RETSIGTYPE close_idle_connection(int sig);
 static RETSIGTYPE wakeup_handler(int sig);
@@ -74,6 +81,8 @@ static bool connect_using_existing_connection(POOL_CONNECTION * frontend,
 								  POOL_CONNECTION_POOL * backend,
 								  StartupPacket *sp);
 static void check_restart_request(void);
+static void prewarm_connections(void);
+static void prewarm_retry_alarm(unsigned int seconds);
 static void enable_authentication_timeout(void);
 static void disable_authentication_timeout(void);
 static int	wait_for_new_connections(int *fds, struct timeval *timeout, SockAddr *saddr);
@@ -87,6 +96,7 @@ static void print_process_status(char *remote_host, char *remote_port);
 static bool backend_cleanup(POOL_CONNECTION * volatile *frontend, POOL_CONNECTION_POOL * volatile backend, bool frontend_invalid);
 static void free_persisten_db_connection_memory(POOL_CONNECTION_POOL_SLOT * cp);
 static int	choose_db_node_id(char *str);
+static double load_balance_weight(int node_id, bool by_response_time);
 static void child_will_go_down(int code, Datum arg);
 static int opt_sort(const void *a, const void *b);
 
@@ -307,6 +317,12 @@ do_child(int *fds)
 		/* Destroy session context for just in case... */
 		pool_session_context_destroy();
 
+		/* Drop pooled connections to standbys detached by failover */
+		pool_detach_down_nodes(NULL);
+
+		/* Fill the connection pool while nobody is waiting for us */
+		prewarm_connections();
+
 		front_end_fd = wait_for_new_connections(fds, &timeout, &saddr);
 		if (front_end_fd == OPERATION_TIMEOUT)
 		{
@@ -360,10 +376,13 @@ do_child(int *fds)
 		/* reset busy flag */
 		idle = 0;
 
+		/* failover may have happened while we were waiting */
+		pool_detach_down_nodes(NULL);
+
 		/* check backend timer is expired */
 		if (backend_timer_expired)
 		{
-			pool_backend_timer();
+			pool_backend_timer(false);
 			backend_timer_expired = 0;
 		}
 
@@ -388,6 +407,7 @@ do_child(int *fds)
 		 * Initialize per session context
 		 */
 		pool_init_session_context(child_frontend, backend);
+		stat_start_session(sp->database);
 
 		/*
 		 * Set protocol versions
@@ -1035,6 +1055,337 @@ static POOL_CONNECTION_POOL * connect_backend(StartupPacket *sp, POOL_CONNECTION
 	return backend;
 }
 
+/*
+ * Can the session be started without connecting to backend?  The frontend
+ * must have been authenticated by pgpool, backend must be able to
+ * authenticate the user without the frontend, and the ParameterStatus
+ * messages for the startup packet must have been saved by an earlier
+ * connection.  If so, the messages are returned in *params.
+ */
+static bool
+can_connect_lazily(POOL_CONNECTION * frontend, StartupPacket *sp,
+				   char **params, int *paramslen)
+{
+	int			auth_kind;
+
+	if (!pool_config->memory_cache_enabled ||
+		!pool_config->memqcache_lazy_backend_connection)
+		return false;
+
+	if (!pool_config->enable_pool_hba || !frontend->frontend_authenticated ||
+		sp->major != PROTO_MAJOR_V3)
+		return false;
+
+	if (!pool_get_startup_params(sp, params, paramslen, &auth_kind))
+		return false;
+
+	switch (auth_kind)
+	{
+		case AUTH_REQ_OK:
+			return true;
+
+		case AUTH_REQ_MD5:
+			/* md5 is passed through to the frontend with a single node */
+			if (RAW_MODE || NUM_BACKENDS == 1)
+				break;
+			/* fall through */
+		case AUTH_REQ_SASL:
+			if (frontend->passwordMapping)
+				return true;
+			break;
+
+		default:
+			break;
+	}
+
+	pfree(*params);
+	return false;
+}
+
+/*
+ * Start the session without connecting to backend, replaying the saved
+ * ParameterStatus messages, and answer simple queries from the query
+ * cache.  Returns true when a message which needs backend arrives.  The
+ * message is put back to the frontend buffer so that it is processed as
+ * usual after connecting to backend.  Returns false if the frontend
+ * terminates the session before that.
+ */
+static bool
+serve_cache_before_connecting(POOL_CONNECTION * frontend, StartupPacket *sp,
+							  char *params, int paramslen)
+{
+	MemoryContext lazy_cxt;
+	MemoryContext oldContext;
+	char		psbuf[NI_MAXHOST + 128];
+	int			len;
+	int			pid;
+	int			key;
+	signed char state = 'I';
+
+	ereport(DEBUG1,
+			(errmsg("starting session without backend connection"),
+			 errdetail("user: %s database: %s", sp->user, sp->database)));
+
+	/* AuthenticationOk */
+	pool_write(frontend, "R", 1);
+	len = htonl(8);
+	pool_write(frontend, &len, sizeof(len));
+	len = htonl(0);
+	pool_write(frontend, &len, sizeof(len));
+
+	/* ParameterStatus saved by an earlier connection */
+	pool_write(frontend, params, paramslen);
+
+	/*
+	 * BackendKeyData.  There is no backend to cancel queries of yet, so the
+	 * key is not known to backend.
+	 */
+	pool_write(frontend, "K", 1);
+	len = htonl(12);
+	pool_write(frontend, &len, sizeof(len));
+	pid = htonl(getpid());
+	pool_write(frontend, &pid, sizeof(pid));
+	key = htonl(random());
+	pool_write(frontend, &key, sizeof(key));
+
+	/* ReadyForQuery */
+	pool_write(frontend, "Z", 1);
+	len = htonl(5);
+	pool_write(frontend, &len, sizeof(len));
+	pool_write_and_flush(frontend, &state, 1);
+
+	snprintf(psbuf, sizeof(psbuf), "%s %s %s idle",
+			 sp->user, sp->database, remote_ps_data);
+	set_ps_display(psbuf, false);
+
+	lazy_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									 "lazy_connection",
+									 ALLOCSET_DEFAULT_SIZES);
+	oldContext = MemoryContextSwitchTo(lazy_cxt);
+
+	for (;;)
+	{
+		char		kind;
+		char	   *contents = NULL;
+
+		MemoryContextReset(lazy_cxt);
+
+		wait_for_frontend_lazily(frontend);
+		pool_read(frontend, &kind, 1);
+		pool_read(frontend, &len, sizeof(len));
+		len = ntohl(len) - sizeof(len);
+		if (len < 0)
+			ereport(ERROR,
+					(errmsg("invalid message length %d from frontend", len + (int) sizeof(len))));
+		if (len > 0)
+		{
+			contents = palloc(len);
+			memcpy(contents, pool_read2(frontend, len), len);
+		}
+
+		if (kind == 'X')
+		{
+			MemoryContextSwitchTo(oldContext);
+			MemoryContextDelete(lazy_cxt);
+			return false;
+		}
+
+		if (kind == 'Q' && contents && contents[len - 1] == '\0' &&
+			pool_is_likely_select(contents) &&
+			pool_fetch_cache_without_backend(frontend, sp->user, sp->database, contents))
+		{
+			pool_stats_count_up_num_cache_hits();
+			continue;
+		}
+
+		/* Put back the message and go connecting to backend */
+		if (len > 0)
+			pool_unread(frontend, contents, len);
+		len = htonl(len + sizeof(len));
+		pool_unread(frontend, &len, sizeof(len));
+		pool_unread(frontend, &kind, 1);
+		break;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(lazy_cxt);
+	return true;
+}
+
+/*
+ * Wait for the next message from the frontend of a session without
+ * backend connection, with the same idle limits as pool_process_query().
+ */
+static void
+wait_for_frontend_lazily(POOL_CONNECTION * frontend)
+{
+	fd_set		readmask;
+	fd_set		exceptmask;
+	struct timeval timeoutdata;
+	struct timeval *timeout;
+	int			fds;
+
+	/*
+	 * frontend idle counters. depends on the following select(2) call's time
+	 * out is 1 second.
+	 */
+	int			idle_count = 0; /* for other than in recovery */
+	int			idle_count_in_recovery = 0; /* for in recovery */
+
+	if (pool_ssl_pending(frontend) || !pool_read_buffer_is_empty(frontend))
+		return;
+
+	for (;;)
+	{
+		/*
+		 * If we are in recovery and client_idle_limit_in_recovery is -1, then
+		 * exit immediately.
+		 */
+		if (*InRecovery > RECOVERY_INIT && pool_config->client_idle_limit_in_recovery == -1)
+			ereport(FRONTEND_ERROR,
+					(pool_error_code("57000"),
+					 errmsg("connection terminated due to online recovery"),
+					 errdetail("child connection forced to terminate due to client_idle_limit_in_recovery = -1")));
+
+		FD_ZERO(&readmask);
+		FD_ZERO(&exceptmask);
+		FD_SET(frontend->fd, &readmask);
+		FD_SET(frontend->fd, &exceptmask);
+
+		if (pool_config->client_idle_limit > 0 ||
+			pool_config->client_idle_limit_in_recovery > 0 ||
+			pool_config->client_idle_limit_in_recovery == -1)
+		{
+			timeoutdata.tv_sec = 1;
+			timeoutdata.tv_usec = 0;
+			timeout = &timeoutdata;
+		}
+		else
+			timeout = NULL;
+
+		fds = select(frontend->fd + 1, &readmask, NULL, &exceptmask, timeout);
+
+		if (fds == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			ereport(FATAL,
+					(errmsg("unable to read data"),
+					 errdetail("select() system call failed with reason \"%s\"", strerror(errno))));
+		}
+
+		if (fds > 0)
+			return;
+
+		/* select timeout */
+		if (*InRecovery == RECOVERY_INIT && pool_config->client_idle_limit > 0)
+		{
+			idle_count++;
+
+			if (idle_count > pool_config->client_idle_limit)
+				ereport(FRONTEND_ERROR,
+						(pool_error_code("57000"),
+						 errmsg("unable to read data"),
+						 errdetail("child connection forced to terminate due to client_idle_limit:%d is reached",
+								   pool_config->client_idle_limit)));
+		}
+		else if (*InRecovery > RECOVERY_INIT && pool_config->client_idle_limit_in_recovery > 0)
+		{
+			idle_count_in_recovery++;
+
+			if (idle_count_in_recovery > pool_config->client_idle_limit_in_recovery)
+				ereport(FRONTEND_ERROR,
+						(pool_error_code("57000"),
+						 errmsg("unable to read data"),
+						 errdetail("child connection forced to terminate due to client_idle_limit_in_recovery:%d is reached", pool_config->client_idle_limit_in_recovery)));
+		}
+	}
+}
+
+/*
+ * Connect to backend for a session started by
+ * serve_cache_before_connecting().  The frontend has been already sent the
+ * messages of connection start, so the messages from backend up to the
+ * first ReadyForQuery are discarded.  If the ParameterStatus messages are
+ * different from those sent to the frontend, they are sent again.
+ */
+static POOL_CONNECTION_POOL *
+connect_backend_lazily(StartupPacket *sp, POOL_CONNECTION * frontend,
+					   char *params, int paramslen)
+{
+	POOL_CONNECTION_POOL *volatile backend = NULL;
+	POOL_CONNECTION *silent;
+	char	   *new_params;
+	int			new_paramslen;
+	int			auth_kind;
+	int			fd;
+	int			i;
+
+	fd = open("/dev/null", O_RDWR);
+	if (fd < 0)
+		ereport(ERROR,
+				(errmsg("unable to connect to backend"),
+				 errdetail("could not open \"/dev/null\": %s", strerror(errno))));
+
+	silent = pool_open(fd, false);
+	silent->protoVersion = frontend->protoVersion;
+	silent->username = frontend->username;
+	silent->database = frontend->database;
+	silent->pool_hba = frontend->pool_hba;
+	silent->passwordMapping = frontend->passwordMapping;
+	silent->frontend_authenticated = frontend->frontend_authenticated;
+
+	PG_TRY();
+	{
+		backend = connect_backend(sp, silent);
+
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			char		kind;
+			int			len;
+
+			if (!VALID_BACKEND(i))
+				continue;
+
+			pool_read_with_error(CONNECTION(backend, i), &kind, sizeof(kind),
+								 "kind of ReadyForQuery");
+			if (kind != 'Z')
+				ereport(ERROR,
+						(errmsg("unable to connect to backend"),
+						 errdetail("backend response with kind \'%c\' when expecting \'Z\'", kind)));
+			pool_read_with_error(CONNECTION(backend, i), &len, sizeof(len),
+								 "message length of ReadyForQuery");
+			pool_read_with_error(CONNECTION(backend, i), &TSTATE(backend, i), 1,
+								 "transaction state of ReadyForQuery");
+		}
+	}
+	PG_CATCH();
+	{
+		if (backend)
+			pool_discard_cp(sp->user, sp->database, sp->major);
+		pool_close(silent);
+		pool_send_fatal_message(frontend, sp->major, "08006",
+								"unable to connect to backend", "",
+								"", __FILE__, __LINE__);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pool_close(silent);
+
+	ereport(DEBUG1,
+			(errmsg("connected to backend at the first query not found in the query cache"),
+			 errdetail("user: %s database: %s", sp->user, sp->database)));
+
+	pool_save_startup_params(backend);
+	if (!pool_get_startup_params(sp, &new_params, &new_paramslen, &auth_kind) ||
+		new_paramslen != paramslen || memcmp(new_params, params, paramslen) != 0)
+		send_params(frontend, backend);
+
+	return backend;
+}
+
 /*
  * signal handler for SIGTERM, SIGINT and SIGQUUT
  */
@@ -1369,6 +1720,7 @@ make_persistent_db_connection(
 	cp->closetime = 0;
 	cp->con->isbackend = 1;
 	pool_set_db_node_id(cp->con, db_node_id);
+	pool_init_params(&cp->con->params);
 
 	pool_ssl_negotiate_clientserver(cp->con);
 
@@ -1537,10 +1889,10 @@ connection_count_up(void)
 	pool_sigset_t oldmask;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(CONN_COUNTER_SEM);
+	pool_lwlock_acquire(CONN_COUNTER_LOCK, POOL_LW_EXCLUSIVE);
 	Req_info->conn_counter++;
 	elog(DEBUG5, "connection_count_up: number of connected children: %d", Req_info->conn_counter);
-	pool_semaphore_unlock(CONN_COUNTER_SEM);
+	pool_lwlock_release(CONN_COUNTER_LOCK);
 	POOL_SETMASK(&oldmask);
 	return Req_info->conn_counter;
 }
@@ -1555,7 +1907,7 @@ connection_count_down(void)
 	pool_sigset_t oldmask;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(CONN_COUNTER_SEM);
+	pool_lwlock_acquire(CONN_COUNTER_LOCK, POOL_LW_EXCLUSIVE);
 
 	/*
 	 * Make sure that we do not decrement too much.  If failed to read a start
@@ -1567,7 +1919,7 @@ connection_count_down(void)
 	if (Req_info->conn_counter > 0)
 		Req_info->conn_counter--;
 	elog(DEBUG5, "connection_count_down: number of connected children: %d", Req_info->conn_counter);
-	pool_semaphore_unlock(CONN_COUNTER_SEM);
+	pool_lwlock_release(CONN_COUNTER_LOCK);
 	POOL_SETMASK(&oldmask);
 }
 
@@ -1597,6 +1949,7 @@ select_load_balancing_node(void)
 	POOL_SESSION_CONTEXT *ses = pool_get_session_context(false);
 	int			tmp;
 	int			no_load_balance_node_id = -2;
+	bool		by_response_time;
 
 	/*
 	 * -2 indicates there's no database_redirect_preference_list. -1 indicates
@@ -1633,7 +1986,7 @@ select_load_balancing_node(void)
 							   pool_config->db_redirect_tokens->token[index_db].weight_token)));
 
 			tmp = choose_db_node_id(pool_config->db_redirect_tokens->token[index_db].right_token);
-			if (tmp == -1 || (tmp >= 0 && VALID_BACKEND(tmp)))
+			if (tmp == -1 || (tmp >= 0 && VALID_BACKEND(tmp) && !BACKEND_INFO(tmp).draining))
 				suggested_node_id = tmp;
 		}
 	}
@@ -1674,7 +2027,7 @@ select_load_balancing_node(void)
 								   pool_config->app_name_redirect_tokens->token[index_app].weight_token)));
 
 				tmp = choose_db_node_id(pool_config->app_name_redirect_tokens->token[index_app].right_token);
-				if (tmp == -1 || (tmp >= 0 && VALID_BACKEND(tmp)))
+				if (tmp == -1 || (tmp >= 0 && VALID_BACKEND(tmp) && !BACKEND_INFO(tmp).draining))
 					suggested_node_id = tmp;
 			}
 		}
@@ -1713,23 +2066,37 @@ select_load_balancing_node(void)
 		}
 	}
 
-	/* Choose a backend in random manner with weight */
+	/*
+	 * Choose a backend in random manner with weight.  Nodes being drained
+	 * are not chosen.  The weights are scaled by the response time of health
+	 * check only if it has been measured for all the candidates.
+	 */
 	selected_slot = MASTER_NODE_ID;
 	total_weight = 0.0;
+	by_response_time = pool_config->load_balance_by_response_time;
 
 	for (i = 0; i < NUM_BACKENDS; i++)
 	{
-		if (VALID_BACKEND_RAW(i))
+		if (VALID_BACKEND_RAW(i) && !BACKEND_INFO(i).draining &&
+			i != no_load_balance_node_id &&
+			!(suggested_node_id == -1 && i == PRIMARY_NODE_ID) &&
+			BACKEND_INFO(i).health_check_srtt == 0)
+			by_response_time = false;
+	}
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (VALID_BACKEND_RAW(i) && !BACKEND_INFO(i).draining)
 		{
 			if (i == no_load_balance_node_id)
 				continue;
 			if (suggested_node_id == -1)
 			{
 				if (i != PRIMARY_NODE_ID)
-					total_weight += BACKEND_INFO(i).backend_weight;
+					total_weight += load_balance_weight(i, by_response_time);
 			}
 			else
-				total_weight += BACKEND_INFO(i).backend_weight;
+				total_weight += load_balance_weight(i, by_response_time);
 		}
 	}
 
@@ -1745,13 +2112,14 @@ select_load_balancing_node(void)
 		if ((suggested_node_id == -1 && i == PRIMARY_NODE_ID) || i == no_load_balance_node_id)
 			continue;
 
-		if (VALID_BACKEND_RAW(i) && BACKEND_INFO(i).backend_weight > 0.0)
+		if (VALID_BACKEND_RAW(i) && !BACKEND_INFO(i).draining &&
+			BACKEND_INFO(i).backend_weight > 0.0)
 		{
 			if (r >= total_weight)
 				selected_slot = i;
 			else
 				break;
-			total_weight += BACKEND_INFO(i).backend_weight;
+			total_weight += load_balance_weight(i, by_response_time);
 		}
 	}
 	ereport(DEBUG1,
@@ -1760,6 +2128,21 @@ select_load_balancing_node(void)
 	return selected_slot;
 }
 
+/*
+ * Load balance weight of the node.  If by_response_time is true, the weight
+ * is divided by the smoothed response time of health check, so that nodes
+ * responding slowly get less queries.
+ */
+static double
+load_balance_weight(int node_id, bool by_response_time)
+{
+	double		weight = BACKEND_INFO(node_id).backend_weight;
+
+	if (by_response_time && BACKEND_INFO(node_id).health_check_srtt > 0)
+		weight /= (double) BACKEND_INFO(node_id).health_check_srtt;
+	return weight;
+}
+
 /* SIGHUP handler */
 static RETSIGTYPE reload_config_handler(int sig)
 {
@@ -1827,6 +2210,95 @@ check_restart_request(void)
 	}
 }
 
+/*
+ * Create pooled connections listed in prewarm_connection_list in advance,
+ * so that clients connecting after a failover or a restart of the child do
+ * not have to wait for connecting and authenticating to each backend.
+ * Passwords are taken from pool_passwd.  Only the first
+ * prewarm_connection_count children do this, each time before waiting for
+ * a client, so that the connections discarded in the meantime are made
+ * again.  Pairs already in the pool cost nothing.  If a connection cannot
+ * be made, it is tried again after PREWARM_MIN_RETRY seconds, doubling up
+ * to PREWARM_MAX_RETRY, and the backend timer wakes us up for that.
+ */
+#define PREWARM_MIN_RETRY	1
+#define PREWARM_MAX_RETRY	60
+
+static void
+prewarm_connections(void)
+{
+	static time_t retry_time = 0;
+	static int	retry_delay = 0;
+	bool		failed = false;
+	time_t		now;
+	int			i;
+
+	if (!pool_config->connection_cache ||
+		pool_config->num_prewarm_connection_list <= 0 ||
+		pool_get_process_context()->proc_id >= pool_config->prewarm_connection_count)
+		return;
+
+	now = time(NULL);
+	if (now < retry_time)
+	{
+		prewarm_retry_alarm(retry_time - now);
+		return;
+	}
+
+	for (i = 0; i < pool_config->num_prewarm_connection_list; i++)
+	{
+		char	   *user;
+		char	   *database;
+		char	   *password;
+
+		/* format is checked when the config file is loaded */
+		user = pstrdup(pool_config->prewarm_connection_list[i]);
+		database = strchr(user, ':');
+		if (database == NULL)
+			continue;
+		*database++ = '\0';
+
+		password = get_pgpool_config_user_password(user, "");
+		if (!pool_prewarm_cp(user, database, password))
+		{
+			/* do not fill the log while retrying */
+			ereport(retry_delay == 0 ? LOG : DEBUG1,
+					(errmsg("could not pre-warm connection for user: \"%s\" database: \"%s\"",
+							user, database)));
+			failed = true;
+		}
+		if (password)
+			pfree(password);
+		pfree(user);
+	}
+
+	if (!failed)
+	{
+		retry_delay = 0;
+		retry_time = 0;
+		return;
+	}
+
+	retry_delay = retry_delay == 0 ? PREWARM_MIN_RETRY : Min(retry_delay * 2, PREWARM_MAX_RETRY);
+	retry_time = time(NULL) + retry_delay;
+	prewarm_retry_alarm(retry_delay);
+}
+
+/*
+ * Make sure the backend timer goes off within "seconds", so that the wait
+ * for a client is interrupted to retry pre-warming.  An earlier alarm set
+ * for the pooled connections is kept.
+ */
+static void
+prewarm_retry_alarm(unsigned int seconds)
+{
+	unsigned int remaining = alarm(0);
+
+	if (remaining == 0 || remaining > seconds)
+		remaining = seconds;
+	pool_alarm(pool_backend_timer_handler, remaining);
+}
+
 /*
  * wait_for_new_connections()
  * functions calls select on sockets and wait for new client
@@ -1891,7 +2363,7 @@ wait_for_new_connections(int *fds, struct timeval *timeout, SockAddr *saddr)
 	 */
 	if (SERIALIZE_ACCEPT)
 	{
-		pool_semaphore_lock(ACCEPT_FD_SEM);
+		pool_lwlock_acquire(ACCEPT_FD_LOCK, POOL_LW_EXCLUSIVE);
 		set_ps_display("wait for connection request", false);
 		ereport(DEBUG1,
 				(errmsg("LOCKING select()")));
@@ -1903,15 +2375,18 @@ wait_for_new_connections(int *fds, struct timeval *timeout, SockAddr *saddr)
 
 	if (SERIALIZE_ACCEPT)
 	{
-		pool_semaphore_unlock(ACCEPT_FD_SEM);
+		pool_lwlock_release(ACCEPT_FD_LOCK);
 		ereport(DEBUG1,
 				(errmsg("UNLOCKING select()")));
 	}
 
-	/* check backend timer is expired */
+	/*
+	 * check backend timer is expired.  Idle connections are only checked if
+	 * no client is waiting to be accepted.
+	 */
 	if (backend_timer_expired)
 	{
-		pool_backend_timer();
+		pool_backend_timer(numfds <= 0);
 		backend_timer_expired = 0;
 	}
 
@@ -2000,7 +2475,7 @@ retry_accept:
 	/* check backend timer is expired */
 	if (backend_timer_expired)
 	{
-		pool_backend_timer();
+		pool_backend_timer(false);
 		backend_timer_expired = 0;
 	}
 	errno = save_errno;
@@ -2288,7 +2763,8 @@ retry_startup:
 	/*
 	 * Check if restart request is set because of failback event happened.  If
 	 * so, close idle connections to backend and make a new copy of backend
-	 * status.
+	 * status.  The same is done if a node which this process stopped using
+	 * because it was being drained is no longer being drained.
 	 */
 	if (pool_get_my_process_info()->need_to_restart)
 	{
@@ -2300,6 +2776,15 @@ retry_startup:
 		close_idle_connection(0);
 		pool_initialize_private_backend_status();
 	}
+	else if (pool_forget_undrained_nodes())
+	{
+		ereport(LOG,
+				(errmsg("selecting backend connection"),
+				 errdetail("node is no longer being drained, discarding existing connections")));
+
+		close_idle_connection(0);
+		pool_initialize_private_backend_status();
+	}
 
 	/*
 	 * if there's no connection associated with user and database, we need to
@@ -2349,6 +2834,25 @@ retry_startup:
 
 	if (backend == NULL)
 	{
+		char	   *params;
+		int			paramslen;
+
+		if (can_connect_lazily(frontend, sp, &params, &paramslen))
+		{
+			/* connect to backend at the first query not found in cache */
+			if (!serve_cache_before_connecting(frontend, sp, params, paramslen))
+			{
+				connection_count_down();
+				pool_free_startup_packet(sp);
+				return NULL;
+			}
+
+			/* this saves the startup parameters itself */
+			backend = connect_backend_lazily(sp, frontend, params, paramslen);
+			pool_free_startup_packet(sp);
+			return backend;
+		}
+
 		/* create a new connection to backend */
 		backend = connect_backend(sp, frontend);
 	}
@@ -2359,6 +2863,10 @@ retry_startup:
 			return NULL;
 	}
 
+	if (pool_config->memory_cache_enabled &&
+		pool_config->memqcache_lazy_backend_connection)
+		pool_save_startup_params(backend);
+
 	pool_free_startup_packet(sp);
 	return backend;
 }
@@ -49,6 +49,7 @@
 #include "utils/elog.h"
 #include "utils/memutils.h"
 #include "context/pool_process_context.h"
+#include "context/pool_session_context.h"
 
 static int	pool_index;			/* Active pool index */
 POOL_CONNECTION_POOL *pool_connection_pool; /* connection pool */
@@ -56,10 +57,20 @@ volatile sig_atomic_t backend_timer_expired = 0;	/* flag for connection
 													 * closed timer is expired */
 volatile sig_atomic_t health_check_timer_expired;	/* non 0 if health check
 													 * timer expired */
+static bool drained_nodes[MAX_NUM_BACKENDS];	/* nodes marked down in the
+												 * local status because they
+												 * were being drained */
 static POOL_CONNECTION_POOL_SLOT * create_cp(POOL_CONNECTION_POOL_SLOT * cp, int slot);
 static POOL_CONNECTION_POOL * new_connection(POOL_CONNECTION_POOL * p);
 static int	check_socket_status(int fd);
+static bool check_idle_cp(POOL_CONNECTION_POOL * p);
+static bool ping_backend(POOL_CONNECTION * con, int major);
+static void discard_idle_cp(POOL_CONNECTION_POOL * p);
+static int	backend_timer_period(void);
 static bool connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool retry);
+static bool node_is_detached(int node_id);
+static bool can_detach_node(POOL_CONNECTION_POOL * backend, int node_id);
+static void set_backend_keepalive(int fd);
 
 /*
 * initialize connection pools. this should be called once at the startup.
@@ -127,6 +138,14 @@ pool_get_cp(char *user, char *database, int protoMajor, int check_socket)
 			}
 			POOL_SETMASK(&oldmask);
 
+			/*
+			 * No need to probe the sockets if the connection has been
+			 * checked by pool_backend_timer() recently.
+			 */
+			if (check_socket && pool_config->connection_check_interval > 0 &&
+				time(NULL) - MASTER_CONNECTION(connection_pool)->checktime < pool_config->connection_check_interval)
+				check_socket = 0;
+
 			if (check_socket)
 			{
 				for (j = 0; j < NUM_BACKENDS; j++)
@@ -229,6 +248,326 @@ pool_discard_cp(char *user, char *database, int protoMajor)
 }
 
 
+/*
+ * Close the connections to standby nodes which have been detached by a
+ * failover that did not restart this process or which are being drained,
+ * and mark the nodes down in the local backend status.  "backend" is the
+ * connection pool used by the current session, or NULL if there is no
+ * session.  The session's connections are only touched between
+ * transactions, so this is called again later if that is not the case now.
+ */
+void
+pool_detach_down_nodes(POOL_CONNECTION_POOL * backend)
+{
+	POOL_CONNECTION_POOL *p;
+	POOL_CONNECTION_POOL_SLOT *s;
+	pool_sigset_t oldmask;
+	bool		draining;
+	int			i,
+				j,
+				k;
+
+	/* Wait until failover finishes updating the status */
+	if (Req_info->switching)
+		return;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!node_is_detached(i))
+			continue;
+
+		if (backend && !can_detach_node(backend, i))
+			continue;
+
+		draining = BACKEND_INFO(i).draining;
+
+		POOL_SETMASK2(&BlockSig, &oldmask);
+
+		p = pool_connection_pool;
+		for (j = 0; j < pool_config->max_pool; j++, p++)
+		{
+			s = CONNECTION_SLOT(p, i);
+			if (s == NULL)
+				continue;
+
+			/*
+			 * The pool timers are kept in the master slot, which may move to
+			 * another node.
+			 */
+			for (k = 0; k < NUM_BACKENDS; k++)
+			{
+				if (k == i || CONNECTION_SLOT(p, k) == NULL)
+					continue;
+				if (CONNECTION_SLOT(p, k)->closetime == 0)
+					CONNECTION_SLOT(p, k)->closetime = s->closetime;
+				if (CONNECTION_SLOT(p, k)->checktime == 0)
+					CONNECTION_SLOT(p, k)->checktime = s->checktime;
+			}
+
+			/* The startup packet is shared with the other slots */
+			s->sp = NULL;
+			pool_close(s->con);
+			pfree(s);
+			CONNECTION_SLOT(p, i) = NULL;
+			memset(&p->info[i], 0, sizeof(ConnectionInfo));
+		}
+
+		if (draining)
+		{
+			*(my_backend_status[i]) = CON_DOWN;
+			drained_nodes[i] = true;
+		}
+		else
+			*(my_backend_status[i]) = BACKEND_INFO(i).backend_status;
+
+		/* Move the session off the draining node */
+		if (backend)
+		{
+			POOL_SESSION_CONTEXT *session_context = pool_get_session_context(true);
+
+			if (session_context && session_context->load_balance_node_id == i)
+			{
+				int			node_id = select_load_balancing_node();
+
+				session_context->load_balance_node_id = node_id;
+				for (k = 0; k < NUM_BACKENDS; k++)
+					pool_coninfo(session_context->process_context->proc_id,
+								 pool_pool_index(), k)->load_balancing_node = node_id;
+			}
+		}
+
+		POOL_SETMASK(&oldmask);
+
+		ereport(LOG,
+				(errmsg("closed pooled connections to backend node %d", i),
+				 errdetail(draining ? "the node is being drained" :
+						   "the node was detached by failover")));
+	}
+}
+
+/*
+ * Forget the nodes marked down in the local status by
+ * pool_detach_down_nodes() because they were being drained, and which are
+ * up and no longer being drained now.  Returns true if there are such
+ * nodes, in which case the caller has to discard the pooled connections
+ * and make the local status again to use the nodes.
+ */
+bool
+pool_forget_undrained_nodes(void)
+{
+	bool		found = false;
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!drained_nodes[i] || BACKEND_INFO(i).draining)
+			continue;
+
+		drained_nodes[i] = false;
+		if (BACKEND_INFO(i).backend_status == CON_UP ||
+			BACKEND_INFO(i).backend_status == CON_CONNECT_WAIT)
+			found = true;
+	}
+	return found;
+}
+
+/*
+ * Returns true if the node is up in the local status but has been detached
+ * by failover or is being drained.  The primary node is not handled because
+ * its failover restarts all children.
+ */
+static bool
+node_is_detached(int node_id)
+{
+	BACKEND_STATUS status = BACKEND_INFO(node_id).backend_status;
+
+	if (!VALID_BACKEND_RAW(node_id))
+		return false;
+
+	if (status != CON_DOWN && status != CON_UNUSED &&
+		!BACKEND_INFO(node_id).draining)
+		return false;
+
+	return node_id != REAL_PRIMARY_NODE_ID;
+}
+
+/*
+ * Returns true if the session's connection to the node can be closed now.
+ * That is the case if the session is idle between transactions, has no
+ * prepared statement or portal on the node, and does not use the node for
+ * load balancing, unless the node is being drained in which case the
+ * session is moved to another load balance node.
+ */
+static bool
+can_detach_node(POOL_CONNECTION_POOL * backend, int node_id)
+{
+	POOL_SESSION_CONTEXT *session_context = pool_get_session_context(true);
+	int			i;
+
+	if (session_context)
+	{
+		if (session_context->load_balance_node_id == node_id &&
+			!BACKEND_INFO(node_id).draining)
+			return false;
+
+		if (session_context->in_progress || pool_is_doing_extended_query_message())
+			return false;
+
+		/* Prepared statements and portals parsed on the node stay there */
+		if (pool_sent_messages_use_node(node_id))
+			return false;
+	}
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (i == node_id || !VALID_BACKEND_RAW(i) || CONNECTION_SLOT(backend, i) == NULL)
+			continue;
+
+		if (TSTATE(backend, i) != 'I')
+			return false;
+	}
+
+	if (CONNECTION_SLOT(backend, node_id) &&
+		(pool_stacklen(CONNECTION(backend, node_id)) > 0 ||
+		 !pool_read_buffer_is_empty(CONNECTION(backend, node_id))))
+		return false;
+
+	return true;
+}
+
+/*
+ * Create a pooled connection for user and database in advance, so that a
+ * frontend asking for it later does not have to wait for connecting and
+ * authenticating to each backend.  Unlike pool_create_cp(), an existing
+ * connection is never discarded to make room.  "password" is used to
+ * authenticate to backends. Returns true if the connection is in the pool.
+ */
+bool
+pool_prewarm_cp(char *user, char *database, char *password)
+{
+	POOL_CONNECTION_POOL *p = pool_connection_pool;
+	POOL_CONNECTION_POOL *newp = NULL;
+	POOL_CONNECTION_POOL_SLOT *s;
+	StartupPacket *sp = NULL;
+	ConnectionInfo *info;
+	MemoryContext oldContext;
+	BackendInfo *bkinfo;
+	bool		ok = true;
+	int			i;
+
+	if (p == NULL)
+		return false;
+
+	for (i = 0; i < pool_config->max_pool; i++, p++)
+	{
+		if (MASTER_CONNECTION(p) == NULL)
+		{
+			if (newp == NULL)
+				newp = p;
+			continue;
+		}
+
+		if (MASTER_CONNECTION(p)->sp &&
+			MASTER_CONNECTION(p)->sp->major == PROTO_MAJOR_V3 &&
+			MASTER_CONNECTION(p)->sp->user != NULL &&
+			strcmp(MASTER_CONNECTION(p)->sp->user, user) == 0 &&
+			strcmp(MASTER_CONNECTION(p)->sp->database, database) == 0)
+			return true;		/* already pooled */
+	}
+
+	/* no empty connection slot */
+	if (newp == NULL)
+		return false;
+
+	oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
+		if (BACKEND_INFO(i).backend_status != CON_UP &&
+			BACKEND_INFO(i).backend_status != CON_CONNECT_WAIT)
+		{
+			ok = false;
+			break;
+		}
+
+		bkinfo = pool_get_node_info(i);
+		s = make_persistent_db_connection_noerror(i, bkinfo->backend_hostname,
+												  bkinfo->backend_port,
+												  database, user,
+												  password ? password : "", false);
+		if (s == NULL)
+		{
+			ok = false;
+			break;
+		}
+
+		/* all slots of a connection pool share one startup packet */
+		if (sp == NULL)
+			sp = s->sp;
+		else
+		{
+			pool_free_startup_packet(s->sp);
+			s->sp = sp;
+		}
+
+		newp->slots[i] = s;
+		newp->info[i].pid = s->pid;
+		newp->info[i].key = s->key;
+		newp->info[i].major = sp->major;
+		newp->info[i].minor = sp->minor;
+		strlcpy(newp->info[i].database, database, sizeof(newp->info[i].database));
+		strlcpy(newp->info[i].user, user, sizeof(newp->info[i].user));
+		newp->info[i].counter = 0;
+		newp->info[i].create_time = time(NULL);
+		newp->info[i].swallow_termination = 0;
+		CONNECTION(newp, i)->con_info = &newp->info[i];
+	}
+
+	if (MASTER_CONNECTION(newp) == NULL)
+		ok = false;
+	else if (ok && !pool_prepare_reauth(MASTER(newp), user, password))
+	{
+		ereport(LOG,
+				(errmsg("cannot pre-warm connection for user: \"%s\" database: \"%s\"", user, database),
+				 errdetail("frontends cannot be authenticated against the connection")));
+		ok = false;
+	}
+
+	if (!ok)
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (CONNECTION_SLOT(newp, i) == NULL)
+				continue;
+
+			CONNECTION_SLOT(newp, i)->sp = NULL;
+			pool_close(CONNECTION(newp, i));
+			pfree(CONNECTION_SLOT(newp, i));
+		}
+		pool_free_startup_packet(sp);
+
+		info = newp->info;
+		memset(newp, 0, sizeof(POOL_CONNECTION_POOL));
+		newp->info = info;
+		memset(newp->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+		MemoryContextSwitchTo(oldContext);
+		return false;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	ereport(DEBUG1,
+			(errmsg("pre-warmed connection for user: \"%s\" database: \"%s\"", user, database)));
+
+	/* the connection is idle until a frontend picks it up */
+	pool_connection_pool_timer(newp);
+
+	return true;
+}
+
 /*
 * create a connection pool by user and database
 */
@@ -343,8 +682,9 @@ pool_connection_pool_timer(POOL_CONNECTION_POOL * backend)
 
 	MASTER_CONNECTION(backend)->closetime = time(NULL); /* set connection close
 														 * time */
+	MASTER_CONNECTION(backend)->checktime = MASTER_CONNECTION(backend)->closetime;
 
-	if (pool_config->connection_life_time == 0)
+	if (backend_timer_period() == 0)
 		return;
 
 	/* look for any other timeout */
@@ -364,9 +704,25 @@ pool_connection_pool_timer(POOL_CONNECTION_POOL * backend)
 	/* no other timer found. set my timer */
 	ereport(DEBUG1,
 			(errmsg("setting backend connection close timer"),
-			 errdetail("setting alarm after %d seconds", pool_config->connection_life_time)));
+			 errdetail("setting alarm after %d seconds", backend_timer_period())));
 
-	pool_alarm(pool_backend_timer_handler, pool_config->connection_life_time);
+	pool_alarm(pool_backend_timer_handler, backend_timer_period());
+}
+
+/*
+ * Return the interval of the backend timer: the shorter one of
+ * connection_life_time and connection_check_interval, or 0 if both are
+ * disabled.
+ */
+static int
+backend_timer_period(void)
+{
+	int			life_time = pool_config->connection_life_time;
+	int			check_interval = pool_config->connection_check_interval;
+
+	if (life_time > 0 && check_interval > 0)
+		return Min(life_time, check_interval);
+	return life_time > 0 ? life_time : check_interval;
 }
 
 /*
@@ -378,17 +734,25 @@ pool_backend_timer_handler(int sig)
 	backend_timer_expired = 1;
 }
 
+/*
+ * Discard the idle pooled connections which have expired by
+ * connection_life_time.  If check_connections is true, also ping the ones
+ * due for connection_check_interval.  That can take a while, so it is only
+ * done while the child is waiting for a client; otherwise the check is
+ * left for the next time, which comes within a second.
+ */
 void
-pool_backend_timer(void)
+pool_backend_timer(bool check_connections)
 {
 #define TMINTMAX 0x7fffffff
 
 	POOL_CONNECTION_POOL *p = pool_connection_pool;
-	int			i,
-				j;
+	int			i;
 	time_t		now;
 	time_t		nearest = TMINTMAX;
-	ConnectionInfo *info;
+	time_t		deadline;
+	int			life_time = pool_config->connection_life_time;
+	int			check_interval = pool_config->connection_check_interval;
 
 	POOL_SETMASK(&BlockSig);
 
@@ -406,57 +770,62 @@ pool_backend_timer(void)
 		if (MASTER_CONNECTION(p)->sp->user == NULL)
 			continue;
 
+		/* connection under use? */
+		if (MASTER_CONNECTION(p)->closetime == 0)
+			continue;
+
+		ereport(DEBUG1,
+				(errmsg("backend timer handler called"),
+				 errdetail("expire time: %ld",
+						   MASTER_CONNECTION(p)->closetime + life_time)));
+
 		/* timer expire? */
-		if (MASTER_CONNECTION(p)->closetime)
+		if (life_time > 0 && now >= (MASTER_CONNECTION(p)->closetime + life_time))
 		{
-			int			freed = 0;
-
+			/* discard expired connection */
 			ereport(DEBUG1,
 					(errmsg("backend timer handler called"),
-					 errdetail("expire time: %ld",
-							   MASTER_CONNECTION(p)->closetime + pool_config->connection_life_time)));
+					 errdetail("expired user: \"%s\" database: \"%s\"",
+							   MASTER_CONNECTION(p)->sp->user, MASTER_CONNECTION(p)->sp->database)));
+			discard_idle_cp(p);
+			continue;
+		}
 
-			if (now >= (MASTER_CONNECTION(p)->closetime + pool_config->connection_life_time))
+		/* time to check the connection is still alive? */
+		if (check_connections && check_interval > 0 &&
+			now >= (MASTER_CONNECTION(p)->checktime + check_interval))
+		{
+			if (!check_idle_cp(p))
 			{
-				/* discard expired connection */
-				ereport(DEBUG1,
-						(errmsg("backend timer handler called"),
-						 errdetail("expired user: \"%s\" database: \"%s\"",
+				ereport(LOG,
+						(errmsg("discarding broken pooled connection"),
+						 errdetail("user: \"%s\" database: \"%s\"",
 								   MASTER_CONNECTION(p)->sp->user, MASTER_CONNECTION(p)->sp->database)));
-				pool_send_frontend_exits(p);
-
-				for (j = 0; j < NUM_BACKENDS; j++)
-				{
-					if (!VALID_BACKEND(j))
-						continue;
-
-					if (!freed)
-					{
-						pool_free_startup_packet(CONNECTION_SLOT(p, j)->sp);
-						freed = 1;
-					}
-					CONNECTION_SLOT(p, j)->sp = NULL;
-					pool_close(CONNECTION(p, j));
-					pfree(CONNECTION_SLOT(p, j));
-				}
-				info = p->info;
-				memset(p, 0, sizeof(POOL_CONNECTION_POOL));
-				p->info = info;
-				memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
-			}
-			else
-			{
-				/* look for nearest timer */
-				if (MASTER_CONNECTION(p)->closetime < nearest)
-					nearest = MASTER_CONNECTION(p)->closetime;
+				discard_idle_cp(p);
+				continue;
 			}
+			MASTER_CONNECTION(p)->checktime = now;
+		}
+
+		/* look for nearest timer */
+		if (life_time > 0)
+		{
+			deadline = MASTER_CONNECTION(p)->closetime + life_time;
+			if (deadline < nearest)
+				nearest = deadline;
+		}
+		if (check_interval > 0)
+		{
+			deadline = MASTER_CONNECTION(p)->checktime + check_interval;
+			if (deadline < nearest)
+				nearest = deadline;
 		}
 	}
 
 	/* any remaining timer */
 	if (nearest != TMINTMAX)
 	{
-		nearest = pool_config->connection_life_time - (now - nearest);
+		nearest = nearest - now;
 		if (nearest <= 0)
 			nearest = 1;
 		pool_alarm(pool_backend_timer_handler, nearest);
@@ -465,6 +834,125 @@ pool_backend_timer(void)
 	POOL_SETMASK(&UnBlockSig);
 }
 
+/*
+ * Close an idle connection pool and make the slot empty.
+ */
+static void
+discard_idle_cp(POOL_CONNECTION_POOL * p)
+{
+	ConnectionInfo *info;
+	int			freed = 0;
+	int			j;
+
+	pool_send_frontend_exits(p);
+
+	for (j = 0; j < NUM_BACKENDS; j++)
+	{
+		if (!VALID_BACKEND(j))
+			continue;
+
+		if (!freed)
+		{
+			pool_free_startup_packet(CONNECTION_SLOT(p, j)->sp);
+			freed = 1;
+		}
+		CONNECTION_SLOT(p, j)->sp = NULL;
+		pool_close(CONNECTION(p, j));
+		pfree(CONNECTION_SLOT(p, j));
+	}
+	info = p->info;
+	memset(p, 0, sizeof(POOL_CONNECTION_POOL));
+	p->info = info;
+	memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+}
+
+/*
+ * Check that all backend connections of an idle connection pool are still
+ * alive.  Returns false if any of them is broken.
+ */
+static bool
+check_idle_cp(POOL_CONNECTION_POOL * p)
+{
+	int			i;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
+		if (CONNECTION_SLOT(p, i) == NULL)
+			return false;
+
+		if (!ping_backend(CONNECTION(p, i), MASTER_CONNECTION(p)->sp->major))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Ping an idle backend connection by sending Sync and waiting for
+ * ReadyForQuery.  Nothing is expected to arrive on an idle connection, so
+ * pending data means the connection is closed or in an unexpected state.
+ * The socket is accessed directly rather than through pool_read() and
+ * friends, which would trigger failover on an error.  SSL connections and
+ * protocol version 2 connections, which have no Sync message, are only
+ * checked for pending data.  The reply is waited for connect_timeout
+ * milliseconds, or PING_TIMEOUT if connect_timeout is 0 (no timeout), so
+ * that a hung backend does not block the child forever.
+ */
+#define PING_TIMEOUT 10000
+
+static bool
+ping_backend(POOL_CONNECTION * con, int major)
+{
+	static const char sync_message[] = {'S', 0, 0, 0, 4};
+	char		reply[6];
+	int			len = 0;
+	int			sts;
+	int			msec;
+	fd_set		rfds;
+	struct timeval timeout;
+
+	if (con->len > 0 || check_socket_status(con->fd) < 0)
+		return false;
+
+	if (con->ssl_active > 0 || major != PROTO_MAJOR_V3)
+		return true;
+
+	if (write(con->fd, sync_message, sizeof(sync_message)) != sizeof(sync_message))
+		return false;
+
+	msec = pool_config->connect_timeout > 0 ? pool_config->connect_timeout : PING_TIMEOUT;
+
+	while (len < sizeof(reply))
+	{
+		FD_ZERO(&rfds);
+		FD_SET(con->fd, &rfds);
+		timeout.tv_sec = msec / 1000;
+		timeout.tv_usec = (msec % 1000) * 1000;
+
+		sts = select(con->fd + 1, &rfds, NULL, NULL, &timeout);
+		if (sts < 0 && errno == EINTR)
+			continue;
+		if (sts <= 0)
+			return false;
+
+		sts = read(con->fd, reply + len, sizeof(reply) - len);
+		if (sts < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (sts <= 0)
+			return false;
+		len += sts;
+	}
+
+	/* ReadyForQuery with idle transaction state is the only valid reply */
+	if (reply[0] != 'Z' || memcmp(reply + 1, "\0\0\0\5", 4) != 0 || reply[5] != 'I')
+		return false;
+
+	/* make sure nothing else followed */
+	return check_socket_status(con->fd) == 0;
+}
+
 /*
  * connect to postmaster through INET domain socket
  */
@@ -737,6 +1225,44 @@ connect_with_timeout(int fd, struct addrinfo *walk, char *host, int port, bool r
 	return true;
 }
 
+/*
+ * Enable TCP keepalive on a backend socket and apply
+ * backend_keepalives_* settings.  Failures are not fatal.
+ */
+static void
+set_backend_keepalive(int fd)
+{
+	int			on = 1;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (char *) &on, sizeof(on)) < 0)
+	{
+		ereport(WARNING,
+				(errmsg("setsockopt(SO_KEEPALIVE) failed with error \"%s\"", strerror(errno))));
+		return;
+	}
+#ifdef TCP_KEEPIDLE
+	if (pool_config->backend_keepalives_idle > 0 &&
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE,
+				   (char *) &pool_config->backend_keepalives_idle, sizeof(int)) < 0)
+		ereport(WARNING,
+				(errmsg("setsockopt(TCP_KEEPIDLE) failed with error \"%s\"", strerror(errno))));
+#endif
+#ifdef TCP_KEEPINTVL
+	if (pool_config->backend_keepalives_interval > 0 &&
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL,
+				   (char *) &pool_config->backend_keepalives_interval, sizeof(int)) < 0)
+		ereport(WARNING,
+				(errmsg("setsockopt(TCP_KEEPINTVL) failed with error \"%s\"", strerror(errno))));
+#endif
+#ifdef TCP_KEEPCNT
+	if (pool_config->backend_keepalives_count > 0 &&
+		setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT,
+				   (char *) &pool_config->backend_keepalives_count, sizeof(int)) < 0)
+		ereport(WARNING,
+				(errmsg("setsockopt(TCP_KEEPCNT) failed with error \"%s\"", strerror(errno))));
+#endif
+}
+
 /*
  * Connect to PostgreSQL server by using INET domain socket.
  * If retry is true, retry to call connect() upon receiving EINTR error.
@@ -802,6 +1328,12 @@ connect_inet_domain_socket_by_port(char *host, int port, bool retry)
 			return -1;
 		}
 
+		/*
+		 * Let the kernel find out dead peers of idle pooled connections, so
+		 * that they are noticed by pool_backend_timer().
+		 */
+		set_backend_keepalive(fd);
+
 		if (!connect_with_timeout(fd, walk, host, port, retry))
 		{
 			close(fd);
@@ -839,6 +1371,7 @@ static POOL_CONNECTION_POOL_SLOT * create_cp(POOL_CONNECTION_POOL_SLOT * cp, int
 	cp->sp = NULL;
 	cp->con = pool_open(fd, true);
 	cp->closetime = 0;
+	cp->checktime = 0;
 	return cp;
 }
 
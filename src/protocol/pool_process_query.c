@@ -71,6 +71,7 @@
 #define ADMIN_SHUTDOWN_ERROR_CODE "57P01"
 #define CRASH_SHUTDOWN_ERROR_CODE "57P02"
 #define IDLE_IN_TRANSACTION_SESSION_TIMEOUT_ERROR_CODE "25P03"
+#define LOCK_NOT_AVAILABLE_ERROR_CODE "55P03"
 
 static int	reset_backend(POOL_CONNECTION_POOL * backend, int qcnt);
 static char *get_insert_command_table_name(InsertStmt *node);
@@ -182,6 +183,13 @@ pool_process_query(POOL_CONNECTION * frontend,
 
 		check_stop_request();
 
+		/*
+		 * Close connections to standbys detached by failover, if we are
+		 * between transactions.
+		 */
+		if (!reset_request)
+			pool_detach_down_nodes(backend);
+
 		/*
 		 * If we are in recovery and client_idle_limit_in_recovery is -1, then
 		 * exit immediately.
@@ -1377,6 +1385,7 @@ pool_send_readyforquery(POOL_CONNECTION * frontend)
 	pool_write(frontend, &len, sizeof(len));
 	pool_write(frontend, "I", 1);
 	pool_flush(frontend);
+	stat_end_request();
 }
 
 /*
@@ -3961,8 +3970,27 @@ is_internal_transaction_needed(Node *node)
  */
 POOL_STATUS
 start_internal_transaction(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, Node *node)
+{
+	return start_internal_transaction_with_lock_timeout(frontend, backend, node, 0);
+}
+
+/*
+ * Same as start_internal_transaction() but if lock_timeout is greater
+ * than 0, also set lock_timeout (in milliseconds) for the internal
+ * transaction.  SET LOCAL is sent along with BEGIN in one query string so
+ * that it does not cost an extra round trip.
+ */
+POOL_STATUS
+start_internal_transaction_with_lock_timeout(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+											 Node *node, int lock_timeout)
 {
 	int			i;
+	char		query[64];
+
+	if (lock_timeout > 0)
+		snprintf(query, sizeof(query), "BEGIN;SET LOCAL lock_timeout TO %d", lock_timeout);
+	else
+		strlcpy(query, "BEGIN", sizeof(query));
 
 	/*
 	 * If we are not in a transaction block, start a new transaction
@@ -3974,9 +4002,9 @@ start_internal_transaction(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * ba
 			if (VALID_BACKEND(i) && !INTERNAL_TRANSACTION_STARTED(backend, i) &&
 				TSTATE(backend, i) == 'I')
 			{
-				per_node_statement_log(backend, i, "BEGIN");
+				per_node_statement_log(backend, i, query);
 
-				if (do_command(frontend, CONNECTION(backend, i), "BEGIN", MAJOR(backend),
+				if (do_command(frontend, CONNECTION(backend, i), query, MAJOR(backend),
 							   MASTER_CONNECTION(backend)->pid, MASTER_CONNECTION(backend)->key, 0) != POOL_CONTINUE)
 					ereport(ERROR,
 							(errmsg("unable to start the internal transaction"),
@@ -4192,6 +4220,18 @@ detect_deadlock_error(POOL_CONNECTION * backend, int major)
 	return r;
 }
 
+int
+detect_lock_not_available_error(POOL_CONNECTION * backend, int major)
+{
+	int			r = extract_message(backend, LOCK_NOT_AVAILABLE_ERROR_CODE, major, 'E', true);
+
+	if (r == SPECIFIED_ERROR)
+		ereport(DEBUG1,
+				(errmsg("detecting lock not available error"),
+				 errdetail("received lock timeout error message from backend")));
+	return r;
+}
+
 int
 detect_serialization_error(POOL_CONNECTION * backend, int major, bool unread)
 {
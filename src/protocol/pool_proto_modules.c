@@ -42,8 +42,10 @@
 #include <ctype.h>
 
 #include "pool.h"
+#include "auth/md5.h"
 #include "rewrite/pool_timestamp.h"
 #include "rewrite/pool_lobj.h"
+#include "rewrite/pool_sequence.h"
 #include "protocol/pool_proto_modules.h"
 #include "pool_config.h"
 #include "parser/pool_string.h"
@@ -96,6 +98,16 @@ static bool
 			process_pg_terminate_backend_func(POOL_QUERY_CONTEXT * query_context);
 static void pool_discard_except_sync_and_ready_for_query(POOL_CONNECTION * frontend,
 											 POOL_CONNECTION_POOL * backend);
+static int	relay_copy_data(POOL_CONNECTION * src, POOL_CONNECTION * *dst, int ndst);
+static bool is_parallel_execution_allowed(POOL_CONNECTION_POOL * backend, int lock_kind);
+static bool parallel_send_and_wait(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+								   POOL_QUERY_CONTEXT * query_context);
+static void discard_query_response(POOL_CONNECTION * cp);
+
+/*
+ * Size of the blocks COPY data is relayed in
+ */
+#define COPY_RELAY_BUFSZ	(64 * 1024)
 
 /*
  * This is the workhorse of processing the pg_terminate_backend function to
@@ -175,6 +187,10 @@ SimpleQuery(POOL_CONNECTION * frontend,
 	static char *sq_nodes = "pool_nodes";
 	static char *sq_version = "pool_version";
 	static char *sq_cache = "pool_cache";
+	static char *sq_backend_stats = "pool_backend_stats";
+	static char *sq_latency = "pool_latency";
+	static char *sq_lwlocks = "pool_lwlocks";
+	static char *sq_failover_trace = "pool_failover_trace";
 	int			commit;
 	List	   *parse_tree_list;
 	Node	   *node = NULL;
@@ -182,6 +198,7 @@ SimpleQuery(POOL_CONNECTION * frontend,
 	int			lock_kind;
 	bool		is_likely_select = false;
 	int			specific_error = 0;
+	bool		parallel = false;
 
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_QUERY_CONTEXT *query_context;
@@ -430,6 +447,38 @@ SimpleQuery(POOL_CONNECTION * frontend,
 						 errdetail("cache reporting")));
 				cache_reporting(frontend, backend);
 			}
+			else if (!strcmp(sq_backend_stats, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("backend stats reporting")));
+				backend_stats_reporting(frontend, backend);
+			}
+			else if (!strcmp(sq_latency, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("latency reporting")));
+				latency_reporting(frontend, backend);
+			}
+			else if (!strcmp(sq_lwlocks, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("lwlocks reporting")));
+				lwlocks_reporting(frontend, backend);
+			}
+			else if (!strcmp(sq_failover_trace, vnode->name))
+			{
+				is_valid_show_command = true;
+				ereport(DEBUG1,
+						(errmsg("SimpleQuery"),
+						 errdetail("failover trace reporting")));
+				failover_trace_reporting(frontend, backend);
+			}
 
 			if (is_valid_show_command)
 			{
@@ -563,11 +612,48 @@ SimpleQuery(POOL_CONNECTION * frontend,
 			 */
 			if (pool_multi_node_to_be_sent(query_context))
 			{
-				/* start a transaction if needed */
-				start_internal_transaction(frontend, backend, (Node *) node);
-
 				/* check if need lock */
 				lock_kind = need_insert_lock(backend, contents, node);
+
+				/*
+				 * If sequence_preallocation is enabled, try to give the
+				 * SERIAL columns pre-allocated values so that the table
+				 * need not be locked.
+				 */
+				if (lock_kind && pool_config->sequence_preallocation &&
+					MAJOR(backend) == PROTO_MAJOR_V3 &&
+					TSTATE(backend, MASTER_NODE_ID) != 'E')
+				{
+					char	   *rewrite_query;
+
+					rewrite_query = rewrite_insert_sequence(backend, node);
+					if (rewrite_query)
+					{
+						query_context->rewritten_query = rewrite_query;
+						query_context->rewritten_length = strlen(rewrite_query) + 1;
+						lock_kind = 0;
+					}
+				}
+
+				/*
+				 * Check if the query could be sent to all nodes at once. If
+				 * so, the internal transaction is started with lock_timeout
+				 * so that cross node lock waits are broken.
+				 */
+				parallel = is_parallel_execution_allowed(backend, lock_kind);
+
+				/* start a transaction if needed */
+				start_internal_transaction_with_lock_timeout(frontend, backend, (Node *) node,
+															 parallel ? pool_config->replication_parallel_lock_timeout : 0);
+
+				/*
+				 * Parallel execution is only used for queries executed in
+				 * our own internal transaction, since only then we can roll
+				 * back and retry the query.
+				 */
+				if (!INTERNAL_TRANSACTION_STARTED(backend, MASTER_NODE_ID))
+					parallel = false;
+
 				if (lock_kind)
 				{
 					/* if so, issue lock command */
@@ -669,6 +755,14 @@ SimpleQuery(POOL_CONNECTION * frontend,
 				return status;
 			}
 
+			/*
+			 * If replication_parallel_execution is enabled, send the query
+			 * to all DB nodes at once. If that failed because of a lock
+			 * wait, the query is retried in the usual way below.
+			 */
+			if (parallel && parallel_send_and_wait(frontend, backend, query_context))
+				return POOL_CONTINUE;
+
 			/* Send the query to master node */
 			pool_send_and_wait(query_context, 1, MASTER_NODE_ID);
 
@@ -788,47 +882,36 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 	{
 		POOL_STATUS status;
 		char	   *search_query = NULL;
-		int			len;
+		int			max_rows;
 
-#define STR_ALLOC_SIZE 1024
 		ereport(DEBUG1, (errmsg("Execute: pool_is_likely_select: true pool_is_writing_transaction: %d TSTATE: %c",
 								pool_is_writing_transaction(),
 								TSTATE(backend, MASTER_SLAVE ? PRIMARY_NODE_ID : REAL_MASTER_NODE_ID))));
 
-		len = strlen(query) + 1;
+		/* row limit follows the portal name */
+		memcpy(&max_rows, contents + strlen(contents) + 1, sizeof(max_rows));
+		max_rows = ntohl(max_rows);
+
 		search_query = MemoryContextStrdup(query_context->memory_context, query);
 
 		ereport(DEBUG1, (errmsg("Execute: checkig cache fetch condition")));
 
 		/*
-		 * Add bind message's info to query to search.
+		 * Add bind message's info to query to search.  The raw bytes of the
+		 * parameters and the result format codes in the bind message are
+		 * hashed, so that the search key stays small however large the
+		 * parameters are.
 		 */
 		if (query_context->is_cache_safe && bind_msg->param_offset && bind_msg->contents)
 		{
-			/* Extract binary contents from bind message */
-			char	   *query_in_bind_msg = bind_msg->contents + bind_msg->param_offset;
-			char		hex_str[4]; /* 02X chars + white space + null end */
-			int			i;
-			int			alloc_len;
-
-			alloc_len = (len / STR_ALLOC_SIZE + 1) * STR_ALLOC_SIZE;
-			search_query = repalloc(search_query, alloc_len);
-
-			for (i = 0; i < bind_msg->len - bind_msg->param_offset; i++)
-			{
-				int			hexlen;
-
-				snprintf(hex_str, sizeof(hex_str), (i == 0) ? " %02X" : "%02X", 0xff & query_in_bind_msg[i]);
-				hexlen = strlen(hex_str);
+			char		digest[POOL_MD5_HASHKEYLEN + 1];
 
-				if ((len + hexlen) >= alloc_len)
-				{
-					alloc_len += STR_ALLOC_SIZE;
-					search_query = repalloc(search_query, alloc_len);
-				}
-				strcat(search_query, hex_str);
-				len += hexlen;
-			}
+			pool_md5_hash(bind_msg->contents + bind_msg->param_offset,
+						  bind_msg->len - bind_msg->param_offset, digest);
+			pfree(search_query);
+			search_query = MemoryContextAlloc(query_context->memory_context,
+											  strlen(query) + sizeof(digest) + 32);
+			sprintf(search_query, "%s /* bind %s */", query, digest);
 
 			/*
 			 * If bind message is sent again to an existing prepared statement,
@@ -846,7 +929,7 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 			 * When a transaction is committed,
 			 * query_context->temp_cache->query is used to create md5 hash to
 			 * search for query cache. So overwrite the query text in temp
-			 * cache to the one with the hex of bind message. If not, md5 hash
+			 * cache to the one with the digest of bind message. If not, md5 hash
 			 * will be created by the query text without bind message, and it
 			 * will happen to find cache never or to get a wrong result.
 			 *
@@ -864,9 +947,14 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 
 		/*
 		 * If the query is SELECT from table to cache, try to fetch cached
-		 * result.
+		 * result.  Once the portal has been executed on backend by a
+		 * row-limited Execute, the rest of it must come from there.
 		 */
-		status = pool_fetch_from_memory_cache(frontend, backend, search_query, &foundp);
+		if (bind_msg->is_executed)
+			status = POOL_CONTINUE;
+		else
+			status = pool_fetch_portal_from_memory_cache(frontend, backend, &bind_msg->portal_cache,
+														 search_query, max_rows, &foundp);
 
 		if (status != POOL_CONTINUE)
 			return status;
@@ -895,6 +983,9 @@ Execute(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
 			query_context->skip_cache_commit = false;
 	}
 
+	if (!foundp)
+		bind_msg->is_executed = true;
+
 	session_context->query_context = query_context;
 
 	/*
@@ -1972,6 +2063,30 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 		}
 	}
 
+	/*
+	 * If the transaction has ended, forget its timestamp.  If DDL was
+	 * executed in it, invalidate relation caches again since other processes
+	 * could have registered the old definitions until it was committed.
+	 * Likewise other processes could have pre-allocated values of sequences
+	 * before they were reset.
+	 */
+	if (state != 'T')
+	{
+		pool_unset_transaction_timestamp();
+
+		if (state != 'E' && session_context->ddl_in_transaction)
+		{
+			pool_relcache_invalidate();
+			session_context->ddl_in_transaction = false;
+		}
+
+		if (state != 'E' && session_context->sequence_reset_in_transaction)
+		{
+			pool_sequence_invalidate(backend);
+			session_context->sequence_reset_in_transaction = false;
+		}
+	}
+
 	if (send_ready)
 	{
 		pool_write(frontend, "Z", 1);
@@ -1985,6 +2100,9 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 			pool_write(frontend, &state, 1);
 		}
 		pool_flush(frontend);
+
+		/* the request from frontend is complete */
+		stat_end_request();
 	}
 
 	if (pool_is_query_in_progress())
@@ -2055,6 +2173,13 @@ ReadyForQuery(POOL_CONNECTION * frontend,
 
 		pool_unset_query_in_progress();
 	}
+
+	/*
+	 * If the query failed, its result has not been cached.  Let processes
+	 * waiting for it go.
+	 */
+	pool_release_in_flight();
+
 	if (!pool_is_doing_extended_query_message())
 	{
 		if (!(node && IsA(node, PrepareStmt)))
@@ -2432,6 +2557,9 @@ ProcessFrontendResponse(POOL_CONNECTION * frontend,
 
 	pool_read(frontend, &fkind, 1);
 
+	/* start timing the request if this is its first message */
+	stat_start_request();
+
 	ereport(DEBUG5,
 			(errmsg("processing frontend response"),
 			 errdetail("received kind '%c'(%02x) from frontend", fkind, fkind)));
@@ -2999,6 +3127,93 @@ CopyOutResponse(POOL_CONNECTION * frontend,
 	return status;
 }
 
+/*
+ * Relay CopyData messages from src to each of dst.  Instead of forwarding
+ * one message at a time, data is read in blocks of up to COPY_RELAY_BUFSZ
+ * bytes spanning many messages, and each block is written to each
+ * connection in dst with one write.  Only the message boundaries are
+ * looked at.  Relaying stops at the first message other than CopyData,
+ * which is put back to src so that the caller processes it as usual.  If
+ * ndst is 0, the messages are discarded.  Returns the number of CopyData
+ * messages relayed.
+ */
+static int
+relay_copy_data(POOL_CONNECTION * src, POOL_CONNECTION * *dst, int ndst)
+{
+	char	   *buf;
+	int			buflen = 0;		/* bytes in buf */
+	int			pos = 0;		/* end of the data to be relayed */
+	int			remaining = 0;	/* bytes of the current message after pos */
+	int			count = 0;
+	bool		done = false;
+	int			i;
+
+	buf = palloc(COPY_RELAY_BUFSZ);
+
+	for (;;)
+	{
+		/* skip over the CopyData messages in the buffer */
+		while (pos < buflen)
+		{
+			int			len;
+
+			if (remaining > 0)
+			{
+				int			n = Min(remaining, buflen - pos);
+
+				pos += n;
+				remaining -= n;
+				continue;
+			}
+
+			/* at a message boundary */
+			if (buf[pos] != 'd')
+			{
+				done = true;
+				break;
+			}
+			if (buflen - pos < 1 + sizeof(len))
+				break;
+
+			memcpy(&len, buf + pos + 1, sizeof(len));
+			len = ntohl(len);
+			if (len < (int) sizeof(len))
+				ereport(ERROR,
+						(errmsg("unable to copy data rows"),
+						 errdetail("invalid CopyData message length:%d", len)));
+
+			remaining = 1 + len;
+			count++;
+		}
+
+		if (pos > 0)
+		{
+			for (i = 0; i < ndst; i++)
+			{
+				pool_write(dst[i], buf, pos);
+				pool_flush(dst[i]);
+			}
+		}
+
+		/* keep a message header which is not complete yet */
+		buflen -= pos;
+		if (buflen > 0)
+			memmove(buf, buf + pos, buflen);
+		pos = 0;
+
+		if (done)
+			break;
+
+		buflen += pool_read_some(src, buf + buflen, COPY_RELAY_BUFSZ - buflen);
+	}
+
+	/* put back the message which is not CopyData */
+	pool_unread(src, buf, buflen);
+	pfree(buf);
+
+	return count;
+}
+
 POOL_STATUS
 CopyDataRows(POOL_CONNECTION * frontend,
 			 POOL_CONNECTION_POOL * backend, int copyin)
@@ -3007,6 +3222,8 @@ CopyDataRows(POOL_CONNECTION * frontend,
 	int			len;
 	int			i;
 	int			copy_count;
+	POOL_CONNECTION *dst[MAX_NUM_BACKENDS];
+	int			ndst;
 
 #ifdef DEBUG
 	int			j = 0;
@@ -3023,6 +3240,15 @@ CopyDataRows(POOL_CONNECTION * frontend,
 				char		kind;
 				char	   *contents = NULL;
 
+				/* relay CopyData messages to the backends in bulk */
+				ndst = 0;
+				for (i = 0; i < NUM_BACKENDS; i++)
+				{
+					if (VALID_BACKEND(i))
+						dst[ndst++] = CONNECTION(backend, i);
+				}
+				copy_count += relay_copy_data(frontend, dst, ndst);
+
 				pool_read(frontend, &kind, 1);
 
 				ereport(DEBUG5,
@@ -3070,6 +3296,18 @@ CopyDataRows(POOL_CONNECTION * frontend,
 			{
 				signed char kind;
 
+				/*
+				 * Relay CopyData messages from the master node to the
+				 * frontend in bulk, and discard those from other nodes.
+				 */
+				dst[0] = frontend;
+				relay_copy_data(MASTER(backend), dst, 1);
+				for (i = 0; i < NUM_BACKENDS; i++)
+				{
+					if (VALID_BACKEND(i) && !IS_MASTER_NODE_ID(i))
+						relay_copy_data(CONNECTION(backend, i), NULL, 0);
+				}
+
 				kind = pool_read_kind(backend);
 
 				SimpleForwardToFrontend(kind, frontend, backend);
@@ -3331,6 +3569,122 @@ generate_error_message(char *prefix, int specific_error, char *query)
 	free_string(msg);
 }
 
+/*
+ * Check if a write query may be sent to all DB nodes at once in native
+ * replication mode rather than to the master node first.  Queries which
+ * need insert_lock must go to the master node first, because it is the
+ * lock acquired on the master node which serializes the assignment of
+ * SERIAL values.  lock_timeout needs PostgreSQL 9.3 or later.
+ */
+static bool
+is_parallel_execution_allowed(POOL_CONNECTION_POOL * backend, int lock_kind)
+{
+	if (!pool_config->replication_parallel_execution || !REPLICATION)
+		return false;
+
+	if (MAJOR(backend) != PROTO_MAJOR_V3)
+		return false;
+
+	if (lock_kind)
+		return false;
+
+	if (Pgversion(backend)->major < 93)
+		return false;
+
+	return true;
+}
+
+/*
+ * Send the query to all DB nodes at once and wait for the responses.
+ *
+ * Without the master node first ordering, two sessions updating the same
+ * rows may each acquire the row lock on a different node first and then
+ * wait for each other forever: PostgreSQL cannot detect such a deadlock
+ * since each node only sees half of it.  The internal transaction has
+ * been started with lock_timeout to break such lock waits.  If any node
+ * reports a lock timeout or a deadlock, the responses are discarded, the
+ * internal transaction is rolled back on all nodes and a new one is
+ * started.  Returns false in this case, and the caller must execute the
+ * query master node first as usual.
+ */
+static bool
+parallel_send_and_wait(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+					   POOL_QUERY_CONTEXT * query_context)
+{
+	bool		lock_failed = false;
+	int			i;
+
+	pool_send_and_wait(query_context, 0, 0);
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
+		if (detect_lock_not_available_error(CONNECTION(backend, i), MAJOR(backend)) == SPECIFIED_ERROR ||
+			detect_deadlock_error(CONNECTION(backend, i), MAJOR(backend)) == SPECIFIED_ERROR)
+		{
+			lock_failed = true;
+			break;
+		}
+	}
+
+	if (!lock_failed)
+		return true;
+
+	ereport(LOG,
+			(errmsg("lock wait timed out while executing query on all nodes at once"),
+			 errdetail("retrying the query on master node first. query: \"%s\"",
+					   query_context->original_query)));
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
+		discard_query_response(CONNECTION(backend, i));
+
+		per_node_statement_log(backend, i, "ROLLBACK");
+		if (do_command(frontend, CONNECTION(backend, i), "ROLLBACK", MAJOR(backend),
+					   MASTER_CONNECTION(backend)->pid, MASTER_CONNECTION(backend)->key, 0) != POOL_CONTINUE)
+			ereport(ERROR,
+					(errmsg("unable to roll back the internal transaction"),
+					 errdetail("do_command returned DEADLOCK status")));
+
+		INTERNAL_TRANSACTION_STARTED(backend, i) = false;
+	}
+
+	start_internal_transaction(frontend, backend, query_context->parse_tree);
+
+	return false;
+}
+
+/*
+ * Read and discard the response to a simple query up to and including
+ * ReadyForQuery (V3 only).
+ */
+static void
+discard_query_response(POOL_CONNECTION * cp)
+{
+	char		kind;
+	int			len;
+	char	   *p;
+
+	for (;;)
+	{
+		pool_read(cp, &kind, sizeof(kind));
+		pool_read(cp, &len, sizeof(len));
+		len = ntohl(len) - sizeof(len);
+		p = pool_read2(cp, len);
+
+		if (kind == 'Z')
+		{
+			cp->tstate = *p;
+			break;
+		}
+	}
+}
+
 /*
  * Make per DB node statement log
  */
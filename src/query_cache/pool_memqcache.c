@@ -31,16 +31,22 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <arpa/inet.h>
 #include <dirent.h>
+#include <sys/mman.h>
 
 #ifdef USE_MEMCACHED
 #include <libmemcached/memcached.h>
 #endif
 
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
 #include "auth/md5.h"
 #include "pool_config.h"
 #include "protocol/pool_proto_modules.h"
@@ -54,20 +60,185 @@
 #include "utils/elog.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
+#include "utils/pool_atomics.h"
+#include "utils/pool_lwlock.h"
+
+/*
+ * Circuit breaker of a memcached server, shared by all processes.  While
+ * open_until (seconds since the epoch) is in the future, the server is
+ * considered down and cache lookups for keys it owns simply miss instead
+ * of waiting for the server.
+ */
+typedef struct
+{
+	volatile uint32 open_until; /* 0 if the server is up */
+	volatile uint32 needs_flush;	/* deletes may have been lost */
+}			POOL_MEMCACHED_BREAKER;
+
+static POOL_MEMCACHED_BREAKER * memcached_breakers = NULL;
+
+/*
+ * Single-flight of cache misses.  The first process which misses a cache
+ * entry marks its key in flight in shared memory while it runs the query
+ * on backend.  The other processes which miss the same entry wait for the
+ * result to be registered instead of running the same query at once.
+ */
+#define IN_FLIGHT_SLOTS 1024
+#define IN_FLIGHT_PROBES 8
+#define IN_FLIGHT_POLL_INTERVAL 10	/* milliseconds */
+
+/*
+ * A mark is the hash of the cache key in the upper 32 bits and the time
+ * after which the mark is void in the lower 32 bits, in milliseconds since
+ * the epoch modulo 2^32.  Both are set by one atomic operation, so that a
+ * mark is never seen with the deadline of a former one.  0 is a free slot.
+ */
+typedef struct
+{
+	volatile uint64 mark;
+}			POOL_IN_FLIGHT;
+
+#define IN_FLIGHT_MARK(key, deadline)	(((uint64) (key) << 32) | (uint32) (deadline))
+#define IN_FLIGHT_KEY(mark)			((uint32) ((mark) >> 32))
+#define IN_FLIGHT_LIVE(mark, now)	((int32) ((uint32) (mark) - (uint32) (now)) > 0)
+#define IN_FLIGHT_MAX_LIFETIME	0x7fffffff	/* milliseconds */
+
+static POOL_IN_FLIGHT * in_flight = NULL;
+static int	my_in_flight = -1;	/* slot marked by this process, or -1 */
+static uint64 my_in_flight_mark;
+
+/*
+ * ParameterStatus messages which backend sent at connection start, saved
+ * for each startup packet so that sessions with the same startup packet
+ * can be started without connecting to backend when
+ * memqcache_lazy_backend_connection is on.  A slot is overwritten by
+ * another startup packet hashed to it.  seq is odd while the slot is
+ * being written.
+ */
+#define STARTUP_PARAMS_SLOTS 128
+#define STARTUP_PARAMS_SIZE 1024
+
+typedef struct
+{
+	volatile uint32 seq;
+	char		key[MAX_KEY];	/* md5 hash of the startup packet */
+	int			auth_kind;		/* authentication method of backend */
+	int			len;			/* length of params */
+	char		params[STARTUP_PARAMS_SIZE];
+}			POOL_STARTUP_PARAMS;
+
+static POOL_STARTUP_PARAMS * startup_params = NULL;
+
+/*
+ * Frequency sketch for cache admission.  This is a count-min sketch of
+ * the number of cache misses of each query.  It is halved every
+ * ADMISSION_SKETCH_SAMPLE misses so that it follows recent frequency
+ * like TinyLFU does, and one-off queries do not evict frequent ones.
+ */
+#define ADMISSION_SKETCH_DEPTH 4
+#define ADMISSION_SKETCH_WIDTH 4096
+#define ADMISSION_SKETCH_SAMPLE (ADMISSION_SKETCH_WIDTH * 8)
+
+typedef struct
+{
+	volatile uint32 misses;		/* number of misses since the last halving */
+	volatile uint32 counters[ADMISSION_SKETCH_DEPTH][ADMISSION_SKETCH_WIDTH];
+}			POOL_ADMISSION_SKETCH;
+
+static POOL_ADMISSION_SKETCH * admission_sketch = NULL;
+
+/*
+ * Cache rules compiled from memqcache_expire_table_list and
+ * memqcache_expire_query_list.  Rules are numbered from 1 in the order of
+ * the table list then the query list.  They are compiled again when the
+ * lists are changed by reloading the configuration.
+ *
+ * The stats of a rule are counted in a stats slot, found by the kind and
+ * the pattern of the rule (see cache_rule_slot()), so that the stats stay
+ * with the rule when a reload reorders the rules or changes the cache
+ * expiration.  Cached items remember the slot rather than the rule number
+ * for the same reason.
+ */
+typedef struct
+{
+	char	   *rule;			/* the rule as written in the list */
+	bool		is_query;		/* matches query text rather than tables */
+	int			expire;			/* cache expiration in seconds */
+	int			slot;			/* stats slot, -1 if none */
+	regex_t		regexv;
+}			POOL_CACHE_RULE;
+
+static POOL_CACHE_RULE cache_rules[MAX_CACHE_RULES + 1];
+static int	num_cache_rules = 0;
+
+/* Stats slot of the item last fetched from the cache storage */
+static int	fetched_cache_rule_slot = 0;
 
 #ifdef USE_MEMCACHED
-memcached_st *memc;
+/*
+ * A memcached server listed in memqcache_memcached_host and the connection
+ * of this process to it.
+ */
+typedef struct
+{
+	char		host[MAX_DB_HOST_NAMELEN];
+	int			port;
+	memcached_st *memc;			/* NULL if the server could not be set up */
+}			POOL_MEMCACHED_SERVER;
+
+/*
+ * A point on the consistent hashing ring.  A key belongs to the server of
+ * the first point whose hash is not less than the hash of the key.
+ */
+typedef struct
+{
+	uint32		hash;
+	int			server;
+}			POOL_MEMCACHED_POINT;
+
+static POOL_MEMCACHED_SERVER memcached_servers[MAX_MEMCACHED_SERVERS];
+static int	num_memcached_servers = 0;
+static POOL_MEMCACHED_POINT memcached_ring[MAX_MEMCACHED_SERVERS * MEMCACHED_POINTS_PER_SERVER];
+static int	memcached_ring_size = 0;
 #endif
 
 static char *encode_key(const char *s, char *buf, POOL_CONNECTION_POOL * backend);
 #ifdef DEBUG
 static void dump_cache_data(const char *data, size_t len);
 #endif
-static int	pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids);
+static int	pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids, int rule);
+static int	pool_fetch_cache_stale(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len, bool *stale);
+static uint64 in_flight_now(void);
+static uint32 in_flight_key(POOL_CONNECTION_POOL * backend, const char *query);
+static bool in_flight_marked(uint32 key);
+static bool pool_claim_in_flight(POOL_CONNECTION_POOL * backend, const char *query);
+static bool pool_wait_in_flight(POOL_CONNECTION_POOL * backend, char *contents, char **qcache, size_t *qcachelen);
+static bool pool_search_memory_cache(POOL_CONNECTION_POOL * backend, char *contents, char **qcache, size_t *qcachelen);
+static POOL_STARTUP_PARAMS * startup_params_slot(StartupPacket *sp, char *key);
+static void admission_sketch_hashes(const char *key, uint32 *hashes);
+static void pool_count_cache_miss(POOL_CONNECTION_POOL * backend, const char *query);
+static bool pool_admit_cache(const char *key);
+static bool cache_rules_changed(void);
+static void pool_compile_cache_rules(void);
+static int	pool_get_cache_rule(const char *query, int num_tables, char (*table_names)[POOL_NAMEDATALEN]);
+static int	pool_get_cache_rule_expire(int rule);
+static int	pool_get_cache_rule_slot(int rule);
+static int	cache_rule_slot(bool is_query, const char *pattern);
+static void pool_stats_count_up_cache_rule(int slot, bool admitted);
+static char *pool_compress_cache_data(char *data, size_t *len);
+static char *pool_decompress_cache_data(const char *data, size_t *len);
 static int	send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen);
+static bool pool_lookup_memory_cache(POOL_CONNECTION_POOL * backend, char *contents, char **qcache, size_t *qcachelen, bool *stale);
+static POOL_STATUS pool_send_cached_result(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend, char *qcache, size_t qcachelen, char *contents);
+static char *pool_get_cached_portal_chunk(POOL_PORTAL_CACHE * portal, int max_rows, size_t *len);
 static void send_message(POOL_CONNECTION * conn, char kind, int len, const char *data);
 #ifdef USE_MEMCACHED
-static int	delete_cache_on_memcached(const char *key);
+static void delete_cache_on_memcached(const char *keys, int nkeys);
+static uint32 memcached_hash(const char *hexkey);
+static int	memcached_point_cmp(const void *p1, const void *p2);
+static int	memcached_key_server(const char *key);
+static memcached_st * memcached_server_connection(int server);
+static void memcached_server_failed(int server, bool lost_deletes);
 #endif
 static int	pool_get_dml_table_oid(int **oid);
 static int	pool_get_dropdb_table_oids(int **oids, int dboid);
@@ -76,9 +247,9 @@ static void pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool
 static int	pool_get_database_oid(void);
 static void pool_add_table_oid_map(POOL_CACHEKEY * cachkey, int num_table_oids, int *table_oids);
 static void pool_reset_memqcache_buffer(bool reset_dml_oids);
-static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, time_t expire);
-static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash);
-static char *pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts);
+static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, time_t expire, int rule_slot);
+static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash, bool *stale);
+static char *pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts, bool *stale);
 static POOL_QUERY_CACHE_ARRAY * pool_add_query_cache_array(POOL_QUERY_CACHE_ARRAY * cache_array, POOL_TEMP_QUERY_CACHE * cache);
 static void pool_add_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, char kind, char *data, int data_len);
 static void pool_add_oids_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, int num_oids, int *oids);
@@ -95,6 +266,9 @@ static void pool_check_and_discard_cache_buffer(int num_oids, int *oids);
 
 static void pool_set_memqcache_blocks(int num_blocks);
 static int	pool_get_memqcache_blocks(void);
+static int	pool_get_memqcache_active_blocks(void);
+static int	pool_memqcache_blocks_for_size(int64 size);
+static void pool_release_cache_blocks(int from, int to);
 static void *pool_memory_cache_address(void);
 static void pool_reset_fsmm(size_t size);
 static void *pool_fsmm_address(void);
@@ -114,7 +288,7 @@ static POOL_CACHE_BLOCKID pool_reuse_block(void);
 static void dump_shmem_cache(POOL_CACHE_BLOCKID blockid);
 #endif
 
-static int	pool_hash_reset(int nelements);
+static int	pool_hash_reset(void);
 static int	pool_hash_insert(POOL_QUERY_HASH * key, POOL_CACHEID * cacheid, bool update);
 static uint32 create_hash_key(POOL_QUERY_HASH * key);
 static volatile POOL_HASH_ELEMENT *get_new_hash_element(void);
@@ -126,48 +300,133 @@ static void inject_cached_message(POOL_CONNECTION * backend, char *qcache, int q
  * if true, shared memory is locked in this process now.
  */
 static int is_shmem_locked;
+static POOL_MEMQ_LOCK_TYPE shmem_lock_type;
 
 /*
- * Connect to Memcached
+ * Connect to Memcached.  memqcache_memcached_host is a comma separated
+ * list of "host[:port]"; memqcache_memcached_port is used for servers
+ * listed without a port.  Keys are distributed over the servers by
+ * consistent hashing, so adding or removing a server only moves the keys
+ * of that server.
  */
 int
 memcached_connect(void)
 {
-	char	   *memqcache_memcached_host;
-	int			memqcache_memcached_port;
 #ifdef USE_MEMCACHED
-	memcached_server_st *servers;
-	memcached_return rc;
+	char	   *hosts;
+	char	   *tok;
+	char	   *saveptr;
+	int			i;
+	int			j;
 
 	/* Already connected? */
-	if (memc)
+	if (num_memcached_servers > 0)
 	{
 		return 0;
 	}
-#endif
 
-	memqcache_memcached_host = pool_config->memqcache_memcached_host;
-	memqcache_memcached_port = pool_config->memqcache_memcached_port;
+	hosts = pstrdup(pool_config->memqcache_memcached_host);
 
-	ereport(DEBUG1,
-			(errmsg("connecting to memcached on Host:\"%s:%d\"", memqcache_memcached_host, memqcache_memcached_port)));
+	for (tok = strtok_r(hosts, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr))
+	{
+		POOL_MEMCACHED_SERVER *server;
+		char	   *p;
+		memcached_return rc;
 
-#ifdef USE_MEMCACHED
-	memc = memcached_create(NULL);
-	servers = memcached_server_list_append(NULL,
-										   memqcache_memcached_host,
-										   memqcache_memcached_port,
-										   &rc);
+		while (isspace((unsigned char) *tok))
+			tok++;
+		p = tok + strlen(tok);
+		while (p > tok && isspace((unsigned char) p[-1]))
+			*--p = '\0';
+		if (*tok == '\0')
+			continue;
+
+		if (num_memcached_servers >= MAX_MEMCACHED_SERVERS)
+		{
+			ereport(WARNING,
+					(errmsg("too many memcached servers in memqcache_memcached_host"),
+					 errdetail("only the first %d servers are used", MAX_MEMCACHED_SERVERS)));
+			break;
+		}
+
+		server = &memcached_servers[num_memcached_servers++];
+		server->port = pool_config->memqcache_memcached_port;
+
+		/* a trailing ":port" unless the host is an IPv6 address */
+		p = strrchr(tok, ':');
+		if (p != NULL && p == strchr(tok, ':') && p[1] != '\0' &&
+			strspn(p + 1, "0123456789") == strlen(p + 1))
+		{
+			*p = '\0';
+			server->port = atoi(p + 1);
+		}
+		strlcpy(server->host, tok, sizeof(server->host));
+
+		ereport(DEBUG1,
+				(errmsg("connecting to memcached on Host:\"%s:%d\"", server->host, server->port)));
+
+		server->memc = memcached_create(NULL);
+		if (server->memc == NULL)
+		{
+			ereport(WARNING,
+					(errmsg("failed to connect to memcached on \"%s:%d\", could not create memcached handle",
+							server->host, server->port)));
+			continue;
+		}
+
+		/*
+		 * Do not let a server which is down block us longer than
+		 * memqcache_memcached_timeout.  The connect timeout is only
+		 * effective in non-blocking mode.
+		 */
+		memcached_behavior_set(server->memc, MEMCACHED_BEHAVIOR_NO_BLOCK, 1);
+		memcached_behavior_set(server->memc, MEMCACHED_BEHAVIOR_TCP_NODELAY, 1);
+		memcached_behavior_set(server->memc, MEMCACHED_BEHAVIOR_CONNECT_TIMEOUT,
+							   pool_config->memqcache_memcached_timeout);
+		memcached_behavior_set(server->memc, MEMCACHED_BEHAVIOR_POLL_TIMEOUT,
+							   pool_config->memqcache_memcached_timeout);
+
+		rc = memcached_server_add(server->memc, server->host, server->port);
+		if (rc != MEMCACHED_SUCCESS)
+		{
+			ereport(WARNING,
+					(errmsg("failed to connect to memcached on \"%s:%d\", server add error:\"%s\"",
+							server->host, server->port, memcached_strerror(server->memc, rc))));
+			memcached_free(server->memc);
+			server->memc = NULL;
+		}
+	}
+	pfree(hosts);
 
-	rc = memcached_server_push(memc, servers);
-	if (rc != MEMCACHED_SUCCESS)
+	if (num_memcached_servers == 0)
 	{
 		ereport(WARNING,
-				(errmsg("failed to connect to memcached, server push error:\"%s\"\n", memcached_strerror(memc, rc))));
-		memc = (memcached_st *) - 1;
+				(errmsg("failed to connect to memcached, no server is specified in memqcache_memcached_host")));
 		return -1;
 	}
-	memcached_server_list_free(servers);
+
+	/*
+	 * Build the consistent hashing ring.  A server which could not be set up
+	 * keeps its points, so that every process maps keys to servers in the
+	 * same way; its keys just miss.
+	 */
+	memcached_ring_size = 0;
+	for (i = 0; i < num_memcached_servers; i++)
+	{
+		for (j = 0; j < MEMCACHED_POINTS_PER_SERVER; j++)
+		{
+			char		point[MAX_DB_HOST_NAMELEN + 32];
+			char		hexkey[POOL_MD5_HASHKEYLEN + 1];
+
+			snprintf(point, sizeof(point), "%s:%d-%d",
+					 memcached_servers[i].host, memcached_servers[i].port, j);
+			pool_md5_hash(point, strlen(point), hexkey);
+			memcached_ring[memcached_ring_size].hash = memcached_hash(hexkey);
+			memcached_ring[memcached_ring_size].server = i;
+			memcached_ring_size++;
+		}
+	}
+	qsort(memcached_ring, memcached_ring_size, sizeof(POOL_MEMCACHED_POINT), memcached_point_cmp);
 #else
 	ereport(WARNING,
 			(errmsg("failed to connect to memcached, memcached support is not enabled")));
@@ -183,17 +442,192 @@ void
 memcached_disconnect(void)
 {
 #ifdef USE_MEMCACHED
-	if (!memc)
+	int			i;
+
+	for (i = 0; i < num_memcached_servers; i++)
 	{
-		return;
+		if (memcached_servers[i].memc)
+			memcached_free(memcached_servers[i].memc);
+		memcached_servers[i].memc = NULL;
 	}
-	memcached_free(memc);
+	num_memcached_servers = 0;
+	memcached_ring_size = 0;
 #else
 	ereport(WARNING,
 			(errmsg("failed to disconnect from memcached, memcached support is not enabled")));
 #endif
 }
 
+/*
+ * Shared memory area for the circuit breakers of memcached servers.
+ */
+size_t
+pool_memcached_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(POOL_MEMCACHED_BREAKER) * MAX_MEMCACHED_SERVERS);
+}
+
+void
+pool_memcached_init(void *addr)
+{
+	memcached_breakers = (POOL_MEMCACHED_BREAKER *) addr;
+	memset(memcached_breakers, 0, sizeof(POOL_MEMCACHED_BREAKER) * MAX_MEMCACHED_SERVERS);
+}
+
+#ifdef USE_MEMCACHED
+/*
+ * Hash value of a hex string such as a cache key: its first 8 digits.
+ */
+static uint32
+memcached_hash(const char *hexkey)
+{
+	uint32		hash = 0;
+	int			i;
+
+	for (i = 0; i < 8 && hexkey[i]; i++)
+	{
+		char		c = hexkey[i];
+
+		hash <<= 4;
+		if (c >= '0' && c <= '9')
+			hash |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			hash |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			hash |= c - 'A' + 10;
+	}
+	return hash;
+}
+
+static int
+memcached_point_cmp(const void *p1, const void *p2)
+{
+	uint32		h1 = ((POOL_MEMCACHED_POINT *) p1)->hash;
+	uint32		h2 = ((POOL_MEMCACHED_POINT *) p2)->hash;
+
+	if (h1 < h2)
+		return -1;
+	if (h1 > h2)
+		return 1;
+	return 0;
+}
+
+/*
+ * Return the index of the memcached server which owns the key.
+ */
+static int
+memcached_key_server(const char *key)
+{
+	uint32		hash = memcached_hash(key);
+	int			lo = 0;
+	int			hi = memcached_ring_size;
+
+	while (lo < hi)
+	{
+		int			mid = (lo + hi) / 2;
+
+		if (memcached_ring[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == memcached_ring_size)
+		lo = 0;
+	return memcached_ring[lo].server;
+}
+
+/*
+ * Return the connection to the memcached server, or NULL if its circuit
+ * breaker is open.  Once memqcache_memcached_retry_timeout has passed, one
+ * process is let through to try the server again.  If deletes were lost
+ * while the server was down, the server is flushed first so that no stale
+ * cache entry is returned from it.
+ */
+static memcached_st *
+memcached_server_connection(int server)
+{
+	POOL_MEMCACHED_BREAKER *breaker;
+	memcached_st *memc = memcached_servers[server].memc;
+	uint32		open_until;
+	uint32		now;
+
+	if (memc == NULL || memcached_breakers == NULL)
+		return memc;
+
+	breaker = &memcached_breakers[server];
+	open_until = pool_atomic_read_u32(&breaker->open_until);
+	if (open_until == 0)
+		return memc;
+
+	now = (uint32) time(NULL);
+	if (now < open_until)
+		return NULL;
+
+	/* hold off the other processes while we try the server */
+	if (!pool_atomic_compare_exchange_u32(&breaker->open_until, &open_until,
+										  now + pool_config->memqcache_memcached_retry_timeout))
+		return NULL;
+
+	for (;;)
+	{
+		while (pool_atomic_read_u32(&breaker->needs_flush))
+		{
+			memcached_return rc;
+
+			pool_atomic_write_u32(&breaker->needs_flush, 0);
+			rc = memcached_flush(memc, 0);
+			if (rc != MEMCACHED_SUCCESS)
+			{
+				ereport(LOG,
+						(errmsg("failed to flush memcached on \"%s:%d\", error:\"%s\"",
+								memcached_servers[server].host, memcached_servers[server].port,
+								memcached_strerror(memc, rc))));
+				memcached_server_failed(server, true);
+				return NULL;
+			}
+		}
+		pool_atomic_write_u32(&breaker->open_until, 0);
+
+		/* a delete may have been skipped just before we closed the breaker */
+		if (!pool_atomic_read_u32(&breaker->needs_flush))
+			break;
+	}
+
+	ereport(LOG,
+			(errmsg("memcached on \"%s:%d\" is available again",
+					memcached_servers[server].host, memcached_servers[server].port)));
+	return memc;
+}
+
+/*
+ * Open the circuit breaker of a memcached server after an error, so that
+ * nobody waits for the server until memqcache_memcached_retry_timeout has
+ * passed.  If lost_deletes is true, the server is flushed before it is
+ * used again.
+ */
+static void
+memcached_server_failed(int server, bool lost_deletes)
+{
+	POOL_MEMCACHED_BREAKER *breaker;
+
+	if (memcached_breakers == NULL)
+		return;
+
+	breaker = &memcached_breakers[server];
+	if (lost_deletes)
+		pool_atomic_write_u32(&breaker->needs_flush, 1);
+
+	if (pool_atomic_read_u32(&breaker->open_until) == 0)
+		ereport(LOG,
+				(errmsg("memcached on \"%s:%d\" is considered down for %d seconds",
+						memcached_servers[server].host, memcached_servers[server].port,
+						pool_config->memqcache_memcached_retry_timeout)));
+
+	pool_atomic_write_u32(&breaker->open_until,
+						  (uint32) time(NULL) + pool_config->memqcache_memcached_retry_timeout);
+}
+#endif
+
 /*
  * Register buffer data for query cache in memory cache
  */
@@ -207,6 +641,16 @@ memqcache_register(char kind,
 	POOL_SESSION_CONTEXT *session_context;
 	POOL_QUERY_CONTEXT *query_context;
 
+	/*
+	 * PortalSuspended means that a row-limited Execute did not fetch the
+	 * whole result.  Don't cache the partial result.
+	 */
+	if (kind == 's')
+	{
+		pool_set_cache_exceeded();
+		return;
+	}
+
 	cache = pool_get_current_cache();
 
 	if (cache == NULL)
@@ -231,7 +675,7 @@ memqcache_register(char kind,
  * Commit SELECT results to cache storage.
  */
 static int
-pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids)
+pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_t datalen, int num_oids, int *oids, int rule)
 {
 #ifdef USE_MEMCACHED
 	memcached_return rc;
@@ -239,6 +683,7 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 	POOL_CACHEKEY cachekey;
 	char		tmpkey[MAX_KEY];
 	time_t		memqcache_expire;
+	char	   *rawdata = data;
 
 	/*
 	 * get_buflen() will return -1 if query result exceeds memqcache_maxcache
@@ -260,16 +705,29 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 	dump_cache_data(data, datalen);
 #endif
 
-
 	/* encode md5key for memcached */
 	encode_key(query, tmpkey, backend);
 	ereport(DEBUG2,
 			(errmsg("commiting SELECT results to cache storage"),
 			 errdetail("search key : \"%s\"", tmpkey)));
 
+	/* Has the query missed the cache often enough to be cached? */
+	if (!pool_admit_cache(tmpkey))
+	{
+		ereport(DEBUG1,
+				(errmsg("commiting SELECT results to cache storage"),
+				 errdetail("not admitted by memqcache_admission_threshold")));
+		pool_stats_count_up_cache_rule(pool_get_cache_rule_slot(rule), false);
+		return 0;
+	}
+
+	data = pool_compress_cache_data(data, &datalen);
+	if (data == NULL)
+		return 0;
+
 	memcpy(cachekey.hashkey, tmpkey, 32);
 
-	memqcache_expire = pool_config->memqcache_expire;
+	memqcache_expire = pool_get_cache_rule_expire(rule);
 	ereport(DEBUG1,
 			(errmsg("commiting SELECT results to cache storage"),
 			 errdetail("memqcache_expire = %ld", memqcache_expire)));
@@ -281,7 +739,8 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 
 		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
-		cacheid = pool_hash_search(&query_hash);
+		/* An expired item is removed here and replaced by the new result */
+		cacheid = pool_find_item_on_shmem_cache(&query_hash, NULL);
 
 		if (cacheid != NULL)
 		{
@@ -289,11 +748,16 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 					(errmsg("commiting SELECT results to cache storage"),
 					 errdetail("item already exists")));
 
+			if (data != rawdata)
+				pfree(data);
 			return 0;
 		}
 		else
 		{
-			cacheid = pool_add_item_shmem_cache(&query_hash, data, datalen,memqcache_expire);
+			cacheid = pool_add_item_shmem_cache(&query_hash, data, datalen, memqcache_expire,
+												pool_get_cache_rule_slot(rule));
+			if (data != rawdata)
+				pfree(data);
 			if (cacheid == NULL)
 			{
 				ereport(LOG,
@@ -315,12 +779,30 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 #ifdef USE_MEMCACHED
 	else
 	{
+		int			server = memcached_key_server(tmpkey);
+		memcached_st *memc = memcached_server_connection(server);
+
+		if (memc == NULL)
+		{
+			if (data != rawdata)
+				pfree(data);
+			ereport(DEBUG1,
+					(errmsg("commiting SELECT results to cache storage"),
+					 errdetail("memcached server is down, skipped")));
+			return -1;
+		}
+
+		/* The stats slot of the cache rule is kept in the flags of the item */
 		rc = memcached_set(memc, tmpkey, 32,
-						   data, datalen, (time_t) memqcache_expire, 0);
+						   data, datalen, (time_t) memqcache_expire,
+						   (uint32_t) pool_get_cache_rule_slot(rule));
+		if (data != rawdata)
+			pfree(data);
 		if (rc != MEMCACHED_SUCCESS)
 		{
 			ereport(WARNING,
 					(errmsg("cache commit failed with error:\"%s\"", memcached_strerror(memc, rc))));
+			memcached_server_failed(server, false);
 			return -1;
 		}
 		ereport(DEBUG1,
@@ -329,6 +811,8 @@ pool_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *data, size_
 	}
 #endif
 
+	pool_stats_count_up_cache_rule(pool_get_cache_rule_slot(rule), true);
+
 /*
  * Register cache id to oid map
  */
@@ -391,7 +875,8 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 
 		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
-		cacheid = pool_hash_search(&query_hash);
+		/* An expired item is removed here and replaced by the new result */
+		cacheid = pool_find_item_on_shmem_cache(&query_hash, NULL);
 
 		if (cacheid != NULL)
 		{
@@ -403,7 +888,7 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 		}
 		else
 		{
-			cacheid = pool_add_item_shmem_cache(&query_hash, data, datalen, memqcache_expire);
+			cacheid = pool_add_item_shmem_cache(&query_hash, data, datalen, memqcache_expire, 0);
 			if (cacheid == NULL)
 			{
 				ereport(LOG,
@@ -425,12 +910,19 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
 #ifdef USE_MEMCACHED
 	else
 	{
+		int			server = memcached_key_server(tmpkey);
+		memcached_st *memc = memcached_server_connection(server);
+
+		if (memc == NULL)
+			return -1;
+
 		rc = memcached_set(memc, tmpkey, 32,
 						   data, datalen, (time_t) memqcache_expire, 0);
 		if (rc != MEMCACHED_SUCCESS)
 		{
 			ereport(WARNING,
 					(errmsg("cache commit failed with error:\"%s\"", memcached_strerror(memc, rc))));
+			memcached_server_failed(server, false);
 			return -1;
 		}
 		ereport(DEBUG1,
@@ -450,12 +942,26 @@ pool_catalog_commit_cache(POOL_CONNECTION_POOL * backend, char *query, char *dat
  */
 int
 pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len)
+{
+	return pool_fetch_cache_stale(backend, query, buf, len, NULL);
+}
+
+/*
+ * Same as pool_fetch_cache() but if stale is not NULL, an item expired
+ * less than memqcache_stale_grace seconds ago is fetched too and *stale
+ * is set to true.  Only the shared memory cache keeps expired items.
+ */
+static int
+pool_fetch_cache_stale(POOL_CONNECTION_POOL * backend, const char *query, char **buf, size_t *len, bool *stale)
 {
 	char	   *ptr;
 	char		tmpkey[MAX_KEY];
 	int			sts;
 	char	   *p;
 
+	if (stale)
+		*stale = false;
+
 	if (strlen(query) <= 0)
 		ereport(ERROR,
 				(errmsg("fetching from cache storage, no query")));
@@ -474,7 +980,8 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 
 		memcpy(query_hash.query_hash, tmpkey, sizeof(query_hash.query_hash));
 
-		ptr = pool_get_item_shmem_cache(&query_hash, &mylen, &sts);
+		ptr = pool_get_item_shmem_cache(&query_hash, &mylen, &sts,
+										pool_config->memqcache_stale_grace > 0 ? stale : NULL);
 		if (ptr == NULL)
 		{
 			ereport(DEBUG1,
@@ -484,12 +991,24 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 			return 1;
 		}
 		*len = mylen;
+		fetched_cache_rule_slot = ((POOL_CACHE_ITEM_HEADER *) (ptr - sizeof(POOL_CACHE_ITEM_HEADER)))->rule_slot;
 	}
 #ifdef USE_MEMCACHED
 	else
 	{
 		memcached_return rc;
 		unsigned int flags;
+		int			server = memcached_key_server(tmpkey);
+		memcached_st *memc = memcached_server_connection(server);
+
+		if (memc == NULL)
+		{
+			/* The server is down.  Behave as if cache not found */
+			ereport(DEBUG1,
+					(errmsg("fetching from cache storage"),
+					 errdetail("memcached server is down for key: \"%s\"", tmpkey)));
+			return 1;
+		}
 
 		ptr = memcached_get(memc, tmpkey, strlen(tmpkey), len, &flags, &rc);
 
@@ -501,9 +1020,10 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 						(errmsg("fetching from cache storage, memcached_get failed with error: \"%s\"", memcached_strerror(memc, rc))));
 
 				/*
-				 * Turn off memory cache support to prevent future errors.
+				 * Stop using the server for a while to prevent future
+				 * errors.
 				 */
-				pool_config->memory_cache_enabled = 0;
+				memcached_server_failed(server, false);
 				/* Behave as if cache not found */
 				return 1;
 			}
@@ -516,6 +1036,7 @@ pool_fetch_cache(POOL_CONNECTION_POOL * backend, const char *query, char **buf,
 				return 1;
 			}
 		}
+		fetched_cache_rule_slot = (int) flags;
 	}
 #else
 	else
@@ -571,154 +1092,1103 @@ encode_key(const char *s, char *buf, POOL_CONNECTION_POOL * backend)
 			(errmsg("memcache encode key"),
 			 errdetail("query: \"%s\"", s)));
 
-	length = u_length + d_length + q_length + 1;
+	length = u_length + d_length + q_length + 1;
+
+	strkey = (char *) palloc(sizeof(char) * length);
+
+	snprintf(strkey, length, "%s%s%s", backend->info->user, s, backend->info->database);
+
+	pool_md5_hash(strkey, strlen(strkey), buf);
+	ereport(DEBUG1,
+			(errmsg("memcache encode key"),
+			 errdetail("`%s' -> `%s'", strkey, buf)));
+	pfree(strkey);
+	return buf;
+}
+
+#ifdef DEBUG
+/*
+ * dump cache data
+ */
+static void
+dump_cache_data(const char *data, size_t len)
+{
+	int			i;
+	int			plen;
+
+
+	fprintf(stderr, "shmem: len = %zd\n", len);
+
+	while (len > 0)
+	{
+		fprintf(stderr, "shmem: kind:%c\n", *data++);
+		len--;
+		memmove(&plen, data, 4);
+		len -= 4;
+		data += 4;
+		plen = ntohl(plen);
+		fprintf(stderr, "shmem: len:%d\n", plen);
+		plen -= 4;
+
+		fprintf(stderr, "shmem: ");
+		for (i = 0; i < plen; i++)
+		{
+			fprintf(stderr, "%02x ", (unsigned char) (*data++));
+			len--;
+		}
+		fprintf(stderr, "\n");
+	}
+}
+#endif
+
+/*
+ * Compressed SELECT results start with this byte, which is never the kind
+ * of a protocol message, followed by the uncompressed length in network
+ * byte order and the compressed messages.
+ */
+#define POOL_CACHE_COMPRESSED_LZ4		'\0'
+#define POOL_CACHE_COMPRESSED_HDRSZ		(1 + sizeof(int32))
+
+/*
+ * Compress SELECT results to be committed if memqcache_compression is
+ * enabled and they are at least memqcache_compression_threshold bytes.
+ * Returns the data to be stored, which is either data itself or a palloc'd
+ * compressed copy, and sets *len to its length.  They are stored as is if
+ * compression does not make them smaller.  Returns NULL if the data to be
+ * stored exceeds memqcache_maxcache.
+ */
+static char *
+pool_compress_cache_data(char *data, size_t *len)
+{
+#ifdef USE_LZ4
+	if (pool_config->memqcache_compression == MEMQCACHE_COMPRESSION_LZ4 &&
+		*len >= pool_config->memqcache_compression_threshold)
+	{
+		int			bound = LZ4_compressBound(*len);
+		char	   *buf = palloc(POOL_CACHE_COMPRESSED_HDRSZ + bound);
+		int			clen;
+
+		clen = LZ4_compress_default(data, buf + POOL_CACHE_COMPRESSED_HDRSZ, *len, bound);
+		if (clen > 0 && POOL_CACHE_COMPRESSED_HDRSZ + clen < *len)
+		{
+			int32		rawlen = htonl(*len);
+
+			buf[0] = POOL_CACHE_COMPRESSED_LZ4;
+			memcpy(buf + 1, &rawlen, sizeof(rawlen));
+
+			ereport(DEBUG1,
+					(errmsg("commiting SELECT results to cache storage"),
+					 errdetail("compressed %zu bytes to %zu bytes",
+							   *len, POOL_CACHE_COMPRESSED_HDRSZ + clen)));
+
+			*len = POOL_CACHE_COMPRESSED_HDRSZ + clen;
+			data = buf;
+		}
+		else
+			pfree(buf);
+	}
+#endif
+
+	if (*len > pool_config->memqcache_maxcache)
+	{
+		ereport(DEBUG1,
+				(errmsg("commiting SELECT results to cache storage"),
+				 errdetail("data size %zu exceeds memqcache_maxcache %d",
+						   *len, pool_config->memqcache_maxcache)));
+		return NULL;
+	}
+
+	return data;
+}
+
+/*
+ * Decompress SELECT results fetched from cache storage if they are
+ * compressed.  Returns a palloc'd buffer and sets *len to its length, or
+ * returns data itself if it is not compressed.  Returns NULL if the data
+ * cannot be decompressed.
+ */
+static char *
+pool_decompress_cache_data(const char *data, size_t *len)
+{
+#ifdef USE_LZ4
+	int32		rawlen;
+	char	   *buf;
+#endif
+
+	if (*len == 0 || data[0] != POOL_CACHE_COMPRESSED_LZ4)
+		return (char *) data;
+
+#ifdef USE_LZ4
+	if (*len <= POOL_CACHE_COMPRESSED_HDRSZ)
+		return NULL;
+
+	memcpy(&rawlen, data + 1, sizeof(rawlen));
+	rawlen = ntohl(rawlen);
+	if (rawlen <= 0)
+		return NULL;
+
+	buf = palloc(rawlen);
+	if (LZ4_decompress_safe(data + POOL_CACHE_COMPRESSED_HDRSZ, buf,
+							*len - POOL_CACHE_COMPRESSED_HDRSZ, rawlen) != rawlen)
+	{
+		pfree(buf);
+		return NULL;
+	}
+
+	*len = rawlen;
+	return buf;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * send cached messages
+ */
+static int
+send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen)
+{
+	int			msg = 0;
+	int			i = 0;
+	int			is_prepared_stmt = 0;
+	int			len;
+	const char *p;
+
+	while (i < qcachelen)
+	{
+		char		tmpkind;
+		int			tmplen;
+
+		tmpkind = qcache[i];
+		i++;
+
+		memcpy(&tmplen, qcache + i, sizeof(tmplen));
+		i += sizeof(tmplen);
+		len = ntohl(tmplen);
+		p = qcache + i;
+		i += len - sizeof(tmplen);
+
+		/* No need to cache PARSE and BIND responses */
+		if (tmpkind == '1' || tmpkind == '2')
+		{
+			is_prepared_stmt = 1;
+			continue;
+		}
+
+		/*
+		 * In the prepared statement execution, there is no need to send 'T'
+		 * response to the frontend.
+		 */
+		if (is_prepared_stmt && tmpkind == 'T')
+		{
+			continue;
+		}
+
+		/* send message to frontend */
+		ereport(DEBUG1,
+				(errmsg("memcache: sending cached messages: '%c' len: %d", tmpkind, len)));
+		send_message(frontend, tmpkind, len, p);
+
+		msg++;
+	}
+
+	return msg;
+}
+
+/*
+ * send message to frontend
+ */
+static void
+send_message(POOL_CONNECTION * conn, char kind, int len, const char *data)
+{
+	ereport(DEBUG2,
+			(errmsg("memcache: sending messages: kind '%c', len=%d, data=%p", kind, len, data)));
+
+	pool_write(conn, &kind, 1);
+
+	len = htonl(len);
+	pool_write(conn, &len, sizeof(len));
+
+	len = ntohl(len);
+	pool_write(conn, (void *) data, len - sizeof(len));
+}
+
+#ifdef USE_MEMCACHED
+/*
+ * Delete query cache entries on memcached.  keys holds nkeys hash keys of
+ * 32 bytes each.  The keys are grouped by the server owning them and sent
+ * to each server in one pipeline without waiting for a reply per key.
+ * Deletes which could not be sent make the server be flushed when it comes
+ * back.
+ */
+static void
+delete_cache_on_memcached(const char *keys, int nkeys)
+{
+	int		   *owner;
+	int			server;
+	int			i;
+
+	if (nkeys <= 0)
+		return;
+
+	owner = palloc(sizeof(int) * nkeys);
+	for (i = 0; i < nkeys; i++)
+		owner[i] = memcached_key_server(keys + i * 32);
+
+	for (server = 0; server < num_memcached_servers; server++)
+	{
+		memcached_st *memc;
+		memcached_return rc = MEMCACHED_SUCCESS;
+		int			n = 0;
+
+		for (i = 0; i < nkeys; i++)
+		{
+			if (owner[i] == server)
+				n++;
+		}
+		if (n == 0)
+			continue;
+
+		memc = memcached_server_connection(server);
+		if (memc == NULL)
+		{
+			/* the server is down.  Flush it when it comes back */
+			if (memcached_breakers)
+				pool_atomic_write_u32(&memcached_breakers[server].needs_flush, 1);
+			continue;
+		}
+
+		ereport(DEBUG2,
+				(errmsg("memcache: deleteing %d cache entries on memcached \"%s:%d\"",
+						n, memcached_servers[server].host, memcached_servers[server].port)));
+
+		memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_NOREPLY, 1);
+		memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 1);
+
+		/* delete cache data on memcached. key is md5 hash query */
+		for (i = 0; i < nkeys; i++)
+		{
+			if (owner[i] != server)
+				continue;
+			rc = memcached_delete(memc, keys + i * 32, 32, (time_t) 0);
+			if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED)
+				break;
+		}
+		if (rc == MEMCACHED_SUCCESS || rc == MEMCACHED_BUFFERED)
+			rc = memcached_flush_buffers(memc);
+
+		memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 0);
+		memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_NOREPLY, 0);
+
+		/* delete cache data on memcached is failed */
+		if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED)
+		{
+			ereport(LOG,
+					(errmsg("failed to delete cache on memcached, error:\"%s\"", memcached_strerror(memc, rc))));
+			memcached_server_failed(server, true);
+		}
+	}
+
+	pfree(owner);
+}
+#endif
+
+/*
+ * Look up the cache storage and return decompressed cached messages in
+ * *qcache.  Returns false if not found.  If stale is not NULL, an item
+ * within the grace window of stale-while-revalidate is returned too and
+ * *stale is set.
+ */
+static bool
+pool_lookup_memory_cache(POOL_CONNECTION_POOL * backend, char *contents,
+						 char **qcache, size_t *qcachelen, bool *stale)
+{
+	int			sts;
+	char	   *p;
+	pool_sigset_t oldmask;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
+
+	PG_TRY();
+	{
+		sts = pool_fetch_cache_stale(backend, contents, qcache, qcachelen, stale);
+	}
+	PG_CATCH();
+	{
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+
+	if (sts != 0)
+		/* Cache not found */
+		return false;
+
+	/*
+	 * Decompress the cached messages outside of the lock.  If they cannot be
+	 * decompressed, behave as if the cache was not found.
+	 */
+	p = pool_decompress_cache_data(*qcache, qcachelen);
+	if (p == NULL)
+	{
+		ereport(LOG,
+				(errmsg("fetch from memory cache"),
+				 errdetail("failed to decompress cached SELECT results, statement: %s", contents)));
+		pfree(*qcache);
+		return false;
+	}
+	if (p != *qcache)
+	{
+		pfree(*qcache);
+		*qcache = p;
+	}
+	return true;
+}
+
+/*
+ * Send cached messages found in the cache storage.
+ */
+static POOL_STATUS
+pool_send_cached_result(POOL_CONNECTION * frontend,
+						POOL_CONNECTION_POOL * backend,
+						char *qcache, size_t qcachelen, char *contents)
+{
+	/*
+	 * Cache found. If we are doing extended query and in streaming
+	 * replication mode, we need to retrieve any responses from backend and
+	 * forward them to frontend.
+	 */
+	if (pool_is_doing_extended_query_message() && SL_MODE)
+	{
+		POOL_SESSION_CONTEXT *session_context;
+		POOL_CONNECTION *target_backend;
+
+		ereport(DEBUG1,
+				(errmsg("memcache: injecting cache data")));
+
+		session_context = pool_get_session_context(true);
+		target_backend = CONNECTION(backend, session_context->load_balance_node_id);
+		inject_cached_message(target_backend, qcache, qcachelen);
+	}
+	else
+	{
+		/*
+		 * Send each messages to frontend
+		 */
+		send_cached_messages(frontend, qcache, qcachelen);
+	}
+
+	/*
+	 * Send a "READY FOR QUERY" if not in extended query.
+	 */
+	if (!pool_is_doing_extended_query_message() && MAJOR(backend) == PROTO_MAJOR_V3)
+	{
+		signed char state;
+
+		/*
+		 * We keep previous transaction state.
+		 */
+		state = MASTER(backend)->tstate;
+		send_message(frontend, 'Z', 5, (char *) &state);
+		stat_end_request();
+	}
+
+	if (!pool_is_doing_extended_query_message() || !SL_MODE)
+	{
+		if (pool_flush(frontend))
+		{
+			return POOL_END;
+		}
+	}
+
+	if (pool_config->log_per_node_statement)
+		ereport(LOG,
+				(errmsg("fetch from memory cache"),
+				 errdetail("query result fetched from cache. statement: %s", contents)));
+
+	ereport(DEBUG1,
+			(errmsg("fetch from memory cache"),
+			 errdetail("query result found in the query cache, %s", contents)));
+
+	return POOL_CONTINUE;
+}
+
+/*
+ * Look up the cache storage with stale-while-revalidate and single-flight
+ * of cache misses.  A stale result is returned while another process is
+ * refreshing it; otherwise this process refreshes it.  On a miss, if
+ * another process is running the same query, wait for its result.
+ */
+static bool
+pool_search_memory_cache(POOL_CONNECTION_POOL * backend, char *contents,
+						 char **qcache, size_t *qcachelen)
+{
+	bool		stale;
+
+	if (pool_lookup_memory_cache(backend, contents, qcache, qcachelen, &stale))
+	{
+		if (!stale || pool_claim_in_flight(backend, contents))
+			return true;
+
+		ereport(DEBUG1,
+				(errmsg("fetch from memory cache"),
+				 errdetail("refreshing stale cache, statement: %s", contents)));
+		pfree(*qcache);
+		pool_count_cache_miss(backend, contents);
+		return false;
+	}
+
+	pool_count_cache_miss(backend, contents);
+
+	if (pool_config->memqcache_single_flight_timeout <= 0)
+		return false;
+
+	if (!pool_claim_in_flight(backend, contents))
+		return false;
+
+	return pool_wait_in_flight(backend, contents, qcache, qcachelen);
+}
+
+/*
+ * Shared memory area for the single-flight of cache misses.
+ */
+size_t
+pool_in_flight_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(POOL_IN_FLIGHT) * IN_FLIGHT_SLOTS);
+}
+
+void
+pool_in_flight_init(void *addr)
+{
+	in_flight = (POOL_IN_FLIGHT *) addr;
+	memset(in_flight, 0, sizeof(POOL_IN_FLIGHT) * IN_FLIGHT_SLOTS);
+}
+
+static uint64
+in_flight_now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+ * Hash of the cache key of the query: its first 8 hex digits.  0 means a
+ * free slot and is not used.
+ */
+static uint32
+in_flight_key(POOL_CONNECTION_POOL * backend, const char *query)
+{
+	char		tmpkey[MAX_KEY];
+	char		hex[9];
+	uint32		key;
+
+	encode_key(query, tmpkey, backend);
+	memcpy(hex, tmpkey, 8);
+	hex[8] = '\0';
+	key = (uint32) strtoul(hex, NULL, 16);
+	return key ? key : 1;
+}
+
+/*
+ * Is the key marked in flight by some process?
+ */
+static bool
+in_flight_marked(uint32 key)
+{
+	uint64		now = in_flight_now();
+	int			i;
+
+	for (i = 0; i < IN_FLIGHT_PROBES; i++)
+	{
+		POOL_IN_FLIGHT *f = &in_flight[(key + i) % IN_FLIGHT_SLOTS];
+		uint64		mark = pool_atomic_read_u64(&f->mark);
+
+		if (IN_FLIGHT_KEY(mark) == key && IN_FLIGHT_LIVE(mark, now))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Mark the query in flight.  Returns true if another process has already
+ * marked it, i.e. is running the same query on backend.  Otherwise this
+ * process marks it, if a slot is available, and returns false.  The mark
+ * is void after memqcache_single_flight_timeout (or memqcache_stale_grace
+ * if single-flight is disabled) even if it is not released, so that a
+ * process which has gone away does not hold the others off.
+ */
+static bool
+pool_claim_in_flight(POOL_CONNECTION_POOL * backend, const char *query)
+{
+	uint32		key;
+	uint64		now;
+	uint64		lifetime;
+	int			i;
+
+	if (in_flight == NULL)
+		return false;
+
+	/* A process marks only one query at a time */
+	pool_release_in_flight();
+
+	key = in_flight_key(backend, query);
+
+	lifetime = pool_config->memqcache_single_flight_timeout;
+	if (lifetime <= 0)
+		lifetime = (uint64) pool_config->memqcache_stale_grace * 1000;
+	if (lifetime > IN_FLIGHT_MAX_LIFETIME)
+		lifetime = IN_FLIGHT_MAX_LIFETIME;
+
+	now = in_flight_now();
+
+	/*
+	 * Look for a live mark of the key in all the probed slots before taking
+	 * one, so that the key is not marked twice.
+	 */
+	if (in_flight_marked(key))
+		return true;
+
+	for (i = 0; i < IN_FLIGHT_PROBES; i++)
+	{
+		int			slot = (key + i) % IN_FLIGHT_SLOTS;
+		POOL_IN_FLIGHT *f = &in_flight[slot];
+		uint64		cur = pool_atomic_read_u64(&f->mark);
+
+		for (;;)
+		{
+			if (cur != 0 && IN_FLIGHT_LIVE(cur, now))
+			{
+				/* Marked by a process running the same query */
+				if (IN_FLIGHT_KEY(cur) == key)
+					return true;
+				break;
+			}
+
+			/* The slot is free, or its mark is void: take it */
+			if (pool_atomic_compare_exchange_u64(&f->mark, &cur,
+												 IN_FLIGHT_MARK(key, now + lifetime)))
+			{
+				my_in_flight = slot;
+				my_in_flight_mark = IN_FLIGHT_MARK(key, now + lifetime);
+				break;
+			}
+			/* Lost the slot; see who has taken it */
+		}
+
+		if (my_in_flight < 0)
+			continue;
+
+		/*
+		 * A process may have marked the key in a later slot meanwhile, after
+		 * this slot was freed.  The mark in the last slot wins.
+		 */
+		for (i++; i < IN_FLIGHT_PROBES; i++)
+		{
+			uint64		mark = pool_atomic_read_u64(&in_flight[(key + i) % IN_FLIGHT_SLOTS].mark);
+
+			if (IN_FLIGHT_KEY(mark) == key && IN_FLIGHT_LIVE(mark, now))
+			{
+				pool_release_in_flight();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	return false;
+}
+
+/*
+ * Release the in-flight mark of this process, if any.  This is called once
+ * the result of the query has been registered to the cache storage, or
+ * the query has ended without registering.
+ */
+void
+pool_release_in_flight(void)
+{
+	uint64		mark = my_in_flight_mark;
+
+	if (my_in_flight < 0)
+		return;
+
+	pool_atomic_compare_exchange_u64(&in_flight[my_in_flight].mark, &mark, 0);
+	my_in_flight = -1;
+}
+
+/*
+ * Wait for another process running the same query to register its result,
+ * for up to memqcache_single_flight_timeout.  Returns true with the result
+ * in *qcache if it shows up.
+ */
+static bool
+pool_wait_in_flight(POOL_CONNECTION_POOL * backend, char *contents,
+					char **qcache, size_t *qcachelen)
+{
+	uint32		key = in_flight_key(backend, contents);
+	uint64		deadline = in_flight_now() + pool_config->memqcache_single_flight_timeout;
+
+	ereport(DEBUG1,
+			(errmsg("fetch from memory cache"),
+			 errdetail("waiting for another process running the same query, statement: %s", contents)));
+
+	while (in_flight_now() < deadline)
+	{
+		bool		marked;
+
+		usleep(IN_FLIGHT_POLL_INTERVAL * 1000);
+
+		marked = in_flight_marked(key);
+		if (pool_lookup_memory_cache(backend, contents, qcache, qcachelen, NULL))
+			return true;
+
+		/* The query has ended without registering the result */
+		if (!marked)
+			break;
+	}
+
+	return false;
+}
+
+/*
+ * Shared memory area for the frequency sketch of cache admission.
+ */
+size_t
+pool_admission_sketch_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(POOL_ADMISSION_SKETCH));
+}
+
+void
+pool_admission_sketch_init(void *addr)
+{
+	admission_sketch = (POOL_ADMISSION_SKETCH *) addr;
+	memset(admission_sketch, 0, sizeof(POOL_ADMISSION_SKETCH));
+}
+
+/*
+ * Shared memory area for the startup parameters of sessions.
+ */
+size_t
+pool_startup_params_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(POOL_STARTUP_PARAMS) * STARTUP_PARAMS_SLOTS);
+}
+
+void
+pool_startup_params_init(void *addr)
+{
+	startup_params = (POOL_STARTUP_PARAMS *) addr;
+	memset(startup_params, 0, sizeof(POOL_STARTUP_PARAMS) * STARTUP_PARAMS_SLOTS);
+}
+
+/*
+ * Return the slot for the startup packet, with the md5 hash of the
+ * packet in key.
+ */
+static POOL_STARTUP_PARAMS *
+startup_params_slot(StartupPacket *sp, char *key)
+{
+	char		hex[9];
+
+	pool_md5_hash(sp->startup_packet, sp->len, key);
+	memcpy(hex, key, 8);
+	hex[8] = '\0';
+	return &startup_params[strtoul(hex, NULL, 16) % STARTUP_PARAMS_SLOTS];
+}
+
+/*
+ * Save the ParameterStatus messages and the authentication method of a
+ * new connection to backend, for the startup packet of the connection.
+ */
+void
+pool_save_startup_params(POOL_CONNECTION_POOL * backend)
+{
+	POOL_STARTUP_PARAMS *slot;
+	char		key[MAX_KEY];
+	char		buf[STARTUP_PARAMS_SIZE];
+	char	   *name;
+	char	   *value;
+	int			index = 0;
+	int			len = 0;
+	int			auth_kind = MASTER(backend)->auth_kind;
+	uint32		seq;
+
+	if (startup_params == NULL)
+		return;
+
+	while (pool_get_param(&MASTER(backend)->params, index++, &name, &value) == 0)
+	{
+		int			msglen = sizeof(int) + strlen(name) + 1 + strlen(value) + 1;
+		int			nlen = htonl(msglen);
+
+		/* Too many parameters to save */
+		if (len + 1 + msglen > sizeof(buf))
+			return;
+
+		buf[len++] = 'S';
+		memcpy(buf + len, &nlen, sizeof(nlen));
+		len += sizeof(nlen);
+		strcpy(buf + len, name);
+		len += strlen(name) + 1;
+		strcpy(buf + len, value);
+		len += strlen(value) + 1;
+	}
+
+	slot = startup_params_slot(MASTER_CONNECTION(backend)->sp, key);
+	seq = pool_atomic_read_u32(&slot->seq);
+
+	/* Already saved? */
+	if (!(seq & 1) && strncmp(slot->key, key, sizeof(slot->key)) == 0 &&
+		slot->auth_kind == auth_kind && slot->len == len &&
+		memcmp(slot->params, buf, len) == 0)
+		return;
+
+	/* Another process is writing the slot.  Leave it to the process */
+	if ((seq & 1) || !pool_atomic_compare_exchange_u32(&slot->seq, &seq, seq + 1))
+		return;
+
+	strlcpy(slot->key, key, sizeof(slot->key));
+	slot->auth_kind = auth_kind;
+	slot->len = len;
+	memcpy(slot->params, buf, len);
+	pool_atomic_write_u32(&slot->seq, seq + 2);
+}
+
+/*
+ * Look up the ParameterStatus messages and the authentication method of
+ * backend saved for the startup packet.  The messages are returned in a
+ * palloc'd buffer.
+ */
+bool
+pool_get_startup_params(StartupPacket *sp, char **params, int *len, int *auth_kind)
+{
+	POOL_STARTUP_PARAMS *slot;
+	char		key[MAX_KEY];
+	uint32		seq;
+	int			l;
+
+	if (startup_params == NULL)
+		return false;
+
+	slot = startup_params_slot(sp, key);
+	seq = pool_atomic_read_u32(&slot->seq);
+	if ((seq & 1) || seq == 0 || strncmp(slot->key, key, sizeof(slot->key)) != 0)
+		return false;
+
+	l = slot->len;
+	if (l < 0 || l > STARTUP_PARAMS_SIZE)
+		return false;
+
+	*params = palloc(l);
+	memcpy(*params, slot->params, l);
+	*len = l;
+	*auth_kind = slot->auth_kind;
+
+	/* The slot was overwritten while we were copying it */
+	if (pool_atomic_read_u32(&slot->seq) != seq)
+	{
+		pfree(*params);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Hashes of a cache key for each row of the sketch.  The key is a md5 hex
+ * string, so its 32 hex digits give four independent 32 bit hashes.
+ */
+static void
+admission_sketch_hashes(const char *key, uint32 *hashes)
+{
+	char		hex[9];
+	int			i;
+
+	for (i = 0; i < ADMISSION_SKETCH_DEPTH; i++)
+	{
+		memcpy(hex, key + i * 8, 8);
+		hex[8] = '\0';
+		hashes[i] = (uint32) strtoul(hex, NULL, 16);
+	}
+}
+
+/*
+ * Count up cache misses of the query in the frequency sketch.
+ */
+static void
+pool_count_cache_miss(POOL_CONNECTION_POOL * backend, const char *query)
+{
+	char		tmpkey[MAX_KEY];
+	uint32		hashes[ADMISSION_SKETCH_DEPTH];
+	uint32		misses;
+	int			i;
+	int			j;
+
+	if (admission_sketch == NULL || pool_config->memqcache_admission_threshold <= 1)
+		return;
+
+	encode_key(query, tmpkey, backend);
+	admission_sketch_hashes(tmpkey, hashes);
+
+	for (i = 0; i < ADMISSION_SKETCH_DEPTH; i++)
+		pool_atomic_fetch_add_u32(&admission_sketch->counters[i][hashes[i] % ADMISSION_SKETCH_WIDTH], 1);
+
+	/*
+	 * Age the sketch.  Only the process which counts up the last miss of
+	 * the sample halves the counters.  Counts by other processes meanwhile
+	 * may be lost, which is fine since the sketch is an estimate anyway.
+	 */
+	misses = pool_atomic_fetch_add_u32(&admission_sketch->misses, 1) + 1;
+	if (misses != ADMISSION_SKETCH_SAMPLE)
+		return;
+
+	for (i = 0; i < ADMISSION_SKETCH_DEPTH; i++)
+	{
+		for (j = 0; j < ADMISSION_SKETCH_WIDTH; j++)
+		{
+			volatile uint32 *counter = &admission_sketch->counters[i][j];
+
+			pool_atomic_write_u32(counter, pool_atomic_read_u32(counter) / 2);
+		}
+	}
+	pool_atomic_write_u32(&admission_sketch->misses, 0);
+}
+
+/*
+ * Returns true if the result of the query whose cache key is given may be
+ * cached, that is, the query has missed the cache at least
+ * memqcache_admission_threshold times recently.
+ */
+static bool
+pool_admit_cache(const char *key)
+{
+	uint32		hashes[ADMISSION_SKETCH_DEPTH];
+	uint32		estimate = UINT32_MAX;
+	int			i;
+
+	if (admission_sketch == NULL || pool_config->memqcache_admission_threshold <= 1)
+		return true;
+
+	admission_sketch_hashes(key, hashes);
 
-	strkey = (char *) palloc(sizeof(char) * length);
+	for (i = 0; i < ADMISSION_SKETCH_DEPTH; i++)
+	{
+		uint32		count = pool_atomic_read_u32(&admission_sketch->counters[i][hashes[i] % ADMISSION_SKETCH_WIDTH]);
 
-	snprintf(strkey, length, "%s%s%s", backend->info->user, s, backend->info->database);
+		if (count < estimate)
+			estimate = count;
+	}
 
-	pool_md5_hash(strkey, strlen(strkey), buf);
-	ereport(DEBUG1,
-			(errmsg("memcache encode key"),
-			 errdetail("`%s' -> `%s'", strkey, buf)));
-	pfree(strkey);
-	return buf;
+	return estimate >= pool_config->memqcache_admission_threshold;
 }
 
-#ifdef DEBUG
 /*
- * dump cache data
+ * Returns true if the compiled cache rules are different from the current
+ * memqcache_expire_table_list and memqcache_expire_query_list.
  */
-static void
-dump_cache_data(const char *data, size_t len)
+static bool
+cache_rules_changed(void)
 {
+	int			n = 0;
 	int			i;
-	int			plen;
-
-
-	fprintf(stderr, "shmem: len = %zd\n", len);
 
-	while (len > 0)
+	for (i = 0; i < pool_config->num_memqcache_expire_table_list && n < MAX_CACHE_RULES; i++, n++)
 	{
-		fprintf(stderr, "shmem: kind:%c\n", *data++);
-		len--;
-		memmove(&plen, data, 4);
-		len -= 4;
-		data += 4;
-		plen = ntohl(plen);
-		fprintf(stderr, "shmem: len:%d\n", plen);
-		plen -= 4;
-
-		fprintf(stderr, "shmem: ");
-		for (i = 0; i < plen; i++)
-		{
-			fprintf(stderr, "%02x ", (unsigned char) (*data++));
-			len--;
-		}
-		fprintf(stderr, "\n");
+		if (n >= num_cache_rules || cache_rules[n + 1].is_query ||
+			strcmp(cache_rules[n + 1].rule, pool_config->memqcache_expire_table_list[i]))
+			return true;
+	}
+	for (i = 0; i < pool_config->num_memqcache_expire_query_list && n < MAX_CACHE_RULES; i++, n++)
+	{
+		if (n >= num_cache_rules || !cache_rules[n + 1].is_query ||
+			strcmp(cache_rules[n + 1].rule, pool_config->memqcache_expire_query_list[i]))
+			return true;
 	}
+	return n != num_cache_rules;
 }
-#endif
 
 /*
- * send cached messages
+ * Compile the cache rules.  Each rule is a regular expression and the
+ * cache expiration time in seconds separated by the last colon.  Like
+ * white_memqcache_table_list, a table pattern has to match the whole table
+ * name, while a query pattern may match any part of the query.  An invalid
+ * rule is kept but never matches, so that the numbering of rules follows
+ * the lists.
  */
-static int
-send_cached_messages(POOL_CONNECTION * frontend, const char *qcache, int qcachelen)
+static void
+pool_compile_cache_rules(void)
 {
-	int			msg = 0;
-	int			i = 0;
-	int			is_prepared_stmt = 0;
-	int			len;
-	const char *p;
+	MemoryContext old_context;
+	int			i;
 
-	while (i < qcachelen)
+	for (i = 1; i <= num_cache_rules; i++)
 	{
-		char		tmpkind;
-		int			tmplen;
+		if (cache_rules[i].expire >= 0)
+			regfree(&cache_rules[i].regexv);
+		pfree(cache_rules[i].rule);
+	}
+	num_cache_rules = 0;
 
-		tmpkind = qcache[i];
-		i++;
+	old_context = MemoryContextSwitchTo(TopMemoryContext);
 
-		memcpy(&tmplen, qcache + i, sizeof(tmplen));
-		i += sizeof(tmplen);
-		len = ntohl(tmplen);
-		p = qcache + i;
-		i += len - sizeof(tmplen);
+	for (i = 0; i < pool_config->num_memqcache_expire_table_list + pool_config->num_memqcache_expire_query_list; i++)
+	{
+		POOL_CACHE_RULE *r;
+		bool		is_query = (i >= pool_config->num_memqcache_expire_table_list);
+		char	   *rule;
+		char	   *pattern;
+		char	   *colon;
+		char	   *end;
+		long		expire;
 
-		/* No need to cache PARSE and BIND responses */
-		if (tmpkind == '1' || tmpkind == '2')
+		rule = is_query ? pool_config->memqcache_expire_query_list[i - pool_config->num_memqcache_expire_table_list]
+			: pool_config->memqcache_expire_table_list[i];
+
+		if (num_cache_rules >= MAX_CACHE_RULES)
 		{
-			is_prepared_stmt = 1;
-			continue;
+			ereport(WARNING,
+					(errmsg("too many cache rules, \"%s\" and later rules are ignored", rule),
+					 errdetail("up to %d rules are allowed", MAX_CACHE_RULES)));
+			break;
 		}
 
-		/*
-		 * In the prepared statement execution, there is no need to send 'T'
-		 * response to the frontend.
-		 */
-		if (is_prepared_stmt && tmpkind == 'T')
+		r = &cache_rules[++num_cache_rules];
+		r->rule = pstrdup(rule);
+		r->is_query = is_query;
+		r->expire = -1;
+		r->slot = -1;
+
+		pattern = pstrdup(rule);
+		colon = strrchr(pattern, ':');
+		if (colon == NULL)
+		{
+			ereport(WARNING,
+					(errmsg("invalid cache rule \"%s\"", rule),
+					 errdetail("cache expiration time is missing")));
+			pfree(pattern);
+			continue;
+		}
+		*colon = '\0';
+		expire = strtol(colon + 1, &end, 10);
+		if (*(colon + 1) == '\0' || *end != '\0' || expire < 0 || expire > INT_MAX)
 		{
+			ereport(WARNING,
+					(errmsg("invalid cache rule \"%s\"", rule),
+					 errdetail("invalid cache expiration time \"%s\"", colon + 1)));
+			pfree(pattern);
 			continue;
 		}
+		r->slot = cache_rule_slot(is_query, pattern);
 
-		/* send message to frontend */
-		ereport(DEBUG1,
-				(errmsg("memcache: sending cached messages: '%c' len: %d", tmpkind, len)));
-		send_message(frontend, tmpkind, len, p);
+		if (!is_query)
+		{
+			char	   *anchored = psprintf("%s%s%s", *pattern == '^' ? "" : "^", pattern,
+											pattern[strlen(pattern) - 1] == '$' ? "" : "$");
 
-		msg++;
+			pfree(pattern);
+			pattern = anchored;
+		}
+
+		if (regcomp(&r->regexv, pattern, REG_NOSUB | REG_ICASE | REG_EXTENDED) != 0)
+		{
+			ereport(WARNING,
+					(errmsg("invalid cache rule \"%s\"", rule),
+					 errdetail("invalid pattern \"%s\"", pattern)));
+			pfree(pattern);
+			continue;
+		}
+		pfree(pattern);
+		r->expire = (int) expire;
 	}
 
-	return msg;
+	MemoryContextSwitchTo(old_context);
 }
 
 /*
- * send message to frontend
+ * Returns the cache rule of a SELECT: the first query rule matching the
+ * query, otherwise the table rule with the shortest cache expiration among
+ * the ones matching the tables, otherwise 0.
  */
-static void
-send_message(POOL_CONNECTION * conn, char kind, int len, const char *data)
+static int
+pool_get_cache_rule(const char *query, int num_tables, char (*table_names)[POOL_NAMEDATALEN])
 {
-	ereport(DEBUG2,
-			(errmsg("memcache: sending messages: kind '%c', len=%d, data=%p", kind, len, data)));
+	int			rule = 0;
+	int			i;
+	int			j;
 
-	pool_write(conn, &kind, 1);
+	if (cache_rules_changed())
+		pool_compile_cache_rules();
 
-	len = htonl(len);
-	pool_write(conn, &len, sizeof(len));
+	for (i = 1; i <= num_cache_rules; i++)
+	{
+		if (cache_rules[i].is_query && cache_rules[i].expire >= 0 &&
+			regexec(&cache_rules[i].regexv, query, 0, 0, 0) == 0)
+			return i;
+	}
 
-	len = ntohl(len);
-	pool_write(conn, (void *) data, len - sizeof(len));
-}
+	for (j = 0; j < num_tables; j++)
+	{
+		char		table[POOL_NAMEDATALEN];
+		char	   *p;
+		char	   *q;
 
-#ifdef USE_MEMCACHED
-/*
- * delete query cache on memcached
- */
-static int
-delete_cache_on_memcached(const char *key)
-{
+		/* Match without double quotes as white_memqcache_table_list does */
+		for (p = table_names[j], q = table; *p; p++)
+		{
+			if (*p != '"')
+				*q++ = *p;
+		}
+		*q = '\0';
 
-	memcached_return rc;
+		for (i = 1; i <= num_cache_rules; i++)
+		{
+			if (cache_rules[i].is_query || cache_rules[i].expire < 0 ||
+				regexec(&cache_rules[i].regexv, table, 0, 0, 0) != 0)
+				continue;
 
-	ereport(DEBUG2,
-			(errmsg("memcache: deleteing cache on memcached with key: \"%s\"", key)));
+			/* 0 means no expiration, the longest */
+			if (rule == 0 ||
+				(cache_rules[i].expire > 0 &&
+				 (cache_rules[rule].expire == 0 || cache_rules[i].expire < cache_rules[rule].expire)))
+				rule = i;
+		}
+	}
 
+	if (rule > 0)
+		ereport(DEBUG1,
+				(errmsg("memcache: cache rule \"%s\" is used", cache_rules[rule].rule)));
 
-	/* delete cache data on memcached. key is md5 hash query */
-	rc = memcached_delete(memc, key, 32, (time_t) 0);
+	return rule;
+}
 
-	/* delete cache data on memcached is failed */
-	if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED)
-	{
-		ereport(LOG,
-				(errmsg("failed to delete cache on memcached, error:\"%s\"", memcached_strerror(memc, rc))));
-		return 0;
-	}
-	return 1;
+/*
+ * Cache expiration time of the rule.
+ */
+static int
+pool_get_cache_rule_expire(int rule)
+{
+	if (rule > 0 && rule <= num_cache_rules && cache_rules[rule].expire >= 0)
+		return cache_rules[rule].expire;
+	return pool_config->memqcache_expire;
+}
 
+/*
+ * Stats slot of the rule.  SELECTs no rule matched count in slot 0.
+ */
+static int
+pool_get_cache_rule_slot(int rule)
+{
+	if (rule > 0 && rule <= num_cache_rules)
+		return cache_rules[rule].slot;
+	return 0;
 }
-#endif
 
 /*
  * Fetch SELECT data from cache if possible.
@@ -730,97 +2200,189 @@ pool_fetch_from_memory_cache(POOL_CONNECTION * frontend,
 {
 	char	   *qcache;
 	size_t		qcachelen;
-	int			sts;
-	pool_sigset_t oldmask;
+	POOL_STATUS status;
 
 	ereport(DEBUG1,
 			(errmsg("pool_fetch_from_memory_cache called")));
 
 	*foundp = false;
 
-	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock();
+	if (!pool_search_memory_cache(backend, contents, &qcache, &qcachelen))
+		return POOL_CONTINUE;
 
-	PG_TRY();
-	{
-		sts = pool_fetch_cache(backend, contents, &qcache, &qcachelen);
-	}
-	PG_CATCH();
-	{
-		pool_shmem_unlock();
-		POOL_SETMASK(&oldmask);
-		PG_RE_THROW();
-	}
-	PG_END_TRY();
+	status = pool_send_cached_result(frontend, backend, qcache, qcachelen, contents);
+	pfree(qcache);
+	if (status != POOL_CONTINUE)
+		return status;
 
-	pool_shmem_unlock();
-	POOL_SETMASK(&oldmask);
+	*foundp = true;
+	return POOL_CONTINUE;
+}
 
-	if (sts != 0)
-		/* Cache not found */
-		return POOL_CONTINUE;
+/*
+ * Send the result of a simple query to a frontend which has not connected
+ * to backend yet, if it is found in the cache.  user and database are of
+ * the session.  A stale result is not sent, so that the query is run on
+ * backend and the cache is refreshed.  Returns true if the result has been
+ * sent followed by ReadyForQuery.
+ */
+bool
+pool_fetch_cache_without_backend(POOL_CONNECTION * frontend,
+								 char *user, char *database, char *query)
+{
+	POOL_CONNECTION_POOL backend;
+	ConnectionInfo info;
+	char	   *qcache;
+	size_t		qcachelen;
+	bool		stale;
+	signed char state = 'I';
 
-	/*
-	 * Cache found. If we are doing extended query and in streaming
-	 * replication mode, we need to retrieve any responses from backend and
-	 * forward them to frontend.
-	 */
-	if (pool_is_doing_extended_query_message() && SL_MODE)
-	{
-		POOL_SESSION_CONTEXT *session_context;
-		POOL_CONNECTION *target_backend;
+	/* The cache key is made only of the user and database of the session */
+	memset(&backend, 0, sizeof(backend));
+	memset(&info, 0, sizeof(info));
+	strlcpy(info.user, user, sizeof(info.user));
+	strlcpy(info.database, database, sizeof(info.database));
+	backend.info = &info;
 
-		ereport(DEBUG1,
-				(errmsg("memcache: injecting cache data")));
+	if (!pool_lookup_memory_cache(&backend, query, &qcache, &qcachelen, &stale))
+		return false;
 
-		session_context = pool_get_session_context(true);
-		target_backend = CONNECTION(backend, session_context->load_balance_node_id);
-		inject_cached_message(target_backend, qcache, qcachelen);
-	}
-	else
+	if (stale)
 	{
-		/*
-		 * Send each messages to frontend
-		 */
-		send_cached_messages(frontend, qcache, qcachelen);
+		pfree(qcache);
+		return false;
 	}
 
+	send_cached_messages(frontend, qcache, qcachelen);
 	pfree(qcache);
+	send_message(frontend, 'Z', 5, (char *) &state);
+	pool_flush(frontend);
 
-	/*
-	 * Send a "READY FOR QUERY" if not in extended query.
-	 */
-	if (!pool_is_doing_extended_query_message() && MAJOR(backend) == PROTO_MAJOR_V3)
+	if (pool_config->log_per_node_statement)
+		ereport(LOG,
+				(errmsg("fetch from memory cache"),
+				 errdetail("query result fetched from cache without backend connection. statement: %s", query)));
+
+	return true;
+}
+
+/*
+ * Fetch the result of an Execute message for a portal from cache if
+ * possible.  contents is the cache key made of the statement and the
+ * parameters bound to the portal.  If max_rows is greater than 0, only
+ * that many rows are sent followed by PortalSuspended, and the rest of the
+ * cached result is kept in *portal for following Execute messages.
+ */
+POOL_STATUS
+pool_fetch_portal_from_memory_cache(POOL_CONNECTION * frontend,
+									POOL_CONNECTION_POOL * backend,
+									POOL_PORTAL_CACHE * portal,
+									char *contents, int max_rows, bool *foundp)
+{
+	char	   *qcache;
+	size_t		qcachelen;
+	char	   *chunk;
+	size_t		chunklen;
+	POOL_STATUS status;
+
+	*foundp = false;
+
+	if (portal->data == NULL)
 	{
-		signed char state;
+		if (max_rows <= 0)
+			return pool_fetch_from_memory_cache(frontend, backend, contents, foundp);
 
-		/*
-		 * We keep previous transaction state.
-		 */
-		state = MASTER(backend)->tstate;
-		send_message(frontend, 'Z', 5, (char *) &state);
+		if (!pool_search_memory_cache(backend, contents, &qcache, &qcachelen))
+			return POOL_CONTINUE;
+
+		portal->data = MemoryContextAlloc(pool_get_session_context(false)->memory_context, qcachelen);
+		memcpy(portal->data, qcache, qcachelen);
+		portal->len = qcachelen;
+		portal->offset = 0;
+		pfree(qcache);
 	}
 
-	if (!pool_is_doing_extended_query_message() || !SL_MODE)
+	chunk = pool_get_cached_portal_chunk(portal, max_rows, &chunklen);
+	status = pool_send_cached_result(frontend, backend, chunk, chunklen, contents);
+	pfree(chunk);
+	if (status != POOL_CONTINUE)
+		return status;
+
+	*foundp = true;
+	return POOL_CONTINUE;
+}
+
+/*
+ * Cut the cached messages to send for an Execute message with max_rows
+ * out of the portal's cached result: the messages up to the max_rows-th
+ * DataRow followed by PortalSuspended, or all the rest if there are no
+ * more rows than that.  The command tag of a portal resumed this way
+ * reports the rows sent by the last Execute as PostgreSQL does.
+ */
+static char *
+pool_get_cached_portal_chunk(POOL_PORTAL_CACHE * portal, int max_rows, size_t *len)
+{
+	POOL_INTERNAL_BUFFER *buffer;
+	bool		resumed = portal->offset > 0;
+	size_t		i = portal->offset;
+	int			nrows = 0;
+	char	   *chunk;
+
+	buffer = pool_create_buffer();
+
+	while (i < portal->len)
 	{
-		if (pool_flush(frontend))
+		char		kind = portal->data[i];
+		int			msglen;
+
+		memcpy(&msglen, portal->data + i + 1, sizeof(msglen));
+		msglen = ntohl(msglen);
+
+		if (max_rows > 0 && nrows >= max_rows)
 		{
-			return POOL_END;
+			char		skind = 's';
+			int			slen = htonl(sizeof(int));
+
+			/* more messages to come.  Suspend the portal */
+			pool_add_buffer(buffer, &skind, 1);
+			pool_add_buffer(buffer, &slen, sizeof(slen));
+			portal->offset = i;
+			chunk = pool_get_buffer(buffer, len);
+			pool_discard_buffer(buffer);
+			return chunk;
 		}
-	}
 
-	*foundp = true;
+		if (kind == 'D')
+			nrows++;
 
-	if (pool_config->log_per_node_statement)
-		ereport(LOG,
-				(errmsg("fetch from memory cache"),
-				 errdetail("query result fetched from cache. statement: %s", contents)));
+		if (kind == 'C' && resumed &&
+			strncmp(portal->data + i + 1 + sizeof(msglen), "SELECT ", 7) == 0)
+		{
+			char		ckind = 'C';
+			char		tag[64];
+			int			taglen;
+
+			snprintf(tag, sizeof(tag), "SELECT %d", nrows);
+			taglen = htonl(sizeof(int) + strlen(tag) + 1);
+			pool_add_buffer(buffer, &ckind, 1);
+			pool_add_buffer(buffer, &taglen, sizeof(taglen));
+			pool_add_buffer(buffer, tag, strlen(tag) + 1);
+		}
+		else
+			pool_add_buffer(buffer, portal->data + i, 1 + msglen);
 
-	ereport(DEBUG1,
-			(errmsg("fetch from memory cache"),
-			 errdetail("query result found in the query cache, %s", contents)));
+		i += 1 + msglen;
+	}
 
-	return POOL_CONTINUE;
+	/* The whole result has been sent */
+	pfree(portal->data);
+	portal->data = NULL;
+	portal->len = 0;
+	portal->offset = 0;
+
+	chunk = pool_get_buffer(buffer, len);
+	pool_discard_buffer(buffer);
+	return chunk;
 }
 
 /*
@@ -1660,6 +3222,11 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 	int			i;
 	int			len;
 	POOL_CACHEKEY buf;
+#ifdef USE_MEMCACHED
+	char	   *delkeys = NULL;
+	int			ndelkeys = 0;
+	int			maxdelkeys = 0;
+#endif
 
 	/*
 	 * Create memqcache_oiddir
@@ -1718,6 +3285,7 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 		int			fd;
 		int			oid = table_oid[i];
 		int			sts;
+		bool		error = false;
 		struct flock fl;
 
 		/*
@@ -1757,9 +3325,8 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 			{
 				ereport(WARNING,
 						(errmsg("memcache: invalidating query cache, failed to read file:\"%s\". error:\"%s\"", path, strerror(errno))));
-
-				close(fd);
-				return;
+				error = true;
+				break;
 			}
 			else if (sts == len)
 			{
@@ -1782,7 +3349,14 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 							(errmsg("memcache invalidating query cache"),
 							 errdetail("deleting %s", delbuf)));
 
-					delete_cache_on_memcached(delbuf);
+					/* deletes are sent in a batch per table */
+					if (ndelkeys >= maxdelkeys)
+					{
+						maxdelkeys = maxdelkeys ? maxdelkeys * 2 : 128;
+						delkeys = delkeys ? repalloc(delkeys, maxdelkeys * 32) : palloc(maxdelkeys * 32);
+					}
+					memcpy(delkeys + ndelkeys * 32, buf.hashkey, 32);
+					ndelkeys++;
 				}
 #endif
 				continue;
@@ -1795,18 +3369,35 @@ pool_invalidate_query_cache(int num_table_oids, int *table_oid, bool unlinkp, in
 			{
 				ereport(WARNING,
 						(errmsg("memcache: invalidating query cache, invalid data length:%d in file:\"%s\"", sts, path)));
-				close(fd);
-				return;
+				error = true;
 			}
 			break;
 		}
 
+#ifdef USE_MEMCACHED
+		if (ndelkeys > 0)
+		{
+			delete_cache_on_memcached(delkeys, ndelkeys);
+			ndelkeys = 0;
+		}
+#endif
+
+		if (error)
+		{
+			close(fd);
+			break;
+		}
+
 		if (unlinkp)
 		{
 			unlink(path);
 		}
 		close(fd);
 	}
+#ifdef USE_MEMCACHED
+	if (delkeys)
+		pfree(delkeys);
+#endif
 #ifdef SHMEMCACHE_DEBUG
 	dump_shmem_cache(0);
 #endif
@@ -1878,9 +3469,12 @@ pool_is_shmem_cache(void)
 }
 
 /*
- * Remember memory cache number of blocks.
+ * Remember memory cache number of blocks.  This is the number of blocks
+ * reserved at start up.  The number of blocks in use, which follows
+ * memqcache_total_size, is kept on shared memory.
  */
 static int	memqcache_num_blocks;
+static volatile int *memqcache_active_blocks;
 static void
 pool_set_memqcache_blocks(int num_blocks)
 {
@@ -1896,6 +3490,31 @@ pool_get_memqcache_blocks(void)
 	return memqcache_num_blocks;
 }
 
+/*
+ * Return number of blocks in use.
+ */
+static int
+pool_get_memqcache_active_blocks(void)
+{
+	return *memqcache_active_blocks;
+}
+
+/*
+ * Number of blocks for the storage size, which is at least one and at
+ * most the number of blocks reserved.
+ */
+static int
+pool_memqcache_blocks_for_size(int64 size)
+{
+	int64		num_blocks = size / pool_config->memqcache_cache_block_size;
+
+	if (num_blocks < 1)
+		num_blocks = 1;
+	if (memqcache_num_blocks > 0 && num_blocks > memqcache_num_blocks)
+		num_blocks = memqcache_num_blocks;
+	return (int) num_blocks;
+}
+
 /*
  * Query cache on shared memory management modules.
  */
@@ -1926,6 +3545,11 @@ pool_shared_memory_cache_size(void)
 						   pool_config->memqcache_total_size,
 						   pool_config->memqcache_cache_block_size)));
 
+	/* Reserve blocks for memqcache_total_size to grow up to */
+	if (pool_config->memqcache_total_size_limit / pool_config->memqcache_cache_block_size > num_blocks)
+		num_blocks = pool_config->memqcache_total_size_limit /
+			pool_config->memqcache_cache_block_size;
+
 	ereport(LOG,
 			(errmsg("memory cache initialized"),
 			 errdetail("memcache blocks :%ld", num_blocks)));
@@ -1947,6 +3571,9 @@ pool_init_memory_cache(size_t size)
 			(errmsg("memory cache request size : %zd", size)));
 
 	shmem = pool_shared_memory_create(size);
+
+	memqcache_active_blocks = pool_shared_memory_create(sizeof(*memqcache_active_blocks));
+	*memqcache_active_blocks = pool_memqcache_blocks_for_size(pool_config->memqcache_total_size);
 	return 0;
 }
 
@@ -1960,11 +3587,12 @@ pool_clear_memory_cache(void)
 	pool_sigset_t oldmask;
 
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock();
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
 	PG_TRY();
 	{
-		size = pool_shared_memory_cache_size();
+		/* Blocks not in use are already empty */
+		size = (size_t) pool_get_memqcache_active_blocks() * pool_config->memqcache_cache_block_size;
 		memset(shmem, 0, size);
 
 		size = pool_shared_memory_fsmm_size();
@@ -1972,7 +3600,7 @@ pool_clear_memory_cache(void)
 
 		pool_discard_oid_maps();
 
-		pool_hash_reset(pool_config->memqcache_max_num_cache);
+		pool_hash_reset();
 	}
 	PG_CATCH();
 	{
@@ -2041,12 +3669,14 @@ static void *fsmm;
 int
 pool_init_fsmm(size_t size)
 {
-	int			maxblock = pool_get_memqcache_blocks();
+	int			maxblock = pool_get_memqcache_active_blocks();
 	int			encode_value;
 
 	fsmm = pool_shared_memory_create(size);
 	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
 	memset(fsmm, encode_value, maxblock);
+	/* Blocks not in use have no free space so that they are never chosen */
+	memset((char *) fsmm + maxblock, 0, size - maxblock);
 	return 0;
 }
 
@@ -2084,10 +3714,12 @@ pool_allocate_fsmm_clock_hand(void)
 static void
 pool_reset_fsmm(size_t size)
 {
+	int			maxblock = pool_get_memqcache_active_blocks();
 	int			encode_value;
 
 	encode_value = POOL_MAX_FREE_SPACE / POOL_FSMM_RATIO;
-	memset(fsmm, encode_value, size);
+	memset(fsmm, encode_value, maxblock);
+	memset((char *) fsmm + maxblock, 0, size - maxblock);
 
 	*pool_fsmm_clock_hand = 0;
 }
@@ -2098,7 +3730,7 @@ pool_reset_fsmm(size_t size)
  */
 static POOL_CACHE_BLOCKID pool_reuse_block(void)
 {
-	int			maxblock = pool_get_memqcache_blocks();
+	int			maxblock = pool_get_memqcache_active_blocks();
 	char	   *block = block_address(*pool_fsmm_clock_hand);
 	POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) block;
 	POOL_CACHE_BLOCKID reused_block;
@@ -2143,7 +3775,7 @@ static POOL_CACHE_BLOCKID pool_get_block(size_t free_space)
 	int			encode_value;
 	unsigned char *p = pool_fsmm_address();
 	int			i;
-	int			maxblock = pool_get_memqcache_blocks();
+	int			maxblock = pool_get_memqcache_active_blocks();
 	POOL_CACHE_BLOCK_HEADER *bh;
 
 	if (p == NULL)
@@ -2230,7 +3862,7 @@ pool_update_fsmm(POOL_CACHE_BLOCKID blockid, size_t free_space)
  * The cache id is overwritten by the subsequent call to this function.
  * On error returns NULL.
  */
-static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, time_t expire)
+static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, char *data, int size, time_t expire, int rule_slot)
 {
 	static POOL_CACHEID cacheid;
 	POOL_CACHE_BLOCKID blockid;
@@ -2274,6 +3906,9 @@ static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, ch
 		return NULL;
 	}
 
+	/* Remove an expired item for the same query left by a reader, if any */
+	pool_find_item_on_shmem_cache(query_hash, NULL);
+
 	/* Add overhead */
 	request_size = size + sizeof(POOL_CACHE_ITEM_POINTER) + sizeof(POOL_CACHE_ITEM_HEADER);
 
@@ -2436,6 +4071,7 @@ static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, ch
 	/* Fill in cache item header */
 	ci.header.timestamp = time(NULL);
 	ci.header.expire = expire;
+	ci.header.rule_slot = rule_slot;
 	ci.header.total_length = sizeof(POOL_CACHE_ITEM_HEADER) + size;
 
 	/* Calculate item body address */
@@ -2514,7 +4150,7 @@ static POOL_CACHEID * pool_add_item_shmem_cache(POOL_QUERY_HASH * query_hash, ch
  * Detail is set to *sts. (0: success, 1: not found, -1: error)
  */
 static char *
-pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
+pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts, bool *stale)
 {
 	POOL_CACHEID *cacheid;
 	POOL_CACHE_ITEM_HEADER *cih;
@@ -2545,7 +4181,7 @@ pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
 	/*
 	 * Find cache header by using hash table
 	 */
-	cacheid = pool_find_item_on_shmem_cache(query_hash);
+	cacheid = pool_find_item_on_shmem_cache(query_hash, stale);
 	if (cacheid == NULL)
 	{
 		/* Not found */
@@ -2564,7 +4200,7 @@ pool_get_item_shmem_cache(POOL_QUERY_HASH * query_hash, int *size, int *sts)
  * On success returns cache id.
  * The cache id is overwritten by the subsequent call to this function.
  */
-static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash)
+static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash, bool *stale)
 {
 	static POOL_CACHEID cacheid;
 	POOL_CACHEID *c;
@@ -2589,7 +4225,23 @@ static POOL_CACHEID * pool_find_item_on_shmem_cache(POOL_QUERY_HASH * query_hash
 					(errmsg("memcache finding item"),
 					 errdetail("cache expired: now: %ld timestamp: %ld",
 							   now, cih->timestamp + cih->expire)));
-			pool_delete_item_shmem_cache(c);
+
+			/* Still within the grace window of stale-while-revalidate? */
+			if (stale && now <= cih->timestamp + cih->expire + pool_config->memqcache_stale_grace)
+			{
+				*stale = true;
+				cacheid.blockid = c->blockid;
+				cacheid.itemid = c->itemid;
+				return &cacheid;
+			}
+
+			/*
+			 * Readers hold the lock in shared mode and must not modify the
+			 * storage.  The expired item is then removed when the query
+			 * result is cached again.
+			 */
+			if (shmem_lock_type == POOL_MEMQ_EXCLUSIVE_LOCK)
+				pool_delete_item_shmem_cache(c);
 			return NULL;
 		}
 	}
@@ -2808,14 +4460,27 @@ pool_wipe_out_cache_block(POOL_CACHE_BLOCKID blockid)
 
 /*
  * Acquire lock: XXX giant lock
+ *
+ * A shared lock is enough for looking up cache entries.  Anything which
+ * modifies the cache storage needs an exclusive lock.  If the lock is
+ * already held, nothing is done, but a shared lock cannot be upgraded: the
+ * caller must release it first.
  */
 void
-pool_shmem_lock(void)
+pool_shmem_lock(POOL_MEMQ_LOCK_TYPE type)
 {
+	if (pool_is_shmem_cache() && is_shmem_locked &&
+		type == POOL_MEMQ_EXCLUSIVE_LOCK && shmem_lock_type == POOL_MEMQ_SHARED_LOCK)
+		ereport(ERROR,
+				(errmsg("unable to lock the query cache in exclusive mode"),
+				 errdetail("the lock is already held in shared mode")));
+
 	if (pool_is_shmem_cache() && !is_shmem_locked)
 	{
-		pool_semaphore_lock(SHM_CACHE_SEM);
+		pool_lwlock_acquire(SHM_CACHE_LOCK,
+							type == POOL_MEMQ_SHARED_LOCK ? POOL_LW_SHARED : POOL_LW_EXCLUSIVE);
 		is_shmem_locked = true;
+		shmem_lock_type = type;
 	}
 }
 
@@ -2827,7 +4492,7 @@ pool_shmem_unlock(void)
 {
 	if (pool_is_shmem_cache() && is_shmem_locked)
 	{
-		pool_semaphore_unlock(SHM_CACHE_SEM);
+		pool_lwlock_release(SHM_CACHE_LOCK);
 		is_shmem_locked = false;
 	}
 }
@@ -2994,6 +4659,7 @@ pool_create_temp_query_cache(char *query)
 	p->buffer = pool_create_buffer();
 	p->oids = pool_create_buffer();
 	p->num_oids = 0;
+	p->rule = 0;
 	p->is_exceeded = false;
 	p->is_discarded = false;
 
@@ -3037,6 +4703,7 @@ pool_add_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, char kind, char *d
 	POOL_INTERNAL_BUFFER *buffer;
 	size_t		buflen;
 	int			send_len;
+	int			maxcache;
 
 	if (temp_cache == NULL)
 	{
@@ -3067,16 +4734,23 @@ pool_add_temp_query_cache(POOL_TEMP_QUERY_CACHE * temp_cache, char kind, char *d
 		return;
 	}
 
-	/* Check data limit */
+	/*
+	 * Check data limit.  If the results are to be compressed, they may grow
+	 * up to memqcache_maxcache_uncompressed, and memqcache_maxcache is checked
+	 * after compression.
+	 */
 	buffer = temp_cache->buffer;
 	buflen = pool_get_buffer_length(buffer);
+	maxcache = pool_config->memqcache_maxcache;
+	if (pool_config->memqcache_compression != MEMQCACHE_COMPRESSION_OFF)
+		maxcache = Max(maxcache, pool_config->memqcache_maxcache_uncompressed);
 
-	if ((buflen + data_len + sizeof(int) + 1) > pool_config->memqcache_maxcache)
+	if ((buflen + data_len + sizeof(int) + 1) > maxcache)
 	{
 		ereport(DEBUG1,
 				(errmsg("memcache adding temporary query cache"),
 				 errdetail("data size exceeds memqcache_maxcache. current:%zd requested:%zd memq_maxcache:%d",
-						   buflen, data_len + sizeof(int) + 1, pool_config->memqcache_maxcache)));
+						   buflen, data_len + sizeof(int) + 1, maxcache)));
 		temp_cache->is_exceeded = true;
 		return;
 	}
@@ -3334,6 +5008,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 	size_t		len;
 	int			num_oids;
 	int		   *oids;
+	int			rule;
 	int			i;
 
 	session_context = pool_get_session_context(true);
@@ -3352,6 +5027,8 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 				(errmsg("query cache handler for ReadyForQuery"),
 				 errdetail("num_oids: %d oid: %d", num_oids, *oids)));
 
+		rule = pool_get_cache_rule(query, num_oids, ctx.table_names);
+
 		if (state == 'I')		/* Not inside a transaction? */
 		{
 			/*
@@ -3367,14 +5044,14 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 				 */
 				/* Register to memcached or shmem */
 				POOL_SETMASK2(&BlockSig, &oldmask);
-				pool_shmem_lock();
+				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
 				cache_buffer = pool_get_current_cache_buffer(&len);
 				if (cache_buffer)
 				{
 					if (session_context->query_context->skip_cache_commit == false)
 					{
-						if (pool_commit_cache(backend, query, cache_buffer, len, num_oids, oids) != 0)
+						if (pool_commit_cache(backend, query, cache_buffer, len, num_oids, oids, rule) != 0)
 						{
 							ereport(WARNING,
 									(errmsg("ReadyForQuery: pool_commit_cache failed")));
@@ -3418,6 +5095,8 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 
 			/* In transaction. Keep to temp query cache array */
 			pool_add_oids_temp_query_cache(cache, num_oids, oids);
+			if (cache)
+				cache->rule = rule;
 
 			/*
 			 * If temp cache has been overflowed, just trash the half baked
@@ -3471,7 +5150,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 		int			num_caches;
 
 		POOL_SETMASK2(&BlockSig, &oldmask);
-		pool_shmem_lock();
+		pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 
 		/* Invalidate query cache */
 		if (pool_config->memqcache_auto_cache_invalidation)
@@ -3500,7 +5179,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 			oids = pool_get_buffer(cache->oids, &len);
 			cache_buffer = pool_get_buffer(cache->buffer, &len);
 
-			if (pool_commit_cache(backend, cache->query, cache_buffer, len, num_oids, oids) != 0)
+			if (pool_commit_cache(backend, cache->query, cache_buffer, len, num_oids, oids, cache->rule) != 0)
 			{
 				ereport(WARNING,
 						(errmsg("ReadyForQuery: pool_commit_cache failed")));
@@ -3548,7 +5227,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 
 			if (num_oids > 0 && pool_config->memqcache_auto_cache_invalidation)
 			{
-				pool_shmem_lock();
+				pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 				pool_invalidate_query_cache(num_oids, oids, true, dboid);
 				pool_discard_oid_maps_by_db(dboid);
 				pool_shmem_unlock();
@@ -3577,7 +5256,7 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 				if (state == 'I')
 				{
 					POOL_SETMASK2(&BlockSig, &oldmask);
-					pool_shmem_lock();
+					pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 					pool_invalidate_query_cache(num_oids, oids, true, 0);
 					pool_shmem_unlock();
 					POOL_SETMASK(&oldmask);
@@ -3604,70 +5283,168 @@ pool_handle_query_cache(POOL_CONNECTION_POOL * backend, char *query, Node *node,
 			}
 		}
 	}
+
+	/* The result, if any, has been registered.  Let waiting processes go */
+	pool_release_in_flight();
 }
 
+/*
+ * Query cache stats in shared memory, sharded per child process the same
+ * way as the statement counters are.  See PER_CHILD_STAT in
+ * utils/statistics.c.
+ */
+/*
+ * Stats slots of cache rules.  Slot 0 is for SELECTs no rule matched.  A
+ * slot is assigned to the kind and pattern of a rule the first time a
+ * process compiles the rule, and never released, so that there are more
+ * slots than rules to leave room for rules changed by reload.  While a
+ * slot is being assigned its state carries the pid of the process
+ * assigning it.
+ */
+#define MAX_CACHE_RULE_SLOTS	(MAX_CACHE_RULES * 2)
+#define CACHE_RULE_KEY_LEN		256
+
+#define CACHE_RULE_SLOT_FREE	0
+#define CACHE_RULE_SLOT_READY	1
+#define CACHE_RULE_SLOT_BUSY	0x80000000	/* ORed with pid of the assigner */
+
+typedef struct
+{
+	uint32		state;			/* CACHE_RULE_SLOT_* */
+	char		key[CACHE_RULE_KEY_LEN];	/* "table:" or "query:" and the
+											 * pattern */
+}			POOL_CACHE_RULE_SLOT;
+
+typedef struct
+{
+	uint64		num_selects;	/* number of successful SELECTs */
+	uint64		num_cache_hits; /* number of SELECTs extracted from cache */
+	/* same as above and more, per stats slot of cache rules */
+	uint64		rule_cache_hits[MAX_CACHE_RULE_SLOTS + 1];
+	uint64		rule_cache_stores[MAX_CACHE_RULE_SLOTS + 1];
+	uint64		rule_not_admitted[MAX_CACHE_RULE_SLOTS + 1];
+}			POOL_QUERY_CACHE_STATS_SHARD;
+
+#define STATS_SHARD_SIZE	CACHELINEALIGN(sizeof(POOL_QUERY_CACHE_STATS_SHARD))
+
+typedef struct
+{
+	time_t		start_time;		/* start time when the statistics begins */
+	int			num_shards;
+	char	   *shards;			/* num_shards * STATS_SHARD_SIZE */
+	POOL_CACHE_RULE_SLOT rule_slots[MAX_CACHE_RULE_SLOTS + 1];
+}			POOL_QUERY_CACHE_STATS_AREA;
+
+static POOL_QUERY_CACHE_STATS_AREA * stats;
+
+static volatile POOL_QUERY_CACHE_STATS_SHARD * stats_shard(int i);
+static volatile POOL_QUERY_CACHE_STATS_SHARD * my_stats_shard(void);
+
 /*
  * Create and initialize query cache stats
  */
-static POOL_QUERY_CACHE_STATS * stats;
 int
 pool_init_memqcache_stats(void)
 {
-	stats = pool_shared_memory_create(sizeof(POOL_QUERY_CACHE_STATS));
+	int			num_shards = pool_config->num_init_children;
+	char	   *p;
+
+	p = pool_shared_memory_create(CACHELINEALIGN(sizeof(POOL_QUERY_CACHE_STATS_AREA)) +
+								  num_shards * STATS_SHARD_SIZE +
+								  POOL_CACHE_LINE_SIZE);
+	p = (char *) CACHELINEALIGN(p);
+	stats = (POOL_QUERY_CACHE_STATS_AREA *) p;
+	stats->num_shards = num_shards;
+	stats->shards = p + CACHELINEALIGN(sizeof(POOL_QUERY_CACHE_STATS_AREA));
+	memset(stats->rule_slots, 0, sizeof(stats->rule_slots));
 	pool_reset_memqcache_stats();
 	return 0;
 }
 
+static volatile POOL_QUERY_CACHE_STATS_SHARD *
+stats_shard(int i)
+{
+	return (POOL_QUERY_CACHE_STATS_SHARD *) (stats->shards + i * STATS_SHARD_SIZE);
+}
+
+/*
+ * Return the shard of this process.  Processes other than children do
+ * not count, but fall back to the first shard just in case.  This is why
+ * the counters are still updated atomically.
+ */
+static volatile POOL_QUERY_CACHE_STATS_SHARD *
+my_stats_shard(void)
+{
+	if (my_proc_id < 0 || my_proc_id >= stats->num_shards)
+		return stats_shard(0);
+	return stats_shard(my_proc_id);
+}
+
 /*
- * Returns copy of stats area. The copy is in static area and will be
+ * Returns sum of stats shards. The sum is in static area and will be
  * overwritten by next call to this function.
  */
 POOL_QUERY_CACHE_STATS *
 pool_get_memqcache_stats(void)
 {
 	static POOL_QUERY_CACHE_STATS mystats;
-	pool_sigset_t oldmask;
+	int			i;
 
 	memset(&mystats, 0, sizeof(POOL_QUERY_CACHE_STATS));
 
 	if (stats)
 	{
-		POOL_SETMASK2(&BlockSig, &oldmask);
-		pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
-		memcpy(&mystats, stats, sizeof(POOL_QUERY_CACHE_STATS));
-		pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
-		POOL_SETMASK(&oldmask);
+		mystats.start_time = stats->start_time;
+		for (i = 0; i < stats->num_shards; i++)
+		{
+			volatile POOL_QUERY_CACHE_STATS_SHARD *shard = stats_shard(i);
+			int			j;
+
+			mystats.num_selects += pool_atomic_read_u64(&shard->num_selects);
+			mystats.num_cache_hits += pool_atomic_read_u64(&shard->num_cache_hits);
+			for (j = 0; j <= MAX_CACHE_RULE_SLOTS; j++)
+			{
+				mystats.num_cache_stores += pool_atomic_read_u64(&shard->rule_cache_stores[j]);
+				mystats.num_not_admitted += pool_atomic_read_u64(&shard->rule_not_admitted[j]);
+			}
+		}
 	}
 
 	return &mystats;
 }
 
 /*
- * Reset query cache stats. Caller must lock QUERY_CACHE_STATS_SEM if
- * necessary.
+ * Reset query cache stats.
  */
 void
 pool_reset_memqcache_stats(void)
 {
-	memset(stats, 0, sizeof(POOL_QUERY_CACHE_STATS));
+	int			i;
+
+	for (i = 0; i < stats->num_shards; i++)
+	{
+		volatile POOL_QUERY_CACHE_STATS_SHARD *shard = stats_shard(i);
+		int			j;
+
+		pool_atomic_write_u64(&shard->num_selects, 0);
+		pool_atomic_write_u64(&shard->num_cache_hits, 0);
+		for (j = 0; j <= MAX_CACHE_RULE_SLOTS; j++)
+		{
+			pool_atomic_write_u64(&shard->rule_cache_hits[j], 0);
+			pool_atomic_write_u64(&shard->rule_cache_stores[j], 0);
+			pool_atomic_write_u64(&shard->rule_not_admitted[j], 0);
+		}
+	}
 	stats->start_time = time(NULL);
 }
 
 /*
- * Count up number of successful SELECTs and returns the number.
- * QUERY_CACHE_STATS_SEM lock is acquired in this function.
+ * Count up number of successful SELECTs.
  */
-long long int
+void
 pool_stats_count_up_num_selects(long long int num)
 {
-	pool_sigset_t oldmask;
-
-	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
-	stats->num_selects += num;
-	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
-	POOL_SETMASK(&oldmask);
-	return stats->num_selects;
+	pool_atomic_fetch_add_u64(&my_stats_shard()->num_selects, num);
 }
 
 /*
@@ -3709,20 +5486,140 @@ pool_tmp_stats_reset_num_selects(void)
 }
 
 /*
- * Count up number of SELECTs extracted from cache returns the number.
- * QUERY_CACHE_STATS_SEM lock is acquired in this function.
+ * Count up number of SELECTs extracted from cache.
  */
-long long int
+void
 pool_stats_count_up_num_cache_hits(void)
 {
-	pool_sigset_t oldmask;
+	volatile POOL_QUERY_CACHE_STATS_SHARD *shard = my_stats_shard();
 
-	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_semaphore_lock(QUERY_CACHE_STATS_SEM);
-	stats->num_cache_hits++;
-	pool_semaphore_unlock(QUERY_CACHE_STATS_SEM);
-	POOL_SETMASK(&oldmask);
-	return stats->num_cache_hits;
+	pool_atomic_fetch_add_u64(&shard->num_cache_hits, 1);
+	if (fetched_cache_rule_slot >= 0 && fetched_cache_rule_slot <= MAX_CACHE_RULE_SLOTS)
+		pool_atomic_fetch_add_u64(&shard->rule_cache_hits[fetched_cache_rule_slot], 1);
+}
+
+/*
+ * Count up number of SELECT results cached, or not admitted, in the stats
+ * slot of a cache rule.
+ */
+static void
+pool_stats_count_up_cache_rule(int slot, bool admitted)
+{
+	volatile POOL_QUERY_CACHE_STATS_SHARD *shard = my_stats_shard();
+
+	if (slot < 0 || slot > MAX_CACHE_RULE_SLOTS)
+		return;
+
+	if (admitted)
+		pool_atomic_fetch_add_u64(&shard->rule_cache_stores[slot], 1);
+	else
+		pool_atomic_fetch_add_u64(&shard->rule_not_admitted[slot], 1);
+}
+
+/*
+ * Find or assign the stats slot of a cache rule.  Returns -1 if all slots
+ * are taken by other rules.
+ *
+ * As with the per database stat slots in utils/statistics.c, a slot being
+ * assigned by somebody else is waited for, so that two processes never
+ * end up with separate slots for the same rule, and a slot left half
+ * assigned by a process which died is freed again.
+ */
+static int
+cache_rule_slot(bool is_query, const char *pattern)
+{
+	char		key[CACHE_RULE_KEY_LEN];
+	int			i;
+	int			spin;
+	uint32		state;
+
+	if (stats == NULL)
+		return -1;
+
+	snprintf(key, sizeof(key), "%s:%s", is_query ? "query" : "table", pattern);
+
+retry:
+	for (i = 1; i <= MAX_CACHE_RULE_SLOTS; i++)
+	{
+		volatile POOL_CACHE_RULE_SLOT *slot = &stats->rule_slots[i];
+
+		for (spin = 0; spin < 1000; spin++)
+		{
+			state = pool_atomic_read_u32(&slot->state);
+			if (!(state & CACHE_RULE_SLOT_BUSY))
+				break;
+		}
+
+		if (state == CACHE_RULE_SLOT_READY)
+		{
+			if (strcmp((char *) slot->key, key) == 0)
+				return i;
+			continue;
+		}
+
+		if (state & CACHE_RULE_SLOT_BUSY)
+		{
+			if (kill((pid_t) (state & ~CACHE_RULE_SLOT_BUSY), 0) == 0 || errno != ESRCH)
+				continue;		/* assigner is alive but slow */
+
+			/* the assigner died before finishing, take the slot back */
+			pool_atomic_compare_exchange_u32(&slot->state, &state, CACHE_RULE_SLOT_FREE);
+			goto retry;
+		}
+
+		state = CACHE_RULE_SLOT_FREE;
+		if (!pool_atomic_compare_exchange_u32(&slot->state, &state,
+											  CACHE_RULE_SLOT_BUSY | (uint32) getpid()))
+			goto retry;
+
+		strlcpy((char *) slot->key, key, CACHE_RULE_KEY_LEN);
+		pool_atomic_write_u32(&slot->state, CACHE_RULE_SLOT_READY);
+		return i;
+	}
+
+	ereport(LOG,
+			(errmsg("no stats slot is left for cache rule \"%s\"", pattern),
+			 errdetail("the rule is not counted in SHOW pool_cache")));
+	return -1;
+}
+
+/*
+ * Returns palloc'd stats of rule 0 and the current cache rules.  *nrules
+ * is set to the number of the elements.
+ */
+POOL_CACHE_RULE_STATS *
+pool_get_cache_rule_stats(int *nrules)
+{
+	POOL_CACHE_RULE_STATS *rule_stats;
+	int			i;
+	int			j;
+
+	if (cache_rules_changed())
+		pool_compile_cache_rules();
+
+	*nrules = num_cache_rules + 1;
+	rule_stats = palloc0(sizeof(POOL_CACHE_RULE_STATS) * *nrules);
+
+	for (j = 0; j < *nrules; j++)
+	{
+		int			slot = pool_get_cache_rule_slot(j);
+
+		rule_stats[j].rule = j > 0 ? cache_rules[j].rule : NULL;
+
+		if (stats == NULL || slot < 0)
+			continue;
+
+		for (i = 0; i < stats->num_shards; i++)
+		{
+			volatile POOL_QUERY_CACHE_STATS_SHARD *shard = stats_shard(i);
+
+			rule_stats[j].num_cache_hits += pool_atomic_read_u64(&shard->rule_cache_hits[slot]);
+			rule_stats[j].num_cache_stores += pool_atomic_read_u64(&shard->rule_cache_stores[slot]);
+			rule_stats[j].num_not_admitted += pool_atomic_read_u64(&shard->rule_not_admitted[slot]);
+		}
+	}
+
+	return rule_stats;
 }
 
 /*
@@ -3773,6 +5670,8 @@ pool_hash_init(int nelements)
 	hash_header = pool_shared_memory_create(size);
 	hash_header->nhash = nelements2;
 	hash_header->mask = mask;
+	hash_header->max_entries = Min(pool_config->memqcache_max_num_cache, nelements2 - 1);
+	hash_header->num_entries = 0;
 
 #ifdef POOL_HASH_DEBUG
 	ereport(LOG,
@@ -3801,41 +5700,30 @@ pool_hash_init(int nelements)
 }
 
 /*
- * Reset hash table on shared memory "nelements" is max number of
- * hash keys. The actual number of hash key is rounded up to power of
- * 2.
+ * Reset hash table on shared memory.  The number of hash keys is the one
+ * reserved at start up, which memqcache_max_num_cache may not exceed even
+ * after reloading, so it is kept as is.
  */
 static int
-pool_hash_reset(int nelements)
+pool_hash_reset(void)
 {
+	int			max_entries;
 	size_t		size;
 	int			nelements2;		/* number of rounded up hash keys */
-	int			shift;
 	uint32		mask;
 	POOL_HASH_HEADER hh;
 	int			i;
 
-	if (nelements <= 0)
-		ereport(ERROR,
-				(errmsg("clearing hash table on shared memory, invalid number of elements: %d", nelements)));
-
-	/* Round up to power of 2 */
-	shift = 32;
-	nelements2 = 1;
-	do
-	{
-		nelements2 <<= 1;
-		shift--;
-	} while (nelements2 < nelements);
-
-	mask = ~0;
-	mask >>= shift;
+	nelements2 = hash_header->nhash;
+	mask = hash_header->mask;
 
 	size = (char *) &hh.elements - (char *) &hh + sizeof(POOL_HEADER_ELEMENT) * nelements2;
+	max_entries = hash_header->max_entries;
 	memset((void *) hash_header, 0, size);
 
 	hash_header->nhash = nelements2;
 	hash_header->mask = mask;
+	hash_header->max_entries = max_entries;
 
 	size = sizeof(POOL_HASH_ELEMENT) * nelements2;
 	memset((void *) hash_elements, 0, size);
@@ -4080,7 +5968,7 @@ get_new_hash_element(void)
 {
 	volatile	POOL_HASH_ELEMENT *elm;
 
-	if (!hash_free->next)
+	if (!is_free_hash_element())
 	{
 		/* No free element */
 		return NULL;
@@ -4095,6 +5983,7 @@ get_new_hash_element(void)
 
 	elm = hash_free->next;
 	hash_free->next = elm->next;
+	hash_header->num_entries++;
 
 	return elm;
 }
@@ -4117,15 +6006,157 @@ put_back_hash_element(volatile POOL_HASH_ELEMENT * element)
 	elm = hash_free->next;
 	hash_free->next = (POOL_HASH_ELEMENT *) element;
 	element->next = elm;
+	hash_header->num_entries--;
 }
 
 /*
- * Return true if there's a free hash element.
+ * Return true if there's a free hash element.  Elements beyond
+ * memqcache_max_num_cache are not used.
  */
 static bool
 is_free_hash_element(void)
 {
-	return hash_free->next != NULL;
+	return hash_free->next != NULL &&
+		hash_header->num_entries < hash_header->max_entries;
+}
+
+/*
+ * Resize the shared memory cache storage and hash table to the current
+ * memqcache_total_size and memqcache_max_num_cache, within the limits
+ * reserved at start up.  This is called by pgpool main process after
+ * reloading the configuration.  Cache entries in the blocks no longer in
+ * use are removed and the memory of the blocks is returned to the
+ * system.  If there are more cache entries than the new
+ * memqcache_max_num_cache, blocks are evicted by the clock algorithm as
+ * when the storage is full.
+ */
+void
+pool_resize_memory_cache(void)
+{
+	pool_sigset_t oldmask;
+	int			old_blocks;
+	int			new_blocks;
+	int			max_entries;
+	int			i;
+
+	if (memqcache_active_blocks == NULL || hash_header == NULL)
+		return;
+
+	new_blocks = pool_memqcache_blocks_for_size(pool_config->memqcache_total_size);
+	if ((int64) new_blocks * pool_config->memqcache_cache_block_size < pool_config->memqcache_total_size)
+		ereport(WARNING,
+				(errmsg("memqcache_total_size %ld exceeds the reserved size",
+						pool_config->memqcache_total_size),
+				 errdetail("the cache storage is resized to %ld bytes",
+						   (int64) new_blocks * pool_config->memqcache_cache_block_size),
+				 errhint("memqcache_total_size_limit needs to be raised at server start.")));
+
+	max_entries = pool_config->memqcache_max_num_cache;
+	if (max_entries > hash_header->nhash - 1)
+	{
+		ereport(WARNING,
+				(errmsg("memqcache_max_num_cache %d exceeds the reserved number of cache entries",
+						max_entries),
+				 errdetail("the number of cache entries is limited to %ld", hash_header->nhash - 1),
+				 errhint("memqcache_max_num_cache_limit needs to be raised at server start.")));
+		max_entries = hash_header->nhash - 1;
+	}
+	if (max_entries < 1)
+		max_entries = 1;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
+
+	PG_TRY();
+	{
+		old_blocks = pool_get_memqcache_active_blocks();
+
+		if (new_blocks < old_blocks)
+		{
+			/* Stop using the blocks first, then remove the entries in them */
+			*memqcache_active_blocks = new_blocks;
+			if (*pool_fsmm_clock_hand >= new_blocks)
+				*pool_fsmm_clock_hand = 0;
+			pool_release_cache_blocks(new_blocks, old_blocks);
+		}
+		else if (new_blocks > old_blocks)
+		{
+			*memqcache_active_blocks = new_blocks;
+			for (i = old_blocks; i < new_blocks; i++)
+			{
+				pool_init_cache_block(i);
+				pool_update_fsmm(i, POOL_MAX_FREE_SPACE);
+			}
+		}
+
+		hash_header->max_entries = max_entries;
+		for (i = 0; hash_header->num_entries > max_entries && i < new_blocks; i++)
+			pool_reuse_block();
+	}
+	PG_CATCH();
+	{
+		pool_shmem_unlock();
+		POOL_SETMASK(&oldmask);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pool_shmem_unlock();
+	POOL_SETMASK(&oldmask);
+
+	if (new_blocks != old_blocks)
+		ereport(LOG,
+				(errmsg("memory cache resized"),
+				 errdetail("memcache blocks: %d -> %d", old_blocks, new_blocks)));
+}
+
+/*
+ * Remove the cache entries in the blocks from "from" to "to" - 1, which
+ * are no longer in use, and return their memory to the system.
+ */
+static void
+pool_release_cache_blocks(int from, int to)
+{
+	size_t		size;
+	size_t		page_size;
+	char	   *start;
+	char	   *end;
+	int			i;
+	int			j;
+
+	for (i = from; i < to; i++)
+	{
+		char	   *p = block_address(i);
+		POOL_CACHE_BLOCK_HEADER *bh = (POOL_CACHE_BLOCK_HEADER *) p;
+
+		if (bh->flags & POOL_BLOCK_USED)
+		{
+			for (j = 0; j < bh->num_items; j++)
+			{
+				POOL_CACHE_ITEM_POINTER *cip = item_pointer(p, j);
+
+				if (!(POOL_ITEM_DELETED & cip->flags))
+					pool_hash_delete(&cip->query_hash);
+			}
+		}
+		memset(bh, 0, sizeof(POOL_CACHE_BLOCK_HEADER));
+		pool_update_fsmm(i, 0);
+	}
+
+	/*
+	 * Only whole pages can be released.  The storage may be on huge pages,
+	 * in which case partial huge pages must not be touched.
+	 */
+	if (!pool_shared_memory_info(shmem, &size, &page_size))
+		page_size = sysconf(_SC_PAGESIZE);
+	start = (char *) TYPEALIGN(page_size, block_address(from));
+	end = (char *) ((intptr_t) block_address(to) & ~((intptr_t) (page_size - 1)));
+#ifdef MADV_REMOVE
+	if (end > start && madvise(start, end - start, MADV_REMOVE) != 0)
+		ereport(DEBUG1,
+				(errmsg("could not release memory of cache blocks"),
+				 errdetail("madvise failed with error \"%s\"", strerror(errno))));
+#endif
 }
 
 /*
@@ -4149,16 +6180,15 @@ pool_get_shmem_storage_stats(void)
 		return &mystats;
 
 	/*
-	 * Cop cache hit data
+	 * Copy cache hit data
 	 */
-	mystats.cache_stats.num_selects = stats->num_selects;
-	mystats.cache_stats.num_cache_hits = stats->num_cache_hits;
+	memcpy(&mystats.cache_stats, pool_get_memqcache_stats(), sizeof(mystats.cache_stats));
 
 	if (pool_config->memqcache_method != SHMEM_CACHE)
 		return &mystats;
 
 	/* number of total hash entries */
-	mystats.num_hash_entries = hash_header->nhash;
+	mystats.num_hash_entries = hash_header->max_entries;
 
 	/* number of used hash entries */
 	for (i = 0; i < hash_header->nhash; i++)
@@ -4171,7 +6201,19 @@ pool_get_shmem_storage_stats(void)
 		}
 	}
 
-	nblocks = pool_get_memqcache_blocks();
+	/* size of the cache storage and of the pages it is mapped on */
+	{
+		size_t		size;
+		size_t		page_size;
+
+		if (pool_shared_memory_info(shmem, &size, &page_size))
+		{
+			mystats.shmem_size = size;
+			mystats.shmem_page_size = page_size;
+		}
+	}
+
+	nblocks = pool_get_memqcache_active_blocks();
 
 	for (i = 0; i < nblocks; i++)
 	{
@@ -4209,11 +6251,6 @@ pool_get_shmem_storage_stats(void)
 		}
 	}
 
-	/*
-	 * Copy POOL_QUERY_CACHE_STATS
-	 */
-	memcpy(&mystats.cache_stats, stats, sizeof(mystats.cache_stats));
-
 	return &mystats;
 }
 
@@ -0,0 +1,634 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2019	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_sequence.c: pre-allocation of sequence values for INSERT in
+ * native replication mode.
+ *
+ * Instead of locking the table (insert_lock) so that nextval() returns
+ * the same value on all nodes, an INSERT into a table with SERIAL columns
+ * is rewritten to carry explicit values for those columns.  The values
+ * are fetched from the master node in blocks of
+ * sequence_preallocation_size and handed out from shared memory, so that
+ * concurrent INSERTs do not wait for each other except for the short
+ * critical section taking values out of the block.  Each time a block is
+ * fetched the sequences on the other nodes are advanced too, so that
+ * they do not hand out used values after failover.
+ *
+ * Like sequence caching of PostgreSQL, values which are pre-allocated but
+ * not used leave gaps in the sequence.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "rewrite/pool_sequence.h"
+#include "protocol/pool_proto_modules.h"
+#include "utils/elog.h"
+#include "utils/palloc.h"
+#include "utils/pool_lwlock.h"
+#include "utils/pool_relcache.h"
+#include "utils/pool_select_walker.h"
+#include "parser/parsenodes.h"
+
+#define SEQ_NAME_LEN	256
+
+/*
+ * Query to find the columns whose default is nextval() of their owned
+ * sequence.  The second column is the position of the column among the
+ * non dropped columns, which is used for INSERT without column list.
+ */
+#define SEQATTRQUERY "SELECT a.attname, a.n, pg_catalog.pg_get_serial_sequence(a.attrelid::pg_catalog.regclass::pg_catalog.text, a.attname)" \
+	" FROM (SELECT attrelid, attname, attnum, pg_catalog.row_number() OVER (ORDER BY attnum) - 1 AS n" \
+	" FROM pg_catalog.pg_attribute WHERE attrelid = pg_catalog.to_regclass('%s') AND attnum >= 1 AND NOT attisdropped) a" \
+	" JOIN pg_catalog.pg_attrdef d ON (d.adrelid = a.attrelid AND d.adnum = a.attnum)" \
+	" WHERE pg_catalog.pg_get_expr(d.adbin, d.adrelid) ~ 'nextval' ORDER BY a.attnum"
+
+typedef struct
+{
+	char	   *attname;		/* column name */
+	int			position;		/* position among non dropped columns */
+	char	   *seqname;		/* qualified sequence name */
+}			SeqAttr;
+
+typedef struct
+{
+	bool		usable;			/* false if some nextval() default is not of
+								 * an owned sequence */
+	int			natts;			/* number of SERIAL columns */
+	SeqAttr		attr[1];
+}			SeqRel;
+
+/*
+ * A block of pre-allocated values of a sequence in shared memory.
+ */
+typedef struct
+{
+	char		dbname[SEQ_NAME_LEN];	/* database name, "" if unused */
+	char		seqname[SEQ_NAME_LEN];	/* qualified sequence name */
+	uint32		last_used;		/* clock value of the last use */
+	int			next;			/* index of the next value to hand out */
+	int			count;			/* number of values in the block */
+}			SEQ_SLOT;
+
+typedef struct
+{
+	uint32		clock;			/* incremented at every slot use */
+	SEQ_SLOT	slots[SEQUENCE_PREALLOC_SLOTS];
+	int64		values[1];		/* SEQUENCE_PREALLOC_SLOTS blocks */
+}			SEQ_AREA;
+
+static SEQ_AREA * seq_area = NULL;
+
+static POOL_RELCACHE * seq_relcache;
+
+static void *seq_register_func(POOL_SELECT_RESULT * res);
+static void *seq_unregister_func(void *data);
+static SeqRel * relcache_lookup(POOL_CONNECTION_POOL * backend, char *table);
+static A_Const *makeSequenceConst(void);
+static void get_sequence_values(POOL_CONNECTION_POOL * backend, char *seqname, int n, int64 *values);
+static int	take_values(char *dbname, char *seqname, int n, int64 *values);
+static void store_values(char *dbname, char *seqname, int64 *values, int n);
+static void fetch_values(POOL_CONNECTION_POOL * backend, char *seqname, int n, int64 *values);
+static SEQ_SLOT * find_slot(char *dbname, char *seqname);
+static char *quote_literal(char *str);
+
+size_t
+pool_sequence_shared_memory_size(void)
+{
+	return MAXALIGN(offsetof(SEQ_AREA, values) +
+					sizeof(int64) * SEQUENCE_PREALLOC_SLOTS * pool_config->sequence_preallocation_size);
+}
+
+void
+pool_sequence_init(void *addr)
+{
+	seq_area = (SEQ_AREA *) addr;
+	memset(seq_area, 0, pool_sequence_shared_memory_size());
+}
+
+static void *
+seq_register_func(POOL_SELECT_RESULT * res)
+{
+/* Number of result columns included in res */
+#define NUM_COLS		3
+
+	SeqRel	   *rel;
+	int			i;
+
+	if (res->numrows == 0)
+		return NULL;
+
+	rel = (SeqRel *) malloc(sizeof(SeqRel) + sizeof(SeqAttr) * (res->numrows - 1));
+	rel->usable = true;
+
+	for (i = 0; i < res->numrows; i++)
+	{
+		rel->attr[i].attname = strdup(res->data[i * NUM_COLS]);
+		rel->attr[i].position = atoi(res->data[i * NUM_COLS + 1]);
+
+		/* default is nextval() of a sequence not owned by the column */
+		if (res->data[i * NUM_COLS + 2] == NULL)
+		{
+			rel->attr[i].seqname = NULL;
+			rel->usable = false;
+		}
+		else
+			rel->attr[i].seqname = strdup(res->data[i * NUM_COLS + 2]);
+
+		ereport(DEBUG1,
+				(errmsg("sequence register function"),
+				 errdetail("attname %s position %d seqname %s",
+						   rel->attr[i].attname, rel->attr[i].position,
+						   rel->attr[i].seqname ? rel->attr[i].seqname : "NULL")));
+	}
+
+	rel->natts = res->numrows;
+	return (void *) rel;
+}
+
+static void *
+seq_unregister_func(void *data)
+{
+	SeqRel	   *rel = (SeqRel *) data;
+	int			i;
+
+	if (rel)
+	{
+		for (i = 0; i < rel->natts; i++)
+		{
+			free(rel->attr[i].attname);
+			if (rel->attr[i].seqname)
+				free(rel->attr[i].seqname);
+		}
+		free(rel);
+	}
+	return (void *) 0;
+}
+
+static SeqRel *
+relcache_lookup(POOL_CONNECTION_POOL * backend, char *table)
+{
+	if (!seq_relcache)
+	{
+		seq_relcache = pool_create_relcache(pool_config->relcache_size, SEQATTRQUERY,
+											seq_register_func, seq_unregister_func, false);
+		if (seq_relcache == NULL)
+		{
+			ereport(WARNING,
+					(errmsg("unable to create relcache")));
+			return NULL;
+		}
+	}
+
+	return (SeqRel *) pool_search_relcache(seq_relcache, backend, table);
+}
+
+/*
+ * Make a constant for a sequence value.  The value is filled in after all
+ * the values needed by the query have been fetched.
+ */
+static A_Const *
+makeSequenceConst(void)
+{
+	A_Const    *con;
+
+	con = makeNode(A_Const);
+	con->val.type = T_Float;	/* may not fit into int */
+	con->val.val.str = NULL;
+	return con;
+}
+
+/*
+ * Rewrite INSERT into a table with SERIAL columns so that it carries
+ * pre-allocated values for them instead of relying on nextval() being
+ * called in the same order on all nodes.  Returns the rewritten query
+ * string as a palloc'd string, or NULL if the query cannot be rewritten
+ * and insert_lock must be used instead.  The parse tree is modified.
+ *
+ * Only INSERT ... VALUES and INSERT ... DEFAULT VALUES are rewritten,
+ * since the number of values needed for INSERT ... SELECT is not known
+ * beforehand.
+ */
+char *
+rewrite_insert_sequence(POOL_CONNECTION_POOL * backend, Node *node)
+{
+	InsertStmt *i_stmt;
+	SelectStmt *selectStmt;
+	SeqRel	   *rel;
+	ListCell   *lc_row,
+			   *lc_val,
+			   *lc_col;
+	int			i;
+
+	if (seq_area == NULL || !IsA(node, InsertStmt))
+		return NULL;
+
+	i_stmt = (InsertStmt *) node;
+
+	if (i_stmt->selectStmt != NULL &&
+		(!IsA(i_stmt->selectStmt, SelectStmt) ||
+		 ((SelectStmt *) i_stmt->selectStmt)->valuesLists == NIL))
+		return NULL;
+
+	/* SEQATTRQUERY needs to_regclass() */
+	if (!pool_has_to_regclass())
+		return NULL;
+
+	rel = relcache_lookup(backend, make_table_name_from_rangevar(i_stmt->relation));
+	if (rel == NULL || !rel->usable)
+		return NULL;
+
+	/*
+	 * INSERT INTO rel DEFAULT VALUES is handled as INSERT INTO rel VALUES
+	 * () and the columns are appended below.
+	 */
+	if (i_stmt->selectStmt == NULL)
+	{
+		selectStmt = makeNode(SelectStmt);
+		selectStmt->valuesLists = list_make1(NIL);
+		i_stmt->selectStmt = (Node *) selectStmt;
+	}
+	else
+		selectStmt = (SelectStmt *) i_stmt->selectStmt;
+
+	for (i = 0; i < rel->natts; i++)
+	{
+		SeqAttr    *attr = &rel->attr[i];
+		List	   *consts = NIL;
+		ListCell   *lc;
+		int64	   *values;
+		int			col_index = -1;
+		int			n;
+
+		if (i_stmt->cols == NIL)
+		{
+			/*
+			 * INSERT INTO rel VALUES (...): the value is given by position.
+			 * Columns not given at the end of the list get their default,
+			 * so append DEFAULTs up to the SERIAL column.
+			 */
+			foreach(lc_row, selectStmt->valuesLists)
+			{
+				List	   *row = (List *) lfirst(lc_row);
+
+				if (list_length(row) > attr->position)
+				{
+					lc_val = list_nth_cell(row, attr->position);
+					if (!IsA(lfirst(lc_val), SetToDefault))
+						continue;
+					lfirst(lc_val) = makeSequenceConst();
+					consts = lappend(consts, lfirst(lc_val));
+				}
+				else
+				{
+					while (list_length(row) < attr->position)
+						row = lappend(row, makeNode(SetToDefault));
+					row = lappend(row, makeSequenceConst());
+					consts = lappend(consts, llast(row));
+					lfirst(lc_row) = row;
+				}
+			}
+		}
+		else
+		{
+			/*
+			 * INSERT INTO rel(col1, col2) VALUES (...): replace DEFAULT of
+			 * the SERIAL column, or add the column if not given.
+			 */
+			n = 0;
+			foreach(lc_col, i_stmt->cols)
+			{
+				ResTarget  *col = (ResTarget *) lfirst(lc_col);
+
+				if (strcmp(col->name, attr->attname) == 0)
+				{
+					col_index = n;
+					break;
+				}
+				n++;
+			}
+
+			if (col_index < 0)
+			{
+				ResTarget  *col = makeNode(ResTarget);
+
+				col->name = attr->attname;
+				col->indirection = NIL;
+				col->val = NULL;
+				i_stmt->cols = lappend(i_stmt->cols, col);
+			}
+
+			foreach(lc_row, selectStmt->valuesLists)
+			{
+				List	   *row = (List *) lfirst(lc_row);
+
+				if (col_index >= 0)
+				{
+					if (list_length(row) <= col_index)
+						continue;
+					lc_val = list_nth_cell(row, col_index);
+					if (!IsA(lfirst(lc_val), SetToDefault))
+						continue;
+					lfirst(lc_val) = makeSequenceConst();
+					consts = lappend(consts, lfirst(lc_val));
+				}
+				else
+				{
+					row = lappend(row, makeSequenceConst());
+					consts = lappend(consts, llast(row));
+					lfirst(lc_row) = row;
+				}
+			}
+		}
+
+		if (consts == NIL)
+			continue;
+
+		n = list_length(consts);
+		values = palloc(sizeof(int64) * n);
+		get_sequence_values(backend, attr->seqname, n, values);
+
+		n = 0;
+		foreach(lc, consts)
+		{
+			A_Const    *con = (A_Const *) lfirst(lc);
+
+			con->val.val.str = psprintf("%lld", (long long) values[n++]);
+		}
+		pfree(values);
+		list_free(consts);
+	}
+
+	return nodeToString(node);
+}
+
+/*
+ * Discard the pre-allocated values of all sequences in the database of
+ * the session, and the SERIAL columns cached by all processes.  Called on
+ * statements which may reset or recreate sequences, and again at the end
+ * of their transaction.
+ */
+void
+pool_sequence_invalidate(POOL_CONNECTION_POOL * backend)
+{
+	char	   *dbname = MASTER_CONNECTION(backend)->sp->database;
+	int			i;
+
+	if (seq_area == NULL)
+		return;
+
+	/* SERIAL columns cached by other processes are looked up again */
+	pool_relcache_invalidate();
+
+	pool_lwlock_acquire(SEQUENCE_LOCK, POOL_LW_EXCLUSIVE);
+	for (i = 0; i < SEQUENCE_PREALLOC_SLOTS; i++)
+	{
+		SEQ_SLOT   *slot = &seq_area->slots[i];
+
+		if (strcmp(slot->dbname, dbname) == 0)
+		{
+			slot->dbname[0] = '\0';
+			slot->next = slot->count = 0;
+		}
+	}
+	pool_lwlock_release(SEQUENCE_LOCK);
+}
+
+/*
+ * Get n values of the sequence, from the pre-allocated block if possible.
+ */
+static void
+get_sequence_values(POOL_CONNECTION_POOL * backend, char *seqname, int n, int64 *values)
+{
+	char	   *dbname = MASTER_CONNECTION(backend)->sp->database;
+	int			size = pool_config->sequence_preallocation_size;
+	int			got;
+	int			need;
+	int64	   *block;
+
+	got = take_values(dbname, seqname, n, values);
+	if (got == n)
+		return;
+
+	need = n - got;
+
+	/* More than a block is needed.  Just fetch them. */
+	if (need >= size)
+	{
+		fetch_values(backend, seqname, need, values + got);
+		return;
+	}
+
+	/*
+	 * Fetch a new block without holding the lock, use the first values
+	 * and keep the rest for others.
+	 */
+	block = palloc(sizeof(int64) * size);
+	fetch_values(backend, seqname, size, block);
+	memcpy(values + got, block, sizeof(int64) * need);
+	store_values(dbname, seqname, block + need, size - need);
+	pfree(block);
+}
+
+/*
+ * Take at most n values out of the block of the sequence.  Returns the
+ * number of values taken.
+ */
+static int
+take_values(char *dbname, char *seqname, int n, int64 *values)
+{
+	SEQ_SLOT   *slot;
+	int			taken = 0;
+
+	pool_lwlock_acquire(SEQUENCE_LOCK, POOL_LW_EXCLUSIVE);
+
+	slot = find_slot(dbname, seqname);
+	if (slot)
+	{
+		int64	   *block = seq_area->values + (slot - seq_area->slots) * pool_config->sequence_preallocation_size;
+
+		taken = Min(n, slot->count - slot->next);
+		memcpy(values, block + slot->next, sizeof(int64) * taken);
+		slot->next += taken;
+		slot->last_used = ++seq_area->clock;
+	}
+
+	pool_lwlock_release(SEQUENCE_LOCK);
+
+	return taken;
+}
+
+/*
+ * Keep n values as the block of the sequence.  If another process has
+ * filled the block meanwhile, the values are thrown away.  If there's no
+ * slot for the sequence, the least recently used one is taken over.
+ */
+static void
+store_values(char *dbname, char *seqname, int64 *values, int n)
+{
+	SEQ_SLOT   *slot;
+	int			i;
+
+	if (n <= 0)
+		return;
+
+	pool_lwlock_acquire(SEQUENCE_LOCK, POOL_LW_EXCLUSIVE);
+
+	slot = find_slot(dbname, seqname);
+	if (slot == NULL)
+	{
+		slot = &seq_area->slots[0];
+		for (i = 0; i < SEQUENCE_PREALLOC_SLOTS; i++)
+		{
+			if (seq_area->slots[i].dbname[0] == '\0')
+			{
+				slot = &seq_area->slots[i];
+				break;
+			}
+			if (seq_area->slots[i].last_used < slot->last_used)
+				slot = &seq_area->slots[i];
+		}
+		strlcpy(slot->dbname, dbname, sizeof(slot->dbname));
+		strlcpy(slot->seqname, seqname, sizeof(slot->seqname));
+		slot->next = slot->count = 0;
+	}
+
+	if (slot->next >= slot->count)
+	{
+		int64	   *block = seq_area->values + (slot - seq_area->slots) * pool_config->sequence_preallocation_size;
+
+		memcpy(block, values, sizeof(int64) * n);
+		slot->next = 0;
+		slot->count = n;
+	}
+	slot->last_used = ++seq_area->clock;
+
+	pool_lwlock_release(SEQUENCE_LOCK);
+}
+
+/*
+ * Fetch n values of the sequence from the master node, and advance the
+ * sequence on the other nodes to the last one.
+ */
+static void
+fetch_values(POOL_CONNECTION_POOL * backend, char *seqname, int n, int64 *values)
+{
+	POOL_SELECT_RESULT *res;
+	char	   *literal;
+	char	   *query;
+	int64		last;
+	int			i;
+
+	literal = quote_literal(seqname);
+
+	query = psprintf("SELECT pg_catalog.nextval(%s) FROM pg_catalog.generate_series(1, %d)", literal, n);
+	per_node_statement_log(backend, MASTER_NODE_ID, query);
+	do_query(MASTER(backend), query, &res, MAJOR(backend));
+	pfree(query);
+
+	if (res == NULL || res->numrows != n)
+	{
+		if (res)
+			free_select_result(res);
+		ereport(ERROR,
+				(errmsg("unable to pre-allocate values of sequence \"%s\"", seqname)));
+	}
+
+	for (i = 0; i < n; i++)
+		values[i] = strtoll(res->data[i], NULL, 10);
+	free_select_result(res);
+
+	/*
+	 * Other processes may advance the sequences concurrently, so only move
+	 * them forward.  The lock keeps a slower fetch from setting a lower
+	 * value after a faster one has set a higher one.  A single value does
+	 * not tell the direction of the sequence; SERIAL sequences are
+	 * ascending.
+	 */
+	last = values[n - 1];
+	query = psprintf("SELECT pg_catalog.setval(%s, pg_catalog.%s(%lld, last_value)) FROM %s",
+					 literal, (n > 1 && values[0] > last) ? "least" : "greatest",
+					 (long long) last, seqname);
+
+	pool_lwlock_acquire(SEQUENCE_LOCK, POOL_LW_EXCLUSIVE);
+
+	PG_TRY();
+	{
+		for (i = 0; i < NUM_BACKENDS; i++)
+		{
+			if (!VALID_BACKEND(i) || IS_MASTER_NODE_ID(i))
+				continue;
+
+			per_node_statement_log(backend, i, query);
+			do_query(CONNECTION(backend, i), query, &res, MAJOR(backend));
+			if (res)
+				free_select_result(res);
+		}
+	}
+	PG_CATCH();
+	{
+		pool_lwlock_release(SEQUENCE_LOCK);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pool_lwlock_release(SEQUENCE_LOCK);
+
+	pfree(query);
+	pfree(literal);
+}
+
+static SEQ_SLOT *
+find_slot(char *dbname, char *seqname)
+{
+	int			i;
+
+	for (i = 0; i < SEQUENCE_PREALLOC_SLOTS; i++)
+	{
+		SEQ_SLOT   *slot = &seq_area->slots[i];
+
+		if (strcmp(slot->dbname, dbname) == 0 &&
+			strcmp(slot->seqname, seqname) == 0)
+			return slot;
+	}
+	return NULL;
+}
+
+/*
+ * Make a SQL string literal of str.
+ */
+static char *
+quote_literal(char *str)
+{
+	char	   *buf = palloc(strlen(str) * 2 + 3);
+	char	   *p = buf;
+
+	*p++ = '\'';
+	for (; *str; str++)
+	{
+		if (*str == '\'')
+			*p++ = '\'';
+		*p++ = *str;
+	}
+	*p++ = '\'';
+	*p = '\0';
+	return buf;
+}
@@ -31,6 +31,7 @@
 #include "pool_config.h"
 #include "parser/parsenodes.h"
 #include "parser/parser.h"
+#include "parser/stringinfo.h"
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "context/pool_session_context.h"
@@ -59,6 +60,8 @@ typedef struct
 									 * insread of const */
 	bool		rewrite;		/* has rewritten? */
 	List	   *params;			/* list of additional params */
+	List	   *default_exprs;	/* default value expressions to evaluate */
+	List	   *default_consts; /* constants to be set to their values */
 }			TSRewriteContext;
 
 static void *ts_register_func(POOL_SELECT_RESULT * res);
@@ -68,10 +71,10 @@ static bool isStringConst(Node *node, const char *str);
 static bool rewrite_timestamp_walker(Node *node, void *context);
 static bool rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx);
 static bool rewrite_timestamp_update(UpdateStmt *u_stmt, TSRewriteContext * ctx);
-static char *get_current_timestamp(POOL_CONNECTION_POOL * backend);
+static char *get_current_timestamp(POOL_CONNECTION_POOL * backend, List *exprs, List *consts);
 static Node *makeTsExpr(TSRewriteContext * ctx);
 static TypeCast *makeTypeCastFromSvfOp(SQLValueFunctionOp op);
-static A_Const *makeStringConstFromQuery(POOL_CONNECTION_POOL * backend, char *expression);
+static A_Const *makeDefaultConst(TSRewriteContext * ctx, char *expression);
 bool		raw_expression_tree_walker(Node *node, bool (*walker) (), void *context);
 
 POOL_RELCACHE *ts_relcache;
@@ -476,17 +479,46 @@ rewrite_timestamp_walker(Node *node, void *context)
 
 
 /*
- * Get `now()' from MASTER node
+ * Get `now()' from MASTER node.  Since it does not change in a
+ * transaction, it is fetched only once in a transaction block.
+ *
+ * Default value expressions of columns in exprs are evaluated in the same
+ * query, and their values are set to the corresponding constants in
+ * consts, so that a statement costs at most one round trip.
  */
 static char *
-get_current_timestamp(POOL_CONNECTION_POOL * backend)
+get_current_timestamp(POOL_CONNECTION_POOL * backend, List *exprs, List *consts)
 {
 	POOL_SELECT_RESULT *res;
 	static char timestamp[64];
+	StringInfoData query;
+	ListCell   *lc_expr,
+			   *lc_const;
+	char	   *cached;
+	bool		in_transaction;
+	int			i;
+
+	in_transaction = TSTATE(backend, MASTER_NODE_ID) == 'T';
+	cached = in_transaction ? pool_get_transaction_timestamp() : NULL;
+
+	if (cached && exprs == NIL)
+	{
+		ereport(DEBUG1,
+				(errmsg("rewriting timestamp"),
+				 errdetail("use transaction timestamp %s", cached)));
+		return cached;
+	}
 
-	do_query(MASTER(backend), "SELECT now()", &res, MAJOR(backend));
+	initStringInfo(&query);
+	appendStringInfoString(&query, "SELECT now()");
+	foreach(lc_expr, exprs)
+		appendStringInfo(&query, ", %s", (char *) lfirst(lc_expr));
 
-	if (res->numrows != 1)
+	per_node_statement_log(backend, MASTER_NODE_ID, query.data);
+	do_query(MASTER(backend), query.data, &res, MAJOR(backend));
+	pfree(query.data);
+
+	if (res->numrows != 1 || res->rowdesc->num_attrs != list_length(exprs) + 1)
 	{
 		free_select_result(res);
 		return NULL;
@@ -494,7 +526,23 @@ get_current_timestamp(POOL_CONNECTION_POOL * backend)
 
 	strlcpy(timestamp, res->data[0], sizeof(timestamp));
 
+	i = 1;
+	forboth(lc_expr, exprs, lc_const, consts)
+	{
+		A_Const    *con = (A_Const *) lfirst(lc_const);
+
+		if (res->data[i])
+			con->val.val.str = pstrdup(res->data[i]);
+		else
+			con->val.type = T_Null;
+		i++;
+	}
+
 	free_select_result(res);
+
+	if (in_transaction)
+		pool_set_transaction_timestamp(timestamp);
+
 	return timestamp;
 }
 
@@ -545,7 +593,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 					values = lappend(values, makeTsExpr(ctx));
 				else
 					values = lappend(values,
-									 makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc));
+									 makeDefaultConst(ctx, relcache->attr[i].adsrc));
 			}
 			else
 				values = lappend(values, makeNode(SetToDefault));
@@ -606,7 +654,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 						if (ctx->rewrite_to_params)
 							lfirst(lc_val) = makeTsExpr(ctx);
 						else
-							lfirst(lc_val) = makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc);
+							lfirst(lc_val) = makeDefaultConst(ctx, relcache->attr[i].adsrc);
 					}
 					i++;
 				}
@@ -621,7 +669,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 							values = lappend(values, makeTsExpr(ctx));
 						else
 							values = lappend(values,
-											 makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc));
+											 makeDefaultConst(ctx, relcache->attr[i].adsrc));
 					}
 					else
 						values = lappend(values, makeNode(SetToDefault));
@@ -688,7 +736,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 						if (ctx->rewrite_to_params)
 							lfirst(lc_val) = makeTsExpr(ctx);
 						else
-							lfirst(lc_val) = makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc);
+							lfirst(lc_val) = makeDefaultConst(ctx, relcache->attr[i].adsrc);
 					}
 				}
 
@@ -699,7 +747,7 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext * ctx)
 						values = lappend(values, makeTsExpr(ctx));
 					else
 						values = lappend(values,
-										 makeStringConstFromQuery(ctx->backend, relcache->attr[appended_columns_list[i]].adsrc));
+										 makeDefaultConst(ctx, relcache->attr[appended_columns_list[i]].adsrc));
 				}
 			}
 			free(appended_columns_list);
@@ -764,7 +812,7 @@ rewrite_timestamp_update(UpdateStmt *u_stmt, TSRewriteContext * ctx)
 						if (ctx->rewrite_to_params)
 							res->val = (Node *) makeTsExpr(ctx);
 						else
-							res->val = (Node *) makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc);
+							res->val = (Node *) makeDefaultConst(ctx, relcache->attr[i].adsrc);
 						rewrite = true;
 					}
 					break;
@@ -805,6 +853,8 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 	ctx.num_params = 0;
 	ctx.rewrite = false;
 	ctx.params = NIL;
+	ctx.default_exprs = NIL;
+	ctx.default_consts = NIL;
 
 	/*
 	 * Prepare?
@@ -947,7 +997,7 @@ rewrite_timestamp(POOL_CONNECTION_POOL * backend, Node *node,
 	}
 	else
 	{
-		timestamp = get_current_timestamp(backend);
+		timestamp = get_current_timestamp(backend, ctx.default_exprs, ctx.default_consts);
 		if (timestamp == NULL)
 		{
 			ereport(WARNING,
@@ -994,7 +1044,7 @@ bind_rewrite_timestamp(POOL_CONNECTION_POOL * backend,
 	fprintf(stderr, "\n");
 #endif
 
-	ts = get_current_timestamp(backend);
+	ts = get_current_timestamp(backend, NIL, NIL);
 	if (ts == NULL)
 	{
 		ereport(WARNING,
@@ -1148,32 +1198,22 @@ bind_rewrite_timestamp(POOL_CONNECTION_POOL * backend,
 }
 
 /* make A_Const of T_String from "SELECT <expression>"*/
+/*
+ * Make a constant for the default value of a column.  The value is filled
+ * in by get_current_timestamp() together with the other default values of
+ * the statement.
+ */
 static A_Const *
-makeStringConstFromQuery(POOL_CONNECTION_POOL * backend, char *expression)
+makeDefaultConst(TSRewriteContext * ctx, char *expression)
 {
 	A_Const    *con;
-	POOL_SELECT_RESULT *res;
-	char		query[1024];
-	int			len;
-	char	   *str;
-
-	snprintf(query, sizeof(query), "SELECT %s", expression);
-	do_query(MASTER(backend), query, &res, MAJOR(backend));
-
-	if (res->numrows != 1)
-	{
-		free_select_result(res);
-		return NULL;
-	}
-
-	len = strlen(res->data[0]) + 1;
-	str = palloc(len);
-	strcpy(str, res->data[0]);
-	free_select_result(res);
 
 	con = makeNode(A_Const);
 	con->val.type = T_String;
-	con->val.val.str = str;
+	con->val.val.str = NULL;
+
+	ctx->default_exprs = lappend(ctx->default_exprs, pstrdup(expression));
+	ctx->default_consts = lappend(ctx->default_consts, con);
 	return con;
 }
 
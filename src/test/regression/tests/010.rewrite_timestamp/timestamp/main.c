@@ -103,21 +103,38 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 		return (void *) &(rc[1]);
 }
 
-/* dummy result of "SELECT now()" */
+/* dummy result of "SELECT now(), <default value>, ..." */
 void
 do_query(POOL_CONNECTION * backend, char *query, POOL_SELECT_RESULT * *result, int major)
 {
 	static POOL_SELECT_RESULT res;
-	static char *data[1] = {
-		"2009-01-01 23:59:59.123456+09"
-	};
+	static RowDesc rowdesc;
+	static char *data[16];
+	char	   *p;
+	int			i;
 
+	rowdesc.num_attrs = 1;
+	for (p = query; *p; p++)
+	{
+		if (*p == ',')
+			rowdesc.num_attrs++;
+	}
+
+	for (i = 0; i < rowdesc.num_attrs; i++)
+		data[i] = "2009-01-01 23:59:59.123456+09";
+
+	res.rowdesc = &rowdesc;
 	res.numrows = 1;
 	res.data = data;
 
 	*result = &res;
 }
 
+void
+per_node_statement_log(POOL_CONNECTION_POOL * backend, int node_id, char *query)
+{
+}
+
 char *
 make_table_name_from_rangevar(RangeVar *rangevar)
 {
@@ -134,11 +151,14 @@ main(int argc, char **argv)
 	StartupPacket sp;
 	POOL_CONNECTION_POOL backend;
 	POOL_CONNECTION_POOL_SLOT slot;
+	POOL_CONNECTION con;
 	POOL_SENT_MESSAGE msg;
 	POOL_QUERY_CONTEXT ctx;
 
 	backend.slots[0] = &slot;
 	slot.sp = &sp;
+	slot.con = &con;
+	con.tstate = 'I';
 	bool		error;
 
 	MemoryContextInit();
@@ -184,6 +204,15 @@ pool_get_session_context(bool noerror)
 {
 	return NULL;
 }
+char *
+pool_get_transaction_timestamp(void)
+{
+	return NULL;
+}
+void
+pool_set_transaction_timestamp(const char *timestamp)
+{
+}
 int
 pg_frontend_exists(void)
 {
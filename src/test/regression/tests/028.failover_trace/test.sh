@@ -0,0 +1,122 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for pcp_failover_trace and SHOW pool_failover_trace.
+# While pgbench is running, the primary node is shut down.  Clients must
+# be able to run queries through pgpool-II again after the failover, and
+# the time they cannot, measured by a probe client, must stay within
+# MAX_DOWNTIME seconds.
+# The failover trace dumped with pcp_failover_trace must show the steps
+# of the failover of the node in order, and SHOW pool_failover_trace
+# must show the same events.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PG_CTL=$PGBIN/pg_ctl
+PSQL="$PGBIN/psql -X"
+PGBENCH=$PGBENCH_PATH
+MAX_DOWNTIME=20
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 3 || exit 1
+echo "done."
+
+echo "health_check_period = 1" >> etc/pgpool.conf
+echo "health_check_max_retries = 0" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+$PGBENCH -i test
+
+# client load
+$PGBENCH -S -c 4 -T 30 test > pgbench.log 2>&1 &
+PGBENCH_PID=$!
+
+# probe client: one query every 100ms, recording the time and the result
+(
+	end=`expr $(date +%s) + 30`
+	while [ $(date +%s) -lt $end ]
+	do
+		if $PSQL -c "select 1" test >/dev/null 2>&1;then
+			echo "`date +%s.%N` ok"
+		else
+			echo "`date +%s.%N` ng"
+		fi
+		sleep 0.1
+	done
+) > probe.log &
+PROBE_PID=$!
+
+sleep 5
+
+# trigger failover on the primary node
+$PG_CTL -D data0 -m i stop
+
+wait $PROBE_PID
+wait $PGBENCH_PID
+
+$PGPOOL_INSTALL_DIR/bin/pcp_failover_trace -w -h localhost -p $PCP_PORT > trace.log
+$PSQL -t -A -c "SHOW pool_failover_trace" test > show_trace.log
+
+./shutdownall
+
+# client visible downtime: from the first failed query to the next
+# successful one
+downtime=`awk '$2 == "ng" && start == "" {start = $1}
+	$2 == "ok" && start != "" && end == "" {end = $1}
+	END {if (start == "") print 0; else if (end == "") print -1; else printf "%.3f\n", end - start}' probe.log`
+echo "client visible downtime: $downtime seconds"
+
+if [ "$downtime" = "-1" ];then
+	echo "pgpool-II did not come back after failover"
+	exit 1
+fi
+
+if awk -v d=$downtime -v max=$MAX_DOWNTIME 'BEGIN {exit !(d > max)}';then
+	echo "client visible downtime is longer than $MAX_DOWNTIME seconds"
+	exit 1
+fi
+
+# events of the failover request of node 0.  The fields are sequence
+# number, date, time, pid, request number, request kind, event, node id,
+# elapsed time and detail.
+request=`awk '$6 == "failover" && $7 == "failover_start" && $8 == 0 {print $5; exit}' trace.log`
+if [ -z "$request" ];then
+	echo "failover of node 0 is not found in the failover trace"
+	cat trace.log
+	exit 1
+fi
+
+# the steps must appear in this order.  Other events, such as the ones
+# of follow_master_command, may come in between.
+awk -v request=$request '$5 == request {print $7}' trace.log > events.log
+expected="request_queued failover_start command_start command_end degenerate_done primary_search_start primary_search_end child_restart_start child_restart_end failover_end"
+awk -v expected="$expected" 'BEGIN {n = split(expected, e, " "); i = 1}
+	i <= n && $1 == e[i] {i++}
+	END {exit i <= n ? 1 : 0}' events.log
+if [ $? != 0 ];then
+	echo "failover steps are missing or out of order"
+	cat trace.log
+	exit 1
+fi
+
+# SHOW pool_failover_trace shows the same events
+for event in $expected
+do
+	if ! grep -q "|$event|" show_trace.log;then
+		echo "$event is not found by SHOW pool_failover_trace"
+		cat show_trace.log
+		exit 1
+	fi
+done
+
+exit 0
@@ -0,0 +1,99 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for child_cpu_affinity.
+# Child processes must be bound to the CPU sets in child_cpu_affinity in
+# turn, which is checked with Cpus_allowed_list of each child.  An
+# invalid CPU list must be rejected at startup.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+
+if [ ! -f /proc/self/status ];then
+	echo "/proc is not available"
+	exit 0
+fi
+
+ncpus=`getconf _NPROCESSORS_ONLN`
+if [ $ncpus -lt 2 ];then
+	cpusets="0"
+else
+	cpusets="0;1"
+fi
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+echo "num_init_children = 4" >> etc/pgpool.conf
+echo "child_cpu_affinity = '$cpusets'" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+# children_cpus: Cpus_allowed_list of each child process waiting for
+# clients, one per line
+function children_cpus
+{
+	for pid in `ps -o pid=,args= --ppid \`cat run/pgpool.pid\` | grep "pgpool: wait for connection request" | awk '{print $1}'`
+	do
+		awk '/^Cpus_allowed_list:/ {print $2}' /proc/$pid/status
+	done
+}
+
+children_cpus > cpus.txt
+cat cpus.txt
+
+if [ `wc -l < cpus.txt` != 4 ];then
+	echo "child processes were not found"
+	./shutdownall
+	exit 1
+fi
+
+# every child is bound to one of the sets, and every set is used
+if grep -v -x "0\|1" cpus.txt;then
+	echo "child process is not bound to the CPU sets"
+	./shutdownall
+	exit 1
+fi
+for cpu in `echo "$cpusets" | tr ';' ' '`
+do
+	if ! grep -q -x "$cpu" cpus.txt;then
+		echo "no child process is bound to CPU $cpu"
+		./shutdownall
+		exit 1
+	fi
+done
+
+./shutdownall
+
+# an invalid CPU list must be rejected
+echo "child_cpu_affinity = '0;x-1'" >> etc/pgpool.conf
+
+./startall
+sleep 5
+
+if $PSQL -c "SELECT 1" test > /dev/null 2>&1;then
+	echo "pgpool-II started with an invalid child_cpu_affinity"
+	./shutdownall
+	exit 1
+fi
+
+if ! grep -q "invalid configuration for key \"child_cpu_affinity\"" log/pgpool.log;then
+	echo "invalid child_cpu_affinity was not reported"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for memqcache_compression.
+# A result of about 300kB with a memqcache_maxcache too small for it
+# must not be cached without compression, and must be cached compressed
+# and fetched from the cache intact with memqcache_compression = lz4.
+# requires pgpool built with --with-lz4.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+PGBENCH=$PGBENCH_PATH
+
+if ! ldd $PGPOOL_INSTALL_DIR/bin/pgpool | grep -q liblz4
+then
+	echo "pgpool is not built with --with-lz4"
+	exit 0
+fi
+
+for compression in off lz4
+do
+	rm -fr $TESTDIR
+	mkdir $TESTDIR
+	cd $TESTDIR
+
+	echo -n "creating test environment..."
+	$PGPOOL_SETUP -m s -n 2 || exit 1
+	echo "done."
+
+	echo "memory_cache_enabled = on" >> etc/pgpool.conf
+	echo "memqcache_compression = $compression" >> etc/pgpool.conf
+	echo "memqcache_maxcache = 102400" >> etc/pgpool.conf
+	echo "memqcache_maxcache_uncompressed = 409600" >> etc/pgpool.conf
+
+	source ./bashrc.ports
+
+	export PGPORT=$PGPOOL_PORT
+
+	./startall
+	wait_for_pgpool_startup
+
+	$PGBENCH -i -s 1 test
+
+	QUERY="SELECT * FROM pgbench_accounts WHERE aid <= 3000 ORDER BY aid"
+
+	$PSQL -c "$QUERY" test > result1.txt
+	$PSQL -c "$QUERY" test > result2.txt
+	cmp result1.txt result2.txt
+	if [ $? != 0 ];then
+		echo "cached result differs"
+		./shutdownall
+		exit 1
+	fi
+
+	grep "fetched from cache" log/pgpool.log | grep pgbench_accounts > /dev/null
+	cached=$?
+	if [ $compression = off -a $cached = 0 ];then
+		echo "result larger than memqcache_maxcache was cached"
+		./shutdownall
+		exit 1
+	fi
+	if [ $compression = lz4 -a $cached != 0 ];then
+		echo "result was not fetched from cache"
+		./shutdownall
+		exit 1
+	fi
+
+	./shutdownall
+	cd ..
+done
+
+exit 0
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for relaying COPY data.
+# COPY FROM STDIN and COPY TO STDOUT of some ten MB, much more than a
+# relay block, are run through pgpool-II in streaming replication mode
+# and native replication mode.  The data must come back intact, and in
+# native replication mode the copied rows must reach both nodes.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+ROWS=200000
+
+for mode in s r
+do
+	rm -fr $TESTDIR
+	mkdir $TESTDIR
+	cd $TESTDIR
+
+	echo -n "creating test environment..."
+	$PGPOOL_SETUP -m $mode -n 2 || exit 1
+	echo "done."
+
+	source ./bashrc.ports
+
+	export PGPORT=$PGPOOL_PORT
+	BACKEND_PORT=`awk -F= '/^backend_port0/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+	./startall
+	wait_for_pgpool_startup
+
+	$PSQL test <<EOF
+CREATE TABLE copy_t (i int, t text);
+EOF
+	$PSQL -p $BACKEND_PORT -c "COPY (SELECT i, repeat('x', 100) FROM generate_series(1, $ROWS) i) TO STDOUT" test > copy.data
+
+	$PSQL -c "COPY copy_t FROM STDIN" test < copy.data
+	if [ $? != 0 ];then
+		./shutdownall
+		exit 1
+	fi
+
+	$PSQL -c "COPY copy_t TO STDOUT" test > copy.out
+	if [ $? != 0 ];then
+		./shutdownall
+		exit 1
+	fi
+
+	cmp copy.data copy.out
+	if [ $? != 0 ];then
+		echo "COPY TO STDOUT returned different data"
+		./shutdownall
+		exit 1
+	fi
+
+	# in native replication mode both nodes must have all rows
+	if [ $mode = r ];then
+		for port in $BACKEND_PORT `expr $BACKEND_PORT + 1`
+		do
+			count=`$PSQL -p $port -t -A -c "SELECT count(*) FROM copy_t" test`
+			if [ "$count" != $ROWS ];then
+				echo "node on port $port has $count rows"
+				./shutdownall
+				exit 1
+			fi
+		done
+	fi
+
+	./shutdownall
+	cd ..
+done
+
+exit 0
@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for replication_parallel_execution.
+# Concurrent sessions update the same rows in crossing order so that
+# parallel execution runs into cross node lock waits.  Those must be
+# retried master node first and the nodes must end up identical, with
+# replication_parallel_execution off and on.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+PGBENCH=$PGBENCH_PATH
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m r -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "replication_parallel_execution = off" >> etc/pgpool.conf
+echo "replication_parallel_lock_timeout = 100" >> etc/pgpool.conf
+echo "insert_lock = on" >> etc/pgpool.conf
+echo "log_min_messages = log" >> etc/pgpool.conf
+
+export PGPORT=$PGPOOL_PORT
+BACKEND_PORT=`awk -F= '/^backend_port0/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+./startall
+wait_for_pgpool_startup
+
+$PSQL test <<EOF
+CREATE TABLE t1(id int PRIMARY KEY, v int);
+INSERT INTO t1 SELECT i, 0 FROM generate_series(1, 10) i;
+CREATE TABLE t2(i SERIAL, j int);
+EOF
+
+# autocommit updates, so that each runs in an internal transaction
+cat > pgbench.sql <<EOF
+\set id random(1, 10)
+\set delta random(-100, 100)
+UPDATE t1 SET v = v + :delta WHERE id = :id;
+UPDATE t1 SET v = v - :delta WHERE id = 11 - :id;
+INSERT INTO t2(j) VALUES (:delta);
+EOF
+
+for parallel in off on
+do
+	sed -i "s/^replication_parallel_execution = .*/replication_parallel_execution = $parallel/" etc/pgpool.conf
+	./pgpool_reload
+	sleep 1
+
+	$PGBENCH -n -f pgbench.sql -c 8 -T 10 test > pgbench.log 2>&1
+	if [ $? != 0 ];then
+		echo "pgbench failed with replication_parallel_execution = $parallel"
+		cat pgbench.log
+		./shutdownall
+		exit 1
+	fi
+done
+
+# check if database contents are identical
+for port in $BACKEND_PORT `expr $BACKEND_PORT + 1`
+do
+	$PSQL -p $port -t -A test <<EOF > dump_$port.txt
+SELECT * FROM t1 ORDER BY id;
+SELECT * FROM t2 ORDER BY i;
+EOF
+done
+
+diff dump_$BACKEND_PORT.txt dump_`expr $BACKEND_PORT + 1`.txt
+if [ $? != 0 ];then
+	# contents are not identical
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
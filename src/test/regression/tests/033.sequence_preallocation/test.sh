@@ -0,0 +1,130 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for sequence_preallocation.
+# Concurrent sessions insert into tables with SERIAL columns.  The
+# INSERTs must be rewritten to carry pre-allocated values, and the
+# nodes must end up identical, including the sequences.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+PGBENCH=$PGBENCH_PATH
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m r -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "insert_lock = on" >> etc/pgpool.conf
+echo "sequence_preallocation = on" >> etc/pgpool.conf
+echo "sequence_preallocation_size = 10" >> etc/pgpool.conf
+echo "log_per_node_statement = on" >> etc/pgpool.conf
+
+export PGPORT=$PGPOOL_PORT
+BACKEND_PORT=`awk -F= '/^backend_port0/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+./startall
+wait_for_pgpool_startup
+
+$PSQL test <<EOF
+CREATE TABLE t1(i SERIAL, j int);
+CREATE TABLE t2(a text, i BIGSERIAL, j int DEFAULT 0, k SERIAL);
+EOF
+
+cat > pgbench.sql <<EOF
+\set v random(1, 1000)
+INSERT INTO t1(j) VALUES (:v);
+INSERT INTO t1 VALUES (DEFAULT, :v), (DEFAULT, :v + 1);
+INSERT INTO t2 VALUES ('a');
+INSERT INTO t2(k, a) VALUES (DEFAULT, 'b'), (DEFAULT, 'c');
+INSERT INTO t2 DEFAULT VALUES;
+EOF
+
+$PGBENCH -n -f pgbench.sql -c 8 -t 100 test > pgbench.log 2>&1
+if [ $? != 0 ];then
+	echo "pgbench failed"
+	cat pgbench.log
+	./shutdownall
+	exit 1
+fi
+
+# the INSERTs must not have locked the tables
+if grep -q "LOCK TABLE\|FOR UPDATE" log/pgpool.log;then
+	echo "INSERT locked the table"
+	./shutdownall
+	exit 1
+fi
+
+# check_identical: check if database contents are identical
+function check_identical
+{
+	for port in $BACKEND_PORT `expr $BACKEND_PORT + 1`
+	do
+		$PSQL -p $port -t -A test <<EOF > dump_$port.txt
+SELECT count(*), count(DISTINCT i) FROM t1;
+SELECT * FROM t1 ORDER BY i;
+SELECT count(*), count(DISTINCT i), count(DISTINCT k) FROM t2;
+SELECT * FROM t2 ORDER BY i;
+EOF
+	done
+
+	diff dump_$BACKEND_PORT.txt dump_`expr $BACKEND_PORT + 1`.txt
+	if [ $? != 0 ];then
+		# contents are not identical
+		./shutdownall
+		exit 1
+	fi
+}
+
+check_identical
+
+# a SERIAL column added by ALTER TABLE must be seen by all the sessions,
+# including the ones which have cached the columns of the table.  The
+# table is emptied first, since existing rows may be stored in different
+# order on each node.
+$PSQL test <<EOF
+TRUNCATE t1;
+ALTER TABLE t1 ADD COLUMN m SERIAL;
+EOF
+
+cat > pgbench2.sql <<EOF
+\set v random(1, 1000)
+INSERT INTO t1(j) VALUES (:v);
+EOF
+
+$PGBENCH -n -f pgbench2.sql -c 8 -t 100 test > pgbench.log 2>&1
+if [ $? != 0 ];then
+	echo "pgbench failed after ALTER TABLE"
+	cat pgbench.log
+	./shutdownall
+	exit 1
+fi
+
+check_identical
+
+# the sequences must have been advanced on all nodes, so that inserting
+# without pgpool does not hand out used values
+for port in $BACKEND_PORT `expr $BACKEND_PORT + 1`
+do
+	$PSQL -p $port test -c "INSERT INTO t1(j) VALUES (0)"
+	if [ $? != 0 ];then
+		./shutdownall
+		exit 1
+	fi
+	dup=`$PSQL -p $port -t -A test -c "SELECT count(*) - count(DISTINCT i) FROM t1"`
+	if [ "$dup" != "0" ];then
+		echo "sequence of node on port $port is behind"
+		./shutdownall
+		exit 1
+	fi
+done
+
+./shutdownall
+
+exit 0
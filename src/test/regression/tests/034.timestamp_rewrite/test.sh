@@ -0,0 +1,108 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for timestamp rewriting.
+# Transactions writing now() and timestamp column defaults are run
+# through pgpool-II in native replication mode.  now() must be fetched
+# only once in a transaction, the nodes must end up identical, and a
+# column added by ALTER TABLE must be seen by the relation cache shared
+# among child processes.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+PGBENCH=$PGBENCH_PATH
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m r -n 2 || exit 1
+echo "done."
+
+source ./bashrc.ports
+
+echo "enable_shared_relcache = on" >> etc/pgpool.conf
+echo "log_per_node_statement = on" >> etc/pgpool.conf
+
+export PGPORT=$PGPOOL_PORT
+BACKEND_PORT=`awk -F= '/^backend_port0/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+./startall
+wait_for_pgpool_startup
+
+$PSQL test <<EOF
+CREATE TABLE t1(id int, v int, created timestamptz DEFAULT now(), day date DEFAULT CURRENT_DATE);
+CREATE TABLE t2(id int PRIMARY KEY, updated timestamptz);
+INSERT INTO t2 SELECT i, now() FROM generate_series(1, 100) i;
+EOF
+
+# now() must be fetched once for the three statements
+before=`grep -c "SELECT now()" log/pgpool.log`
+$PSQL test <<EOF
+BEGIN;
+UPDATE t2 SET updated = now() WHERE id = 1;
+UPDATE t2 SET updated = CURRENT_TIMESTAMP WHERE id = 2;
+UPDATE t2 SET updated = now() WHERE id = 3;
+END;
+EOF
+after=`grep -c "SELECT now()" log/pgpool.log`
+if [ `expr $after - $before` != 1 ];then
+	echo "now() was fetched `expr $after - $before` times in a transaction"
+	./shutdownall
+	exit 1
+fi
+
+cat > pgbench.sql <<EOF
+\set id random(1, 100)
+BEGIN;
+UPDATE t2 SET updated = now() WHERE id = :id;
+INSERT INTO t1(id, v) VALUES (:id, 1), (:id, 2);
+INSERT INTO t1 VALUES (:id, 3, now(), CURRENT_DATE);
+INSERT INTO t1 DEFAULT VALUES;
+UPDATE t2 SET updated = CURRENT_TIMESTAMP WHERE id = :id;
+END;
+EOF
+
+# now() must be fetched at most once per transaction
+before=`grep -c "SELECT now()" log/pgpool.log`
+$PGBENCH -n -f pgbench.sql -c 4 -t 100 test > pgbench.log 2>&1
+if [ $? != 0 ];then
+	echo "pgbench failed"
+	cat pgbench.log
+	./shutdownall
+	exit 1
+fi
+after=`grep -c "SELECT now()" log/pgpool.log`
+if [ `expr $after - $before` -gt 400 ];then
+	echo "now() was fetched `expr $after - $before` times in 400 transactions"
+	./shutdownall
+	exit 1
+fi
+
+# a column added after the relation cache was registered
+$PSQL test <<EOF
+ALTER TABLE t1 ADD COLUMN c3 timestamptz DEFAULT now();
+INSERT INTO t1(id, v) VALUES (0, 0);
+EOF
+
+# check if database contents are identical
+for port in $BACKEND_PORT `expr $BACKEND_PORT + 1`
+do
+	$PSQL -p $port -t -A test <<EOF > dump_$port.txt
+SELECT * FROM t1 ORDER BY id, v, created;
+SELECT * FROM t2 ORDER BY id;
+EOF
+done
+
+diff dump_$BACKEND_PORT.txt dump_`expr $BACKEND_PORT + 1`.txt
+if [ $? != 0 ];then
+	# contents are not identical
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
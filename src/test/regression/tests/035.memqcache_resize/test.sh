@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for resizing the shared memory query cache by reload.
+# memqcache_total_size and memqcache_max_num_cache are grown and shrunk
+# by reloading, and SHOW pool_cache must report the new sizes.  After
+# shrinking, the number of cache entries must be within the new limit
+# and the remaining entries must still be fetched from the cache.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+BLOCK_SIZE=1048576
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+echo "memory_cache_enabled = on" >> etc/pgpool.conf
+echo "memqcache_cache_block_size = $BLOCK_SIZE" >> etc/pgpool.conf
+echo "memqcache_total_size_limit = 67108864" >> etc/pgpool.conf
+echo "memqcache_max_num_cache_limit = 10000" >> etc/pgpool.conf
+echo "memqcache_total_size = 16777216" >> etc/pgpool.conf
+echo "memqcache_max_num_cache = 1000" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+# check_cache_size total_size max_num_cache
+# The storage size is the sum of used, free and fragmented sizes, which
+# may fall short of the total size by less than a block.
+function check_cache_size
+{
+	$PSQL -t -A -c "SHOW pool_cache" test > pool_cache.txt
+	cat pool_cache.txt
+	awk -F'|' -v total=$1 -v num=$2 -v block=$BLOCK_SIZE '
+		{
+			size = $7 + $8 + $9;
+			if ($4 != num) {print "num_hash_entries " $4 " != " num; exit 1}
+			if (size > total || size <= total - block) {print "cache storage size " size " != " total; exit 1}
+			if ($6 > num) {print "num_cache_entries " $6 " > " num; exit 1}
+		}' pool_cache.txt
+	if [ $? != 0 ];then
+		./shutdownall
+		exit 1
+	fi
+}
+
+# resize memqcache_total_size max_num_cache
+function resize_cache
+{
+	sed -i "s/^memqcache_total_size = .*/memqcache_total_size = $1/" etc/pgpool.conf
+	sed -i "s/^memqcache_max_num_cache = .*/memqcache_max_num_cache = $2/" etc/pgpool.conf
+	./pgpool_reload
+	sleep 1
+}
+
+check_cache_size 16777216 1000
+
+$PSQL test <<EOF
+CREATE TABLE t1(i int);
+INSERT INTO t1 SELECT generate_series(1, 1000);
+EOF
+
+# fill the cache with entries of about 10kB
+for i in `seq 1 500`
+do
+	echo "SELECT i, repeat('x', 10) FROM t1 WHERE i <= $i + 500;"
+done > queries.sql
+
+# grow
+resize_cache 33554432 5000
+check_cache_size 33554432 5000
+$PSQL -f queries.sql test > /dev/null
+
+# shrink below the number of cached entries
+resize_cache 4194304 100
+check_cache_size 4194304 100
+
+# the cache must still work after shrinking
+$PSQL -f queries.sql test > result1.txt
+$PSQL -f queries.sql test > result2.txt
+cmp result1.txt result2.txt
+if [ $? != 0 ];then
+	echo "cached result differs"
+	./shutdownall
+	exit 1
+fi
+check_cache_size 4194304 100
+
+# beyond the limits reserved at start up
+resize_cache 134217728 20000
+check_cache_size 67108864 16383
+
+grep "memqcache_total_size .* exceeds the reserved size" log/pgpool.log > /dev/null
+if [ $? != 0 ];then
+	echo "exceeding memqcache_total_size_limit is not reported"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
@@ -0,0 +1,90 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for memqcache_single_flight_timeout and
+# memqcache_stale_grace.
+# Concurrent sessions run the same slow query which is not cached yet.
+# It must be run on backend only once, and the other sessions must get
+# the result from the cache.  After the cache entry expires, concurrent
+# sessions must again run the query on backend only once, to refresh
+# it, while the others are served the stale entry.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+CLIENTS=8
+QUERY="SELECT count(*) FROM t1 a, t1 b WHERE a.i <> b.i"
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+echo "memory_cache_enabled = on" >> etc/pgpool.conf
+echo "memqcache_expire = 3" >> etc/pgpool.conf
+echo "memqcache_single_flight_timeout = 30000" >> etc/pgpool.conf
+echo "memqcache_stale_grace = 60" >> etc/pgpool.conf
+echo "log_per_node_statement = on" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+$PSQL test <<EOF
+CREATE TABLE t1(i int);
+INSERT INTO t1 SELECT generate_series(1, 3000);
+EOF
+
+# run_concurrently name: run the query in $CLIENTS sessions at once
+function run_concurrently
+{
+	for i in `seq 1 $CLIENTS`
+	do
+		$PSQL -t -A -c "$QUERY" test > $1_$i.txt &
+	done
+	wait
+
+	for i in `seq 1 $CLIENTS`
+	do
+		if [ "`cat $1_$i.txt`" != 8997000 ];then
+			echo "wrong result in session $i: `cat $1_$i.txt`"
+			./shutdownall
+			exit 1
+		fi
+	done
+}
+
+# count_executions: number of times the query was run on backend
+function count_executions
+{
+	grep "DB node id: .* statement: $QUERY" log/pgpool.log | wc -l
+}
+
+# cache misses of the same query at once
+run_concurrently miss
+n=`count_executions`
+echo "executed $n time(s) on cache miss"
+if [ $n != 1 ];then
+	./shutdownall
+	exit 1
+fi
+
+# let the entry expire, then refresh it
+sleep 4
+run_concurrently stale
+n=`count_executions`
+echo "executed $n time(s) in total after the entry expired"
+if [ $n != 2 ];then
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
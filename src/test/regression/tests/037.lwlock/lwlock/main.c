@@ -0,0 +1,354 @@
+/*
+ * Stress and recovery tests of the lightweight locks in
+ * utils/pool_lwlock.c.  The locks are created in anonymous shared memory
+ * and used by forked processes, like pgpool main process and its
+ * children do.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "pool.h"
+#include "utils/elog.h"
+#include "utils/pool_atomics.h"
+#include "utils/pool_lwlock.h"
+
+#define NPROCS		8
+#define ITERATIONS	200000
+#define LOCKID		SHM_CACHE_LOCK
+
+typedef struct
+{
+	volatile uint64 counter;	/* incremented in exclusive mode */
+	volatile uint32 writer_inside;	/* set while a writer holds the lock */
+	volatile uint64 exclusive_count[NPROCS];
+	volatile uint32 errors;
+	volatile uint32 order;		/* sequence of the writer preference test */
+	volatile uint32 writer_order;
+	volatile uint32 reader_order;
+}			TEST_AREA;
+
+static TEST_AREA * area;
+static int	last_elevel;
+static int	num_warnings;
+
+/*
+ * Stubs of the functions pool_lwlock.o depends on.
+ */
+void *
+pool_shared_memory_create(size_t size)
+{
+	void	   *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED)
+	{
+		perror("mmap");
+		exit(1);
+	}
+	return p;
+}
+
+bool
+errstart(int elevel, const char *filename, int lineno,
+		 const char *funcname, const char *domain)
+{
+	last_elevel = elevel;
+	return elevel >= WARNING;
+}
+
+int
+errmsg(const char *fmt,...)
+{
+	va_list		ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	return 0;
+}
+
+void
+errfinish(int dummy,...)
+{
+	if (last_elevel >= ERROR)
+		abort();
+	num_warnings++;
+}
+
+static double
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+wait_child(pid_t pid)
+{
+	int			status;
+
+	waitpid(pid, &status, 0);
+	pool_lwlock_cleanup_process(pid);
+}
+
+static void
+check(bool ok, const char *test)
+{
+	printf("%s: %s\n", test, ok ? "ok" : "NG");
+	if (!ok)
+		exit(1);
+}
+
+/*
+ * Processes mix shared and exclusive mode.  Writers increment a counter
+ * without atomic operations, readers check that no writer is inside.
+ * Some of them must have waited for the lock.
+ */
+static void
+test_mixed(void)
+{
+	pid_t		pids[NPROCS];
+	uint64		expected = 0;
+	POOL_LWLOCK_STATS stats;
+	int			i;
+
+	for (i = 0; i < NPROCS; i++)
+	{
+		pids[i] = fork();
+		if (pids[i] == 0)
+		{
+			unsigned int seed = i;
+			int			j;
+
+			for (j = 0; j < ITERATIONS; j++)
+			{
+				if (rand_r(&seed) % 4 == 0)
+				{
+					pool_lwlock_acquire(LOCKID, POOL_LW_EXCLUSIVE);
+					area->writer_inside = 1;
+					area->counter = area->counter + 1;
+					area->exclusive_count[i]++;
+					/* now and then, let the others run into the lock */
+					if (j % 100 == 0)
+						sched_yield();
+					area->writer_inside = 0;
+					pool_lwlock_release(LOCKID);
+				}
+				else
+				{
+					pool_lwlock_acquire(LOCKID, POOL_LW_SHARED);
+					if (area->writer_inside)
+						pool_atomic_fetch_add_u32(&area->errors, 1);
+					if (j % 100 == 1)
+						sched_yield();
+					pool_lwlock_release(LOCKID);
+				}
+			}
+			_exit(0);
+		}
+	}
+	for (i = 0; i < NPROCS; i++)
+		wait_child(pids[i]);
+
+	for (i = 0; i < NPROCS; i++)
+		expected += area->exclusive_count[i];
+
+	pool_lwlock_get_stats(LOCKID, &stats);
+
+	check(area->counter == expected && area->errors == 0 &&
+		  stats.acquire_count == NPROCS * ITERATIONS && stats.contended_count > 0,
+		  "mixed shared and exclusive mode");
+}
+
+/*
+ * Fork a process which holds the lock in shared mode for msec
+ * milliseconds.  A process must not fork while holding a lock.
+ */
+static pid_t
+hold_shared(int msec)
+{
+	pid_t		pid = fork();
+
+	if (pid == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_SHARED);
+		usleep(msec * 1000);
+		pool_lwlock_release(LOCKID);
+		_exit(0);
+	}
+	usleep(50000);				/* let it take the lock */
+	return pid;
+}
+
+/*
+ * A writer waiting for readers to go must not be overtaken by new
+ * readers.
+ */
+static void
+test_writer_preference(void)
+{
+	pid_t		holder;
+	pid_t		writer;
+	pid_t		reader;
+
+	holder = hold_shared(400);
+
+	writer = fork();
+	if (writer == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_EXCLUSIVE);
+		area->writer_order = pool_atomic_fetch_add_u32(&area->order, 1) + 1;
+		usleep(100000);
+		pool_lwlock_release(LOCKID);
+		_exit(0);
+	}
+	usleep(200000);				/* let the writer go to sleep */
+
+	reader = fork();
+	if (reader == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_SHARED);
+		area->reader_order = pool_atomic_fetch_add_u32(&area->order, 1) + 1;
+		pool_lwlock_release(LOCKID);
+		_exit(0);
+	}
+
+	wait_child(holder);
+	wait_child(writer);
+	wait_child(reader);
+
+	check(area->writer_order == 1 && area->reader_order == 2, "writer preference");
+}
+
+/*
+ * Locks held in shared mode by a process which dies are given back when
+ * the process is reaped.
+ */
+static void
+test_dead_shared_holder(void)
+{
+	pid_t		pid;
+	double		start;
+
+	pid = fork();
+	if (pid == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_SHARED);
+		_exit(0);
+	}
+	wait_child(pid);
+
+	start = now_ms();
+	pool_lwlock_acquire(LOCKID, POOL_LW_EXCLUSIVE);
+	pool_lwlock_release(LOCKID);
+	check(now_ms() - start < 500, "shared lock of a reaped process");
+}
+
+/*
+ * Locks held in shared mode by a process which dies without being reaped
+ * are given back by a waiter.
+ */
+static void
+test_dead_shared_holder_unreaped(void)
+{
+	pid_t		pid;
+	int			status;
+	double		start;
+
+	pid = fork();
+	if (pid == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_SHARED);
+		_exit(0);
+	}
+	waitpid(pid, &status, 0);
+
+	start = now_ms();
+	pool_lwlock_acquire(LOCKID, POOL_LW_EXCLUSIVE);
+	pool_lwlock_release(LOCKID);
+	check(now_ms() - start < 5000, "shared lock of a process gone without being reaped");
+}
+
+/*
+ * A writer killed while waiting must not keep readers waiting.
+ */
+static void
+test_dead_exclusive_waiter(void)
+{
+	pid_t		holder;
+	pid_t		pid;
+	pid_t		reader;
+	double		start;
+
+	holder = hold_shared(300);
+
+	pid = fork();
+	if (pid == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_EXCLUSIVE);
+		_exit(0);
+	}
+	usleep(200000);				/* let the writer go to sleep */
+	kill(pid, SIGKILL);
+	wait_child(pid);
+	wait_child(holder);
+
+	start = now_ms();
+	reader = fork();
+	if (reader == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_SHARED);
+		pool_lwlock_release(LOCKID);
+		_exit(0);
+	}
+	wait_child(reader);
+	check(now_ms() - start < 500, "exclusive waiter killed while sleeping");
+}
+
+/*
+ * A lock held in exclusive mode by a process which dies is taken over.
+ */
+static void
+test_dead_exclusive_holder(void)
+{
+	pid_t		pid;
+
+	pid = fork();
+	if (pid == 0)
+	{
+		pool_lwlock_acquire(LOCKID, POOL_LW_EXCLUSIVE);
+		_exit(0);
+	}
+	wait_child(pid);
+
+	num_warnings = 0;
+	pool_lwlock_acquire(LOCKID, POOL_LW_EXCLUSIVE);
+	pool_lwlock_release(LOCKID);
+	check(num_warnings == 1, "exclusive lock of a dead process");
+}
+
+int
+main(int argc, char **argv)
+{
+	area = pool_shared_memory_create(sizeof(TEST_AREA));
+	memset(area, 0, sizeof(TEST_AREA));
+	pool_lwlock_create(MAX_NUM_LWLOCKS, LWLOCK_HOLDERS(NPROCS));
+
+	test_mixed();
+	test_writer_preference();
+	test_dead_shared_holder();
+	test_dead_shared_holder_unreaped();
+	test_dead_exclusive_waiter();
+	test_dead_exclusive_holder();
+
+	return 0;
+}
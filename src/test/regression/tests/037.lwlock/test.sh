@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for the lightweight locks.
+# Processes mixing shared and exclusive mode must keep a counter exact,
+# a waiting writer must not be overtaken by new readers, and the locks
+# of processes which die holding or waiting for them must be given back.
+#
+cd lwlock
+make clean
+make
+if [ $? != 0 ];then
+	echo "building lwlock-test failed"
+	exit 1
+fi
+
+make test
+if [ $? != 0 ];then
+	echo NG
+	exit 1
+fi
+cd ..
+
+echo OK
+exit 0
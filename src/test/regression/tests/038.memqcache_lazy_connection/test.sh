@@ -0,0 +1,139 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for memqcache_lazy_backend_connection.
+# A session whose queries are all found in the query cache must not
+# connect to backend.  At the first query not found in the cache, the
+# session must connect to backend, and if the ParameterStatus messages
+# of backend differ from those replayed at the session start, they must
+# be sent again.  client_idle_limit must be applied to sessions without
+# backend connection.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+WHOAMI=`whoami`
+timeout=30
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+echo "memory_cache_enabled = on" >> etc/pgpool.conf
+echo "memqcache_lazy_backend_connection = on" >> etc/pgpool.conf
+echo "enable_pool_hba = on" >> etc/pgpool.conf
+echo "connection_cache = off" >> etc/pgpool.conf
+
+for i in data0 data1
+do
+	echo "log_connections = on" >> $i/postgresql.conf
+done
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+$PSQL test <<EOF
+CREATE TABLE t1(i int);
+INSERT INTO t1 VALUES(1);
+EOF
+
+cp -r ../tests ./
+
+# run_pgproto name: run tests/name.data and save the output in name.out
+function run_pgproto
+{
+	timeout $timeout $PGPOOL_INSTALL_DIR/bin/pgproto -u $WHOAMI -p $PGPOOL_PORT -d test -f tests/$1.data > $1.out 2>&1
+	if [ $? != 0 ];then
+		echo "pgproto failed for $1"
+		cat $1.out
+		./shutdownall
+		exit 1
+	fi
+}
+
+# count_connections: number of connections to database test on backend
+function count_connections
+{
+	sleep 1
+	cat data0/*log/* data1/*log/* | grep "connection authorized: user=$WHOAMI database=test" | wc -l
+}
+
+# first session connects to backend, and saves the ParameterStatus
+run_pgproto hit
+if ! grep -q "ReadyForQuery" hit.out;then
+	echo "first session failed"
+	./shutdownall
+	exit 1
+fi
+
+# cache hit only: no connection to backend
+n=`count_connections`
+run_pgproto hit
+m=`count_connections`
+echo "connections to backend by the cache hit only session: `expr $m - $n`"
+if [ $m != $n ];then
+	./shutdownall
+	exit 1
+fi
+if grep -q "ParameterStatus" hit.out;then
+	echo "ParameterStatus sent again without backend connection"
+	./shutdownall
+	exit 1
+fi
+
+# cache miss: connects to backend, with the same ParameterStatus
+run_pgproto miss
+m=`count_connections`
+echo "connections to backend by the cache miss session: `expr $m - $n`"
+if [ $m = $n ];then
+	./shutdownall
+	exit 1
+fi
+if grep -q "ParameterStatus" miss.out;then
+	echo "ParameterStatus sent again although it was not changed"
+	./shutdownall
+	exit 1
+fi
+
+# change DateStyle of the database, behind pgpool
+$PSQL -p 11002 -c "ALTER DATABASE test SET DateStyle TO 'SQL, DMY'" test
+
+# cache miss: the new DateStyle must be sent
+run_pgproto miss
+if ! grep -q "ParameterStatus" miss.out;then
+	echo "changed ParameterStatus was not sent again"
+	cat miss.out
+	./shutdownall
+	exit 1
+fi
+
+# idle session without backend connection
+echo "client_idle_limit = 2" >> etc/pgpool.conf
+./pgpool_reload
+sleep 1
+
+n=`count_connections`
+(sleep 5) | $PSQL test
+m=`count_connections`
+if [ $m != $n ];then
+	echo "idle session connected to backend"
+	./shutdownall
+	exit 1
+fi
+if ! grep -q "client_idle_limit:2 is reached" log/pgpool.log;then
+	echo "client_idle_limit was not applied"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
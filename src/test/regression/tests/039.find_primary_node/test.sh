@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for searching for the primary node.
+# All nodes are checked at once, and the answer is used only if exactly
+# one primary node is found.  If a standby has been promoted behind
+# pgpool-II so that there are two primary nodes, the nodes must be
+# checked one by one again, and only one of them must be used as the
+# primary node.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+PG_CTL=$PGBIN/pg_ctl
+FALLBACK="primary nodes found by checking all nodes at once"
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+echo "search_primary_node_timeout = 5" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+# one primary and one standby: the answer of the parallel check is used
+grep -q "find_primary_node: primary node is 0" log/pgpool.log
+if [ $? != 0 ];then
+	echo "node 0 was not found as the primary node"
+	./shutdownall
+	exit 1
+fi
+if grep -q "$FALLBACK" log/pgpool.log;then
+	echo "nodes were checked one by one with a single primary node"
+	./shutdownall
+	exit 1
+fi
+
+# promote the standby behind pgpool-II, and restart pgpool-II only
+$PG_CTL -D data1 promote
+sleep 5
+
+$PGPOOL_INSTALL_DIR/bin/pgpool -f etc/pgpool.conf -m f stop
+mv log/pgpool.log log/pgpool.log.1
+
+echo 'dir=`pwd`' > pgpool.sh
+grep pgpool.conf startall >> pgpool.sh
+sh pgpool.sh
+wait_for_pgpool_startup
+
+grep -q "2 $FALLBACK" log/pgpool.log
+if [ $? != 0 ];then
+	echo "nodes were not checked one by one with two primary nodes"
+	./shutdownall
+	exit 1
+fi
+
+n=`$PSQL -t -c "SHOW pool_nodes" test | grep -c primary`
+echo "number of primary nodes: $n"
+if [ "$n" != 1 ];then
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
@@ -0,0 +1,121 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for memqcache_expire_table_list and
+# memqcache_admission_threshold.
+# A cache entry made by a rule must expire after the time of the rule,
+# while entries of other rules stay.  A query which has missed the cache
+# fewer times than memqcache_admission_threshold must not be cached.
+# The stats of a rule shown by SHOW pool_cache must stay with the rule
+# when a reload reorders the rules.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+echo "memory_cache_enabled = on" >> etc/pgpool.conf
+echo "memqcache_expire_table_list = 't1:2,t2:100'" >> etc/pgpool.conf
+echo "memqcache_admission_threshold = 1" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+$PSQL test <<EOF
+CREATE TABLE t1(i int);
+CREATE TABLE t2(i int);
+CREATE TABLE t3(i int);
+INSERT INTO t1 VALUES(1);
+INSERT INTO t2 VALUES(2);
+INSERT INTO t3 VALUES(3);
+EOF
+
+# hits table: number of times SELECT from the table was fetched from cache
+function hits
+{
+	grep "fetched from cache" log/pgpool.log | grep -F "statement: SELECT * FROM $1" | wc -l
+}
+
+# check_hits table expected: check the number of cache hits of the table
+function check_hits
+{
+	n=`hits $1`
+	if [ $n != $2 ];then
+		echo "SELECT from $1 was fetched from cache $n times, expected $2"
+		./shutdownall
+		exit 1
+	fi
+}
+
+# rule_hits rule: num_cache_hits of the rule in SHOW pool_cache
+function rule_hits
+{
+	$PSQL -t -A -c "SHOW pool_cache" test | awk -F'|' -v rule="$1" '$14 == rule {print $1}'
+}
+
+for i in 1 2
+do
+	$PSQL -c "SELECT * FROM t1" test
+	$PSQL -c "SELECT * FROM t2" test
+done
+check_hits t1 1
+check_hits t2 1
+
+# t1 expires by its rule, t2 does not
+sleep 3
+$PSQL -c "SELECT * FROM t1" test
+$PSQL -c "SELECT * FROM t2" test
+check_hits t1 1
+check_hits t2 2
+
+# reorder the rules and change the time of t1.  The stats must follow.
+sed -i "s/^memqcache_expire_table_list = .*/memqcache_expire_table_list = 't2:100,t1:5'/" etc/pgpool.conf
+echo "memqcache_admission_threshold = 3" >> etc/pgpool.conf
+./pgpool_reload
+sleep 1
+
+$PSQL -c "SELECT * FROM t2" test
+check_hits t2 3
+n=`rule_hits t2:100`
+if [ "$n" != 3 ];then
+	echo "num_cache_hits of rule t2:100 is \"$n\" after reload, expected 3"
+	./shutdownall
+	exit 1
+fi
+n=`rule_hits t1:5`
+if [ "$n" != 1 ];then
+	echo "num_cache_hits of rule t1:5 is \"$n\" after reload, expected 1"
+	./shutdownall
+	exit 1
+fi
+
+# t3 is cached only at the third miss
+for i in 1 2 3
+do
+	$PSQL -c "SELECT * FROM t3" test
+	check_hits t3 0
+done
+$PSQL -c "SELECT * FROM t3" test
+check_hits t3 1
+
+n=`$PSQL -t -A -c "SHOW pool_cache" test | head -1 | awk -F'|' '{print $13}'`
+if [ "$n" != 2 ];then
+	echo "num_not_admitted is \"$n\", expected 2"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
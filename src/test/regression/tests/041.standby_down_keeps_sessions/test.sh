@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for failover of a standby node without restarting
+# children.
+# When a standby goes down, a session not using it must keep running on
+# the same backend connection, and the pooled connection to the primary
+# must be reused by the next session.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+PG_CTL=$PGBIN/pg_ctl
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 3 || exit 1
+echo "done."
+
+# one child, whose sessions are load balanced to the primary only
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "max_pool = 1" >> etc/pgpool.conf
+echo "backend_weight1 = 0" >> etc/pgpool.conf
+echo "backend_weight2 = 0" >> etc/pgpool.conf
+echo "health_check_period = 1" >> etc/pgpool.conf
+echo "health_check_max_retries = 0" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+# make a pooled connection
+$PSQL -t -A -c "SELECT pg_backend_pid()" test > before.out
+
+# a session running across the failover
+(echo "SELECT pg_backend_pid();"; sleep 10; echo "SELECT pg_backend_pid();") | $PSQL -t -A test > session.out 2>&1 &
+SESSION_PID=$!
+
+sleep 2
+
+# shut down standby node 2
+$PG_CTL -D data2 -m i stop
+
+for i in `seq 1 20`
+do
+	if grep -q "failover done. shutdown host .*(11004)" log/pgpool.log;then
+		break
+	fi
+	sleep 1
+done
+
+wait $SESSION_PID
+
+if ! grep -q "failover done. shutdown host .*(11004)" log/pgpool.log;then
+	echo "failover of node 2 was not done"
+	./shutdownall
+	exit 1
+fi
+
+# the session must have run both queries on the same connection
+cat session.out
+if [ `wc -l < session.out` != 2 -o `sort -u session.out | wc -l` != 1 ];then
+	echo "session was disturbed by failover of the standby"
+	./shutdownall
+	exit 1
+fi
+
+# the next session must reuse the pooled connection
+$PSQL -t -A -c "SELECT pg_backend_pid()" test > after.out
+if ! cmp -s before.out after.out || ! cmp -s before.out <(head -1 session.out);then
+	echo "pooled connection was not kept"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
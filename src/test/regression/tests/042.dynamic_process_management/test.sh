@@ -0,0 +1,98 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for process_management_mode = dynamic.
+# Only min_spare_children children must be forked at startup.  While
+# clients are connected, children must be added until there are
+# min_spare_children idle ones again, and when the clients have gone,
+# idle children must be shut down down to max_spare_children.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+echo "process_management_mode = dynamic" >> etc/pgpool.conf
+echo "num_init_children = 10" >> etc/pgpool.conf
+echo "min_spare_children = 2" >> etc/pgpool.conf
+echo "max_spare_children = 4" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+
+./startall
+wait_for_pgpool_startup
+
+# children: number of child processes serving clients or waiting for one
+function children
+{
+	ps -o args= --ppid `cat run/pgpool.pid` | grep "^pgpool: " | grep -v "PCP\|worker process\|health check" | wc -l
+}
+
+# idle_children: number of child processes waiting for a client
+function idle_children
+{
+	ps -o args= --ppid `cat run/pgpool.pid` | grep -c "^pgpool: wait for connection request"
+}
+
+# wait_for condition: wait up to 10 seconds until the condition holds
+function wait_for
+{
+	for i in `seq 1 10`
+	do
+		if eval "$1";then
+			return 0
+		fi
+		sleep 1
+	done
+	echo "\"$1\" does not hold: `children` children, `idle_children` idle"
+	./shutdownall
+	exit 1
+}
+
+# min_spare_children children at startup, rather than num_init_children.
+# One more may have been forked while wait_for_pgpool_startup was
+# served.
+wait_for '[ `children` -ge 2 -a `children` -le 4 ]'
+
+# four sessions
+pids=""
+for i in 1 2 3 4
+do
+	(echo "SELECT 1;"; sleep 12; echo "SELECT 2;") | $PSQL test > session$i.out 2>&1 &
+	pids="$pids $!"
+done
+
+# spare children are added for the sessions
+wait_for '[ `idle_children` -ge 2 -a `children` -ge 6 ]'
+if [ `children` -gt 10 ];then
+	echo "more children than num_init_children"
+	./shutdownall
+	exit 1
+fi
+
+for pid in $pids
+do
+	wait $pid
+	if [ $? != 0 ];then
+		echo "session failed"
+		cat session*.out
+		./shutdownall
+		exit 1
+	fi
+done
+
+# too many idle children after the sessions
+wait_for '[ `idle_children` -le 4 ]'
+
+./shutdownall
+
+exit 0
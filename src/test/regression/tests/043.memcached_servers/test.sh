@@ -0,0 +1,160 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for query cache on multiple memcached servers.
+# Cache entries must be spread over the servers and invalidated on all of
+# them.  When a server goes down, its entries must simply miss, while
+# the entries of the other server are still fetched from cache.
+# need to configure --with-memcached=/usr and memcached command.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+WHOAMI=`whoami`
+PORT1=11311
+PORT2=11312
+
+if ! ldd $PGPOOL_INSTALL_DIR/bin/pgpool | grep -q libmemcached
+then
+	echo "pgpool is not built with --with-memcached"
+	exit 0
+fi
+
+if ! which memcached > /dev/null 2>&1
+then
+	echo "memcached command is not found"
+	exit 0
+fi
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+for port in $PORT1 $PORT2
+do
+	memcached -d -l 127.0.0.1 -p $port -U 0 -u $WHOAMI -P `pwd`/memcached$port.pid || exit 1
+done
+sleep 1
+
+echo "memory_cache_enabled = on" >> etc/pgpool.conf
+echo "memqcache_method = 'memcached'" >> etc/pgpool.conf
+echo "memqcache_memcached_host = '127.0.0.1:$PORT1,127.0.0.1:$PORT2'" >> etc/pgpool.conf
+echo "memqcache_memcached_retry_timeout = 60" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+BACKEND_PORT=`awk -F= '/^backend_port0/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+./startall
+wait_for_pgpool_startup
+
+# stop_all: stop pgpool-II, PostgreSQL and memcached
+function stop_all
+{
+	./shutdownall
+	for port in $PORT1 $PORT2
+	do
+		if [ -f memcached$port.pid ];then
+			kill `cat memcached$port.pid`
+		fi
+	done
+}
+
+# curr_items port: number of items on the memcached server
+function curr_items
+{
+	exec 3<>/dev/tcp/127.0.0.1/$1
+	printf "stats\r\nquit\r\n" >&3
+	awk '/STAT curr_items/ {print $3}' <&3 | tr -d '\r'
+	exec 3<&-
+}
+
+# hits: number of SELECTs fetched from cache
+function hits
+{
+	grep "fetched from cache" log/pgpool.log | grep -F "FROM t1 WHERE" | wc -l
+}
+
+# run_queries: run the queries through pgpool-II, bounded in time, and
+# check the results against the ones of the backend
+function run_queries
+{
+	for i in `seq 1 20`
+	do
+		timeout 5 $PSQL -t -A -c "SELECT * FROM t1 WHERE i = $i" test > result.txt
+		if [ $? != 0 ];then
+			echo "query $i failed or did not return in time"
+			stop_all
+			exit 1
+		fi
+		$PSQL -p $BACKEND_PORT -t -A -c "SELECT * FROM t1 WHERE i = $i" test > expected.txt
+		if ! cmp -s result.txt expected.txt;then
+			echo "query $i returned a stale result"
+			stop_all
+			exit 1
+		fi
+	done
+}
+
+$PSQL test <<EOF
+CREATE TABLE t1(i int, j int);
+INSERT INTO t1 SELECT i, 0 FROM generate_series(1, 20) i;
+EOF
+
+# the second run is fetched from cache
+run_queries
+run_queries
+n=`hits`
+if [ $n != 20 ];then
+	echo "$n queries were fetched from cache, expected 20"
+	stop_all
+	exit 1
+fi
+
+# the entries are spread over both servers
+for port in $PORT1 $PORT2
+do
+	n=`curr_items $port`
+	echo "memcached on port $port: $n items"
+	if [ -z "$n" -o "$n" = 0 ];then
+		echo "no cache entry on memcached on port $port"
+		stop_all
+		exit 1
+	fi
+done
+
+# the entries are invalidated on both servers
+$PSQL -c "UPDATE t1 SET j = j + 1" test
+run_queries
+
+# one server goes down
+kill `cat memcached$PORT2.pid`
+rm memcached$PORT2.pid
+sleep 1
+
+before=`hits`
+run_queries
+run_queries
+after=`hits`
+
+if ! grep -q "memcached on \"127.0.0.1:$PORT2\" is considered down" log/pgpool.log;then
+	echo "memcached on port $PORT2 was not considered down"
+	stop_all
+	exit 1
+fi
+
+# the entries of the server still up are fetched from cache
+if [ $after = $before ];then
+	echo "nothing was fetched from cache after a server went down"
+	stop_all
+	exit 1
+fi
+
+stop_all
+
+exit 0
@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for prewarm_connection_list.
+# The listed connection must be made before any client connects, be
+# handed to the first client, and be made again when connection_life_time
+# has closed it.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+WHOAMI=`whoami`
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 2 || exit 1
+echo "done."
+
+# one child, whose sessions are load balanced to the primary only
+echo "num_init_children = 1" >> etc/pgpool.conf
+echo "backend_weight1 = 0" >> etc/pgpool.conf
+echo "connection_life_time = 3" >> etc/pgpool.conf
+echo "prewarm_connection_list = '$WHOAMI:test'" >> etc/pgpool.conf
+echo "prewarm_connection_count = 1" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+BACKEND_PORT=`awk -F= '/^backend_port0/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+./startall
+
+# backend_pids: pids of the connections to database test on node 0
+function backend_pids
+{
+	$PSQL -p $BACKEND_PORT -t -A -c "SELECT pid FROM pg_stat_activity WHERE datname = 'test' AND usename = '$WHOAMI' ORDER BY pid" postgres
+}
+
+# wait_for_prewarm pid: wait up to 20 seconds for a pre-warmed connection
+# other than pid, and print its pid
+function wait_for_prewarm
+{
+	for i in `seq 1 20`
+	do
+		pids=`backend_pids`
+		if [ -n "$pids" -a "$pids" != "$1" ];then
+			echo $pids
+			return 0
+		fi
+		sleep 1
+	done
+	return 1
+}
+
+# the connection is made without any client
+pid1=`wait_for_prewarm`
+if [ -z "$pid1" ];then
+	echo "connection was not pre-warmed"
+	./shutdownall
+	exit 1
+fi
+echo "pre-warmed connection: $pid1"
+
+# the first client gets it
+pid=`$PSQL -t -A -c "SELECT pg_backend_pid()" test`
+if [ "$pid" != "$pid1" ];then
+	echo "client got backend $pid, not the pre-warmed one"
+	./shutdownall
+	exit 1
+fi
+
+# closed by connection_life_time and made again
+pid2=`wait_for_prewarm $pid1`
+if [ -z "$pid2" ];then
+	echo "connection was not pre-warmed again after it expired"
+	./shutdownall
+	exit 1
+fi
+echo "pre-warmed connection after expiry: $pid2"
+
+./shutdownall
+
+exit 0
@@ -0,0 +1,98 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for health_check_async.
+# A single health check process must check all the nodes every
+# health_check_async_interval milliseconds and record their response
+# time, used by load_balance_by_response_time.  A stopped node must be
+# detected and failed over well within a second or two.  A stopped node
+# whose failover is disallowed must be checked less and less often.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PG_CTL=$PGBIN/pg_ctl
+PSQL="$PGBIN/psql -X"
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 3 || exit 1
+echo "done."
+
+echo "health_check_async = on" >> etc/pgpool.conf
+echo "health_check_period = 1" >> etc/pgpool.conf
+echo "health_check_async_interval = 200" >> etc/pgpool.conf
+echo "health_check_max_retries = 0" >> etc/pgpool.conf
+echo "load_balance_by_response_time = on" >> etc/pgpool.conf
+echo "backend_flag2 = 'DISALLOW_TO_FAILOVER'" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+PORT1=`awk -F= '/^backend_port1/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+./startall
+wait_for_pgpool_startup
+
+# one health check process for all the nodes
+n=`ps -o args= --ppid \`cat run/pgpool.pid\` | grep -c "health check process"`
+if [ $n != 1 ];then
+	echo "$n health check processes, expected 1"
+	./shutdownall
+	exit 1
+fi
+
+# the response time of every node has been measured
+sleep 2
+$PSQL -t -A -c "SHOW pool_backend_stats" test > stats.out
+cat stats.out
+if [ `awk -F'|' '$13 > 0' stats.out | wc -l` != 3 ];then
+	echo "health_check_srtt is not measured for all the nodes"
+	./shutdownall
+	exit 1
+fi
+
+# SELECTs are still load balanced
+for i in `seq 1 20`
+do
+	$PSQL -c "SELECT 1" test > /dev/null
+done
+n=`$PSQL -t -A -c "SHOW pool_backend_stats" test | awk -F'|' '{n += $6} END {print n}'`
+if [ "$n" -lt 20 ];then
+	echo "only $n SELECTs were counted"
+	./shutdownall
+	exit 1
+fi
+
+# shut down standby node 1, which must be failed over shortly
+$PG_CTL -D data1 -m i stop
+for i in `seq 1 20`
+do
+	if grep -q "failover done. shutdown host .*($PORT1)" log/pgpool.log;then
+		break
+	fi
+	sleep 0.2
+done
+if ! grep -q "failover done. shutdown host .*($PORT1)" log/pgpool.log;then
+	echo "failover of node 1 was not done within 4 seconds"
+	./shutdownall
+	exit 1
+fi
+
+# shut down standby node 2, which must not be failed over, and must be
+# checked less often while it is down
+$PG_CTL -D data2 -m i stop
+sleep 6
+n=`grep -c "health check failed on node 2 but failover is disallowed" log/pgpool.log`
+echo "node 2 failed the health check $n times in 6 seconds"
+if [ $n -lt 2 -o $n -gt 10 ];then
+	echo "health check of node 2 did not back off"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
@@ -0,0 +1,132 @@
+#!/usr/bin/env bash
+#-------------------------------------------------------------------
+# test script for draining a node with pcp_detach_node -D.
+# While pgbench is running, including a client using prepared
+# statements, a standby is drained.  SHOW pool_nodes must show it as
+# draining, a session must move off the node at a transaction boundary,
+# and no client may see an error.  pcp_attach_node must undrain the
+# node, which is then used for load balancing again.
+#
+source $TESTLIBS
+TESTDIR=testdir
+PSQL="$PGBIN/psql -X"
+PGBENCH=$PGBENCH_PATH
+
+rm -fr $TESTDIR
+mkdir $TESTDIR
+cd $TESTDIR
+
+# create test environment
+echo -n "creating test environment..."
+$PGPOOL_SETUP -m s -n 3 || exit 1
+echo "done."
+
+# SELECTs are load balanced to node 1 only, so that sessions use the
+# node to be drained
+echo "backend_weight0 = 0" >> etc/pgpool.conf
+echo "backend_weight2 = 0" >> etc/pgpool.conf
+
+source ./bashrc.ports
+
+export PGPORT=$PGPOOL_PORT
+PORT1=`awk -F= '/^backend_port1/ {gsub(/ /, "", $2); port = $2} END {print port}' etc/pgpool.conf`
+
+./startall
+wait_for_pgpool_startup
+
+$PGBENCH -i test
+
+# node_status node: status of the node in SHOW pool_nodes
+function node_status
+{
+	$PSQL -t -A -c "SHOW pool_nodes" test | awk -F'|' -v node=$1 '$1 == node {print $4}'
+}
+
+# wait_for_status node status: wait up to 10 seconds until the node has
+# the status.  The request is applied by the main process.
+function wait_for_status
+{
+	for i in `seq 1 20`
+	do
+		if [ "`node_status $1`" = "$2" ];then
+			return 0
+		fi
+		sleep 0.5
+	done
+	echo "node $1 is \"`node_status $1`\", expected \"$2\""
+	./shutdownall
+	exit 1
+}
+
+# a session running across the drain
+(echo "SELECT current_setting('port');"; sleep 8; echo "SELECT current_setting('port');") | $PSQL -t -A test > session.out 2>&1 &
+SESSION_PID=$!
+
+$PGBENCH -S -c 4 -T 15 test > pgbench.log 2>&1 &
+PGBENCH_PID=$!
+$PGBENCH -S -M prepared -c 2 -T 15 test > pgbench_prepared.log 2>&1 &
+PREPARED_PID=$!
+
+sleep 3
+
+$PGPOOL_INSTALL_DIR/bin/pcp_detach_node -w -h localhost -p $PCP_PORT -D 1
+if [ $? != 0 ];then
+	echo "pcp_detach_node -D failed"
+	./shutdownall
+	exit 1
+fi
+wait_for_status 1 draining
+
+failed=0
+wait $SESSION_PID || failed=1
+wait $PGBENCH_PID || failed=1
+wait $PREPARED_PID || failed=1
+if [ $failed != 0 ] || grep -q "ERROR\|FATAL" session.out pgbench.log pgbench_prepared.log;then
+	echo "a client failed while node 1 was drained"
+	cat session.out pgbench.log pgbench_prepared.log
+	./shutdownall
+	exit 1
+fi
+
+# the session must have moved off node 1 after its first query
+cat session.out
+if [ "`head -1 session.out`" != "$PORT1" -o "`tail -1 session.out`" = "$PORT1" ];then
+	echo "session did not move off node 1 while it was drained"
+	./shutdownall
+	exit 1
+fi
+
+if ! grep -q "DETAIL:  the node is being drained" log/pgpool.log;then
+	echo "pooled connections to node 1 were not closed"
+	./shutdownall
+	exit 1
+fi
+
+# the node is still draining, and no new session uses it
+wait_for_status 1 draining
+n=`$PSQL -t -A -c "SELECT current_setting('port')" test`
+if [ "$n" = "$PORT1" ];then
+	echo "a new session used node 1 while it was drained"
+	./shutdownall
+	exit 1
+fi
+
+# undrain the node
+$PGPOOL_INSTALL_DIR/bin/pcp_attach_node -w -h localhost -p $PCP_PORT 1
+if [ $? != 0 ];then
+	echo "pcp_attach_node failed"
+	./shutdownall
+	exit 1
+fi
+wait_for_status 1 up
+
+n=`$PSQL -t -A -c "SELECT current_setting('port')" test`
+if [ "$n" != "$PORT1" ];then
+	echo "node 1 was not used for load balancing after it was undrained"
+	./shutdownall
+	exit 1
+fi
+
+./shutdownall
+
+exit 0
@@ -47,6 +47,8 @@ static void output_watchdog_info_result(PCPResultInfo * pcpResInfo, bool verbose
 static void output_procinfo_result(PCPResultInfo * pcpResInfo, bool all, bool verbose);
 static void output_proccount_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_poolstatus_result(PCPResultInfo * pcpResInfo, bool verbose);
+static void output_latency_stats_result(PCPResultInfo * pcpResInfo, bool verbose);
+static void output_failover_trace_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_nodeinfo_result(PCPResultInfo * pcpResInfo, bool verbose);
 static void output_nodecount_result(PCPResultInfo * pcpResInfo, bool verbose);
 static char *backend_status_to_string(BackendInfo * bi);
@@ -56,6 +58,8 @@ typedef enum
 {
 	PCP_ATTACH_NODE,
 	PCP_DETACH_NODE,
+	PCP_FAILOVER_TRACE,
+	PCP_LATENCY_STATS,
 	PCP_NODE_COUNT,
 	PCP_NODE_INFO,
 	PCP_POOL_STATUS,
@@ -79,7 +83,9 @@ struct AppTypes
 struct AppTypes AllAppTypes[] =
 {
 	{"pcp_attach_node", PCP_ATTACH_NODE, "n:h:p:U:wWvd", "attach a node from pgpool-II"},
-	{"pcp_detach_node", PCP_DETACH_NODE, "n:h:p:U:gwWvd", "detach a node from pgpool-II"},
+	{"pcp_detach_node", PCP_DETACH_NODE, "n:h:p:U:gDwWvd", "detach a node from pgpool-II"},
+	{"pcp_failover_trace", PCP_FAILOVER_TRACE, "h:p:U:wWvd", "display the failover trace of pgpool-II"},
+	{"pcp_latency_stats", PCP_LATENCY_STATS, "h:p:U:wWvd", "display query latency statistics of pgpool-II"},
 	{"pcp_node_count", PCP_NODE_COUNT, "h:p:U:wWvd", "display the total number of nodes under pgpool-II's control"},
 	{"pcp_node_info", PCP_NODE_INFO, "n:h:p:U:wWvd", "display a pgpool-II node's information"},
 	{"pcp_pool_status", PCP_POOL_STATUS, "h:p:U:wWvd", "display pgpool configuration and status"},
@@ -110,6 +116,7 @@ main(int argc, char **argv)
 	bool		debug = false;
 	bool		need_password = true;
 	bool		gracefully = false;
+	bool		drain = false;
 	bool		verbose = false;
 	PCPConnInfo *pcpConn;
 	PCPResultInfo *pcpResInfo;
@@ -127,6 +134,7 @@ main(int argc, char **argv)
 		{"password", no_argument, NULL, 'W'},
 		{"mode", required_argument, NULL, 'm'},
 		{"gracefully", no_argument, NULL, 'g'},
+		{"drain", no_argument, NULL, 'D'},
 		{"verbose", no_argument, NULL, 'v'},
 		{"all", no_argument, NULL, 'a'},
 		{"node-id", required_argument, NULL, 'n'},
@@ -190,6 +198,10 @@ main(int argc, char **argv)
 				gracefully = true;
 				break;
 
+			case 'D':
+				drain = true;
+				break;
+
 			case 'm':
 				if (current_app_type->app_type == PCP_STOP_PGPOOL)
 				{
@@ -350,12 +362,24 @@ main(int argc, char **argv)
 
 	else if (current_app_type->app_type == PCP_DETACH_NODE)
 	{
-		if (gracefully)
+		if (drain)
+			pcpResInfo = pcp_drain_node(pcpConn, nodeID);
+		else if (gracefully)
 			pcpResInfo = pcp_detach_node_gracefully(pcpConn, nodeID);
 		else
 			pcpResInfo = pcp_detach_node(pcpConn, nodeID);
 	}
 
+	else if (current_app_type->app_type == PCP_FAILOVER_TRACE)
+	{
+		pcpResInfo = pcp_failover_trace(pcpConn);
+	}
+
+	else if (current_app_type->app_type == PCP_LATENCY_STATS)
+	{
+		pcpResInfo = pcp_latency_stats(pcpConn);
+	}
+
 	else if (current_app_type->app_type == PCP_NODE_COUNT)
 	{
 		pcpResInfo = pcp_node_count(pcpConn);
@@ -432,6 +456,12 @@ main(int argc, char **argv)
 		if (current_app_type->app_type == PCP_POOL_STATUS)
 			output_poolstatus_result(pcpResInfo, verbose);
 
+		if (current_app_type->app_type == PCP_LATENCY_STATS)
+			output_latency_stats_result(pcpResInfo, verbose);
+
+		if (current_app_type->app_type == PCP_FAILOVER_TRACE)
+			output_failover_trace_result(pcpResInfo, verbose);
+
 		if (current_app_type->app_type == PCP_PROC_COUNT)
 			output_proccount_result(pcpResInfo, verbose);
 
@@ -540,6 +570,100 @@ output_poolstatus_result(PCPResultInfo * pcpResInfo, bool verbose)
 	}
 }
 
+static void
+output_latency_stats_result(PCPResultInfo * pcpResInfo, bool verbose)
+{
+	POOL_REPORT_LATENCY *stats;
+	int			i;
+	int			array_size = pcp_result_slot_count(pcpResInfo);
+
+	for (i = 0; i < array_size; i++)
+	{
+		stats = (POOL_REPORT_LATENCY *) pcp_get_binary_data(pcpResInfo, i);
+		if (stats == NULL)
+		{
+			printf("****Data at %d slot is NULL\n", i);
+			continue;
+		}
+
+		if (verbose)
+		{
+			printf("Scope          : %s\n", stats->scope);
+			printf("Name           : %s\n", stats->name);
+			printf("Statement      : %s\n", stats->statement);
+			printf("Count          : %s\n", stats->count);
+			printf("Backend avg us : %s\n", stats->backend_avg);
+			printf("Backend p50 us : %s\n", stats->backend_p50);
+			printf("Backend p99 us : %s\n", stats->backend_p99);
+			printf("Backend max us : %s\n", stats->backend_max);
+			printf("Pgpool avg us  : %s\n", stats->pgpool_avg);
+			printf("Pgpool p50 us  : %s\n", stats->pgpool_p50);
+			printf("Pgpool p99 us  : %s\n", stats->pgpool_p99);
+			printf("Pgpool max us  : %s\n\n", stats->pgpool_max);
+		}
+		else
+		{
+			printf("%s %s %s %s %s %s %s %s %s %s %s %s\n",
+				   stats->scope,
+				   *stats->name ? stats->name : "-",
+				   stats->statement,
+				   stats->count,
+				   stats->backend_avg,
+				   stats->backend_p50,
+				   stats->backend_p99,
+				   stats->backend_max,
+				   stats->pgpool_avg,
+				   stats->pgpool_p50,
+				   stats->pgpool_p99,
+				   stats->pgpool_max);
+		}
+	}
+}
+
+static void
+output_failover_trace_result(PCPResultInfo * pcpResInfo, bool verbose)
+{
+	POOL_REPORT_FAILOVER_TRACE *trace;
+	int			i;
+	int			array_size = pcp_result_slot_count(pcpResInfo);
+
+	for (i = 0; i < array_size; i++)
+	{
+		trace = (POOL_REPORT_FAILOVER_TRACE *) pcp_get_binary_data(pcpResInfo, i);
+		if (trace == NULL)
+		{
+			printf("****Data at %d slot is NULL\n", i);
+			continue;
+		}
+
+		if (verbose)
+		{
+			printf("Seq        : %s\n", trace->seq);
+			printf("Time       : %s\n", trace->time);
+			printf("Pid        : %s\n", trace->pid);
+			printf("Request    : %s\n", trace->request);
+			printf("Kind       : %s\n", trace->kind);
+			printf("Event      : %s\n", trace->event);
+			printf("Node ID    : %s\n", trace->node_id);
+			printf("Elapsed ms : %s\n", trace->elapsed);
+			printf("Detail     : %s\n\n", trace->detail);
+		}
+		else
+		{
+			printf("%s %s %s %s %s %s %s %s %s\n",
+				   trace->seq,
+				   trace->time,
+				   trace->pid,
+				   *trace->request ? trace->request : "-",
+				   trace->kind,
+				   trace->event,
+				   trace->node_id,
+				   *trace->elapsed ? trace->elapsed : "-",
+				   *trace->detail ? trace->detail : "-");
+		}
+	}
+}
+
 static void
 output_proccount_result(PCPResultInfo * pcpResInfo, bool verbose)
 {
@@ -744,6 +868,10 @@ usage(void)
 	{
 		fprintf(stderr, "  -g, --gracefully       promote gracefully(optional)\n");
 	}
+	if (current_app_type->app_type == PCP_DETACH_NODE)
+	{
+		fprintf(stderr, "  -D, --drain            stop routing new work to the node instead of detaching it(optional)\n");
+	}
 
 	if (current_app_type->app_type == PCP_WATCHDOG_INFO)
 	{
@@ -810,11 +938,21 @@ backend_status_to_string(BackendInfo * bi)
 			break;
 
 		case CON_CONNECT_WAIT:
-			statusName = BACKEND_STATUS_CON_CONNECT_WAIT;
+			{
+				if (bi->draining)
+					statusName = BACKEND_STATUS_DRAINING;
+				else
+					statusName = BACKEND_STATUS_CON_CONNECT_WAIT;
+			}
 			break;
 
 		case CON_UP:
-			statusName = BACKEND_STATUS_CON_UP;
+			{
+				if (bi->draining)
+					statusName = BACKEND_STATUS_DRAINING;
+				else
+					statusName = BACKEND_STATUS_CON_UP;
+			}
 			break;
 
 		case CON_DOWN:
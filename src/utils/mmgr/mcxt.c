@@ -49,6 +49,7 @@ MemoryContext ProcessLoopContext = NULL;	/* This context resets at every
 											 * main loop iteration of a
 											 * process */
 MemoryContext CacheMemoryContext = NULL;
+MemoryContext ConfigMemoryContext = NULL;	/* configuration values */
 MemoryContext MessageContext = NULL;
 MemoryContext QueryContext = NULL;
 
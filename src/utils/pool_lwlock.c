@@ -0,0 +1,650 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Portions Copyright (c) 2003-2019, PgPool Global Development Group
+ * Portions Copyright (c) 2003-2004, PostgreSQL Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ */
+#include "pool.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "utils/elog.h"
+#include "utils/pool_atomics.h"
+#include "utils/pool_lwlock.h"
+
+/*
+ * Lightweight locks.
+ *
+ * Each lock is a 32-bit state word in shared memory.  The high bit
+ * LW_VAL_EXCLUSIVE is set while the lock is held in exclusive mode, in
+ * which case the low bits are the pid of the holder.  Otherwise the low
+ * bits count the holders in shared mode.  Acquiring or releasing
+ * an uncontended lock is a single compare-and-swap on the state word; no
+ * system call is made.  A process which cannot get the lock spins for a
+ * short while, then goes to sleep with futex(2) until the holder wakes it
+ * up.  Shared and exclusive lockers sleep on different wakeup counters, so
+ * that either kind can be woken up alone.
+ *
+ * Exclusive lockers are preferred: while one is sleeping, new shared
+ * lockers wait too, so that a steady stream of readers cannot hold a
+ * writer off.  A shared locker which has waited LW_WAIT_TIMEOUT_MS stops
+ * giving way, so that a waiter which has gone away cannot stall the
+ * readers.
+ *
+ * SysV semaphores used to undo the lock operations of a process which
+ * died while holding a lock (SEM_UNDO).  To keep that, the pid of the
+ * exclusive holder is set and cleared in the state word by the same
+ * compare-and-swap which takes and gives back the lock, so that a lock
+ * held exclusively always names its holder.  The shared locks held
+ * and the lock waited for by each process in an entry of the holder
+ * table.  When pgpool main reaps a process, the locks it held in shared
+ * mode and its place among the waiters are given back.  Waiters also
+ * check every LW_WAIT_TIMEOUT_MS whether the holders are still alive, and
+ * clean up after those which are not.
+ */
+#define LW_VAL_EXCLUSIVE	((uint32) 1 << 31)
+#define LW_SHARED_MASK		(LW_VAL_EXCLUSIVE - 1)
+#define LW_OWNER_MASK		LW_SHARED_MASK
+
+#define LW_SPINS			100
+#define LW_WAIT_TIMEOUT_MS	1000
+
+typedef struct
+{
+	volatile uint32 state;		/* exclusive bit + pid of the exclusive
+								 * holder or number of shared holders */
+	volatile uint32 shared_waiters; /* number of sleeping shared lockers */
+	volatile uint32 exclusive_waiters;	/* number of sleeping exclusive
+										 * lockers */
+	volatile uint32 shared_wakeup;	/* bumped to wake up shared lockers */
+	volatile uint32 exclusive_wakeup;	/* bumped to wake up exclusive
+										 * lockers */
+
+	/* Instrumentation */
+	volatile uint64 acquire_count;
+	volatile uint64 contended_count;
+	volatile uint64 wait_usec;
+	volatile uint64 max_wait_usec;
+}			POOL_LWLOCK;
+
+/*
+ * Each lock gets its own cache line so that processes working on
+ * different locks do not disturb each other.
+ */
+typedef union
+{
+	POOL_LWLOCK lock;
+	char		pad[POOL_CACHE_LINE_SIZE];
+}			POOL_LWLOCK_PADDED;
+
+/*
+ * Locks of a process, so that they can be given back if it dies.  An
+ * entry is taken by a process the first time it holds a lock in shared
+ * mode or waits for a lock.
+ */
+typedef struct
+{
+	volatile uint32 pid;		/* process owning the entry, 0 if free */
+	volatile uint32 shared;		/* bit per lock held in shared mode */
+	volatile uint32 waiting;	/* LW_WAITING() of the lock slept on, or 0 */
+}			POOL_LWLOCK_HOLDER;
+
+#define LW_WAITING(lockid, mode)	((((uint32) (lockid)) << 1 | (mode)) + 1)
+#define LW_WAITING_LOCKID(w)		(((w) - 1) >> 1)
+#define LW_WAITING_MODE(w)			((POOL_LWLOCK_MODE) (((w) - 1) & 1))
+
+static const char *const lwlock_names[MAX_NUM_LWLOCKS] = {
+	"conn_counter",				/* CONN_COUNTER_LOCK */
+	"request_info",				/* REQUEST_INFO_LOCK */
+	"shm_cache",				/* SHM_CACHE_LOCK */
+	"pcp_request",				/* PCP_REQUEST_LOCK */
+	"accept_fd",				/* ACCEPT_FD_LOCK */
+	"sequence"					/* SEQUENCE_LOCK */
+};
+
+static POOL_LWLOCK_PADDED * lwlocks;
+static int	num_lwlocks;
+static POOL_LWLOCK_HOLDER * lwlock_holders;
+static int	num_lwlock_holders;
+
+/* Locks held by this process */
+static bool lwlock_held[MAX_NUM_LWLOCKS];
+static POOL_LWLOCK_MODE lwlock_held_mode[MAX_NUM_LWLOCKS];
+
+/* Cached getpid() of this process, refreshed in every forked child */
+static uint32 lwlock_pid;
+
+/* Holder table entry of this process, or NULL */
+static POOL_LWLOCK_HOLDER * my_holder;
+
+static bool lwlock_attempt(POOL_LWLOCK * lock, POOL_LWLOCK_MODE mode, bool prefer_exclusive, uint32 *observed);
+static void lwlock_wait(POOL_LWLOCK * lock, int lockid, POOL_LWLOCK_MODE mode);
+static void lwlock_release_state(POOL_LWLOCK * lock, uint32 val);
+static bool lwlock_takeover(POOL_LWLOCK * lock, int lockid, uint32 observed);
+static void lwlock_cleanup_dead_holders(void);
+static bool lwlock_cleanup_holder(POOL_LWLOCK_HOLDER * holder, uint32 pid);
+static POOL_LWLOCK_HOLDER * lwlock_get_holder(void);
+static bool lwlock_sleep(volatile uint32 *addr, uint32 val);
+static void lwlock_wakeup(volatile uint32 *addr, int nwaiters);
+static void lwlock_atfork_child(void);
+
+static inline void
+lwlock_spin_delay(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/*
+ * Create the locks in shared memory, with room in the holder table for
+ * numHolders processes.  Called by pgpool main process before any child
+ * is forked.
+ */
+void
+pool_lwlock_create(int numLocks, int numHolders)
+{
+	if (numLocks > MAX_NUM_LWLOCKS)
+		ereport(FATAL,
+				(errmsg("unable to create lightweight locks:%d, maximum is %d", numLocks, MAX_NUM_LWLOCKS)));
+
+	lwlocks = pool_shared_memory_create(sizeof(POOL_LWLOCK_PADDED) * numLocks);
+	memset(lwlocks, 0, sizeof(POOL_LWLOCK_PADDED) * numLocks);
+	num_lwlocks = numLocks;
+
+	lwlock_holders = pool_shared_memory_create(sizeof(POOL_LWLOCK_HOLDER) * numHolders);
+	memset(lwlock_holders, 0, sizeof(POOL_LWLOCK_HOLDER) * numHolders);
+	num_lwlock_holders = numHolders;
+
+	lwlock_pid = (uint32) getpid();
+	pthread_atfork(NULL, NULL, lwlock_atfork_child);
+}
+
+/*
+ * Acquire a lock in the given mode, sleeping if necessary.  The locks are
+ * not reentrant.
+ */
+void
+pool_lwlock_acquire(int lockid, POOL_LWLOCK_MODE mode)
+{
+	POOL_LWLOCK *lock = &lwlocks[lockid].lock;
+	uint32		observed;
+
+	if (lwlock_held[lockid])
+		ereport(ERROR,
+				(errmsg("lightweight lock \"%s\" is already held", lwlock_names[lockid])));
+
+	if (!lwlock_attempt(lock, mode, true, &observed))
+		lwlock_wait(lock, lockid, mode);
+
+	/* Other holders can only count concurrently in shared mode */
+	if (mode == POOL_LW_EXCLUSIVE)
+		lock->acquire_count++;
+	else
+	{
+		POOL_LWLOCK_HOLDER *holder = lwlock_get_holder();
+
+		if (holder)
+			__atomic_fetch_or(&holder->shared, (uint32) 1 << lockid, __ATOMIC_SEQ_CST);
+		pool_atomic_fetch_add_u64(&lock->acquire_count, 1);
+	}
+
+	lwlock_held[lockid] = true;
+	lwlock_held_mode[lockid] = mode;
+}
+
+/*
+ * Release a lock held by this process, waking up waiters if there are any.
+ */
+void
+pool_lwlock_release(int lockid)
+{
+	POOL_LWLOCK *lock = &lwlocks[lockid].lock;
+
+	if (!lwlock_held[lockid])
+	{
+		ereport(WARNING,
+				(errmsg("failed to release lightweight lock \"%s\", the lock is not held", lwlock_names[lockid])));
+		return;
+	}
+	lwlock_held[lockid] = false;
+
+	if (lwlock_held_mode[lockid] == POOL_LW_EXCLUSIVE)
+		lwlock_release_state(lock, LW_VAL_EXCLUSIVE | lwlock_pid);
+	else
+	{
+		/*
+		 * Forget the lock before giving it back.  If we die in between, the
+		 * lock is leaked rather than released twice.
+		 */
+		if (my_holder)
+			__atomic_fetch_and(&my_holder->shared, ~((uint32) 1 << lockid), __ATOMIC_SEQ_CST);
+		lwlock_release_state(lock, 1);
+	}
+}
+
+/*
+ * Returns true if the lock is held by this process.
+ */
+bool
+pool_lwlock_held(int lockid)
+{
+	return lwlock_held[lockid];
+}
+
+/*
+ * Give back the locks held in shared mode by a process which has exited,
+ * and its place among the waiters.  Called by pgpool main process when it
+ * reaps a process.
+ */
+void
+pool_lwlock_cleanup_process(pid_t pid)
+{
+	int			i;
+
+	if (lwlock_holders == NULL)
+		return;
+
+	for (i = 0; i < num_lwlock_holders; i++)
+	{
+		if (pool_atomic_read_u32(&lwlock_holders[i].pid) == (uint32) pid)
+		{
+			lwlock_cleanup_holder(&lwlock_holders[i], (uint32) pid);
+			break;
+		}
+	}
+}
+
+/*
+ * Returns the wait time statistics of a lock.
+ */
+void
+pool_lwlock_get_stats(int lockid, POOL_LWLOCK_STATS * stats)
+{
+	POOL_LWLOCK *lock = &lwlocks[lockid].lock;
+
+	stats->name = lwlock_names[lockid];
+	stats->acquire_count = pool_atomic_read_u64(&lock->acquire_count);
+	stats->contended_count = pool_atomic_read_u64(&lock->contended_count);
+	stats->wait_usec = pool_atomic_read_u64(&lock->wait_usec);
+	stats->max_wait_usec = pool_atomic_read_u64(&lock->max_wait_usec);
+}
+
+/*
+ * Try to acquire the lock once without waiting.  If prefer_exclusive is
+ * true, a shared locker gives way to sleeping exclusive lockers.  On
+ * failure the state which prevented us from getting the lock is returned
+ * in *observed.
+ */
+static bool
+lwlock_attempt(POOL_LWLOCK * lock, POOL_LWLOCK_MODE mode, bool prefer_exclusive, uint32 *observed)
+{
+	uint32		old = pool_atomic_read_u32(&lock->state);
+	uint32		new;
+
+	for (;;)
+	{
+		if (mode == POOL_LW_EXCLUSIVE)
+		{
+			if (old != 0)
+				break;
+			new = LW_VAL_EXCLUSIVE | lwlock_pid;
+		}
+		else
+		{
+			if (old & LW_VAL_EXCLUSIVE)
+				break;
+			if (prefer_exclusive && pool_atomic_read_u32(&lock->exclusive_waiters) > 0)
+				break;
+			new = old + 1;
+		}
+
+		if (pool_atomic_compare_exchange_u32(&lock->state, &old, new))
+			return true;
+	}
+
+	*observed = old;
+	return false;
+}
+
+/*
+ * Slow path of pool_lwlock_acquire().  Spin for a while, then sleep until
+ * the lock is released.
+ */
+static void
+lwlock_wait(POOL_LWLOCK * lock, int lockid, POOL_LWLOCK_MODE mode)
+{
+	POOL_LWLOCK_HOLDER *holder;
+	volatile uint32 *waiters;
+	volatile uint32 *wakeup;
+	struct timespec start;
+	struct timespec end;
+	uint64		waited;
+	uint32		observed;
+	bool		prefer_exclusive = true;
+	int			i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < LW_SPINS; i++)
+	{
+		lwlock_spin_delay();
+		if (lwlock_attempt(lock, mode, prefer_exclusive, &observed))
+			goto acquired;
+	}
+
+	holder = lwlock_get_holder();
+	if (mode == POOL_LW_EXCLUSIVE)
+	{
+		waiters = &lock->exclusive_waiters;
+		wakeup = &lock->exclusive_wakeup;
+	}
+	else
+	{
+		waiters = &lock->shared_waiters;
+		wakeup = &lock->shared_wakeup;
+	}
+
+	for (;;)
+	{
+		uint32		seq;
+		bool		acquired;
+		bool		woken = true;
+
+		/*
+		 * Count ourselves among the waiters before the last attempt, so that
+		 * a holder releasing the lock after it sees us and bumps the wakeup
+		 * counter.  Record it after counting: if we die in between, the
+		 * waiter is leaked rather than uncounted twice.
+		 */
+		__atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+		if (holder)
+			pool_atomic_write_u32(&holder->waiting, LW_WAITING(lockid, mode));
+		seq = pool_atomic_read_u32(wakeup);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		acquired = lwlock_attempt(lock, mode, prefer_exclusive, &observed);
+		if (!acquired)
+			woken = lwlock_sleep(wakeup, seq);
+
+		if (holder)
+			pool_atomic_write_u32(&holder->waiting, 0);
+		pool_atomic_fetch_sub_u32(waiters, 1);
+
+		if (acquired)
+			break;
+
+		if (!woken)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			if ((end.tv_sec - start.tv_sec) * 1000 +
+				(end.tv_nsec - start.tv_nsec) / 1000000 >= LW_WAIT_TIMEOUT_MS)
+			{
+				/* Stop giving way to exclusive lockers which may be gone */
+				prefer_exclusive = false;
+
+				if (!(observed & LW_VAL_EXCLUSIVE) && (observed & LW_SHARED_MASK))
+					lwlock_cleanup_dead_holders();
+			}
+
+			if (lwlock_takeover(lock, lockid, observed))
+			{
+				/*
+				 * We now hold the lock of the dead process exclusively. Keep
+				 * it if that is what we wanted, otherwise let everybody go.
+				 */
+				if (mode == POOL_LW_EXCLUSIVE)
+					break;
+				lwlock_held[lockid] = true;
+				lwlock_held_mode[lockid] = POOL_LW_EXCLUSIVE;
+				pool_lwlock_release(lockid);
+			}
+		}
+
+		if (lwlock_attempt(lock, mode, prefer_exclusive, &observed))
+			break;
+	}
+
+acquired:
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	waited = (uint64) (end.tv_sec - start.tv_sec) * 1000000 +
+		(end.tv_nsec - start.tv_nsec) / 1000;
+
+	pool_atomic_fetch_add_u64(&lock->contended_count, 1);
+	pool_atomic_fetch_add_u64(&lock->wait_usec, waited);
+	pool_atomic_max_u64(&lock->max_wait_usec, waited);
+}
+
+/*
+ * Subtract val from the state of the lock, and wake up the waiters which
+ * may now get it.  A free lock goes to a sleeping exclusive locker first.
+ * Shared lockers are woken up when no exclusive locker is waiting.
+ */
+static void
+lwlock_release_state(POOL_LWLOCK * lock, uint32 val)
+{
+	uint32		state;
+
+	state = __atomic_sub_fetch(&lock->state, val, __ATOMIC_SEQ_CST);
+
+	/*
+	 * Pairs with the barrier in lwlock_wait(): either we see the waiter's
+	 * counter, or the waiter sees the new state and does not go to sleep.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (pool_atomic_read_u32(&lock->exclusive_waiters) > 0)
+	{
+		if (state == 0)
+		{
+			pool_atomic_fetch_add_u32(&lock->exclusive_wakeup, 1);
+			lwlock_wakeup(&lock->exclusive_wakeup, 1);
+		}
+	}
+	else if (!(state & LW_VAL_EXCLUSIVE) &&
+			 pool_atomic_read_u32(&lock->shared_waiters) > 0)
+	{
+		pool_atomic_fetch_add_u32(&lock->shared_wakeup, 1);
+		lwlock_wakeup(&lock->shared_wakeup, INT_MAX);
+	}
+}
+
+/*
+ * Called after waiting LW_WAIT_TIMEOUT_MS for the lock.  If the lock is
+ * still held exclusively by a process which does not exist any more, make
+ * ourselves the exclusive holder and return true.
+ */
+static bool
+lwlock_takeover(POOL_LWLOCK * lock, int lockid, uint32 observed)
+{
+	uint32		owner = observed & LW_OWNER_MASK;
+
+	if (!(observed & LW_VAL_EXCLUSIVE))
+		return false;
+
+	if (kill((pid_t) owner, 0) == 0 || errno != ESRCH)
+		return false;
+
+	/* Whoever manages to replace the dead pid in the state owns the lock */
+	if (!pool_atomic_compare_exchange_u32(&lock->state, &observed, LW_VAL_EXCLUSIVE | lwlock_pid))
+		return false;
+
+	ereport(WARNING,
+			(errmsg("lightweight lock \"%s\" was held by process %d which no longer exists, taking it over",
+					lwlock_names[lockid], (int) owner)));
+	return true;
+}
+
+/*
+ * Clean up after the processes in the holder table which do not exist any
+ * more.
+ */
+static void
+lwlock_cleanup_dead_holders(void)
+{
+	int			i;
+
+	for (i = 0; i < num_lwlock_holders; i++)
+	{
+		uint32		pid = pool_atomic_read_u32(&lwlock_holders[i].pid);
+
+		if (pid == 0 || pid == lwlock_pid)
+			continue;
+		if (kill((pid_t) pid, 0) == 0 || errno != ESRCH)
+			continue;
+		lwlock_cleanup_holder(&lwlock_holders[i], pid);
+	}
+}
+
+/*
+ * Give back the locks recorded in the holder table entry of process pid,
+ * which has gone away, and free the entry.  Returns false if somebody else
+ * has already done it.
+ */
+static bool
+lwlock_cleanup_holder(POOL_LWLOCK_HOLDER * holder, uint32 pid)
+{
+	uint32		expected = pid;
+	uint32		shared;
+	uint32		waiting;
+	int			lockid;
+
+	/* Whoever replaces the pid of the dead process cleans up after it */
+	if (!pool_atomic_compare_exchange_u32(&holder->pid, &expected, lwlock_pid))
+		return false;
+
+	shared = pool_atomic_read_u32(&holder->shared);
+	waiting = pool_atomic_read_u32(&holder->waiting);
+
+	for (lockid = 0; lockid < num_lwlocks; lockid++)
+	{
+		if (!(shared & ((uint32) 1 << lockid)))
+			continue;
+
+		ereport(WARNING,
+				(errmsg("lightweight lock \"%s\" was held in shared mode by process %d which no longer exists, releasing it",
+						lwlock_names[lockid], (int) pid)));
+		lwlock_release_state(&lwlocks[lockid].lock, 1);
+	}
+
+	if (waiting)
+	{
+		POOL_LWLOCK *lock = &lwlocks[LW_WAITING_LOCKID(waiting)].lock;
+
+		if (LW_WAITING_MODE(waiting) == POOL_LW_EXCLUSIVE)
+			pool_atomic_fetch_sub_u32(&lock->exclusive_waiters, 1);
+		else
+			pool_atomic_fetch_sub_u32(&lock->shared_waiters, 1);
+	}
+
+	pool_atomic_write_u32(&holder->shared, 0);
+	pool_atomic_write_u32(&holder->waiting, 0);
+	pool_atomic_write_u32(&holder->pid, 0);
+	return true;
+}
+
+/*
+ * Returns the holder table entry of this process, taking a free one the
+ * first time.  Returns NULL if the table is full, in which case the locks
+ * of this process cannot be given back if it dies.
+ */
+static POOL_LWLOCK_HOLDER *
+lwlock_get_holder(void)
+{
+	int			retry;
+	int			i;
+
+	if (my_holder || lwlock_holders == NULL)
+		return my_holder;
+
+	for (retry = 0; retry < 2; retry++)
+	{
+		for (i = 0; i < num_lwlock_holders; i++)
+		{
+			uint32		expected = 0;
+
+			if (pool_atomic_compare_exchange_u32(&lwlock_holders[i].pid, &expected, lwlock_pid))
+			{
+				my_holder = &lwlock_holders[i];
+				return my_holder;
+			}
+		}
+
+		/* Entries of processes gone without being reaped may be reused */
+		lwlock_cleanup_dead_holders();
+	}
+
+	ereport(DEBUG1,
+			(errmsg("no free entry in the lightweight lock holder table")));
+	return NULL;
+}
+
+/*
+ * Sleep while *addr equals val.  Returns false if the sleep timed out.
+ */
+static bool
+lwlock_sleep(volatile uint32 *addr, uint32 val)
+{
+#ifdef __linux__
+	struct timespec timeout;
+
+	timeout.tv_sec = LW_WAIT_TIMEOUT_MS / 1000;
+	timeout.tv_nsec = (LW_WAIT_TIMEOUT_MS % 1000) * 1000000L;
+
+	/*
+	 * EAGAIN means the state has already changed and EINTR that we got a
+	 * signal.  In both cases the caller just retries.
+	 */
+	if (syscall(SYS_futex, addr, FUTEX_WAIT, val, &timeout, NULL, 0) < 0 &&
+		errno == ETIMEDOUT)
+		return false;
+	return true;
+#else
+	/* No futex.  Poll the lock and check the holders each time. */
+	usleep(1000);
+	return false;
+#endif
+}
+
+/*
+ * Wake up at most nwaiters processes sleeping on *addr.
+ */
+static void
+lwlock_wakeup(volatile uint32 *addr, int nwaiters)
+{
+#ifdef __linux__
+	syscall(SYS_futex, addr, FUTEX_WAKE, nwaiters, NULL, NULL, 0);
+#endif
+}
+
+static void
+lwlock_atfork_child(void)
+{
+	lwlock_pid = (uint32) getpid();
+	my_holder = NULL;
+}
@@ -24,14 +24,31 @@
 #include "protocol/pool_proto_modules.h"
 #include "utils/elog.h"
 #include "utils/pool_stream.h"
+#include "utils/pool_lwlock.h"
 #include "pool_config.h"
 #include "query_cache/pool_memqcache.h"
 #include "version.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <netinet/in.h>
 
+static void send_report_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+				short num_fields, char **fields);
+/*
+ * Memory usage of a process shown by SHOW pool_processes.  This is kept out
+ * of POOL_REPORT_PROCESSES, which is part of the libpcp ABI.
+ */
+typedef struct
+{
+	char		rss[POOLCONFIG_MAXCOUNTLEN + 1];	/* resident set size in kB */
+	char		pss[POOLCONFIG_MAXCOUNTLEN + 1];	/* proportional set size in kB */
+	char		private_dirty[POOLCONFIG_MAXCOUNTLEN + 1];	/* private dirty
+															 * memory in kB */
+}			POOL_PROCESS_MEMORY;
+
+static void get_process_memory(pid_t pid, POOL_PROCESS_MEMORY * memory);
 
 void
 send_row_description(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
@@ -150,6 +167,7 @@ send_complete_and_ready(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backe
 	}
 
 	pool_flush(frontend);
+	stat_end_request();
 }
 
 POOL_REPORT_CONFIG *
@@ -300,6 +318,48 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "number of reserved connections", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "process_management_mode", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s",
+			 pool_config->process_management_mode == PM_DYNAMIC ? "dynamic" : "static");
+	StrNCpy(status[i].desc, "child process management mode", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "min_spare_children", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->min_spare_children);
+	StrNCpy(status[i].desc, "minimum number of idle children", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "max_spare_children", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_spare_children);
+	StrNCpy(status[i].desc, "maximum number of idle children", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "child_cpu_affinity", POOLCONFIG_MAXNAMELEN);
+	*(status[i].value) = '\0';
+	for (j = 0; j < pool_config->num_child_cpu_affinity; j++)
+	{
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		strncat(status[i].value, pool_config->child_cpu_affinity[j], len);
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		if (j != pool_config->num_child_cpu_affinity - 1)
+			strncat(status[i].value, ";", len);
+	}
+	StrNCpy(status[i].desc, "CPU sets children are bound to", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "shared_memory_numa_policy", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s",
+			 pool_config->shared_memory_numa_policy == NUMA_POLICY_INTERLEAVE ? "interleave" : "default");
+	StrNCpy(status[i].desc, "NUMA placement of shared memory", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "huge_pages", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s",
+			 pool_config->huge_pages == HUGE_PAGES_ON ? "on" :
+			 pool_config->huge_pages == HUGE_PAGES_TRY ? "try" : "off");
+	StrNCpy(status[i].desc, "use huge pages for shared memory", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "max_pool", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_pool);
 	StrNCpy(status[i].desc, "max # of connection pool per child", POOLCONFIG_MAXDESCLEN);
@@ -321,6 +381,26 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "if idle for this seconds, connection closes", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "connection_check_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->connection_check_interval);
+	StrNCpy(status[i].desc, "interval to check idle pooled connections", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "backend_keepalives_idle", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->backend_keepalives_idle);
+	StrNCpy(status[i].desc, "TCP keepalive idle time for backend connections", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "backend_keepalives_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->backend_keepalives_interval);
+	StrNCpy(status[i].desc, "TCP keepalive interval for backend connections", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "backend_keepalives_count", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->backend_keepalives_count);
+	StrNCpy(status[i].desc, "TCP keepalive probes for backend connections", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "client_idle_limit", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->client_idle_limit);
 	StrNCpy(status[i].desc, "if idle for this seconds, child connection closes", POOLCONFIG_MAXDESCLEN);
@@ -428,6 +508,24 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "queries issued at the end of session", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "prewarm_connection_list", POOLCONFIG_MAXNAMELEN);
+	*(status[i].value) = '\0';
+	for (j = 0; j < pool_config->num_prewarm_connection_list; j++)
+	{
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		strncat(status[i].value, pool_config->prewarm_connection_list[j], len);
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		if (j != pool_config->num_prewarm_connection_list - 1)
+			strncat(status[i].value, ",", len);
+	}
+	StrNCpy(status[i].desc, "user:database pairs connected in advance", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "prewarm_connection_count", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->prewarm_connection_count);
+	StrNCpy(status[i].desc, "# of children keeping pre-warmed connections", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* REPLICATION MODE */
 
 	StrNCpy(status[i].name, "replication_mode", POOLCONFIG_MAXNAMELEN);
@@ -450,6 +548,26 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "table name used for large object replication control", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "replication_parallel_execution", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->replication_parallel_execution);
+	StrNCpy(status[i].desc, "non 0 if write queries are sent to all nodes at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "replication_parallel_lock_timeout", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->replication_parallel_lock_timeout);
+	StrNCpy(status[i].desc, "lock wait time in milliseconds before retrying on master node first", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "sequence_preallocation", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sequence_preallocation);
+	StrNCpy(status[i].desc, "non 0 if INSERT gets pre-allocated sequence values", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "sequence_preallocation_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sequence_preallocation_size);
+	StrNCpy(status[i].desc, "number of sequence values fetched at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* - Degenerate handling - */
 	StrNCpy(status[i].name, "replication_stop_on_mismatch", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->replication_stop_on_mismatch);
@@ -522,6 +640,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "statement level load balancing", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "load_balance_by_response_time", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->load_balance_by_response_time);
+	StrNCpy(status[i].desc, "scale load balance weights by health check response time", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* MASTER/SLAVE MODE */
 
 	StrNCpy(status[i].name, "master_slave_mode", POOLCONFIG_MAXNAMELEN);
@@ -623,6 +746,16 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "connect timeout", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "health_check_async", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->health_check_async);
+	StrNCpy(status[i].desc, "check all nodes from a single process", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "health_check_async_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->health_check_async_interval);
+	StrNCpy(status[i].desc, "asynchronous health check interval in milliseconds", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* FAILOVER AND FAILBACK */
 
 	StrNCpy(status[i].name, "failover_command", POOLCONFIG_MAXNAMELEN);
@@ -889,6 +1022,31 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Memcached port number. Mondatory if memqcache_method=memcached", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_memcached_timeout", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_memcached_timeout);
+	StrNCpy(status[i].desc, "Timeout in milliseconds of connecting to and waiting for memcached", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_memcached_retry_timeout", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_memcached_retry_timeout);
+	StrNCpy(status[i].desc, "Seconds to stop using a memcached server after an error", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_single_flight_timeout", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_single_flight_timeout);
+	StrNCpy(status[i].desc, "Milliseconds to wait for another process running the same query on cache miss", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_stale_grace", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_stale_grace);
+	StrNCpy(status[i].desc, "Seconds to serve expired cache while it is refreshed", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_admission_threshold", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_admission_threshold);
+	StrNCpy(status[i].desc, "Number of cache misses of a query before its result is cached", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_total_size", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%ld", pool_config->memqcache_total_size);
 	StrNCpy(status[i].desc, "Total memory size in bytes for storing memory cache. Mandatory if memqcache_method=shmem", POOLCONFIG_MAXDESCLEN);
@@ -899,6 +1057,16 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Total number of cache entries", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_total_size_limit", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%ld", pool_config->memqcache_total_size_limit);
+	StrNCpy(status[i].desc, "Memory size in bytes reserved for memqcache_total_size to grow up to", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_max_num_cache_limit", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_max_num_cache_limit);
+	StrNCpy(status[i].desc, "Number of cache entries reserved for memqcache_max_num_cache to grow up to", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_expire", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_expire);
 	StrNCpy(status[i].desc, "Memory cache entry life time specified in seconds. 60 by default", POOLCONFIG_MAXDESCLEN);
@@ -909,6 +1077,11 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "If true, invalidation of query cache is triggered by corresponding DDL/DML/DCL(and memqcache_expire).  If false, it is only triggered  by memqcache_expire.  True by default.", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_lazy_backend_connection", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_lazy_backend_connection);
+	StrNCpy(status[i].desc, "If true, connect to backend at the first query not found in the query cache", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_maxcache", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_maxcache);
 	StrNCpy(status[i].desc, "Maximum SELECT result size in bytes", POOLCONFIG_MAXDESCLEN);
@@ -919,6 +1092,22 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "Cache block size in bytes. 8192 by default", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_compression", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s",
+			 pool_config->memqcache_compression == MEMQCACHE_COMPRESSION_LZ4 ? "lz4" : "off");
+	StrNCpy(status[i].desc, "Compression method of cached SELECT results", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_compression_threshold", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_compression_threshold);
+	StrNCpy(status[i].desc, "Minimum SELECT result size in bytes to be compressed", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_maxcache_uncompressed", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->memqcache_maxcache_uncompressed);
+	StrNCpy(status[i].desc, "Maximum SELECT result size in bytes before compression", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	StrNCpy(status[i].name, "memqcache_cache_oiddir", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%s", pool_config->memqcache_oiddir);
 	StrNCpy(status[i].desc, "Tempory work directory to record table oids", POOLCONFIG_MAXDESCLEN);
@@ -965,6 +1154,32 @@ get_config(int *nrows)
 	StrNCpy(status[i].desc, "tables not to memqcache", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	StrNCpy(status[i].name, "memqcache_expire_table_list", POOLCONFIG_MAXNAMELEN);
+	*(status[i].value) = '\0';
+	for (j = 0; j < pool_config->num_memqcache_expire_table_list; j++)
+	{
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		strncat(status[i].value, pool_config->memqcache_expire_table_list[j], len);
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		if (j != pool_config->num_memqcache_expire_table_list - 1)
+			strncat(status[i].value, ",", len);
+	}
+	StrNCpy(status[i].desc, "table patterns and their cache expiration", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	StrNCpy(status[i].name, "memqcache_expire_query_list", POOLCONFIG_MAXNAMELEN);
+	*(status[i].value) = '\0';
+	for (j = 0; j < pool_config->num_memqcache_expire_query_list; j++)
+	{
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		strncat(status[i].value, pool_config->memqcache_expire_query_list[j], len);
+		len = POOLCONFIG_MAXVALLEN - strlen(status[i].value);
+		if (j != pool_config->num_memqcache_expire_query_list - 1)
+			strncat(status[i].value, ",", len);
+	}
+	StrNCpy(status[i].desc, "query patterns and their cache expiration", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	/* BACKENDS */
 
 	for (j = 0; j < NUM_BACKENDS; j++)
@@ -1489,7 +1704,7 @@ get_pools(int *nrows)
 	for (child = 0; child < pool_config->num_init_children; child++)
 	{
 		proc_id = process_info[child].pid;
-		pi = pool_get_process_info(proc_id);
+		pi = &process_info[child];
 
 		for (pool = 0; pool < pool_config->max_pool; pool++)
 		{
@@ -1676,6 +1891,46 @@ pools_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	pfree(pools);
 }
 
+/*
+ * Get the memory usage of a process from /proc/<pid>/smaps_rollup.  Pss
+ * divides each shared page among the processes mapping it, and
+ * Private_Dirty is the memory written by the process alone, including the
+ * pages copied on write after fork.  The fields are left empty where the
+ * file is not available, e.g. on Linux older than 4.14 or on other
+ * platforms.
+ */
+static void
+get_process_memory(pid_t pid, POOL_PROCESS_MEMORY * memory)
+{
+	char		path[POOLMAXPATHLEN];
+	char		line[256];
+	long		kb;
+	FILE	   *fp;
+
+	*memory->rss = '\0';
+	*memory->pss = '\0';
+	*memory->private_dirty = '\0';
+
+	if (pid == 0)
+		return;
+
+	snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int) pid);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (sscanf(line, "Rss: %ld kB", &kb) == 1)
+			snprintf(memory->rss, sizeof(memory->rss), "%ld", kb);
+		else if (sscanf(line, "Pss: %ld kB", &kb) == 1)
+			snprintf(memory->pss, sizeof(memory->pss), "%ld", kb);
+		else if (sscanf(line, "Private_Dirty: %ld kB", &kb) == 1)
+			snprintf(memory->private_dirty, sizeof(memory->private_dirty), "%ld", kb);
+	}
+	fclose(fp);
+}
+
 POOL_REPORT_PROCESSES *
 get_processes(int *nrows)
 {
@@ -1690,10 +1945,13 @@ get_processes(int *nrows)
 	for (child = 0; child < pool_config->num_init_children; child++)
 	{
 		proc_id = process_info[child].pid;
-		pi = pool_get_process_info(proc_id);
+		pi = &process_info[child];
 
 		snprintf(processes[child].pool_pid, POOLCONFIG_MAXCOUNTLEN, "%d", proc_id);
-		strftime(processes[child].start_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
+		if (proc_id == 0)
+			StrNCpy(processes[child].start_time, "", POOLCONFIG_MAXDATELEN);
+		else
+			strftime(processes[child].start_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
 		StrNCpy(processes[child].database, "", POOLCONFIG_MAXIDENTLEN);
 		StrNCpy(processes[child].username, "", POOLCONFIG_MAXIDENTLEN);
 		StrNCpy(processes[child].create_time, "", POOLCONFIG_MAXDATELEN);
@@ -1720,102 +1978,31 @@ get_processes(int *nrows)
 void
 processes_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
-	static short num_fields = 6;
-	static char *field_names[] = {"pool_pid", "start_time", "database", "username", "create_time", "pool_counter"};
-	short		s;
-	int			len;
-	int			nrows;
-	int			size;
-	int			hsize;
+	static char *field_names[] = {"pool_pid", "start_time", "database", "username", "create_time",
+	"pool_counter", "rss", "pss", "private_dirty"};
+	short		num_fields = sizeof(field_names) / sizeof(char *);
 	int			i;
-	static unsigned char nullmap[2] = {0xff, 0xff};
-	int			nbytes = (num_fields + 7) / 8;
+	int			nrows;
+	char	   *fields[9];
+	POOL_PROCESS_MEMORY memory;
 
 	POOL_REPORT_PROCESSES *processes = get_processes(&nrows);
 
 	send_row_description(frontend, backend, num_fields, field_names);
 
-	if (MAJOR(backend) == PROTO_MAJOR_V2)
+	for (i = 0; i < nrows; i++)
 	{
-		/* ascii row */
-		for (i = 0; i < nrows; i++)
-		{
-			pool_write(frontend, "D", 1);
-			pool_write_and_flush(frontend, nullmap, nbytes);
-
-			size = strlen(processes[i].pool_pid);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, processes[i].pool_pid, size);
-
-			size = strlen(processes[i].start_time);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, processes[i].start_time, size);
-
-			size = strlen(processes[i].database);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, processes[i].database, size);
-
-			size = strlen(processes[i].username);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, processes[i].username, size);
-
-			size = strlen(processes[i].create_time);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, processes[i].create_time, size);
-
-			size = strlen(processes[i].pool_counter);
-			hsize = htonl(size + 4);
-			pool_write(frontend, &hsize, sizeof(hsize));
-			pool_write(frontend, processes[i].pool_counter, size);
-		}
-	}
-	else
-	{
-		/* data row */
-		for (i = 0; i < nrows; i++)
-		{
-			pool_write(frontend, "D", 1);
-			len = 6;			/* int32 + int16; */
-			len += 4 + strlen(processes[i].pool_pid);	/* int32 + data */
-			len += 4 + strlen(processes[i].start_time); /* int32 + data */
-			len += 4 + strlen(processes[i].database);	/* int32 + data */
-			len += 4 + strlen(processes[i].username);	/* int32 + data */
-			len += 4 + strlen(processes[i].create_time);	/* int32 + data */
-			len += 4 + strlen(processes[i].pool_counter);	/* int32 + data */
-			len = htonl(len);
-			pool_write(frontend, &len, sizeof(len));
-			s = htons(num_fields);
-			pool_write(frontend, &s, sizeof(s));
-
-			len = htonl(strlen(processes[i].pool_pid));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, processes[i].pool_pid, strlen(processes[i].pool_pid));
-
-			len = htonl(strlen(processes[i].start_time));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, processes[i].start_time, strlen(processes[i].start_time));
-
-			len = htonl(strlen(processes[i].database));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, processes[i].database, strlen(processes[i].database));
-
-			len = htonl(strlen(processes[i].username));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, processes[i].username, strlen(processes[i].username));
-
-			len = htonl(strlen(processes[i].create_time));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, processes[i].create_time, strlen(processes[i].create_time));
-
-			len = htonl(strlen(processes[i].pool_counter));
-			pool_write(frontend, &len, sizeof(len));
-			pool_write(frontend, processes[i].pool_counter, strlen(processes[i].pool_counter));
-		}
+		fields[0] = processes[i].pool_pid;
+		fields[1] = processes[i].start_time;
+		fields[2] = processes[i].database;
+		fields[3] = processes[i].username;
+		fields[4] = processes[i].create_time;
+		fields[5] = processes[i].pool_counter;
+		get_process_memory(atoi(processes[i].pool_pid), &memory);
+		fields[6] = memory.rss;
+		fields[7] = memory.pss;
+		fields[8] = memory.private_dirty;
+		send_report_row(frontend, backend, num_fields, fields);
 	}
 
 	send_complete_and_ready(frontend, backend, "SELECT", nrows);
@@ -1888,9 +2075,12 @@ version_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 void
 cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 {
-	static char *field_names[] = {"num_cache_hits", "num_selects", "cache_hit_ratio", "num_hash_entries", "used_hash_entries", "num_cache_entries", "used_cache_entries_size", "free_cache_entries_size", "fragment_cache_entries_size"};
+	static char *field_names[] = {"num_cache_hits", "num_selects", "cache_hit_ratio", "num_hash_entries", "used_hash_entries", "num_cache_entries", "used_cache_entries_size", "free_cache_entries_size", "fragment_cache_entries_size", "shmem_size", "shmem_page_size", "num_cache_stores", "num_not_admitted", "cache_rule"};
 	short		num_fields = sizeof(field_names) / sizeof(char *);
 	int			i;
+	int			j;
+	POOL_CACHE_RULE_STATS *rule_stats;
+	int			nrules;
 	short		s;
 	int			len;
 	int			size;
@@ -1916,7 +2106,7 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	 * Get raw cache stat data
 	 */
 	POOL_SETMASK2(&BlockSig, &oldmask);
-	pool_shmem_lock();
+	pool_shmem_lock(POOL_MEMQ_SHARED_LOCK);
 
 	PG_TRY();
 	{
@@ -1953,6 +2143,14 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->used_cache_entries_size);
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->free_cache_entries_size);
 	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->fragment_cache_entries_size);
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->shmem_size);
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%ld", mystats->shmem_page_size);
+
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%lld", mystats->cache_stats.num_cache_stores);
+	snprintf(strp[i++].string, POOL_CACHE_STATS_MAX_STRING_LEN + 1, "%lld", mystats->cache_stats.num_not_admitted);
+	*strp[i++].string = '\0';
+
+	rule_stats = pool_get_cache_rule_stats(&nrules);
 
 	/*
 	 * Calculate total data length
@@ -2001,7 +2199,475 @@ cache_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
 		}
 	}
 
-	send_complete_and_ready(frontend, backend, "SELECT", 1);
+	/*
+	 * Send a row for each cache rule, if any.  Rule 0 is for the SELECTs
+	 * no rule matched.
+	 */
+	if (nrules > 1)
+	{
+		char	   *fields[14];
+		char		hits[POOL_CACHE_STATS_MAX_STRING_LEN + 1];
+		char		hit_ratio[POOL_CACHE_STATS_MAX_STRING_LEN + 1];
+		char		stores[POOL_CACHE_STATS_MAX_STRING_LEN + 1];
+		char		not_admitted[POOL_CACHE_STATS_MAX_STRING_LEN + 1];
+		long long int misses;
+
+		for (j = 0; j < nrules; j++)
+		{
+			misses = rule_stats[j].num_cache_stores + rule_stats[j].num_not_admitted;
+			ratio = (rule_stats[j].num_cache_hits + misses) == 0 ? 0.0 :
+				(double) rule_stats[j].num_cache_hits / (rule_stats[j].num_cache_hits + misses);
+
+			snprintf(hits, sizeof(hits), "%lld", rule_stats[j].num_cache_hits);
+			snprintf(hit_ratio, sizeof(hit_ratio), "%.2f", ratio);
+			snprintf(stores, sizeof(stores), "%lld", rule_stats[j].num_cache_stores);
+			snprintf(not_admitted, sizeof(not_admitted), "%lld", rule_stats[j].num_not_admitted);
+
+			for (i = 0; i < num_fields; i++)
+				fields[i] = "";
+			fields[0] = hits;
+			fields[2] = hit_ratio;
+			fields[11] = stores;
+			fields[12] = not_admitted;
+			fields[13] = rule_stats[j].rule ? rule_stats[j].rule : "memqcache_expire";
+			send_report_row(frontend, backend, num_fields, fields);
+		}
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", nrules > 1 ? nrules + 1 : 1);
 
+	pfree(rule_stats);
 	pfree(strp);
 }
+
+/*
+ * Send one data row consisting of text fields
+ */
+static void
+send_report_row(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend,
+				short num_fields, char **fields)
+{
+	static unsigned char nullmap[2] = {0xff, 0xff};
+	int			nbytes = (num_fields + 7) / 8;
+	short		s;
+	int			len;
+	int			size;
+	int			hsize;
+	int			i;
+
+	if (MAJOR(backend) == PROTO_MAJOR_V2)
+	{
+		/* ascii row */
+		pool_write(frontend, "D", 1);
+		pool_write_and_flush(frontend, nullmap, nbytes);
+
+		for (i = 0; i < num_fields; i++)
+		{
+			size = strlen(fields[i]);
+			hsize = htonl(size + 4);
+			pool_write(frontend, &hsize, sizeof(hsize));
+			pool_write(frontend, fields[i], size);
+		}
+	}
+	else
+	{
+		/* data row */
+		pool_write(frontend, "D", 1);
+		len = 6;				/* int32 + int16; */
+		for (i = 0; i < num_fields; i++)
+			len += 4 + strlen(fields[i]);	/* int32 + data; */
+		len = htonl(len);
+		pool_write(frontend, &len, sizeof(len));
+		s = htons(num_fields);
+		pool_write(frontend, &s, sizeof(s));
+
+		for (i = 0; i < num_fields; i++)
+		{
+			len = htonl(strlen(fields[i]));
+			pool_write(frontend, &len, sizeof(len));
+			pool_write(frontend, fields[i], strlen(fields[i]));
+		}
+	}
+}
+
+/*
+ * for SHOW pool_backend_stats
+ */
+POOL_REPORT_BACKEND_STATS *
+get_backend_stats(int *nrows)
+{
+	int			i;
+	POOL_REPORT_BACKEND_STATS *stats = palloc0(NUM_BACKENDS * sizeof(POOL_REPORT_BACKEND_STATS));
+	BackendInfo *bi = NULL;
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		bi = pool_get_node_info(i);
+
+		snprintf(stats[i].node_id, POOLCONFIG_MAXIDLEN, "%d", i);
+		StrNCpy(stats[i].hostname, bi->backend_hostname, MAX_DB_HOST_NAMELEN);
+		snprintf(stats[i].port, POOLCONFIG_MAXPORTLEN, "%d", bi->backend_port);
+		snprintf(stats[i].status, POOLCONFIG_MAXSTATLEN, "%s", backend_status_to_str(bi));
+
+		if (STREAM)
+			snprintf(stats[i].role, POOLCONFIG_MAXWEIGHTLEN, "%s",
+					 (i == REAL_PRIMARY_NODE_ID) ? "primary" : "standby");
+		else
+			snprintf(stats[i].role, POOLCONFIG_MAXWEIGHTLEN, "%s",
+					 (i == REAL_MASTER_NODE_ID) ? "master" : "slave");
+
+		snprintf(stats[i].select_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_select_count(i));
+		snprintf(stats[i].insert_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_insert_count(i));
+		snprintf(stats[i].update_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_update_count(i));
+		snprintf(stats[i].delete_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_delete_count(i));
+		snprintf(stats[i].ddl_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_ddl_count(i));
+		snprintf(stats[i].other_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stat_get_other_count(i));
+		snprintf(stats[i].health_check_rtt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, bi->health_check_rtt);
+		snprintf(stats[i].health_check_srtt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, bi->health_check_srtt);
+	}
+
+	*nrows = i;
+
+	return stats;
+}
+
+/*
+ * SHOW pool_backend_stats;
+ */
+void
+backend_stats_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	static char *field_names[] = {"node_id", "hostname", "port", "status", "role", "select_cnt", "insert_cnt", "update_cnt", "delete_cnt", "ddl_cnt", "other_cnt", "health_check_rtt", "health_check_srtt"};
+	short		num_fields = sizeof(field_names) / sizeof(char *);
+	int			i;
+	int			nrows;
+	char	   *fields[13];
+
+	POOL_REPORT_BACKEND_STATS *stats = get_backend_stats(&nrows);
+
+	send_row_description(frontend, backend, num_fields, field_names);
+
+	for (i = 0; i < nrows; i++)
+	{
+		fields[0] = stats[i].node_id;
+		fields[1] = stats[i].hostname;
+		fields[2] = stats[i].port;
+		fields[3] = stats[i].status;
+		fields[4] = stats[i].role;
+		fields[5] = stats[i].select_cnt;
+		fields[6] = stats[i].insert_cnt;
+		fields[7] = stats[i].update_cnt;
+		fields[8] = stats[i].delete_cnt;
+		fields[9] = stats[i].ddl_cnt;
+		fields[10] = stats[i].other_cnt;
+		fields[11] = stats[i].health_check_rtt;
+		fields[12] = stats[i].health_check_srtt;
+		send_report_row(frontend, backend, num_fields, fields);
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", nrows);
+
+	pfree(stats);
+}
+
+/*
+ * Fill in one latency report row.  Returns false if nothing has been
+ * recorded for the scope.
+ */
+static bool
+fill_latency_row(POOL_REPORT_LATENCY * row, STAT_SCOPE scope, int id, const char *scope_name, const char *name, int type)
+{
+	STAT_LATENCY_SUMMARY summary;
+
+	if (!stat_get_latency(scope, id, type, &summary))
+		return false;
+
+	StrNCpy(row->scope, scope_name, POOLCONFIG_MAXSTATLEN);
+	StrNCpy(row->name, name, POOLCONFIG_MAXIDENTLEN);
+	StrNCpy(row->statement, stat_stmt_type_name(type), POOLCONFIG_MAXSTATLEN);
+	snprintf(row->count, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.count);
+	snprintf(row->backend_avg, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.backend_avg);
+	snprintf(row->backend_p50, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.backend_p50);
+	snprintf(row->backend_p99, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.backend_p99);
+	snprintf(row->backend_max, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.backend_max);
+	snprintf(row->pgpool_avg, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.pgpool_avg);
+	snprintf(row->pgpool_p50, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.pgpool_p50);
+	snprintf(row->pgpool_p99, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.pgpool_p99);
+	snprintf(row->pgpool_max, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, summary.pgpool_max);
+
+	return true;
+}
+
+/*
+ * for SHOW pool_latency.  Returns a row per statement type for the whole
+ * pgpool-II, each backend node, each database and each child process.
+ * Statement types nothing has been recorded for are omitted.
+ */
+POOL_REPORT_LATENCY *
+get_latency(int *nrows)
+{
+	POOL_REPORT_LATENCY *rows;
+	char		name[POOLCONFIG_MAXIDENTLEN + 1];
+	char	   *dbname;
+	int			maxrows;
+	int			n = 0;
+	int			i;
+	int			t;
+
+	maxrows = (1 + NUM_BACKENDS + STAT_MAX_DATABASES + pool_config->num_init_children) * STAT_NUM_STMT_TYPES;
+	rows = palloc0(maxrows * sizeof(POOL_REPORT_LATENCY));
+
+	for (t = 0; t < STAT_NUM_STMT_TYPES; t++)
+	{
+		if (fill_latency_row(&rows[n], STAT_SCOPE_GLOBAL, 0, "global", "", t))
+			n++;
+	}
+
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		snprintf(name, sizeof(name), "%d", i);
+		for (t = 0; t < STAT_NUM_STMT_TYPES; t++)
+		{
+			if (fill_latency_row(&rows[n], STAT_SCOPE_NODE, i, "node", name, t))
+				n++;
+		}
+	}
+
+	for (i = 0; i < STAT_MAX_DATABASES; i++)
+	{
+		dbname = stat_get_database_name(i);
+		if (dbname == NULL)
+			continue;
+		for (t = 0; t < STAT_NUM_STMT_TYPES; t++)
+		{
+			if (fill_latency_row(&rows[n], STAT_SCOPE_DATABASE, i, "database", dbname, t))
+				n++;
+		}
+	}
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		snprintf(name, sizeof(name), "%d", process_info[i].pid);
+		for (t = 0; t < STAT_NUM_STMT_TYPES; t++)
+		{
+			if (fill_latency_row(&rows[n], STAT_SCOPE_CHILD, i, "child", name, t))
+				n++;
+		}
+	}
+
+	*nrows = n;
+
+	return rows;
+}
+
+/*
+ * SHOW pool_latency;
+ */
+void
+latency_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	static char *field_names[] = {"scope", "name", "statement", "count",
+		"backend_avg_us", "backend_p50_us", "backend_p99_us", "backend_max_us",
+	"pgpool_avg_us", "pgpool_p50_us", "pgpool_p99_us", "pgpool_max_us"};
+	short		num_fields = sizeof(field_names) / sizeof(char *);
+	int			i;
+	int			nrows;
+	char	   *fields[12];
+
+	POOL_REPORT_LATENCY *rows = get_latency(&nrows);
+
+	send_row_description(frontend, backend, num_fields, field_names);
+
+	for (i = 0; i < nrows; i++)
+	{
+		fields[0] = rows[i].scope;
+		fields[1] = rows[i].name;
+		fields[2] = rows[i].statement;
+		fields[3] = rows[i].count;
+		fields[4] = rows[i].backend_avg;
+		fields[5] = rows[i].backend_p50;
+		fields[6] = rows[i].backend_p99;
+		fields[7] = rows[i].backend_max;
+		fields[8] = rows[i].pgpool_avg;
+		fields[9] = rows[i].pgpool_p50;
+		fields[10] = rows[i].pgpool_p99;
+		fields[11] = rows[i].pgpool_max;
+		send_report_row(frontend, backend, num_fields, fields);
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", nrows);
+
+	pfree(rows);
+}
+
+/*
+ * for SHOW pool_lwlocks
+ */
+POOL_REPORT_LWLOCKS *
+get_lwlocks(int *nrows)
+{
+	int			i;
+	POOL_REPORT_LWLOCKS *locks = palloc0(MAX_NUM_LWLOCKS * sizeof(POOL_REPORT_LWLOCKS));
+	POOL_LWLOCK_STATS stats;
+
+	for (i = 0; i < MAX_NUM_LWLOCKS; i++)
+	{
+		pool_lwlock_get_stats(i, &stats);
+
+		StrNCpy(locks[i].lock_name, stats.name, POOLCONFIG_MAXIDENTLEN);
+		snprintf(locks[i].acquire_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stats.acquire_count);
+		snprintf(locks[i].contended_cnt, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stats.contended_count);
+		snprintf(locks[i].total_wait, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stats.wait_usec);
+		snprintf(locks[i].max_wait, POOLCONFIG_MAXWEIGHTLEN, UINT64_FORMAT, stats.max_wait_usec);
+	}
+
+	*nrows = i;
+
+	return locks;
+}
+
+/*
+ * SHOW pool_lwlocks;
+ */
+void
+lwlocks_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	static char *field_names[] = {"lock_name", "acquire_cnt", "contended_cnt", "total_wait", "max_wait"};
+	short		num_fields = sizeof(field_names) / sizeof(char *);
+	int			i;
+	int			nrows;
+	char	   *fields[5];
+
+	POOL_REPORT_LWLOCKS *locks = get_lwlocks(&nrows);
+
+	send_row_description(frontend, backend, num_fields, field_names);
+
+	for (i = 0; i < nrows; i++)
+	{
+		fields[0] = locks[i].lock_name;
+		fields[1] = locks[i].acquire_cnt;
+		fields[2] = locks[i].contended_cnt;
+		fields[3] = locks[i].total_wait;
+		fields[4] = locks[i].max_wait;
+		send_report_row(frontend, backend, num_fields, fields);
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", nrows);
+
+	pfree(locks);
+}
+
+static const char *
+request_kind_name(POOL_REQUEST_KIND kind)
+{
+	switch (kind)
+	{
+		case NODE_UP_REQUEST:
+			return "failback";
+		case NODE_DOWN_REQUEST:
+			return "failover";
+		case NODE_RECOVERY_REQUEST:
+			return "recovery";
+		case CLOSE_IDLE_REQUEST:
+			return "close idle";
+		case PROMOTE_NODE_REQUEST:
+			return "promote";
+		case NODE_QUARANTINE_REQUEST:
+			return "quarantine";
+		case NODE_DRAIN_REQUEST:
+			return "drain";
+		case NODE_UNDRAIN_REQUEST:
+			return "undrain";
+	}
+	return "unknown";
+}
+
+/*
+ * for SHOW pool_failover_trace
+ */
+POOL_REPORT_FAILOVER_TRACE *
+get_failover_trace(int *nrows)
+{
+	int			nevents;
+	int			i,
+				j;
+	FAILOVER_TRACE_EVENT *events = failover_trace_get_events(&nevents);
+	POOL_REPORT_FAILOVER_TRACE *rows = palloc0((nevents > 0 ? nevents : 1) * sizeof(POOL_REPORT_FAILOVER_TRACE));
+
+	for (i = 0; i < nevents; i++)
+	{
+		FAILOVER_TRACE_EVENT *ev = &events[i];
+		char		timebuf[64];
+		struct tm	tm;
+
+		localtime_r(&ev->time.tv_sec, &tm);
+		strftime(timebuf, sizeof(timebuf), "%Y-%m-%d %H:%M:%S", &tm);
+
+		snprintf(rows[i].seq, POOLCONFIG_MAXWEIGHTLEN, "%u", ev->seq - 1);
+		snprintf(rows[i].time, POOLCONFIG_MAXDATELEN, "%s.%06ld", timebuf, (long) ev->time.tv_usec);
+		snprintf(rows[i].pid, POOLCONFIG_MAXCOUNTLEN, "%d", (int) ev->pid);
+		if (ev->request_no >= 0)
+			snprintf(rows[i].request, POOLCONFIG_MAXCOUNTLEN, "%d", ev->request_no);
+		StrNCpy(rows[i].kind, request_kind_name(ev->reqkind), POOLCONFIG_MAXSTATLEN);
+		StrNCpy(rows[i].event, failover_trace_event_name(ev->kind), POOLCONFIG_MAXIDENTLEN);
+		snprintf(rows[i].node_id, POOLCONFIG_MAXIDLEN, "%d", ev->node_id);
+		StrNCpy(rows[i].detail, ev->detail, POOLCONFIG_MAXIDENTLEN);
+
+		/* time since the previous event of the same request */
+		if (ev->request_no >= 0)
+		{
+			for (j = i - 1; j >= 0; j--)
+			{
+				if (events[j].request_no == ev->request_no)
+				{
+					long		usec = (ev->time.tv_sec - events[j].time.tv_sec) * 1000000L +
+					(ev->time.tv_usec - events[j].time.tv_usec);
+
+					snprintf(rows[i].elapsed, POOLCONFIG_MAXWEIGHTLEN, "%.3f", usec / 1000.0);
+					break;
+				}
+			}
+		}
+	}
+
+	*nrows = nevents;
+	pfree(events);
+
+	return rows;
+}
+
+/*
+ * SHOW pool_failover_trace;
+ */
+void
+failover_trace_reporting(POOL_CONNECTION * frontend, POOL_CONNECTION_POOL * backend)
+{
+	static char *field_names[] = {"seq", "time", "pid", "request", "kind", "event",
+	"node_id", "elapsed", "detail"};
+	short		num_fields = sizeof(field_names) / sizeof(char *);
+	int			i;
+	int			nrows;
+	char	   *fields[9];
+
+	POOL_REPORT_FAILOVER_TRACE *rows = get_failover_trace(&nrows);
+
+	send_row_description(frontend, backend, num_fields, field_names);
+
+	for (i = 0; i < nrows; i++)
+	{
+		fields[0] = rows[i].seq;
+		fields[1] = rows[i].time;
+		fields[2] = rows[i].pid;
+		fields[3] = rows[i].request;
+		fields[4] = rows[i].kind;
+		fields[5] = rows[i].event;
+		fields[6] = rows[i].node_id;
+		fields[7] = rows[i].elapsed;
+		fields[8] = rows[i].detail;
+		send_report_row(frontend, backend, num_fields, fields);
+	}
+
+	send_complete_and_ready(frontend, backend, "SELECT", nrows);
+
+	pfree(rows);
+}
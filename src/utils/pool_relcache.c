@@ -33,7 +33,17 @@
 #include "utils/palloc.h"
 #include "utils/memutils.h"
 #include "utils/elog.h"
+#include "utils/pool_atomics.h"
 
+/*
+ * Generation of relation caches in shared memory.  It is advanced when a
+ * statement which may change the system catalogs (DDL) succeeds or its
+ * transaction ends, and cache entries registered under an older generation
+ * are not used any more.
+ */
+static volatile uint32 *relcache_generation = NULL;
+
+static uint32 get_relcache_generation(void);
 static void SearchRelCacheErrorCb(void *arg);
 static POOL_SELECT_RESULT *query_cache_to_relation_cache(char *data, size_t size);
 static char *relation_cache_to_query_cache(POOL_SELECT_RESULT *res,size_t *size);
@@ -96,6 +106,44 @@ pool_discard_relcache(POOL_RELCACHE * relcache)
 	pfree(relcache);
 }
 
+size_t
+pool_relcache_shared_memory_size(void)
+{
+	return MAXALIGN(sizeof(uint32));
+}
+
+void
+pool_relcache_init(void *addr)
+{
+	relcache_generation = (volatile uint32 *) addr;
+	*relcache_generation = 0;
+}
+
+/*
+ * Invalidate relation caches of all processes, including the ones shared
+ * in the query cache.
+ */
+void
+pool_relcache_invalidate(void)
+{
+	if (relcache_generation == NULL)
+		return;
+
+	pool_atomic_fetch_add_u32(relcache_generation, 1);
+
+	ereport(DEBUG1,
+			(errmsg("invalidating relcache"),
+			 errdetail("new generation: %u", pool_atomic_read_u32(relcache_generation))));
+}
+
+static uint32
+get_relcache_generation(void)
+{
+	if (relcache_generation == NULL)
+		return 0;
+	return pool_atomic_read_u32(relcache_generation);
+}
+
 /*
  * Search relcache. If found, return user data. Otherwise return 0.
  * If not found in cache, do the query and store the result into cache and return it.
@@ -107,6 +155,8 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	int			i;
 	int			maxrefcnt = INT_MAX;
 	char		query[1024];
+	char		cache_key[1024 + 64];
+	uint32		generation;
 	POOL_SELECT_RESULT *res = NULL;
 	int			index = 0;
 	int			local_session_id;
@@ -153,6 +203,7 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	}
 
 	now = time(NULL);
+	generation = get_relcache_generation();
 
 	/* Look for cache first */
 	for (i = 0; i < relcache->num; i++)
@@ -182,6 +233,19 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 				}
 			}
 
+			/* DDL may have changed the relation since registered */
+			if (relcache->cache[i].generation != generation)
+			{
+				ereport(DEBUG1,
+						(errmsg("searching relcache"),
+						 errdetail("relcache for database:%s table:%s invalidated. generation:%u current generation:%u",
+								   dbname, table, relcache->cache[i].generation, generation)));
+
+				relcache->cache[i].refcnt = 0;
+				relcache->cache[i].relname[0] = '\0';
+				break;
+			}
+
 			/* Found */
 			if (relcache->cache[i].refcnt < INT_MAX)
 				relcache->cache[i].refcnt++;
@@ -197,6 +261,13 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	/* Not in cache. Check the system catalog */
 	snprintf(query, sizeof(query), relcache->sql, table);
 
+	/*
+	 * Entries shared in the query cache are looked up by the query and the
+	 * relcache generation, so that those registered before DDL are not
+	 * found.
+	 */
+	snprintf(cache_key, sizeof(cache_key), "%s /* relcache generation %u */", query, generation);
+
 	per_node_statement_log(backend, node_id, query);
 
 	/*
@@ -217,12 +288,12 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 		if (!locked)
 		{
 			POOL_SETMASK2(&BlockSig, &oldmask);
-			pool_shmem_lock();
+			pool_shmem_lock(POOL_MEMQ_EXCLUSIVE_LOCK);
 		}
 	    PG_TRY();
 		{
 			/* search catalog cache in query cache */
-			query_cache_not_found = pool_fetch_cache(backend, query, &query_cache_data, &query_cache_len);
+			query_cache_not_found = pool_fetch_cache(backend, cache_key, &query_cache_data, &query_cache_len);
 		}
 	    PG_CATCH();
 		{
@@ -246,7 +317,7 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 	    if (pool_config->enable_shared_relcache)
 		{
 			query_cache_data = relation_cache_to_query_cache(res, &query_cache_len);
-			pool_catalog_commit_cache(backend, query, query_cache_data, query_cache_len);
+			pool_catalog_commit_cache(backend, cache_key, query_cache_data, query_cache_len);
 		}
 	}
 	else
@@ -312,6 +383,7 @@ pool_search_relcache(POOL_RELCACHE * relcache, POOL_CONNECTION_POOL * backend, c
 		strlcpy(relcache->cache[index].relname, table, MAX_ITEM_LENGTH);
 		relcache->cache[index].refcnt = 1;
 		relcache->cache[index].session_id = local_session_id;
+		relcache->cache[index].generation = generation;
 		if (pool_config->relcache_expire > 0)
 		{
 			relcache->cache[index].expire = now + pool_config->relcache_expire;
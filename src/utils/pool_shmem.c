@@ -23,10 +23,17 @@
 #include "pool.h"
 #include "utils/elog.h"
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/shm.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 
 #include "utils/pool_ipc.h"
+#include "pool_config.h"
 
 
 #ifdef SHM_SHARE_MMU			/* use intimate shared memory on Solaris */
@@ -35,8 +42,27 @@
 #define PG_SHMAT_FLAGS			0
 #endif
 
+/*
+ * Segments created by this process, remembered to report their sizes and
+ * page sizes.  Children inherit the list at fork.
+ */
+#define MAX_SHMEM_SEGMENTS	64
+
+typedef struct
+{
+	void	   *addr;			/* attached address */
+	size_t		size;			/* mapped size */
+	size_t		page_size;		/* size of the pages backing the segment */
+}			POOL_SHMEM_SEGMENT;
+
+static POOL_SHMEM_SEGMENT segments[MAX_SHMEM_SEGMENTS];
+static int	num_segments = 0;
+
 static void IpcMemoryDetach(int status, Datum shmaddr);
 static void IpcMemoryDelete(int status, Datum shmId);
+static void set_numa_policy(void *addr, size_t size);
+static size_t get_huge_page_size(void);
+static int	create_huge_page_segment(size_t size, size_t *mapped_size, size_t *page_size);
 
 
 /*
@@ -48,9 +74,13 @@ pool_shared_memory_create(size_t size)
 {
 	int			shmid;
 	void	   *memAddress;
+	size_t		mapped_size = size;
+	size_t		page_size = sysconf(_SC_PAGESIZE);
 
-	/* Try to create new segment */
-	shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | IPC_EXCL | IPCProtection);
+	/* Try to create new segment, on huge pages if requested */
+	shmid = create_huge_page_segment(size, &mapped_size, &page_size);
+	if (shmid < 0)
+		shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | IPC_EXCL | IPCProtection);
 
 	if (shmid < 0)
 		ereport(FATAL,
@@ -72,9 +102,187 @@ pool_shared_memory_create(size_t size)
 	/* Register on-exit routine to detach new segment before deleting */
 	on_shmem_exit(IpcMemoryDetach, (Datum) memAddress);
 
+	set_numa_policy(memAddress, mapped_size);
+
+	if (num_segments < MAX_SHMEM_SEGMENTS)
+	{
+		segments[num_segments].addr = memAddress;
+		segments[num_segments].size = mapped_size;
+		segments[num_segments].page_size = page_size;
+		num_segments++;
+	}
+
 	return memAddress;
 }
 
+/*
+ * Create a segment backed by huge pages according to huge_pages.  Only
+ * segments of at least one huge page are put on huge pages, smaller ones
+ * would waste most of the page.  The size is rounded up to a multiple of
+ * the huge page size.  Returns the segment id, or -1 if the segment is to
+ * be created on normal pages.  With huge_pages = try, we stop trying after
+ * the first failure.
+ */
+static int
+create_huge_page_segment(size_t size, size_t *mapped_size, size_t *page_size)
+{
+#ifdef SHM_HUGETLB
+	static bool huge_pages_failed = false;
+	size_t		huge_page_size;
+	size_t		huge_size;
+	int			shmid;
+
+	if (pool_config->huge_pages == HUGE_PAGES_OFF || huge_pages_failed)
+		return -1;
+
+	huge_page_size = get_huge_page_size();
+	if (huge_page_size == 0 || size < huge_page_size)
+		return -1;
+
+	huge_size = ((size + huge_page_size - 1) / huge_page_size) * huge_page_size;
+	shmid = shmget(IPC_PRIVATE, huge_size, IPC_CREAT | IPC_EXCL | IPCProtection | SHM_HUGETLB);
+	if (shmid < 0)
+	{
+		int			save_errno = errno;
+
+		if (pool_config->huge_pages == HUGE_PAGES_ON)
+			ereport(FATAL,
+					(errmsg("could not create shared memory of %zu bytes on huge pages", huge_size),
+					 errdetail("shared memory creation failed with error \"%s\"", strerror(save_errno)),
+					 errhint("Check vm.nr_hugepages and vm.hugetlb_shm_group, or set huge_pages to try or off.")));
+
+		ereport(LOG,
+				(errmsg("could not create shared memory of %zu bytes on huge pages, using normal pages", huge_size),
+				 errdetail("shared memory creation failed with error \"%s\"", strerror(save_errno))));
+		huge_pages_failed = true;
+		return -1;
+	}
+
+	*mapped_size = huge_size;
+	*page_size = huge_page_size;
+	return shmid;
+#else
+	if (pool_config->huge_pages == HUGE_PAGES_ON)
+		ereport(FATAL,
+				(errmsg("huge pages are not supported on this platform")));
+	return -1;
+#endif
+}
+
+/*
+ * Return the default huge page size from /proc/meminfo, or 0 if it is not
+ * known.
+ */
+static size_t
+get_huge_page_size(void)
+{
+	static size_t huge_page_size = 0;
+	static bool checked = false;
+	FILE	   *fp;
+	char		line[128];
+	long		kb;
+
+	if (checked)
+		return huge_page_size;
+	checked = true;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (fp == NULL)
+		return 0;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (sscanf(line, "Hugepagesize: %ld kB", &kb) == 1)
+		{
+			huge_page_size = (size_t) kb * 1024;
+			break;
+		}
+	}
+	fclose(fp);
+
+	return huge_page_size;
+}
+
+/*
+ * Get the mapped size and the page size of the segment attached at addr.
+ * Returns false if addr is not the start of a segment created here.
+ */
+bool
+pool_shared_memory_info(void *addr, size_t *size, size_t *page_size)
+{
+	int			i;
+
+	for (i = 0; i < num_segments; i++)
+	{
+		if (segments[i].addr == addr)
+		{
+			*size = segments[i].size;
+			*page_size = segments[i].page_size;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Log the total size of the shared memory segments and how much of it is
+ * on huge pages.
+ */
+void
+pool_shared_memory_report(void)
+{
+	size_t		total = 0;
+	size_t		huge = 0;
+	size_t		huge_page_size = 0;
+	size_t		page_size = sysconf(_SC_PAGESIZE);
+	int			i;
+
+	for (i = 0; i < num_segments; i++)
+	{
+		total += segments[i].size;
+		if (segments[i].page_size > page_size)
+		{
+			huge += segments[i].size;
+			huge_page_size = segments[i].page_size;
+		}
+	}
+
+	if (huge > 0)
+		ereport(LOG,
+				(errmsg("created %d shared memory segments of %zu bytes in total, %zu bytes of them on %zu kB huge pages",
+						num_segments, total, huge, huge_page_size / 1024)));
+	else
+		ereport(LOG,
+				(errmsg("created %d shared memory segments of %zu bytes in total on %zu kB pages",
+						num_segments, total, page_size / 1024)));
+}
+
+/*
+ * Apply shared_memory_numa_policy to a new segment.  This must be done
+ * before the segment is touched, as the pages are placed when they are
+ * first written.  Without a policy that is the NUMA node the main process
+ * runs on, since it initializes all the segments.
+ */
+static void
+set_numa_policy(void *addr, size_t size)
+{
+	if (pool_config->shared_memory_numa_policy != NUMA_POLICY_INTERLEAVE)
+		return;
+
+#if defined(__linux__) && defined(SYS_mbind)
+	{
+		/* all nodes; nodes which do not exist are ignored by the kernel */
+		unsigned long nodemask = ~0UL;
+
+		if (syscall(SYS_mbind, addr, size, MPOL_INTERLEAVE,
+					&nodemask, sizeof(nodemask) * 8, 0) < 0)
+			ereport(WARNING,
+					(errmsg("could not interleave shared memory over NUMA nodes"),
+					 errdetail("mbind() failed with reason: \"%s\"", strerror(errno))));
+	}
+#endif
+}
+
 /*
  * Removes a shared memory segment from process' address spaceq (called as
  * an on_shmem_exit callback, hence funny argument list)
@@ -438,6 +438,108 @@ pool_read2(POOL_CONNECTION * cp, int len)
 	return cp->buf2;
 }
 
+/*
+* read at most len bytes from cp, returning as soon as any data is available.
+* pending data in the read buffer is returned first.  This is used to relay
+* large blocks of data without looking into every message.
+* returns the number of bytes read on success otherwise throws an ereport.
+*/
+int
+pool_read_some(POOL_CONNECTION * cp, void *buf, int len)
+{
+	int			readlen;
+
+	readlen = consume_pending_data(cp, buf, len);
+	if (readlen > 0)
+		return readlen;
+
+	for (;;)
+	{
+		/*
+		 * If select(2) timeout is disabled, there's no need to call
+		 * pool_check_fd().
+		 */
+		if (pool_get_timeout() >= 0 && pool_check_fd(cp))
+		{
+			if (cp->isbackend)
+				ereport(ERROR,
+						(errmsg("unable to read data from DB node %d", cp->db_node_id),
+						 errdetail("pool_check_fd call failed with an error \"%s\"", strerror(errno))));
+			else
+				ereport(FRONTEND_ERROR,
+						(errmsg("unable to read data from frontend"),
+						 errdetail("pool_check_fd call failed with an error \"%s\"", strerror(errno))));
+		}
+
+		if (cp->ssl_active > 0)
+			readlen = pool_ssl_read(cp, buf, len);
+		else
+			readlen = read(cp->fd, buf, len);
+
+		if (readlen > 0)
+			break;
+
+		if (readlen == -1)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+			{
+				ereport(DEBUG5,
+						(errmsg("read on socket failed with error :\"%s\"", strerror(errno)),
+						 errdetail("retrying...")));
+				continue;
+			}
+
+			cp->socket_state = POOL_SOCKET_ERROR;
+			if (cp->isbackend)
+			{
+				if (cp->con_info && cp->con_info->swallow_termination == 1)
+				{
+					cp->con_info->swallow_termination = 0;
+					ereport(FATAL,
+							(errmsg("unable to read data from DB node %d", cp->db_node_id),
+							 errdetail("pg_terminate_backend was called on the backend")));
+				}
+
+				/*
+				 * if failover_on_backend_error is true, then trigger
+				 * failover
+				 */
+				if (pool_config->failover_on_backend_error)
+				{
+					notice_backend_error(cp->db_node_id, REQ_DETAIL_SWITCHOVER);
+					child_exit(POOL_EXIT_AND_RESTART);
+				}
+				ereport(ERROR,
+						(errmsg("unable to read data from DB node %d", cp->db_node_id),
+						 errdetail("socket read failed with an error \"%s\"", strerror(errno))));
+			}
+			else
+				ereport(FRONTEND_ERROR,
+						(errmsg("unable to read data from frontend"),
+						 errdetail("socket read failed with an error \"%s\"", strerror(errno))));
+		}
+		else
+		{
+			cp->socket_state = POOL_SOCKET_EOF;
+			if (cp->isbackend)
+				ereport(FATAL,
+						(errmsg("unable to read data from DB node %d", cp->db_node_id),
+						 errdetail("EOF encountered with backend")));
+			else
+				ereport(FRONTEND_ERROR,
+						(errmsg("unable to read data from frontend"),
+						 errdetail("EOF encountered with frontend")));
+		}
+	}
+
+	if (cp->isbackend)
+		ereport(DEBUG5,
+				(errmsg("pool_read_some: read %d bytes from backend %d",
+						readlen, cp->db_node_id)));
+
+	return readlen;
+}
+
 /*
  * write len bytes to cp the write buffer.
  * returns 0 on success otherwise -1.
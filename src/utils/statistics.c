@@ -17,25 +17,127 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include "pool.h"
+#include "pool_config.h"
 #include "parser/nodes.h"
+#include "utils/palloc.h"
+#include "utils/pool_atomics.h"
+
+/*
+ * Latency histogram.
+ *
+ * Response times are recorded in microseconds into logarithmic buckets
+ * with STAT_HIST_SUB_BUCKETS linear sub buckets per power of two, in the
+ * manner of HDR histograms.  Values below STAT_HIST_SUB_BUCKETS get a
+ * bucket of their own, anything beyond the last bucket is clamped into
+ * it.  With 4 sub buckets the relative error of a reported percentile is
+ * at most 25%, which is plenty for finding out where the time goes.
+ */
+#define STAT_HIST_SUB_BITS		2
+#define STAT_HIST_SUB_BUCKETS	(1 << STAT_HIST_SUB_BITS)
+#define STAT_HIST_MAX_BIT		26	/* about 134 seconds */
+#define STAT_HIST_BUCKETS		(STAT_HIST_SUB_BUCKETS + \
+								 (STAT_HIST_MAX_BIT - STAT_HIST_SUB_BITS + 1) * STAT_HIST_SUB_BUCKETS)
+
+typedef struct
+{
+	uint64		sum;			/* total of recorded values in usec */
+	uint64		max;			/* largest recorded value in usec */
+	uint64		bucket[STAT_HIST_BUCKETS];
+}			STAT_HIST;
+
+/*
+ * Latency of one kind of statement.  "backend" is the time between
+ * forwarding the statement to the backend and receiving ReadyForQuery,
+ * "pgpool" is the rest of the time the request spent inside pgpool-II.
+ */
+typedef struct
+{
+	uint64		count;
+	STAT_HIST	backend;
+	STAT_HIST	pgpool;
+}			STAT_LATENCY;
 
 /*
  * Per backend node stat area in shared memory
  */
 typedef struct
 {
-	uint64		select_cnt;		/* number of read SELECT queries issued */
-	uint64		insert_cnt;		/* number of INSERT queries issued */
-	uint64		update_cnt;		/* number of UPDATE queries issued */
-	uint64		delete_cnt;		/* number of DELETE queries issued */
-	uint64		ddl_cnt;		/* number of DDL queries issued */
-	uint64		other_cnt;		/* number of any other queries issued */
+	STAT_LATENCY latency[STAT_NUM_STMT_TYPES];
 }			PER_NODE_STAT;
 
+/*
+ * Per database stat area.  Slots are assigned on first use and never
+ * released.  While a slot is being claimed its state carries the pid of
+ * the claiming process, so that a claim left behind by a process which
+ * died in the middle of it can be taken over.
+ */
+#define STAT_DB_FREE	0
+#define STAT_DB_READY	1
+#define STAT_DB_BUSY	0x80000000	/* ORed with pid of the claimer */
+
+#define STAT_DB_IS_BUSY(state)	(((state) & STAT_DB_BUSY) != 0)
+#define STAT_DB_CLAIMER(state)	((pid_t) ((state) & ~STAT_DB_BUSY))
+
+typedef struct
+{
+	uint32		state;			/* STAT_DB_FREE, STAT_DB_READY or
+								 * STAT_DB_BUSY | pid */
+	char		database[SM_DATABASE];
+	STAT_LATENCY latency[STAT_NUM_STMT_TYPES];
+}			PER_DB_STAT;
+
+/*
+ * Per child process stat area.  Statement counters are updated for every
+ * statement, so rather than having all children hammer on the same
+ * counters each child counts into its own shard, padded to a cache line
+ * boundary, and readers sum up the shards.  The counters are still
+ * updated atomically since a process other than the owner might count
+ * into the shard, but without contention this costs next to nothing.
+ */
+typedef struct
+{
+	uint64		node_cnt[MAX_NUM_BACKENDS][STAT_NUM_STMT_TYPES];	/* number of
+																	 * statements issued
+																	 * to each node */
+	STAT_LATENCY latency[STAT_NUM_STMT_TYPES];
+}			PER_CHILD_STAT;
+
+#define PER_CHILD_STAT_SIZE	CACHELINEALIGN(sizeof(PER_CHILD_STAT))
+#define PER_CHILD_STAT_SHARD(i) \
+	((volatile PER_CHILD_STAT *) ((char *) per_child_stat + (i) * PER_CHILD_STAT_SIZE))
+
 static volatile PER_NODE_STAT *per_node_stat;
+static volatile PER_DB_STAT *per_db_stat;
+static volatile PER_CHILD_STAT *per_child_stat;
+
+/*
+ * State of the request being timed in this process.  A request starts
+ * when the first message of it arrives from frontend and ends when
+ * ReadyForQuery is forwarded to frontend.
+ */
+static struct timeval request_start;
+static struct timeval request_sent;
+static int	request_node = -1;	/* node the first statement was sent to */
+static STAT_STMT_TYPE request_type;
+static int	my_db_slot = -1;	/* per_db_stat slot of current session */
+
+static STAT_STMT_TYPE stat_stmt_type(Node *parse_tree);
+static int	stat_find_db_slot(char *database);
+static int	stat_hist_index(uint64 usec);
+static uint64 stat_hist_upper_bound(int index);
+static void stat_hist_add(volatile STAT_HIST * hist, uint64 usec);
+static void stat_latency_add(volatile STAT_LATENCY * latency, uint64 backend_usec, uint64 pgpool_usec);
+static void stat_latency_accum(STAT_LATENCY * dst, volatile STAT_LATENCY * src);
+static uint64 stat_hist_percentile(STAT_HIST * hist, uint64 count, double percentile);
+static uint64 usec_diff(struct timeval *start, struct timeval *end);
+static volatile PER_CHILD_STAT * my_child_stat(void);
+static uint64 stat_get_count(int backend_node_id, STAT_STMT_TYPE type);
 
 /*
  * Return shared memory size necessary for this module
@@ -45,8 +147,17 @@ stat_shared_memory_size(void)
 {
 	size_t		size;
 
-	/* query counter area */
-	size = MAXALIGN(MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT));
+	/* per node latency area */
+	size = CACHELINEALIGN(MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT));
+
+	/* per database area */
+	size += CACHELINEALIGN(STAT_MAX_DATABASES * sizeof(PER_DB_STAT));
+
+	/* per child area */
+	size += pool_config->num_init_children * PER_CHILD_STAT_SIZE;
+
+	/* extra room to align the start of the area */
+	size += POOL_CACHE_LINE_SIZE;
 
 	return size;
 }
@@ -58,7 +169,13 @@ stat_shared_memory_size(void)
 void
 stat_set_stat_area(void *address)
 {
-	per_node_stat = (PER_NODE_STAT *) address;
+	char	   *p = (char *) CACHELINEALIGN(address);
+
+	per_node_stat = (PER_NODE_STAT *) p;
+	p += CACHELINEALIGN(MAX_NUM_BACKENDS * sizeof(PER_NODE_STAT));
+	per_db_stat = (PER_DB_STAT *) p;
+	p += CACHELINEALIGN(STAT_MAX_DATABASES * sizeof(PER_DB_STAT));
+	per_child_stat = (PER_CHILD_STAT *) p;
 }
 
 /*
@@ -67,7 +184,79 @@ stat_set_stat_area(void *address)
 void
 stat_init_stat_area(void)
 {
-	memset((void *) per_node_stat, 0, stat_shared_memory_size());
+	memset((void *) per_node_stat, 0,
+		   stat_shared_memory_size() - POOL_CACHE_LINE_SIZE);
+}
+
+/*
+ * Forget the latencies recorded by the child which used the slot before.
+ * Called by pgpool main process before it forks a child into the slot.
+ * The statement counters are kept since they add up to the totals of the
+ * backend nodes.
+ */
+void
+stat_reset_child_stat(int child_id)
+{
+	if (child_id < 0 || child_id >= pool_config->num_init_children)
+		return;
+
+	memset((void *) PER_CHILD_STAT_SHARD(child_id)->latency, 0,
+		   sizeof(PER_CHILD_STAT_SHARD(child_id)->latency));
+}
+
+/*
+ * Called when a new session starts in the child process.  Forget any
+ * request left over from the previous session and look up the stat slot
+ * for the database.
+ */
+void
+stat_start_session(char *database)
+{
+	request_start.tv_sec = 0;
+	request_node = -1;
+	my_db_slot = stat_find_db_slot(database);
+}
+
+/*
+ * Called for every message read from frontend.  Only the first message
+ * after ReadyForQuery starts the timer.
+ */
+void
+stat_start_request(void)
+{
+	if (request_start.tv_sec == 0)
+		gettimeofday(&request_start, NULL);
+}
+
+/*
+ * Called when ReadyForQuery has been forwarded to frontend.  If a
+ * statement was sent to backend during the request, record its latency.
+ */
+void
+stat_end_request(void)
+{
+	struct timeval now;
+	uint64		total;
+	uint64		backend;
+	uint64		pgpool;
+
+	if (request_node >= 0 && request_start.tv_sec != 0)
+	{
+		gettimeofday(&now, NULL);
+		total = usec_diff(&request_start, &now);
+		backend = usec_diff(&request_sent, &now);
+		if (backend > total)
+			backend = total;
+		pgpool = total - backend;
+
+		stat_latency_add(&per_node_stat[request_node].latency[request_type], backend, pgpool);
+		if (my_db_slot >= 0)
+			stat_latency_add(&per_db_stat[my_db_slot].latency[request_type], backend, pgpool);
+		stat_latency_add(&my_child_stat()->latency[request_type], backend, pgpool);
+	}
+
+	request_start.tv_sec = 0;
+	request_node = -1;
 }
 
 /*
@@ -76,6 +265,8 @@ stat_init_stat_area(void)
 void
 stat_count_up(int backend_node_id, Node *parse_tree)
 {
+	STAT_STMT_TYPE type;
+
 	if (parse_tree == NULL)
 	{
 		/*
@@ -87,9 +278,20 @@ stat_count_up(int backend_node_id, Node *parse_tree)
 		return;
 	}
 
-	if (IsA(parse_tree, SelectStmt))
+	type = stat_stmt_type(parse_tree);
+	pool_atomic_fetch_add_u64(&my_child_stat()->node_cnt[backend_node_id][type], 1);
+
+	/*
+	 * The latency of the request is charged to the first statement sent
+	 * and to the first node it was sent to.
+	 */
+	if (request_node < 0)
 	{
-		per_node_stat[backend_node_id].select_cnt++;
+		gettimeofday(&request_sent, NULL);
+		if (request_start.tv_sec == 0)
+			request_start = request_sent;
+		request_node = backend_node_id;
+		request_type = type;
 	}
 }
 
@@ -99,5 +301,381 @@ stat_count_up(int backend_node_id, Node *parse_tree)
 uint64
 stat_get_select_count(int backend_node_id)
 {
-	return per_node_stat[backend_node_id].select_cnt;
+	return stat_get_count(backend_node_id, STAT_SELECT);
+}
+
+uint64
+stat_get_insert_count(int backend_node_id)
+{
+	return stat_get_count(backend_node_id, STAT_INSERT);
+}
+
+uint64
+stat_get_update_count(int backend_node_id)
+{
+	return stat_get_count(backend_node_id, STAT_UPDATE);
+}
+
+uint64
+stat_get_delete_count(int backend_node_id)
+{
+	return stat_get_count(backend_node_id, STAT_DELETE);
+}
+
+uint64
+stat_get_ddl_count(int backend_node_id)
+{
+	return stat_get_count(backend_node_id, STAT_DDL);
+}
+
+uint64
+stat_get_other_count(int backend_node_id)
+{
+	return stat_get_count(backend_node_id, STAT_OTHER);
+}
+
+/*
+ * Return the database name of per database stat slot, or NULL if the slot
+ * is not in use.
+ */
+char *
+stat_get_database_name(int slot)
+{
+	if (slot < 0 || slot >= STAT_MAX_DATABASES ||
+		pool_atomic_read_u32(&per_db_stat[slot].state) != STAT_DB_READY)
+		return NULL;
+	return (char *) per_db_stat[slot].database;
+}
+
+/*
+ * Summarize latency of the given scope.  id is node id, database slot or
+ * child index depending on the scope, and is ignored for
+ * STAT_SCOPE_GLOBAL.  If type is negative, all statement types are
+ * summarized together.  Returns false if nothing has been recorded.
+ */
+bool
+stat_get_latency(STAT_SCOPE scope, int id, int type, STAT_LATENCY_SUMMARY * summary)
+{
+	STAT_LATENCY *lat;
+	volatile STAT_LATENCY *src;
+	int			t;
+	int			i;
+
+	lat = palloc0(sizeof(STAT_LATENCY));
+
+	for (t = 0; t < STAT_NUM_STMT_TYPES; t++)
+	{
+		if (type >= 0 && t != type)
+			continue;
+
+		switch (scope)
+		{
+			case STAT_SCOPE_GLOBAL:
+				for (i = 0; i < pool_config->num_init_children; i++)
+					stat_latency_accum(lat, &PER_CHILD_STAT_SHARD(i)->latency[t]);
+				continue;
+
+			case STAT_SCOPE_NODE:
+				src = &per_node_stat[id].latency[t];
+				break;
+
+			case STAT_SCOPE_DATABASE:
+				src = &per_db_stat[id].latency[t];
+				break;
+
+			case STAT_SCOPE_CHILD:
+				src = &PER_CHILD_STAT_SHARD(id)->latency[t];
+				break;
+
+			default:
+				pfree(lat);
+				return false;
+		}
+		stat_latency_accum(lat, src);
+	}
+
+	memset(summary, 0, sizeof(*summary));
+	summary->count = lat->count;
+	if (lat->count > 0)
+	{
+		summary->backend_avg = lat->backend.sum / lat->count;
+		summary->backend_p50 = stat_hist_percentile(&lat->backend, lat->count, 0.5);
+		summary->backend_p99 = stat_hist_percentile(&lat->backend, lat->count, 0.99);
+		summary->backend_max = lat->backend.max;
+		summary->pgpool_avg = lat->pgpool.sum / lat->count;
+		summary->pgpool_p50 = stat_hist_percentile(&lat->pgpool, lat->count, 0.5);
+		summary->pgpool_p99 = stat_hist_percentile(&lat->pgpool, lat->count, 0.99);
+		summary->pgpool_max = lat->pgpool.max;
+	}
+	pfree(lat);
+
+	return summary->count > 0;
+}
+
+/*
+ * Return printable name of statement type
+ */
+char *
+stat_stmt_type_name(int type)
+{
+	static char *names[] = {"SELECT", "INSERT", "UPDATE", "DELETE", "DDL", "OTHER"};
+
+	if (type < 0 || type >= STAT_NUM_STMT_TYPES)
+		return "ALL";
+	return names[type];
+}
+
+/*
+ * Return the stat shard of this process
+ */
+static volatile PER_CHILD_STAT *
+my_child_stat(void)
+{
+	int			shard = my_proc_id;
+
+	if (shard < 0 || shard >= pool_config->num_init_children)
+		shard = 0;
+	return PER_CHILD_STAT_SHARD(shard);
+}
+
+/*
+ * Sum up the statement counter of all shards
+ */
+static uint64
+stat_get_count(int backend_node_id, STAT_STMT_TYPE type)
+{
+	uint64		count = 0;
+	int			i;
+
+	for (i = 0; i < pool_config->num_init_children; i++)
+		count += pool_atomic_read_u64(&PER_CHILD_STAT_SHARD(i)->node_cnt[backend_node_id][type]);
+
+	return count;
+}
+
+/*
+ * Classify the statement for statistics
+ */
+static STAT_STMT_TYPE
+stat_stmt_type(Node *parse_tree)
+{
+	switch (nodeTag(parse_tree))
+	{
+		case T_SelectStmt:
+			return STAT_SELECT;
+		case T_InsertStmt:
+			return STAT_INSERT;
+		case T_UpdateStmt:
+			return STAT_UPDATE;
+		case T_DeleteStmt:
+			return STAT_DELETE;
+
+		case T_CallStmt:
+		case T_CheckPointStmt:
+		case T_ClosePortalStmt:
+		case T_CopyStmt:
+		case T_DeallocateStmt:
+		case T_DeclareCursorStmt:
+		case T_DiscardStmt:
+		case T_ExecuteStmt:
+		case T_ExplainStmt:
+		case T_FetchStmt:
+		case T_ListenStmt:
+		case T_LoadStmt:
+		case T_LockStmt:
+		case T_NotifyStmt:
+		case T_PrepareStmt:
+		case T_TransactionStmt:
+		case T_UnlistenStmt:
+		case T_VacuumStmt:
+		case T_VariableSetStmt:
+		case T_VariableShowStmt:
+			return STAT_OTHER;
+
+		default:
+			return STAT_DDL;
+	}
+}
+
+/*
+ * Find or assign the per database stat slot.  Returns -1 if all slots are
+ * taken by other databases.
+ *
+ * Slots are never released, so a slot is claimed only when no earlier slot
+ * carries the name.  A slot being claimed by somebody else is waited for,
+ * however long that takes, so that two processes never end up with
+ * separate slots for the same database.  If the claimer has gone away, the
+ * slot is freed again and the search starts over.
+ */
+static int
+stat_find_db_slot(char *database)
+{
+	int			i;
+	int			spin;
+	uint32		state;
+
+	if (database == NULL || *database == '\0')
+		return -1;
+
+retry:
+	for (i = 0; i < STAT_MAX_DATABASES; i++)
+	{
+		for (spin = 0;; spin++)
+		{
+			state = pool_atomic_read_u32(&per_db_stat[i].state);
+			if (!STAT_DB_IS_BUSY(state))
+				break;
+			if (spin < 1000)
+				continue;
+
+			if (kill(STAT_DB_CLAIMER(state), 0) != 0 && errno == ESRCH)
+			{
+				/* the claimer died before finishing, take the slot back */
+				pool_atomic_compare_exchange_u32(&per_db_stat[i].state, &state, STAT_DB_FREE);
+				goto retry;
+			}
+
+			/* the claimer is alive but slow */
+			usleep(1000);
+		}
+
+		if (state == STAT_DB_READY)
+		{
+			if (strncmp((char *) per_db_stat[i].database, database, SM_DATABASE - 1) == 0)
+				return i;
+			continue;
+		}
+
+		state = STAT_DB_FREE;
+		if (!pool_atomic_compare_exchange_u32(&per_db_stat[i].state, &state,
+											  STAT_DB_BUSY | (uint32) getpid()))
+			goto retry;
+
+		strlcpy((char *) per_db_stat[i].database, database, SM_DATABASE);
+		pool_atomic_write_u32(&per_db_stat[i].state, STAT_DB_READY);
+		return i;
+	}
+
+	return -1;
+}
+
+static int
+stat_hist_index(uint64 usec)
+{
+	int			msb;
+	int			index;
+
+	if (usec < STAT_HIST_SUB_BUCKETS)
+		return (int) usec;
+
+	msb = 63 - __builtin_clzll(usec);
+	index = STAT_HIST_SUB_BUCKETS +
+		(msb - STAT_HIST_SUB_BITS) * STAT_HIST_SUB_BUCKETS +
+		(int) ((usec >> (msb - STAT_HIST_SUB_BITS)) & (STAT_HIST_SUB_BUCKETS - 1));
+
+	if (index >= STAT_HIST_BUCKETS)
+		index = STAT_HIST_BUCKETS - 1;
+	return index;
+}
+
+/*
+ * Return the largest value falling into the bucket
+ */
+static uint64
+stat_hist_upper_bound(int index)
+{
+	int			msb;
+	int			sub;
+
+	if (index < STAT_HIST_SUB_BUCKETS)
+		return index;
+
+	msb = (index - STAT_HIST_SUB_BUCKETS) / STAT_HIST_SUB_BUCKETS + STAT_HIST_SUB_BITS;
+	sub = (index - STAT_HIST_SUB_BUCKETS) % STAT_HIST_SUB_BUCKETS;
+
+	return (((uint64) 1) << msb) + ((uint64) (sub + 1) << (msb - STAT_HIST_SUB_BITS)) - 1;
+}
+
+static void
+stat_hist_add(volatile STAT_HIST * hist, uint64 usec)
+{
+	pool_atomic_fetch_add_u64(&hist->sum, usec);
+	pool_atomic_max_u64(&hist->max, usec);
+	pool_atomic_fetch_add_u64(&hist->bucket[stat_hist_index(usec)], 1);
+}
+
+static void
+stat_latency_add(volatile STAT_LATENCY * latency, uint64 backend_usec, uint64 pgpool_usec)
+{
+	pool_atomic_fetch_add_u64(&latency->count, 1);
+	stat_hist_add(&latency->backend, backend_usec);
+	stat_hist_add(&latency->pgpool, pgpool_usec);
+}
+
+/*
+ * Add the snapshot of src to local dst
+ */
+static void
+stat_latency_accum(STAT_LATENCY * dst, volatile STAT_LATENCY * src)
+{
+	int			i;
+	uint64		v;
+
+	dst->count += pool_atomic_read_u64(&src->count);
+
+	dst->backend.sum += pool_atomic_read_u64(&src->backend.sum);
+	v = pool_atomic_read_u64(&src->backend.max);
+	if (v > dst->backend.max)
+		dst->backend.max = v;
+
+	dst->pgpool.sum += pool_atomic_read_u64(&src->pgpool.sum);
+	v = pool_atomic_read_u64(&src->pgpool.max);
+	if (v > dst->pgpool.max)
+		dst->pgpool.max = v;
+
+	for (i = 0; i < STAT_HIST_BUCKETS; i++)
+	{
+		dst->backend.bucket[i] += pool_atomic_read_u64(&src->backend.bucket[i]);
+		dst->pgpool.bucket[i] += pool_atomic_read_u64(&src->pgpool.bucket[i]);
+	}
+}
+
+/*
+ * Return the upper bound of the bucket containing the given percentile,
+ * capped by the recorded maximum.
+ */
+static uint64
+stat_hist_percentile(STAT_HIST * hist, uint64 count, double percentile)
+{
+	uint64		target;
+	uint64		seen = 0;
+	uint64		bound;
+	int			i;
+
+	target = (uint64) (count * percentile);
+	if (target < 1)
+		target = 1;
+
+	for (i = 0; i < STAT_HIST_BUCKETS; i++)
+	{
+		seen += hist->bucket[i];
+		if (seen >= target)
+			break;
+	}
+	if (i >= STAT_HIST_BUCKETS)
+		return hist->max;
+
+	bound = stat_hist_upper_bound(i);
+	return (bound > hist->max) ? hist->max : bound;
+}
+
+static uint64
+usec_diff(struct timeval *start, struct timeval *end)
+{
+	int64		diff;
+
+	diff = (int64) (end->tv_sec - start->tv_sec) * 1000000 +
+		(end->tv_usec - start->tv_usec);
+
+	return (diff < 0) ? 0 : (uint64) diff;
 }
@@ -2331,6 +2331,31 @@ reply_to_failove_command(WDCommandData * ipcCommand, WDFailoverCMDResults cmdRes
  * about the execution of failover command.
  */
 
+/*
+ * Name of the failover command result, for the failover trace
+ */
+static const char *
+failover_result_name(WDFailoverCMDResults res)
+{
+	switch (res)
+	{
+		case FAILOVER_RES_PROCEED:
+			return "proceed";
+		case FAILOVER_RES_NO_QUORUM:
+			return "no quorum";
+		case FAILOVER_RES_BUILDING_CONSENSUS:
+			return "building consensus";
+		case FAILOVER_RES_CONSENSUS_MAY_FAIL:
+			return "consensus may fail";
+		case FAILOVER_RES_MASTER_REJECTED:
+			return "rejected";
+		case FAILOVER_RES_NOT_ALLOWED:
+			return "not allowed";
+		default:
+			return "error";
+	}
+}
+
 static WDFailoverCMDResults compute_failover_consensus(POOL_REQUEST_KIND reqKind, int *node_id_list, int node_count, unsigned char *flags, WatchdogNode * wdNode)
 {
 #ifndef NODE_UP_REQUIRE_CONSENSUS
@@ -2530,7 +2555,11 @@ static IPC_CMD_PREOCESS_RES process_failover_command_on_coordinator(WDCommandDat
 					ipcCommand->commandSource == COMMAND_SOURCE_IPC ?
 					"local pgpool-II on IPC interface" : ipcCommand->sourceWdNode->nodeName)));
 
+	failover_trace_event(FAILOVER_TRACE_CONSENSUS_START, -1, reqKind,
+						 node_count > 0 ? node_id_list[0] : -1, ipcCommand->sourceWdNode->nodeName);
 	res = compute_failover_consensus(reqKind, node_id_list, node_count, &flags, ipcCommand->sourceWdNode);
+	failover_trace_event(FAILOVER_TRACE_CONSENSUS_END, -1, reqKind,
+						 node_count > 0 ? node_id_list[0] : -1, failover_result_name(res));
 
 	if (res == FAILOVER_RES_PROCEED)
 	{
@@ -331,8 +331,15 @@ get_backend_node_status_json(WatchdogNode * wdNode)
 		}
 		jw_put_int_value(jNode, backend_status);
 	}
-	/* put the primary node id */
 	jw_end_element(jNode);
+
+	/* put the draining flags */
+	jw_start_array(jNode, "BackendNodeDrainingList");
+	for (i = 0; i < pool_config->backend_desc->num_backends; i++)
+		jw_put_int_value(jNode, pool_config->backend_desc->backend_info[i].draining ? 1 : 0);
+	jw_end_element(jNode);
+
+	/* put the primary node id */
 	jw_put_int(jNode, "PrimaryNodeId", Req_info->primary_node_id);
 	jw_put_string(jNode, "NodeName", wdNode->nodeName);
 
@@ -364,7 +371,7 @@ get_pg_backend_node_status_from_json(char *json_data, int data_len)
 	if (value->u.array.length <= 0 || value->u.array.length > MAX_NUM_BACKENDS)
 		return NULL;
 
-	backendStatus = palloc(sizeof(WDPGBackendStatus));
+	backendStatus = palloc0(sizeof(WDPGBackendStatus));
 	backendStatus->node_count = value->u.array.length;
 
 	for (i = 0; i < backendStatus->node_count; i++)
@@ -372,6 +379,15 @@ get_pg_backend_node_status_from_json(char *json_data, int data_len)
 		backendStatus->backend_status[i] = value->u.array.values[i]->u.integer;
 	}
 
+	/* draining flags, not sent by older versions */
+	value = json_get_value_for_key(root, "BackendNodeDrainingList");
+	if (value && value->type == json_array &&
+		value->u.array.length == backendStatus->node_count)
+	{
+		for (i = 0; i < backendStatus->node_count; i++)
+			backendStatus->draining[i] = value->u.array.values[i]->u.integer ? true : false;
+	}
+
 	if (json_get_int_value_for_key(root, "PrimaryNodeId", &backendStatus->primary_node_id))
 	{
 		ereport(ERROR,